@@ -73,7 +73,7 @@ protected:
 
 		struct shmem_int shm;
 		struct shmem_conf conf = {
-			.polling = 0,
+			.mode = QueueSignalledMode::AUTO,
 			.queuelen = DEFAULT_SHMEM_QUEUELEN,
 			.samplelen = DEFAULT_SHMEM_SAMPLELEN
 		};
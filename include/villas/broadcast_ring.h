@@ -0,0 +1,158 @@
+/** Single-producer, multiple-consumer broadcast ring for samples.
+ *
+ * @file
+ * @author Steffen Vogel <stvogel@eonerc.rwth-aachen.de>
+ * @copyright 2014-2020, Institute for Automation of Complex Power Systems, EONERC
+ * @license GNU General Public License (version 3)
+ *
+ * VILLASnode
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *********************************************************************************/
+
+/** A broadcast ring distributes the samples of a single producer to multiple
+ * consumers. Each consumer reads all samples via its own cursor.
+ *
+ * The design follows the sequence barriers of the LMAX disruptor:
+ * The producer publishes samples by advancing the head sequence.
+ * A slot is only reused after the cursors of all consumers have passed it.
+ *
+ * The ring holds a single reference to each published sample.
+ * Consumers take their own references when reading.
+ *
+ * If the ring is full, the producer either waits for the slowest consumer
+ * or overruns it by advancing its cursor. A consumer announces its accesses
+ * to the slots so that an overrun never releases samples it is about to read.
+ *
+ * @addtogroup broadcast_ring Broadcast ring
+ * @{
+ */
+
+#pragma once
+
+#include <atomic>
+
+#include <cstddef>
+#include <cstdint>
+
+#include <villas/node/config.h>
+#include <villas/common.hpp>
+#include <villas/list.h>
+#include <villas/queue.h>
+
+/* Forward declarations */
+struct sample;
+
+/** Behaviour of the producer if the slowest consumer did not catch up. */
+enum class BroadcastRingOverflow {
+	DROP,		/**< Skip the oldest samples for the consumers which did not keep up. */
+	BLOCK		/**< Wait until the slowest consumer has made room. */
+};
+
+struct broadcast_ring_consumer {
+	struct broadcast_ring *ring;
+
+	cacheline_pad_t _pad0;
+
+	std::atomic<size_t> cursor;	/**< Sequence number of the next sample to read. */
+	std::atomic<bool> notified;	/**< The producer already signalled the file descriptor. */
+	std::atomic<bool> attached;	/**< Detached consumers are not considered by the producer anymore. */
+	std::atomic<bool> reading;	/**< The consumer is currently accessing the slots after its cursor. */
+
+	cacheline_pad_t _pad1;		/**< Producer area: only the producer reads & writes */
+
+	bool slow;			/**< The consumer lags more than broadcast_ring::slow_threshold samples. */
+	size_t slow_cnt;		/**< Number of times the consumer has become slow. */
+	size_t overruns;		/**< Number of samples skipped because this consumer did not keep up. */
+
+#ifdef HAS_EVENTFD
+	int eventfd;
+#else
+	int pipe[2];
+#endif
+};
+
+struct broadcast_ring {
+	enum State state;
+
+	enum BroadcastRingOverflow overflow;
+
+	size_t buffer_mask;
+	struct sample **buffer;
+
+	size_t slow_threshold;		/**< Lag in samples after which a consumer is considered slow. */
+
+	struct vlist consumers;		/**< List of consumers (struct broadcast_ring_consumer). */
+
+	cacheline_pad_t _pad0;		/**< Shared area: all threads read */
+
+	std::atomic<size_t> head;	/**< Sequence number of the next sample to publish. */
+	std::atomic<bool> closed;
+
+	cacheline_pad_t _pad1;		/**< Producer area: only the producer reads & writes */
+
+	size_t released;		/**< All slots below this sequence number have been released. */
+	size_t dropped;			/**< Total number of samples skipped for all consumers due to overflows. */
+};
+
+int broadcast_ring_init(struct broadcast_ring *r, size_t size, enum BroadcastRingOverflow overflow = BroadcastRingOverflow::DROP) __attribute__ ((warn_unused_result));
+
+/** Release all remaining samples and free the ring. */
+int broadcast_ring_destroy(struct broadcast_ring *r) __attribute__ ((warn_unused_result));
+
+/** Publish up to \p cnt samples to all consumers.
+ *
+ * Consumers can only be registered before the first sample is published.
+ * At most the size of the ring is published at once.
+ *
+ * @return The number of samples actually published or -1 if the ring has been closed.
+ */
+int broadcast_ring_publish(struct broadcast_ring *r, struct sample * const smps[], unsigned cnt);
+
+/** Wake up all waiting consumers and let following reads fail. */
+int broadcast_ring_close(struct broadcast_ring *r);
+
+/** Register a new consumer which will receive all samples published afterwards. */
+int broadcast_ring_consumer_init(struct broadcast_ring_consumer *c, struct broadcast_ring *r) __attribute__ ((warn_unused_result));
+
+/** Stop considering the consumer for the reuse of slots.
+ *
+ * The producer will not block or drop samples because of a detached consumer anymore.
+ */
+void broadcast_ring_consumer_detach(struct broadcast_ring_consumer *c);
+
+/** Release resources of the consumer.
+ *
+ * The ring itself might already have been destroyed at this point.
+ */
+int broadcast_ring_consumer_destroy(struct broadcast_ring_consumer *c) __attribute__ ((warn_unused_result));
+
+/** Read up to \p cnt samples without blocking.
+ *
+ * The caller owns a reference to each returned sample.
+ *
+ * @return The number of samples read or -1 if the ring has been closed.
+ */
+int broadcast_ring_consume(struct broadcast_ring_consumer *c, struct sample *smps[], unsigned cnt);
+
+/** Read up to \p cnt samples and block until at least one is available. */
+int broadcast_ring_consume_wait(struct broadcast_ring_consumer *c, struct sample *smps[], unsigned cnt);
+
+/** Returns a file descriptor which can be used with poll / select to wait for new samples. */
+int broadcast_ring_consumer_fd(struct broadcast_ring_consumer *c);
+
+/** Returns an estimation of the number of samples which have not yet been read by the consumer. */
+size_t broadcast_ring_consumer_lag(struct broadcast_ring_consumer *c);
+
+/** @} */
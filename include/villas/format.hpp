@@ -82,6 +82,18 @@ public:
 	virtual
 	int scan(FILE *f, struct sample * const smps[], unsigned cnt);
 
+	/** Complete the output written to \p f by Format::print().
+	 *
+	 * Formats which buffer samples or append trailers do so here.
+	 * Called before the stream is closed or the output continues in a new file.
+	 * Samples printed afterwards start a new output with its own header.
+	 */
+	virtual
+	int finish(FILE *f)
+	{
+		return 0;
+	}
+
 	/** Print \p cnt samples from \p smps into buffer \p buf of length \p len.
 	 *
 	 * @param buf[out]	The buffer which should be filled with serialized data.
@@ -0,0 +1,219 @@
+/** Chunked columnar format for recordings.
+ *
+ * @file
+ * @author Steffen Vogel <stvogel@eonerc.rwth-aachen.de>
+ * @copyright 2014-2020, Institute for Automation of Complex Power Systems, EONERC
+ * @license GNU General Public License (version 3)
+ *
+ * VILLASnode
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *********************************************************************************/
+
+/** The format consists of a sequence of blocks:
+ *
+ *   HEADER CHUNK* INDEX
+ *
+ * Each block starts with a struct columnar_block. The header describes the
+ * signals. Each chunk holds up to ColumnarFormat::chunk_size samples which are
+ * stored column by column:
+ *
+ *   - Timestamps and sequence numbers are delta-of-delta encoded.
+ *   - Floating point and complex values are XOR encoded against their predecessor.
+ *   - Integers are delta-of-delta encoded.
+ *   - Booleans use a single bit.
+ *
+ * A directory at the start of each chunk contains the length of each column,
+ * so that columns which are not selected for reading are skipped without decoding.
+ *
+ * The index at the end of a recording lists the offset and time range of all
+ * chunks. Its last bytes are a struct columnar_index_trailer.
+ *
+ * All integers are little endian.
+ */
+
+#pragma once
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <ctime>
+
+#include <villas/format.hpp>
+#include <villas/signal_data.h>
+#include <villas/signal_type.h>
+
+/* Forward declarations */
+struct sample;
+
+#define COLUMNAR_MAGIC		0x4c4f4356	/**< "VCOL" */
+#define COLUMNAR_INDEX_MAGIC	0x58494356	/**< "VCIX" */
+#define COLUMNAR_VERSION	1
+#define COLUMNAR_CHUNK_SIZE	1024		/**< Default number of samples per chunk. */
+
+enum class ColumnarBlockType : uint16_t {
+	HEADER	= 1,
+	CHUNK	= 2,
+	INDEX	= 3
+};
+
+struct columnar_block {
+	uint32_t magic;
+	uint16_t type;			/**< See ColumnarBlockType. */
+	uint16_t version;
+	uint32_t length;		/**< Length of the payload following this header. */
+	uint32_t reserved;
+} __attribute__((packed));
+
+struct columnar_chunk {
+	uint32_t count;			/**< Number of samples. */
+	uint32_t flags;			/**< Columns present in the chunk (see SampleFlags). */
+	uint32_t length;		/**< Number of values per sample. */
+	uint32_t columns;		/**< Number of entries in the column directory. */
+} __attribute__((packed));
+
+struct columnar_column {
+	uint8_t type;			/**< See SignalType. Zero for timestamps and sequence numbers. */
+	uint8_t reserved[3];
+	uint32_t length;		/**< Length of the encoded column in bytes. */
+} __attribute__((packed));
+
+struct columnar_index_entry {
+	uint64_t offset;		/**< Offset of the chunk relative to the header block. */
+	uint32_t count;			/**< Number of samples in the chunk. */
+	uint32_t length;		/**< Length of the chunk block including its header. */
+	int64_t first;			/**< Timestamp of the first sample in nanoseconds. */
+	int64_t last;			/**< Timestamp of the last sample in nanoseconds. */
+} __attribute__((packed));
+
+struct columnar_index_trailer {
+	uint64_t count;			/**< Number of index entries. */
+	uint64_t offset;		/**< Offset of the index block relative to the header block. */
+	uint32_t length;		/**< Length of the index block including its header. */
+	uint32_t magic;
+} __attribute__((packed));
+
+namespace villas {
+namespace node {
+
+class ColumnarFormat : public BinaryFormat {
+
+protected:
+	/** Samples of a chunk in row order. */
+	struct Chunk {
+		unsigned count;
+		unsigned length;
+		int flags;
+
+		std::vector<int64_t> ts;		/**< Timestamps in nanoseconds. */
+		std::vector<uint64_t> sequence;
+		std::vector<enum SignalType> types;
+		std::vector<union signal_data> data;	/**< count x length values. */
+
+		void clear(int fl, unsigned len);
+	};
+
+	unsigned chunk_size;
+	std::vector<std::string> column_names;	/**< Names of the selected columns. */
+	std::vector<int> column_indices;	/**< Indices of the selected columns. Resolved from names when reading the header. */
+	bool projection;
+
+	/* Writer state of print() */
+	struct {
+		Chunk chunk;
+		bool header_written;
+		uint64_t offset;		/**< Number of bytes written since the header. */
+		std::vector<struct columnar_index_entry> index;
+	} wr;
+
+	/* Reader state of scan() */
+	struct {
+		Chunk chunk;
+		unsigned pos;			/**< Next sample of the decoded chunk. */
+		std::vector<uint8_t> block;	/**< Partially read block. */
+		size_t fill;
+		off_t stream_pos;		/**< Position of the stream after the last read. */
+		std::vector<std::string> names;	/**< Signal names from the last header. */
+	} rd;
+
+	Chunk scratch;				/**< Used by sprint() and sscan(). */
+	std::vector<uint8_t> encoded;
+
+	void encodeHeader(std::vector<uint8_t> &out);
+	void encodeChunk(std::vector<uint8_t> &out, const Chunk &c);
+
+	int decodeHeader(const uint8_t *buf, size_t len);
+	int decodeChunk(const uint8_t *buf, size_t len, Chunk &c);
+
+	/** Decode the block at \p buf. The samples of a chunk are stored in \p c.
+	 *
+	 * @return The length of the block, zero if it is incomplete or a negative value on errors.
+	 */
+	ssize_t decodeBlock(const uint8_t *buf, size_t len, Chunk &c);
+
+	void appendSample(Chunk &c, const struct sample *smp);
+	unsigned extractSamples(Chunk &c, unsigned pos, struct sample * const smps[], unsigned cnt);
+
+	int writeChunk(FILE *f);
+	void resetReader();
+
+public:
+	ColumnarFormat(int fl);
+
+	virtual
+	void parse(json_t *json);
+
+	virtual
+	int sprint(char *buf, size_t len, size_t *wbytes, const struct sample * const smps[], unsigned cnt);
+
+	virtual
+	int sscan(const char *buf, size_t len, size_t *rbytes, struct sample * const smps[], unsigned cnt);
+
+	virtual
+	int print(FILE *f, const struct sample * const smps[], unsigned cnt);
+
+	virtual
+	int scan(FILE *f, struct sample * const smps[], unsigned cnt);
+
+	/** Write the incomplete chunk and the index. */
+	virtual
+	int finish(FILE *f);
+
+	/** Skip to the first sample which is at least \p delta seconds younger than the first sample of the recording.
+	 *
+	 * The index of the last recording in \p f is used to locate the chunk.
+	 * Following calls to scan() continue at this sample.
+	 *
+	 * @param f A seekable stream.
+	 * @param delta The offset in seconds.
+	 * @param[out] ts The timestamp of the next sample. Unchanged if there is none.
+	 * @retval 0 Success.
+	 * @retval <0 The stream does not end with an index.
+	 */
+	int seek(FILE *f, double delta, struct timespec *ts);
+
+	/** Read the index from the end of a recording.
+	 *
+	 * @param f A seekable stream. Its position is changed.
+	 * @param[out] entries The chunks of the recording.
+	 * @param[out] header The offset of the header block in \p f.
+	 * @retval 0 Success.
+	 * @retval <0 The stream does not end with an index.
+	 */
+	static
+	int readIndex(FILE *f, std::vector<struct columnar_index_entry> &entries, off_t *header);
+};
+
+} /* namespace node */
+} /* namespace villas */
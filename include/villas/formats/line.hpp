@@ -66,6 +66,14 @@ public:
 	virtual int scan(FILE *f, struct sample * const smps[], unsigned cnt);
 	virtual int print(FILE *f, const struct sample * const smps[], unsigned cnt);
 
+	/** The next output gets its own header. */
+	virtual int finish(FILE *f)
+	{
+		header_printed = false;
+
+		return 0;
+	}
+
 	virtual void parse(json_t *json);
 };
 
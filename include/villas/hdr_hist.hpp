@@ -0,0 +1,133 @@
+/** High dynamic range (HDR) histogram.
+ *
+ * @file
+ * @author Steffen Vogel <stvogel@eonerc.rwth-aachen.de>
+ * @copyright 2014-2020, Institute for Automation of Complex Power Systems, EONERC
+ * @license GNU General Public License (version 3)
+ *
+ * VILLASnode
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *********************************************************************************/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include <jansson.h>
+
+#include <villas/log.hpp>
+
+namespace villas {
+
+/** A histogram with log-linear buckets.
+ *
+ * Values are recorded with a constant relative precision of the given number
+ * of significant decimal digits over the whole range from \p resolution to
+ * \p highest. Histograms with equal parameters can be merged.
+ */
+class HdrHist {
+
+public:
+	using cnt_t = uint64_t;
+
+	/** The percentiles which are included in summaries. */
+	static const std::vector<double> percentiles;
+
+	/**
+	 * @param resolution The smallest distinguishable value.
+	 * @param highest The largest trackable value. Larger values are counted in the last bucket.
+	 * @param digits The number of significant decimal digits (1 to 5).
+	 */
+	HdrHist(double resolution = 1e-7, double highest = 3600, int digits = 3);
+
+	/** Record a value. Negative values are counted as zero. */
+	void put(double value);
+
+	/** Record a value and correct for coordinated omission.
+	 *
+	 * If \p value exceeds the expected interval between two samples,
+	 * the measurements which have been suppressed by the stall are
+	 * recorded as well.
+	 */
+	void putCorrected(double value, double interval);
+
+	/** Add all values of another histogram with equal parameters. */
+	void merge(const HdrHist &other);
+
+	void reset();
+
+	/** Get the value below which \p percentile percent of all recorded values fall. */
+	double getPercentile(double percentile) const;
+
+	double getHighest() const
+	{
+		return highest;
+	}
+
+	double getLowest() const
+	{
+		return lowest;
+	}
+
+	double getMean() const;
+
+	double getStddev() const;
+
+	cnt_t getTotal() const
+	{
+		return total;
+	}
+
+	/** Print a summary with the most common percentiles. */
+	void print(Logger logger) const;
+
+	/** Get a summary with the most common percentiles as a JSON object. */
+	json_t * toJson() const;
+
+	/** Print the column names of summaries in CSV format. */
+	static
+	void printCsvHeader(FILE *f);
+
+	/** Print a summary in CSV format without a line break. */
+	void printCsv(FILE *f) const;
+
+protected:
+	double resolution;
+	double highest;
+	double lowest;
+	double sum;
+	double sum_sq;
+
+	cnt_t total;
+
+	int sub_bucket_half_count_magnitude;
+	int64_t sub_bucket_half_count;
+	int64_t sub_bucket_mask;
+	int64_t max_index_value;	/**< Largest trackable value in multiples of the resolution. */
+
+	std::vector<cnt_t> counts;
+
+	size_t getIndex(int64_t value) const;
+
+	int64_t getValueAt(size_t index) const;
+
+	int64_t getHighestEquivalent(int64_t value) const;
+
+	void putIndexed(int64_t value, cnt_t count);
+};
+
+} /* namespace villas */
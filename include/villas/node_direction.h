@@ -32,6 +32,7 @@
 
 #include <villas/common.hpp>
 #include <villas/list.h>
+#include <villas/broadcast_ring.h>
 
 /* Forward declarations */
 struct vnode;
@@ -60,6 +61,12 @@ struct vnode_direction {
 	struct vlist hooks;	/**< List of read / write hooks (struct hook). */
 	struct vlist signals;	/**< Signal description. */
 
+	/** Forwarding of received samples to secondary path sources (input only). */
+	struct {
+		unsigned queuelen;			/**< Number of slots in the broadcast ring. */
+		enum BroadcastRingOverflow overflow;	/**< Policy if the slowest secondary did not catch up. */
+	} secondaries;
+
 	json_t *config;		/**< A JSON object containing the configuration of the node. */
 };
 
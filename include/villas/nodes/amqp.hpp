@@ -29,11 +29,17 @@
 
 #pragma once
 
+#include <ctime>
+
 #include <amqp.h>
 
 #include <villas/list.h>
 #include <villas/format.hpp>
 
+#define AMQP_BUFFER_SIZE	1500
+#define AMQP_MAX_MESSAGE_SIZE	(1 << 24)
+#define AMQP_DEFAULT_CONFIRM_WINDOW 256
+
 /* Forward declarations */
 struct vnode;
 
@@ -45,6 +51,11 @@ struct amqp_ssl_info {
 	char *client_key;
 };
 
+struct amqp_confirm {
+	struct timespec ts;	/**< Time at which the message has been published. */
+	bool pending;		/**< Message has not yet been confirmed. */
+};
+
 struct amqp {
 	char *uri;
 
@@ -58,6 +69,24 @@ struct amqp {
 	amqp_connection_state_t producer;
 	amqp_connection_state_t consumer;
 
+	struct {
+		int prefetch;			/**< Maximum number of unacknowledged deliveries (basic.qos) or 0 for automatic acknowledgement. */
+	} in;
+
+	struct {
+		int samples_per_message;	/**< Maximum number of samples per message or 0 for all samples of a write. */
+		int confirm;			/**< Enable publisher confirms. */
+		int confirm_window;		/**< Maximum number of unconfirmed messages. */
+
+		uint64_t next_tag;		/**< Delivery tag of the next published message. */
+		uint64_t oldest_tag;		/**< Lowest delivery tag which is not yet confirmed. */
+
+		struct amqp_confirm *published;	/**< Ring buffer indexed by delivery tag modulo confirm_window. */
+
+		char *buffer;
+		size_t buffer_size;
+	} out;
+
 	villas::node::Format *formatter;
 };
 
@@ -31,8 +31,17 @@
 
 #include <jansson.h>
 
+#include <sys/socket.h>
+#include <linux/can.h>
+
 #include <villas/timing.h>
 
+/** Maximum number of frames which are received or sent with a single system call. */
+#define CAN_BATCH_SIZE		64
+
+/** Number of entries in the direct lookup table for standard frame format IDs. */
+#define CAN_SFF_TABLE_SIZE	(CAN_SFF_MASK + 1)
+
 /* Forward declarations */
 struct vnode;
 union signal_data;
@@ -43,6 +52,22 @@ struct can_signal {
 	int size;
 };
 
+/** All signals which are carried by frames with the same CAN ID. */
+struct can_id_entry {
+	uint32_t id;
+	unsigned first;			/**< Index of the first signal in can::in_map.signals. */
+	unsigned num;			/**< Number of signals carried by this ID. */
+	bool received;			/**< A frame with this ID has been received for the current sample. */
+};
+
+/** Frames and message headers for a single recvmmsg() / sendmmsg() call. */
+struct can_batch {
+	struct can_frame frames[CAN_BATCH_SIZE];
+	struct iovec iov[CAN_BATCH_SIZE];
+	struct mmsghdr msgs[CAN_BATCH_SIZE];
+	char ctrl[CAN_BATCH_SIZE][CMSG_SPACE(sizeof(struct timeval))];
+};
+
 struct can {
 	/* Settings */
 	char *interface_name;
@@ -53,8 +78,24 @@ struct can {
 	/* States */
 	int socket;
 	union signal_data *sample_buf;
-	size_t sample_buf_num;
+	size_t sample_buf_num;		/**< Number of CAN IDs received for the current sample. */
 	struct timespec start_time;
+
+	struct {
+		struct can_id_entry *ids;	/**< Sorted by CAN ID. */
+		unsigned ids_num;
+		unsigned *signals;		/**< Signal indices grouped by CAN ID. */
+		uint16_t *sff;			/**< Direct index from standard frame format IDs into ids or UINT16_MAX. */
+	} in_map;
+
+	struct {
+		unsigned *slots;		/**< Frame of each output signal. */
+		struct can_frame *frames;	/**< The frames of a single sample. */
+		unsigned frames_num;
+	} out_map;
+
+	struct can_batch *rx;
+	struct can_batch *tx;
 };
 
 /** @see node_type::init */
@@ -70,10 +111,10 @@ int can_parse(struct vnode *n, json_t *json);
 char * can_print(struct vnode *n);
 
 /** @see node_type::check */
-int can_check();
+int can_check(struct vnode *n);
 
 /** @see node_type::prepare */
-int can_prepare();
+int can_prepare(struct vnode *n);
 
 /** @see node_type::start */
 int can_start(struct vnode *n);
@@ -29,9 +29,14 @@
 
 #pragma once
 
+#include <vector>
+
 #include <villas/popen.hpp>
 #include <villas/format.hpp>
 
+#define EXEC_BUFFER_SIZE	4096
+#define EXEC_MAX_FRAME_SIZE	(1 << 24)
+
 /* Forward declarations */
 struct vnode;
 struct sample;
@@ -44,6 +49,17 @@ struct exec {
 
 	bool flush;
 	bool shell;
+	int pipe_size;			/**< Size of the pipe buffers in bytes or 0 for the system default. */
+
+	enum class Framing {
+		LINE,			/**< Formatted samples are exchanged line by line. */
+		LENGTH			/**< Each vector of samples is prefixed by its length as a 32-bit integer in network byte order. */
+	} framing;
+
+	struct {
+		std::vector<char> buffer;
+	} in, out;
+
 	std::string working_dir;
 	std::string command;
 	villas::utils::Popen::arg_list arguments;
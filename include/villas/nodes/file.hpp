@@ -30,15 +30,55 @@
 #pragma once
 
 #include <cstdio>
+#include <cstdint>
+
+#include <pthread.h>
 
 #include <villas/format.hpp>
 #include <villas/task.hpp>
+#include <villas/nodes/file_compression.hpp>
 
 /* Forward declarations */
 struct vnode;
 
 #define FILE_MAX_PATHLEN	512
 
+#define FILE_INDEX_MAGIC	"VILLASIX"
+#define FILE_INDEX_VERSION	1
+#define FILE_INDEX_SUFFIX	".idx"
+
+#define FILE_MMAP_READAHEAD	(4 << 20)	/**< Default number of bytes prefetched ahead of the replay position. */
+#define FILE_MMAP_RECORD_MAX	(16 << 20)	/**< Maximum length of a single record in a memory-mapped file. */
+
+#define FILE_ASYNC_BUFFER_SIZE	(8 << 20)	/**< Default size of each of the two buffers of the asynchronous writer. */
+#define FILE_ASYNC_FLUSH_INTERVAL 1.0		/**< Default number of seconds after which buffered data is written. */
+
+/** Location and timestamp of a single sample in a memory-mapped file. */
+struct file_index_entry {
+	uint64_t offset;
+	uint32_t length;
+	uint32_t flags;
+	uint64_t sequence;
+	int64_t ts_sec;
+	int64_t ts_nsec;
+};
+
+/** Header of the sidecar index file which is stored next to the recording. */
+struct file_index_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t entry_size;
+	uint64_t data_len;		/**< Number of bytes of the recording which are covered by the index. */
+	int64_t data_mtime;		/**< Modification time of the recording when the index has been written. */
+	uint64_t count;			/**< Number of entries following the header. */
+};
+
+/** A buffer of formatted samples which is handed over to the writer thread. */
+struct file_async_buffer {
+	char *data;
+	size_t len;			/**< Number of bytes which are ready to be written. */
+};
+
 struct file {
 	villas::node::Format *formatter;
 	FILE *stream_in;
@@ -55,6 +95,78 @@ struct file {
 	size_t buffer_size_out;		/**< Defines size of output stream buffer. No buffer is created if value is set to zero. */
 	size_t buffer_size_in;		/**< Defines size of input stream buffer. No buffer is created if value is set to zero. */
 
+	enum FileCompression compression;
+	int compression_level;
+	struct file_decompressor *decompressor;	/**< Provides file::stream_in for compressed files. */
+
+	/** Indexed replay of binary formats from a memory-mapped file. */
+	struct {
+		int enabled;
+		double seek;			/**< Start the replay at this many seconds after the first sample. Also supported by 'villas.columnar' without mmap. */
+		size_t readahead;		/**< Number of bytes which are prefetched ahead of the replay position. */
+
+		int fd;
+		char *base;			/**< Base address of the mapping. */
+		size_t len;			/**< Length of the mapping. */
+		size_t prefetched;		/**< The mapping has been prefetched up to this offset. */
+
+		struct file_index_entry *index;	/**< Location and timestamp of each sample. */
+		size_t index_cnt;
+		size_t index_cap;
+		size_t indexed_len;		/**< Number of bytes covered by the index. */
+		bool index_dirty;		/**< The index has been extended since it was last saved. */
+
+		char *scratch;			/**< Records are copied here as formats might modify their input while parsing. */
+		size_t scratch_len;
+
+		size_t pos;			/**< Index of the next sample to replay. */
+		size_t first;			/**< Index of the first sample to replay after seeking and skipping. */
+	} mmap;
+
+	enum class FsyncPolicy {
+		NEVER,			/**< Leave it to the kernel when data reaches the disk. */
+		FLUSH,			/**< Synchronize after each buffer has been written. */
+		ROTATE			/**< Synchronize before a file is closed. */
+	};
+
+	/** Asynchronous writer.
+	 *
+	 * Samples are formatted into the active buffer while a dedicated thread writes the other one to disk.
+	 * The output stream file::stream_out appends to the active buffer.
+	 */
+	struct {
+		int enabled;
+		size_t buffer_size;		/**< Size of each of the two buffers. */
+		double flush_interval;		/**< Maximum time which data stays in the active buffer. */
+		enum FsyncPolicy fsync;
+		size_t rotate_size;		/**< Start a new file once this many bytes have been written to the current one. */
+		double rotate_interval;		/**< Start a new file every n seconds. */
+
+		pthread_t thread;
+		pthread_mutex_t mutex;		/**< Protects file::async::active and the flags below. */
+		pthread_cond_t cond;
+
+		struct file_async_buffer buffers[2];
+		struct file_async_buffer *active;	/**< Filled by file_write(). */
+		struct file_async_buffer *spare;	/**< Written by the writer thread. */
+
+		bool pending;			/**< The writer thread should swap buffers without waiting for the flush interval. */
+		bool overflow;			/**< The last record did not fit into the active buffer. */
+		bool stop;
+
+		/* Only accessed by the writer thread */
+		struct file_compressor compressor;
+		int fd;
+		char *uri;			/**< Name of the current file. */
+		size_t file_bytes;		/**< Size of the current file. */
+		double rotate_next;		/**< Time of the next rotation. */
+		size_t bytes_written;
+		size_t rotations;
+		size_t lost;			/**< Number of bytes discarded as no output file could be opened. */
+
+		size_t dropped;			/**< Number of samples dropped as the writer thread could not keep up. */
+	} async;
+
 	enum class EpochMode {
 		DIRECT,
 		WAIT,
@@ -92,4 +204,13 @@ int file_read(struct vnode *n, struct sample * const smps[], unsigned cnt);
 /** @see node_type::write */
 int file_write(struct vnode *n, struct sample * const smps[], unsigned cnt);
 
+/** Continue an indexed replay at the first sample with a timestamp not earlier than \p ts.
+ *
+ * The lookup uses a binary search on the index. Hence the timestamps of the recording should be monotonic.
+ *
+ * @retval 0 The replay position has been changed.
+ * @retval -1 The node does not use indexed replay.
+ */
+int file_seek(struct vnode *n, const struct timespec *ts);
+
 /** @} */
@@ -0,0 +1,114 @@
+/** Streaming compression for the file node-type.
+ *
+ * @file
+ * @author Steffen Vogel <stvogel@eonerc.rwth-aachen.de>
+ * @copyright 2014-2020, Institute for Automation of Complex Power Systems, EONERC
+ * @license GNU General Public License (version 3)
+ *
+ * VILLASnode
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *********************************************************************************/
+
+/**
+ * @addtogroup file File-IO node type
+ * @ingroup node
+ * @{
+ */
+
+#pragma once
+
+#include <cstdio>
+#include <cstddef>
+
+#include <villas/node/config.h>
+
+#define FILE_COMPRESSION_BUFFER_SIZE	(1 << 20)	/**< Size of the buffers for compressed data. */
+
+enum class FileCompression {
+	NONE,
+	GZIP,
+	ZSTD
+};
+
+/** Compresses data written by the asynchronous writer of the file node.
+ *
+ * Each file gets its own gzip member or zstd frame.
+ * As both formats allow concatenation, compressed files can be appended.
+ */
+struct file_compressor {
+	enum FileCompression type;
+	int level;
+
+	void *ctx;			/**< A z_stream or ZSTD_CCtx. */
+
+	char *buffer;			/**< Compressed data before it is written. */
+	size_t buflen;
+};
+
+/** Decompresses a file and provides the data via a stdio stream. */
+struct file_decompressor {
+	enum FileCompression type;
+
+	int fd;
+	FILE *stream;			/**< Stream of decompressed data. Closing it releases the decompressor. */
+
+	void *ctx;			/**< A z_stream or ZSTD_DCtx. */
+
+	char *buffer;			/**< Compressed data read from the file. */
+	size_t buflen;
+	size_t len;			/**< Number of valid bytes in file_decompressor::buffer. */
+	size_t pos;			/**< Number of bytes of file_decompressor::buffer which have been consumed. */
+
+	off64_t offset;			/**< Number of decompressed bytes which have been provided. */
+};
+
+/** Parse the name of a compression algorithm.
+ *
+ * @retval 0 Success.
+ * @retval -1 Unknown algorithm.
+ */
+int file_compression_lookup(const char *name, enum FileCompression *type);
+
+/** Guess the compression algorithm from the extension of a file name. */
+enum FileCompression file_compression_detect(const char *uri);
+
+const char * file_compression_name(enum FileCompression type);
+
+/** Check if VILLASnode has been built with support for the algorithm. */
+bool file_compression_available(enum FileCompression type);
+
+/** The default level of the compression algorithm. */
+int file_compression_default_level(enum FileCompression type);
+
+int file_compressor_init(struct file_compressor *c, enum FileCompression type, int level) __attribute__ ((warn_unused_result));
+
+int file_compressor_destroy(struct file_compressor *c) __attribute__ ((warn_unused_result));
+
+/** Compress \p len bytes of \p buf and write the result to \p fd.
+ *
+ * All data is flushed to \p fd so that readers can decompress everything written so far.
+ *
+ * @param finish Complete the current member / frame. The following data will start a new one.
+ * @return The number of bytes written to \p fd or a negative value on errors.
+ */
+ssize_t file_compressor_write(struct file_compressor *c, int fd, const char *buf, size_t len, bool finish);
+
+/** Open the compressed file \p uri for reading.
+ *
+ * @return A pointer to the decompressor or nullptr on errors.
+ */
+struct file_decompressor * file_decompressor_open(const char *uri, enum FileCompression type);
+
+/** @} */
@@ -30,6 +30,9 @@
 #pragma once
 
 #include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <vector>
 
 #ifdef __APPLE__
   #include <net/ethernet.h>
@@ -44,8 +47,12 @@
 #include <villas/list.h>
 #include <villas/signal.h>
 
+/** Timeout in milliseconds after which receive threads check for new receivers. */
+#define IEC61850_WAIT_TIMEOUT 100
+
 /* Forward declarations */
 struct vnode;
+struct iec61850_receiver;
 
 enum class IEC61850Type {
 	/* According to IEC 61850-7-2 */
@@ -82,11 +89,37 @@ struct iec61850_type_descriptor {
 	bool subscriber;
 };
 
+/** A thread which receives frames for one or all network interfaces */
+struct iec61850_thread {
+	pthread_t thread;
+
+	char *interface;		/**< Interface served by this thread or nullptr if it serves all. */
+	int affinity;			/**< CPU affinity mask or 0. */
+
+	EthernetHandleSet hset;
+
+	std::mutex mutex;
+	std::vector<struct iec61850_receiver *> receivers; /**< Receivers ticked by this thread. */
+	std::vector<struct iec61850_receiver *> pending; /**< Receivers whose sockets have not been added to the handle set yet. */
+
+	std::atomic<bool> stop;
+};
+
+/** A callback which is invoked after a receiver has processed a frame */
+struct iec61850_flush {
+	void (*cb)(void *ctx);
+	void *ctx;
+};
+
 struct iec61850_receiver {
 	char *interface;
 
 	EthernetSocket socket;
 
+	struct iec61850_thread *thread;
+
+	std::vector<struct iec61850_flush> flushers; /**< Protected by thread->mutex. */
+
 	enum class Type {
 		GOOSE,
 		SAMPLED_VALUES
@@ -116,6 +149,21 @@ int iec61850_receiver_start(struct iec61850_receiver *r);
 
 int iec61850_receiver_stop(struct iec61850_receiver *r);
 
+/** Register a callback which is invoked after each processed frame.
+ *
+ * The callback is invoked by the receive thread with thread->mutex held.
+ * Hence, it must not add or remove callbacks itself.
+ */
+void iec61850_receiver_add_flush(struct iec61850_receiver *r, void (*cb)(void *ctx), void *ctx);
+
+void iec61850_receiver_remove_flush(struct iec61850_receiver *r, void *ctx);
+
+/** Process a single frame if one is available.
+ *
+ * @retval true A frame has been processed.
+ */
+bool iec61850_receiver_tick(struct iec61850_receiver *r);
+
 int iec61850_receiver_destroy(struct iec61850_receiver *r);
 
 /** @} */
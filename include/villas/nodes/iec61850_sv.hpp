@@ -39,6 +39,9 @@
 #include <villas/list.h>
 #include <villas/nodes/iec61850.hpp>
 
+/** Maximum number of ASDUs in a single frame */
+#define IEC61850_SV_MAX_ASDUS 64
+
 /* Forward declarations */
 struct vnode;
 
@@ -56,6 +59,9 @@ struct iec61850_sv {
 		struct queue_signalled queue;
 		struct pool pool;
 
+		struct sample *batch[IEC61850_SV_MAX_ASDUS]; /**< Samples of the ASDUs of the current frame. */
+		unsigned batched;
+
 		struct vlist signals;		/**< Mappings of type struct iec61850_type_descriptor */
 		int total_size;
 	} in;
@@ -64,7 +70,10 @@ struct iec61850_sv {
 		bool enabled;
 
 		SVPublisher publisher;
-		SVPublisher_ASDU asdu;
+		SVPublisher_ASDU *asdus;
+
+		int asdus_per_frame;		/**< Number of samples which are sent in a single frame. */
+		int filled;			/**< Number of ASDUs of the next frame which have been filled already. */
 
 		char *svid;
 
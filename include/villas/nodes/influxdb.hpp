@@ -29,25 +29,99 @@
 
 #pragma once
 
+#include <pthread.h>
+
+#include <curl/curl.h>
+
 #include <villas/list.h>
 
 /* Forward declarations */
 struct vnode;
 struct sample;
 
+#define INFLUXDB_BATCH_MAX_LINES	5000		/**< Default maximum number of lines per batch. */
+#define INFLUXDB_BATCH_MAX_BYTES	(1 << 20)	/**< Default maximum size of a batch in bytes. */
+#define INFLUXDB_BATCH_LINGER		1.0		/**< Default time in seconds a batch waits for more lines. */
+#define INFLUXDB_UDP_PAYLOAD		65000		/**< Maximum payload of a single datagram. */
+#define INFLUXDB_BACKOFF_MIN		0.1		/**< Initial delay in seconds between reconnection attempts. */
+#define INFLUXDB_BACKOFF_MAX		10.0		/**< Maximum delay in seconds between reconnection attempts. */
+#define INFLUXDB_TIMEOUT		5		/**< Timeout in seconds for HTTP requests. */
+
+/** Line protocol data of a batch. */
+struct influxdb_buffer {
+	char *data;
+	size_t len;
+	size_t size;
+	unsigned lines;
+
+	struct timespec first;		/**< Time at which the first line has been added. */
+};
+
+/** Beginning of the body of a HTTP response. */
+struct influxdb_response {
+	char data[256];
+	size_t len;
+};
+
 /** Node-type for signal generation.
  * @see node_type
  */
 struct influxdb {
+	enum class Protocol {
+		UDP,			/**< Line protocol via UDP datagrams. */
+		HTTP			/**< Line protocol via the HTTP /write endpoint. */
+	} protocol;
+
 	char *host;
 	char *port;
 	char *key;
 
+	char *database;			/**< Database for the HTTP /write endpoint. */
+	char *token;			/**< Optional token for the Authorization header. */
+
 	struct vlist fields;
 
-	int sd;
+	int sd;				/**< Socket for protocol 'udp'. */
+
+	CURL *curl;			/**< libcurl: persistent handle for protocol 'http'. */
+	struct curl_slist *headers;	/**< List of HTTP request headers for libcurl. */
+	char *url;			/**< URL of the /write endpoint. */
+
+	struct influxdb_buffer buffer;	/**< Formatted lines of influxdb_write() if batching is disabled. */
+
+	struct {
+		bool enabled;
+
+		unsigned max_lines;
+		size_t max_bytes;
+		double linger;
+
+		pthread_t thread;
+		pthread_mutex_t mutex;
+		pthread_cond_t cond;
+
+		struct influxdb_buffer buffers[2];
+		struct influxdb_buffer *active;	/**< Filled by influxdb_write(). */
+		struct influxdb_buffer *spare;	/**< Sent by the flusher thread. */
+
+		bool pending;		/**< The flusher thread has been woken up to send the active buffer. */
+		bool overflow;		/**< Lines have been dropped as the active buffer was full. */
+		bool stop;
+
+		/* Counters */
+		size_t flushed;		/**< Number of batches which have been sent. */
+		size_t dropped;		/**< Number of batches which have been dropped. */
+		size_t dropped_lines;	/**< Number of lines which have been dropped. */
+		size_t reconnects;
+	} batch;
 };
 
+/** @see node_type::type_start */
+int influxdb_type_start(villas::node::SuperNode *sn);
+
+/** @see node_type::type_stop */
+int influxdb_type_stop();
+
 /** @see node_type::print */
 char * influxdb_print(struct vnode *n);
 
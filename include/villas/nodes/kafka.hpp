@@ -29,16 +29,29 @@
 
 #pragma once
 
+#include <atomic>
+
+#include <jansson.h>
 #include <librdkafka/rdkafka.h>
 
 #include <villas/pool.h>
 #include <villas/format.hpp>
 #include <villas/queue_signalled.h>
 
+#define KAFKA_BUFFER_SIZE	4096
+#define KAFKA_POOL_LENGTH	1024
+#define KAFKA_MAX_FRAME_SIZE	(1 << 24)
+
 /* Forward declarations */
 struct vnode;
 
 struct kafka {
+	enum class PartitionKey {
+		NONE,		/**< Let librdkafka choose the partition. */
+		NODE,		/**< Use the node name as message key. */
+		SIGNAL		/**< Use the value of a signal of the first sample as message key. */
+	};
+
 	struct queue_signalled queue;
 	struct pool pool;
 
@@ -49,14 +62,30 @@ struct kafka {
 	char *consume;			/**< Consumer topic. */
 	char *client_id;		/**< Client ID. */
 
+	json_t *properties;		/**< Additional librdkafka configuration properties. */
+
 	struct {
 		rd_kafka_t *client;
 		rd_kafka_topic_t *topic;
+
+		double linger;		/**< Maximum time in seconds messages are buffered by librdkafka (linger.ms). */
+		int batch_size;		/**< Maximum number of messages per batch (batch.num.messages). */
+		char *compression;	/**< Compression codec (compression.codec). */
+
+		PartitionKey key;
+		char *key_signal;	/**< Name of the signal used as message key. */
+		int key_index;		/**< Index of the key signal. Resolved by kafka_start(). */
+
+		struct pool pool;	/**< Pool of buffers which are handed over to librdkafka without copying. */
+		size_t buffer_size;	/**< Size of the buffers in the pool. */
+		std::atomic<int> inflight; /**< Number of pool buffers not yet released by a delivery report. */
 	} producer;
 
 	struct {
 		rd_kafka_t *client;
+		rd_kafka_queue_t *queue; /**< Consumer queue for batched consumption. */
 		char *group_id;		/**< Group id. */
+		int batch_size;		/**< Maximum number of messages consumed at once. */
 	} consumer;
 
 	struct {
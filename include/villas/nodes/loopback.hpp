@@ -41,6 +41,7 @@ struct sample;
  */
 struct loopback {
 	int queuelen;
+	int zero_copy;			/**< Pass references to the queued samples to the reader instead of copying them. */
 	enum QueueSignalledMode mode;
 	struct queue_signalled queue;
 };
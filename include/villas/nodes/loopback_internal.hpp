@@ -29,7 +29,7 @@
 
 #pragma once
 
-#include <villas/queue_signalled.h>
+#include <villas/broadcast_ring.h>
 #include <villas/pool.h>
 
 /* Forward declarations */
@@ -40,8 +40,10 @@ struct sample;
  * @see node_type
  */
 struct loopback_internal {
-	int queuelen;
-	struct queue_signalled queue;
+	int zero_copy;
+
+	struct broadcast_ring *ring;		/**< Owned by the master path source. */
+	struct broadcast_ring_consumer consumer;
 
 	struct vnode *source;
 };
@@ -58,9 +60,22 @@ int loopback_internal_stop(struct vnode *n);
 /** @see node_type::read */
 int loopback_internal_read(struct vnode *n, struct sample * const smps[], unsigned cnt);
 
-/** @see node_type::write */
-int loopback_internal_write(struct vnode *n, struct sample * const smps[], unsigned cnt);
+/** Create an internal node which reads the samples of \p orig from a broadcast ring. */
+struct vnode * loopback_internal_create(struct vnode *orig, struct broadcast_ring *ring);
 
-struct vnode * loopback_internal_create(struct vnode *orig);
+/** Hand samples which have been pulled from a loopback queue or ring over to the reader.
+ *
+ * In zero-copy mode, the references to the queued samples are passed through by
+ * replacing the samples which have been allocated by the caller of node_read().
+ * The callers samples are released and the queued samples are later returned to
+ * the pool of the writer by the sample_decref() of the caller.
+ *
+ * Samples are still copied if they are shared with other consumers and might be
+ * modified by the read hooks of the node.
+ *
+ * @param smps The samples which have been allocated by the caller of node_read()
+ * @param pulled The samples which have been pulled from the queue.
+ */
+void loopback_internal_pass(struct vnode *n, struct sample * const smps[], struct sample * const pulled[], unsigned cnt, bool zero_copy);
 
 /** @} */
@@ -29,6 +29,8 @@
 
 #pragma once
 
+#include <atomic>
+
 #include <villas/pool.h>
 #include <villas/format.hpp>
 #include <villas/queue_signalled.h>
@@ -37,6 +39,10 @@
 struct vnode;
 struct mosquitto;
 
+#define MQTT_BUFFER_SIZE	1500	/**< Maximum size of a published message. */
+#define MQTT_MAX_PACKETS	64	/**< Maximum number of packets handled per client and event. */
+#define MQTT_LATENCY_SLOTS	1024	/**< Number of messages for which the publish time is tracked. Must be a power of two. */
+
 struct mqtt {
 	struct mosquitto *client;
 	struct queue_signalled queue;
@@ -62,6 +68,20 @@ struct mqtt {
 	} ssl;
 
 	villas::node::Format *formatter;
+
+	/* State of the event loop */
+	struct {
+		int fd;			/**< Socket which is registered with epoll. Negative if none. */
+		uint32_t events;	/**< Events which are registered for fd. */
+		bool registered;	/**< The client is serviced by the event loop. */
+		struct timespec reconnect;	/**< Time of the last reconnect attempt. */
+	} loop;
+
+	/** Publish timestamps by message id for latency statistics. */
+	struct {
+		std::atomic<int> mid;
+		struct timespec ts;
+	} published[MQTT_LATENCY_SLOTS];
 };
 
 /** @see node_type::reverse */
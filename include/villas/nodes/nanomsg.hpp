@@ -35,13 +35,17 @@
 /* Forward declarations */
 struct vnode;
 
-/** The maximum length of a packet which contains stuct msg. */
+/** The initial length of messages allocated for sending. */
 #define NANOMSG_MAX_PACKET_LEN 1500
 
+/** The maximum length of a message allocated for sending. */
+#define NANOMSG_MAX_MSG_SIZE (1 << 24)
+
 struct nanomsg {
 	struct {
 		int socket;
 		struct vlist endpoints;
+		size_t buffer_size;	/**< Size of the next message allocated with nn_allocmsg(). */
 	} in, out;
 
 	villas::node::Format *formatter;
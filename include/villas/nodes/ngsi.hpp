@@ -35,15 +35,40 @@
 
 #pragma once
 
+#include <atomic>
+
 #include <curl/curl.h>
 #include <jansson.h>
+#include <pthread.h>
 
 #include <villas/list.h>
 #include <villas/task.hpp>
+#include <villas/pool.h>
+#include <villas/queue_signalled.h>
 
 /* Forward declarations */
 struct vnode;
 
+#define NGSI_ASYNC_MAX_BATCH		16	/**< Default number of samples per update request. */
+#define NGSI_ASYNC_MAX_INFLIGHT		4	/**< Default number of concurrent update requests. */
+#define NGSI_ASYNC_QUEUE_LENGTH		1024	/**< Default number of samples waiting for an update request. */
+
+struct ngsi_response {
+	char *data;
+	size_t len;
+};
+
+/** An update request of the asynchronous writer. */
+struct ngsi_inflight {
+	CURL *curl;
+
+	char *post;			/**< The request body. */
+	struct ngsi_response response;
+
+	unsigned cnt;			/**< Number of samples in the request. */
+	struct timespec started;
+};
+
 struct ngsi {
 	const char *endpoint;		/**< The NGSI context broker endpoint URL. */
 	const char *entity_id;		/**< The context broker entity id related to this node */
@@ -65,6 +90,29 @@ struct ngsi {
 		CURL *curl;		/**< libcurl: handle */
 		struct vlist signals;	/**< A mapping between indices of the VILLASnode samples and the attributes in ngsi::context */
 	} in, out;
+
+	/** Sends updates from a separate thread so that ngsi_write() does not wait for the context broker. */
+	struct {
+		bool enabled;
+
+		unsigned max_batch;	/**< Maximum number of samples which are coalesced into a single update request. */
+		unsigned max_inflight;	/**< Maximum number of concurrent update requests. */
+		unsigned queue_length;
+
+		struct pool pool;	/**< Copies of the samples passed to ngsi_write(). */
+		struct queue_signalled queue;
+
+		CURLM *multi;
+		struct ngsi_inflight *requests;
+
+		pthread_t thread;
+		std::atomic<bool> stop;
+
+		/* Counters */
+		size_t sent;		/**< Number of samples which have been accepted by the context broker. */
+		size_t failed;		/**< Number of samples in failed update requests. */
+		size_t dropped;		/**< Number of samples dropped because the queue was full. */
+	} async;
 };
 
 /** Initialize global NGSI settings and maps shared memory regions.
@@ -65,8 +65,12 @@ struct signal_generator {
 	double *pulse_high;		/**< Amplitude when pulse signal is on */
 	double *phase;			/**< Phase (rad) offset with respect to program start */
 	int monitor_missed;		/**< Boolean, if set, node counts missed steps and warns user. */
+	int catch_up;			/**< Boolean, if set, steps missed in real-time mode are generated with their nominal timestamps. */
 
 	double *last;			/**< The values from the previous period which are required for random walk. */
+	double *scratch;		/**< The values of a single signal for a vector of samples. */
+	unsigned scratch_len;
+	uint64_t pending;		/**< Number of due steps which have not been generated yet (catch-up mode only). */
 
 	unsigned values;			/**< The number of values which will be emitted by this node. */
 	int limit;			/**< The number of values which should be generated by this node. <0 for infinitve. */
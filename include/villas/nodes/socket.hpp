@@ -29,6 +29,8 @@
 
 #pragma once
 
+#include <netinet/udp.h>
+
 #include <villas/node/config.h>
 #include <villas/socket_addr.h>
 #include <villas/format.hpp>
@@ -39,6 +41,16 @@ struct vnode;
 /** The maximum length of a packet which contains stuct msg. */
 #define SOCKET_INITIAL_BUFFER_LEN (64*1024)
 
+#if defined(__linux__) && defined(UDP_SEGMENT) && defined(UDP_GRO)
+  #define WITH_SOCKET_UDP_OFFLOAD
+
+  /** Maximum number of segments the kernel accepts in a single GSO send. */
+  #define SOCKET_GSO_MAX_SEGMENTS	64
+
+  /** Maximum payload of a single GSO super-datagram. */
+  #define SOCKET_GSO_MAX_LEN		(0xFFFF - 8 - 40)
+#endif /* UDP_SEGMENT && UDP_GRO */
+
 struct socket {
 	int sd;				/**< The socket descriptor */
 	int verify_source;		/**< Verify the source address of incoming packets against socket::remote. */
@@ -59,7 +71,20 @@ struct socket {
 		char *buf;		/**< Buffer for receiving messages */
 		size_t buflen;
 		union sockaddr_union saddr;	/**< Remote address of the socket */
+		int offload;		/**< Use UDP generic segmentation (out) / receive (in) offload. */
 	} in, out;
+
+#ifdef WITH_SOCKET_UDP_OFFLOAD
+	/* Coalesced datagrams which did not fit into the last read */
+	struct {
+		size_t off;		/**< Offset of the next unparsed datagram in socket::in::buf. */
+		size_t len;		/**< End of the coalesced datagrams in socket::in::buf. */
+		size_t segsize;		/**< Size of the individual datagrams. */
+
+		int efd;		/**< An eventfd which is readable while datagrams are pending. */
+		int pfd;		/**< An epoll instance for the socket and the eventfd which is used for poll(). */
+	} gro;
+#endif /* WITH_SOCKET_UDP_OFFLOAD */
 };
 
 
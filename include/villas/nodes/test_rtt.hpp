@@ -32,6 +32,7 @@
 #include <villas/list.h>
 #include <villas/format.hpp>
 #include <villas/task.hpp>
+#include <villas/hdr_hist.hpp>
 
 /* Forward declarations */
 struct test_rtt;
@@ -46,6 +47,8 @@ struct test_rtt_case {
 	char *filename;
 	char *filename_formatted;
 
+	villas::HdrHist *hist;		/**< Round-trip times of this test case. */
+
 	struct vnode *node;
 };
 
@@ -56,6 +59,17 @@ struct test_rtt {
 
 	double cooldown;		/**< Number of seconds to wait beween tests. */
 
+	int log_samples;		/**< Write each received sample to the output file of its case. */
+	int correct_omission;		/**< Correct round-trip times for coordinated omission based on the rate of the case. */
+
+	enum class SummaryFormat {
+		NONE,
+		JSON,
+		CSV
+	} summary_format;		/**< The format of the file with the round-trip time percentiles of all cases. */
+
+	char *summary;			/**< The path of the summary file. */
+
 	int current;			/**< Index of current test in test_rtt::cases */
 	int counter;
 
@@ -29,6 +29,11 @@
 
 #pragma once
 
+#include <map>
+#include <atomic>
+#include <string>
+#include <vector>
+
 #include <spdlog/fmt/ostr.h>
 
 #include <villas/pool.h>
@@ -42,16 +47,38 @@
 struct vnode;
 
 #define DEFAULT_WEBSOCKET_QUEUE_LENGTH	(DEFAULT_QUEUE_LENGTH * 64)
+#define DEFAULT_WEBSOCKET_MAX_LAG	(DEFAULT_QUEUE_LENGTH / 4)	/**< Maximum number of frames queued per connection */
 
 /* Forward declaration */
 struct lws;
 
+/** An encoded message which is shared by all connections using the same format.
+ *
+ * The payload follows the structure after LWS_PRE bytes of headroom for libwebsockets.
+ */
+struct websocket_frame {
+	std::atomic<int> refcnt;
+	bool binary;
+	size_t len;				/**< Length of the payload in bytes. */
+};
+
+/** Serializes the samples of a node once per format. */
+struct websocket_encoder {
+	villas::node::Format *formatter;
+	std::vector<struct websocket_frame *> frames;	/**< Frames of the current call to websocket_write(). */
+};
+
 /** Internal data per websocket node */
 struct websocket {
 	struct vlist destinations;		/**< List of websocket servers connect to in client mode (struct websocket_destination). */
 
 	struct pool pool;
 	struct queue_signalled queue;		/**< For samples which are received from WebSockets */
+
+	int max_lag;				/**< Number of queued frames after which new frames are dropped for a connection. */
+
+	std::map<std::string, struct websocket_encoder> *encoders;	/**< Encoders by format name. Only used by websocket_write(). */
+	villas::Buffer *buffer;			/**< Scratch buffer for encoding. */
 };
 
 struct websocket_destination {
@@ -79,7 +106,11 @@ struct websocket_connection {
 	struct lws *wsi;
 	struct vnode *node;
 	villas::node::Format *formatter;
-	struct queue queue;			/**< For samples which are sent to the Websocket */
+	char *format;				/**< Name of the format used by this connection. */
+	struct queue queue;			/**< For frames which are sent to the Websocket (struct websocket_frame) */
+
+	size_t dropped;				/**< Number of frames dropped because the connection was lagging. */
+	bool lagging;
 
 	struct websocket_destination *destination;
 
@@ -30,10 +30,12 @@
 #pragma once
 
 #include <cstdint>
+#include <atomic>
 #include <jansson.h>
 
 #include <villas/super_node.hpp>
 #include <villas/list.h>
+#include <villas/pool.h>
 #include <villas/format.hpp>
 
 #if ZMQ_BUILD_DRAFT_API && (ZMQ_VERSION_MAJOR > 4 || (ZMQ_VERSION_MAJOR == 4 && ZMQ_VERSION_MINOR >= 2))
@@ -44,6 +46,9 @@
 struct vnode;
 struct sample;
 
+#define ZEROMQ_BUFFER_SIZE	4096	/**< Default size of a message in bytes. */
+#define ZEROMQ_POOL_LENGTH	1024	/**< Number of buffers for zero-copy sends. */
+
 struct zeromq {
 	int ipv6;
 
@@ -71,6 +76,17 @@ struct zeromq {
 		char *filter;
 		int bind, pending;
 	} in, out;
+
+	struct {
+		int zerocopy;			/**< Pass buffers of the pool to ZeroMQ instead of copying them into a new message. */
+		int multipart;			/**< Send the samples of a write as parts of a single multipart message. */
+		size_t buffer_size;		/**< Maximum size of a message (part) in bytes. */
+
+		struct pool pool;		/**< Buffers which are released by ZeroMQ once they have been sent. */
+		std::atomic<int> inflight;	/**< Number of buffers currently owned by ZeroMQ. */
+
+		char *buffer;			/**< Used if zero-copy is disabled or the pool is exhausted. */
+	} send;
 };
 
 /** @see node_type::print */
@@ -31,6 +31,7 @@
 
 #include <villas/pool.h>
 #include <villas/list.h>
+#include <villas/broadcast_ring.h>
 
 /* Forward declarations */
 struct vpath;
@@ -51,6 +52,8 @@ struct vpath_source {
 	struct pool pool;
 	struct vlist mappings;			/**< List of mappings (struct mapping_entry). */
 	struct vlist secondaries;		/**< List of secondary path sources (struct path_sourced). */
+
+	struct broadcast_ring ring;		/**< Forwards received samples to the secondary path sources. */
 };
 
 int path_source_init_master(struct vpath_source *ps, struct vnode *n) __attribute__ ((warn_unused_result));
@@ -23,10 +23,20 @@
 
 #pragma once
 
+#include <atomic>
+
+#include <cstdint>
+
 #include <pthread.h>
 
 #include <villas/queue.h>
 
+/** Number of polls before a reader goes to sleep in the futex mode. */
+#define QUEUE_SIGNALLED_FUTEX_SPIN	1024
+
+/** Maximum time in nanoseconds a reader sleeps before checking for cancellation in the futex mode. */
+#define QUEUE_SIGNALLED_FUTEX_TIMEOUT	100000000
+
 enum class QueueSignalledMode {
 	AUTO, /**< We will choose the best method available on the platform */
 	PTHREAD,
@@ -36,6 +46,9 @@ enum class QueueSignalledMode {
 #elif defined(__APPLE__)
 	PIPE,
 #endif
+#ifdef __linux__
+	FUTEX,	/**< Spin for a while before sleeping on a futex. Wakes only if somebody sleeps. */
+#endif
 };
 
 enum class QueueSignalledFlags {
@@ -58,6 +71,13 @@ struct queue_signalled {
 		int eventfd;
 #elif defined(__APPLE__)
 		int pipe[2];
+#endif
+#ifdef __linux__
+		struct {
+			std::atomic<uint32_t> seq;	/**< Futex word: incremented after each write to the queue. */
+			std::atomic<uint32_t> waiters;	/**< Number of readers which are sleeping or about to sleep. */
+			unsigned spin;			/**< Number of polls before going to sleep. */
+		} futex;
 #endif
 	};
 };
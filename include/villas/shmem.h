@@ -29,6 +29,8 @@
 
 #pragma once
 
+#include <atomic>
+
 #include <villas/pool.h>
 #include <villas/queue.h>
 #include <villas/queue_signalled.h>
@@ -40,16 +42,56 @@
 /** Struct containing all parameters that need to be known when creating a new
  * shared memory object. */
 struct shmem_conf {
-	int polling;			/**< Whether to use polling instead of POSIX CVs */
+	enum QueueSignalledMode mode;	/**< Synchronization of the queues: AUTO, POLLING, PTHREAD or FUTEX */
 	int queuelen;			/**< Size of the queues (in elements) */
 	int samplelen;			/**< Maximum number of data entries in a single sample */
+	int mailbox;			/**< Pass only the latest sample via a seqlock-protected mailbox instead of the queue */
+};
+
+/** One of the two buffers of a latest-value mailbox. */
+struct shmem_mailbox_slot {
+	std::atomic<uint64_t> lock;	/**< Seqlock counter: odd while the writer is updating the slot. */
+
+	uint64_t sequence;
+	unsigned length;
+	int flags;
+
+	struct {
+		struct timespec origin;
+		struct timespec received;
+	} ts;
+
+	union signal_data data[];
+};
+
+/** A seqlock-protected latest-value mailbox.
+ *
+ * The writer alternates between two slots so that a reader of the latest
+ * sample is only disturbed if the writer overtakes it twice.
+ */
+struct shmem_mailbox {
+	off_t slots_off;		/**< Offset from the mailbox to the first slot. */
+	size_t slot_len;		/**< Length of a slot in bytes. */
+	unsigned capacity;		/**< Maximum number of values per slot. */
+
+	std::atomic<uint64_t> written;	/**< Number of published samples. The latest one resides in slot (written % 2). */
+	std::atomic<uint64_t> consumed;	/**< Value of shmem_mailbox::written at the last successful read. */
+	std::atomic<int> closed;
+
+	std::atomic<uint64_t> overwrites;	/**< Number of samples which have been replaced before they were read. */
+	std::atomic<uint64_t> torn_reads;	/**< Number of reads which have been retried due to a concurrent write. */
+
+	std::atomic<uint32_t> seq;	/**< Futex word which is incremented for each published sample. */
+	std::atomic<uint32_t> waiters;	/**< Number of readers sleeping on shmem_mailbox::seq. */
 };
 
 /** The structure that actually resides in the shared memory. */
 struct shmem_shared {
-	int polling;			/**< Whether to use a pthread_cond_t to signal if new samples are written to incoming queue. */
+	int polling;			/**< Whether the reader busy-waits for new samples in the incoming queue. */
+	int mailbox;			/**< Whether samples are passed via shmem_shared::latest instead of the queue. */
 	struct queue_signalled queue;	/**< Queue for samples passed in both directions. */
 	struct pool pool;		/**< Pool for the samples in the queues. */
+	struct shmem_mailbox latest;	/**< Mailbox holding only the latest sample. */
 };
 
 /** Relevant information for one direction of the interface. */
@@ -88,6 +130,8 @@ int shmem_int_open(const char* wname, const char* rname, struct shmem_int* shm,
 int shmem_int_close(struct shmem_int *shm);
 
 /** Read samples from the interface.
+ *
+ * If the other process uses a mailbox, at most the latest sample is returned.
  *
  * @param shm The shared memory interface.
  * @param smps  An array where the pointers to the samples will be written. The samples
@@ -99,6 +143,8 @@ int shmem_int_close(struct shmem_int *shm);
 int shmem_int_read(struct shmem_int *shm, struct sample * const smps[], unsigned cnt);
 
 /** Write samples to the interface.
+ *
+ * In mailbox mode, only the last sample is kept and all samples are released by the writer.
  *
  * @param shm The shared memory interface.
  * @param smps The samples to be written. Must be allocated from shm_int_alloc.
@@ -118,6 +164,54 @@ int shmem_int_write(struct shmem_int *shm, const struct sample * const smps[], u
  */
 int shmem_int_alloc(struct shmem_int *shm, struct sample *smps[], unsigned cnt);
 
+/** Copy the latest sample of the mailbox of the other process into \p smp.
+ *
+ * This function does not allocate. It blocks until a new sample is available
+ * unless the other process uses the polling mode.
+ *
+ * @retval 1 A new sample has been copied to \p smp.
+ * @retval 0 No new sample has been published since the last read.
+ * @retval -1 The other process closed the interface.
+ */
+int shmem_int_read_latest(struct shmem_int *shm, struct sample *smp);
+
+/** Publish the last of \p cnt samples in the own mailbox.
+ *
+ * The samples are only copied and remain owned by the caller.
+ *
+ * @return The number of samples which have been passed.
+ */
+int shmem_int_write_latest(struct shmem_int *shm, const struct sample * const smps[], unsigned cnt);
+
+/** Initialize a mailbox whose slots are allocated from \p m. */
+int shmem_mailbox_init(struct shmem_mailbox *mb, int samplelen, struct memory_type *m);
+
+/** Release the slots of a mailbox which is not shared anymore. */
+int shmem_mailbox_destroy(struct shmem_mailbox *mb);
+
+/** Publish the last of \p cnt samples and wake up a sleeping reader.
+ *
+ * @return The number of samples which have been passed.
+ */
+int shmem_mailbox_put(struct shmem_mailbox *mb, const struct sample * const smps[], unsigned cnt);
+
+/** Copy the latest sample into \p smp without blocking.
+ *
+ * @retval 1 A new sample has been copied to \p smp.
+ * @retval 0 No new sample has been published since the last read.
+ * @retval -1 The mailbox has been closed.
+ */
+int shmem_mailbox_get(struct shmem_mailbox *mb, struct sample *smp);
+
+/** Copy the latest sample into \p smp and block until a new one is available.
+ *
+ * @see shmem_mailbox_get()
+ */
+int shmem_mailbox_wait(struct shmem_mailbox *mb, struct sample *smp);
+
+/** Let following reads fail and wake up a sleeping reader. */
+void shmem_mailbox_close(struct shmem_mailbox *mb);
+
 /** Returns the total size of the shared memory region with the given size of
  * the input/output queues (in elements) and the given number of data elements
  * per struct sample. */
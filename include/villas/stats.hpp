@@ -29,6 +29,8 @@
 #include <unordered_map>
 #include <memory>
 #include <string>
+#include <array>
+#include <atomic>
 
 #include <villas/common.hpp>
 #include <villas/hist.hpp>
@@ -64,9 +66,41 @@ public:
 		/* RTP metrics */
 		RTP_LOSS_FRACTION,	/**< Fraction lost since last RTP SR/RR. */
 		RTP_PKTS_LOST,		/**< Cumul. no. pkts lost. */
-		RTP_JITTER		/**< Interarrival jitter. */
+		RTP_JITTER,		/**< Interarrival jitter. */
+
+		/* File metrics */
+		FILE_FLUSH_BYTES,	/**< Number of bytes written per flush of the asynchronous writer. */
+		FILE_FLUSH_LATENCY,	/**< Time needed to write a buffer of the asynchronous writer. */
+
+		/* InfluxDB metrics */
+		INFLUXDB_BATCH_LINES,	/**< Number of lines per batch which has been sent. */
+		INFLUXDB_FLUSH_LATENCY,	/**< Time needed to send a batch. */
+		INFLUXDB_DROPPED_LINES,	/**< Number of lines per batch which has been dropped. */
+
+		/* NGSI metrics */
+		NGSI_LATENCY,		/**< Round-trip time of asynchronous update requests. */
+		NGSI_BATCH_SIZE,	/**< Number of samples per asynchronous update request. */
+
+		/* MQTT metrics */
+		MQTT_PUBLISH_LATENCY,	/**< Time until a published message has been sent (QoS 0) or acknowledged (QoS 1 and 2). */
+		MQTT_PUBLISH_SAMPLES,	/**< Number of samples per published message. */
+
+		/* Kafka metrics */
+		KAFKA_DELIVERY_LATENCY,	/**< Time from producing a message until its delivery report. */
+		KAFKA_DELIVERY_ERRORS,	/**< Number of messages which could not be delivered. */
+		KAFKA_CONSUME_BATCH,	/**< Number of messages per consumed batch. */
+
+		/* AMQP metrics */
+		AMQP_PUBLISH_BATCH,	/**< Number of messages published per write. */
+		AMQP_CONSUME_BATCH,	/**< Number of deliveries consumed per read. */
+		AMQP_CONFIRM_LATENCY,	/**< Time from publishing a message until it has been confirmed by the broker. */
+		AMQP_CONFIRM_NACKS,	/**< Number of messages which have been rejected by the broker. */
+
+		NUM			/**< Not a metric: the number of metrics. Must remain the last entry. */
 	};
 
+	static constexpr size_t NUM_METRICS = (size_t) Metric::NUM;
+
 	enum class Type {
 		LAST,
 		HIGHEST,
@@ -77,8 +111,77 @@ public:
 		TOTAL
 	};
 
+	/** Scalar summary of the histogram of a metric. */
+	struct Summary {
+		double last;
+		double highest;
+		double lowest;
+		double mean;
+		double var;
+		uintmax_t total;
+	};
+
 protected:
-	std::unordered_map<Metric, villas::Hist> histograms;
+	/** The histogram of a metric and its summary, both published via a seqlock.
+	 *
+	 * Writers never wait: the first one to claim the slot updates the
+	 * histogram in place, concurrent writers and reset() hand over their
+	 * work to it through a small set of pending cells. Readers copy the
+	 * histogram or summary and retry if a writer has been active meanwhile.
+	 */
+	struct Slot {
+		static constexpr size_t NUM_PENDING = 8;
+
+		enum class Cell {
+			EMPTY,
+			FILLING,
+			FULL
+		};
+
+		struct Pending {
+			std::atomic<Cell> state { Cell::EMPTY };
+			double value;
+		};
+
+		villas::Hist hist;
+		Summary summary;
+
+		std::atomic<uint64_t> seq { 0 };	/**< Seqlock counter: odd while the histogram is updated. */
+		std::atomic_flag owned = ATOMIC_FLAG_INIT; /**< Set by the writer which currently updates the histogram. */
+		std::atomic<bool> clear { false };	/**< A reset has been requested but not yet applied. */
+		std::atomic<uintmax_t> dropped { 0 };	/**< Values lost as all pending cells were occupied. */
+
+		std::array<Pending, NUM_PENDING> pending;
+
+		/** Add a value to the histogram without waiting for other writers. */
+		void put(double val);
+
+		/** Reset the histogram without waiting for the writers. */
+		void reset();
+
+		/** Get a consistent copy of the summary without blocking the writers. */
+		Summary read() const;
+
+		/** Get a consistent copy of the histogram without blocking the writers.
+		 *
+		 * @param h A histogram with the same number of buckets.
+		 */
+		void read(villas::Hist &h) const;
+
+	protected:
+		/** Apply pending work and \p val to the histogram. Requires ownership of the slot. */
+		void apply(const double *val);
+
+		/** Apply work which has been handed over while another writer owned the slot. */
+		void flush();
+
+		bool hasWork() const;
+	};
+
+	int buckets;
+	int warmup;
+
+	std::array<Slot, NUM_METRICS> slots;	/**< Indexed by Metric. */
 
 	struct MetricDescription {
 		const char *name;
@@ -125,7 +228,11 @@ public:
 
 	union signal_data getValue(enum Metric sm, enum Type st) const;
 
-	const villas::Hist & getHistogram(enum Metric sm) const;
+	/** Get a consistent copy of the scalar summary of a metric. */
+	Summary getSummary(enum Metric sm) const;
+
+	/** Get a consistent copy of the histogram of a metric. */
+	villas::Hist getHistogram(enum Metric sm) const;
 
 	static std::unordered_map<Metric, MetricDescription> metrics;
 	static std::unordered_map<Type, TypeDescription> types;
@@ -0,0 +1,407 @@
+/** Single-producer, multiple-consumer broadcast ring for samples.
+ *
+ * @author Steffen Vogel <stvogel@eonerc.rwth-aachen.de>
+ * @copyright 2014-2020, Institute for Automation of Complex Power Systems, EONERC
+ * @license GNU General Public License (version 3)
+ *
+ * VILLASnode
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *********************************************************************************/
+
+#include <ctime>
+
+#include <sched.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <villas/broadcast_ring.h>
+#include <villas/sample.h>
+#include <villas/memory.h>
+#include <villas/utils.hpp>
+#include <villas/log.hpp>
+
+#ifdef HAS_EVENTFD
+  #include <sys/eventfd.h>
+#endif
+
+using namespace villas;
+
+/* Number of yields of a blocked producer before it starts to sleep */
+static constexpr int BROADCAST_RING_SPIN_COUNT = 16;
+
+/* Upper bound for the sleep of a blocked producer in nanoseconds */
+static constexpr long BROADCAST_RING_MAX_BACKOFF = 1000000;
+
+static int broadcast_ring_consumer_signal(struct broadcast_ring_consumer *c)
+{
+	int ret;
+
+	/* Only write to the file descriptor if the consumer did not already get notified */
+	if (std::atomic_exchange(&c->notified, true))
+		return 0;
+
+#ifdef HAS_EVENTFD
+	uint64_t incr = 1;
+	ret = write(c->eventfd, &incr, sizeof(incr));
+#else
+	uint8_t incr = 1;
+	ret = write(c->pipe[1], &incr, sizeof(incr));
+#endif
+
+	return ret < 0 ? ret : 0;
+}
+
+/** Release all slots which have been passed by all consumers. */
+static void broadcast_ring_reclaim(struct broadcast_ring *r)
+{
+	size_t head = std::atomic_load_explicit(&r->head, std::memory_order_relaxed);
+	size_t min = head;
+
+	for (size_t i = 0; i < vlist_length(&r->consumers); i++) {
+		auto *c = (struct broadcast_ring_consumer *) vlist_at(&r->consumers, i);
+
+		if (!std::atomic_load_explicit(&c->attached, std::memory_order_acquire))
+			continue;
+
+		size_t cursor = std::atomic_load_explicit(&c->cursor, std::memory_order_acquire);
+		size_t lag = head - cursor;
+
+		if (!c->slow && lag >= r->slow_threshold) {
+			auto logger = logging.get("broadcast_ring");
+
+			/* Only warn once as a consumer might oscillate around the threshold */
+			if (c->slow_cnt++ == 0)
+				logger->warn("Consumer {} is lagging behind by {} samples", i, lag);
+			else
+				logger->debug("Consumer {} is lagging behind by {} samples", i, lag);
+
+			c->slow = true;
+		}
+		else if (c->slow && lag < r->slow_threshold / 2)
+			c->slow = false;
+
+		if (cursor < min)
+			min = cursor;
+	}
+
+	for (size_t seq = r->released; seq < min; seq++)
+		sample_decref(r->buffer[seq & r->buffer_mask]);
+
+	r->released = min;
+}
+
+/** Advance the cursor of a consumer which did not keep up to \p target. */
+static void broadcast_ring_overrun(struct broadcast_ring *r, struct broadcast_ring_consumer *c, size_t target)
+{
+	size_t cursor = std::atomic_load(&c->cursor);
+
+	/* The consumer might advance its cursor concurrently */
+	while (cursor < target) {
+		if (!std::atomic_compare_exchange_weak(&c->cursor, &cursor, target))
+			continue;
+
+		c->overruns += target - cursor;
+		r->dropped += target - cursor;
+
+		/* The consumer might still have loaded the old cursor.
+		 * Its read of the skipped slots is bounded and fails afterwards. */
+		while (std::atomic_load(&c->reading))
+			sched_yield();
+
+		break;
+	}
+}
+
+int broadcast_ring_init(struct broadcast_ring *r, size_t size, enum BroadcastRingOverflow overflow)
+{
+	int ret;
+
+	/* Ring size must be 2 exponent */
+	if (!IS_POW2(size)) {
+		size_t old_size = size;
+		size = LOG2_CEIL(size);
+
+		auto logger = logging.get("broadcast_ring");
+		logger->warn("A broadcast ring size was changed from {} to {}", old_size, size);
+	}
+
+	r->buffer = (struct sample **) memory_alloc(sizeof(struct sample *) * size);
+	if (!r->buffer)
+		return -2;
+
+	ret = vlist_init(&r->consumers);
+	if (ret)
+		return ret;
+
+	r->overflow = overflow;
+	r->buffer_mask = size - 1;
+	r->slow_threshold = size - size / 4;
+	r->released = 0;
+	r->dropped = 0;
+
+	std::atomic_store_explicit(&r->head, (size_t) 0, std::memory_order_relaxed);
+	std::atomic_store_explicit(&r->closed, false, std::memory_order_relaxed);
+
+	r->state = State::INITIALIZED;
+
+	return 0;
+}
+
+int broadcast_ring_destroy(struct broadcast_ring *r)
+{
+	int ret;
+
+	if (r->state == State::DESTROYED)
+		return 0;
+
+	size_t head = std::atomic_load(&r->head);
+	for (size_t seq = r->released; seq < head; seq++)
+		sample_decref(r->buffer[seq & r->buffer_mask]);
+
+	ret = vlist_destroy(&r->consumers, nullptr, false);
+	if (ret)
+		return ret;
+
+	ret = memory_free(r->buffer);
+	if (ret)
+		return ret;
+
+	r->state = State::DESTROYED;
+
+	return 0;
+}
+
+int broadcast_ring_publish(struct broadcast_ring *r, struct sample * const smps[], unsigned cnt)
+{
+	size_t head, avail, size = r->buffer_mask + 1;
+	unsigned published;
+
+	if (std::atomic_load_explicit(&r->closed, std::memory_order_relaxed))
+		return -1;
+
+	broadcast_ring_reclaim(r);
+
+	head = std::atomic_load_explicit(&r->head, std::memory_order_relaxed);
+	avail = size - (head - r->released);
+
+	if (avail < cnt) {
+		if (r->overflow == BroadcastRingOverflow::BLOCK) {
+			/* Back off exponentially to avoid burning the core of the path thread */
+			for (int backoff = 0; avail < cnt && avail < size; backoff++) {
+				if (std::atomic_load_explicit(&r->closed, std::memory_order_relaxed))
+					return -1;
+
+				pthread_testcancel();
+
+				if (backoff < BROADCAST_RING_SPIN_COUNT)
+					sched_yield();
+				else {
+					long ns = MIN(1000L << MIN(backoff - BROADCAST_RING_SPIN_COUNT, 10), BROADCAST_RING_MAX_BACKOFF);
+					struct timespec ts = { 0, ns };
+
+					nanosleep(&ts, nullptr);
+				}
+
+				broadcast_ring_reclaim(r);
+
+				avail = size - (head - r->released);
+			}
+		}
+		else {
+			/* Overrun only the consumers which are holding back the ring */
+			size_t target = head + MIN(cnt, size) - size;
+
+			for (size_t i = 0; i < vlist_length(&r->consumers); i++) {
+				auto *c = (struct broadcast_ring_consumer *) vlist_at(&r->consumers, i);
+
+				if (!std::atomic_load_explicit(&c->attached, std::memory_order_relaxed))
+					continue;
+
+				broadcast_ring_overrun(r, c, target);
+			}
+
+			broadcast_ring_reclaim(r);
+
+			avail = size - (head - r->released);
+		}
+	}
+
+	published = MIN(cnt, avail);
+
+	for (unsigned i = 0; i < published; i++) {
+		sample_incref(smps[i]);
+
+		r->buffer[(head + i) & r->buffer_mask] = smps[i];
+	}
+
+	/* Publish the new samples to the consumers */
+	std::atomic_store(&r->head, head + published);
+
+	if (published > 0) {
+		for (size_t i = 0; i < vlist_length(&r->consumers); i++) {
+			auto *c = (struct broadcast_ring_consumer *) vlist_at(&r->consumers, i);
+
+			if (!std::atomic_load_explicit(&c->attached, std::memory_order_relaxed))
+				continue;
+
+			broadcast_ring_consumer_signal(c);
+		}
+	}
+
+	return published;
+}
+
+int broadcast_ring_close(struct broadcast_ring *r)
+{
+	std::atomic_store(&r->closed, true);
+
+	for (size_t i = 0; i < vlist_length(&r->consumers); i++) {
+		auto *c = (struct broadcast_ring_consumer *) vlist_at(&r->consumers, i);
+
+		std::atomic_store(&c->notified, false);
+
+		broadcast_ring_consumer_signal(c);
+	}
+
+	return 0;
+}
+
+int broadcast_ring_consumer_init(struct broadcast_ring_consumer *c, struct broadcast_ring *r)
+{
+	c->ring = r;
+	c->slow = false;
+	c->slow_cnt = 0;
+	c->overruns = 0;
+
+	std::atomic_store_explicit(&c->cursor, std::atomic_load(&r->head), std::memory_order_relaxed);
+	std::atomic_store_explicit(&c->notified, false, std::memory_order_relaxed);
+	std::atomic_store_explicit(&c->reading, false, std::memory_order_relaxed);
+	std::atomic_store_explicit(&c->attached, true, std::memory_order_release);
+
+#ifdef HAS_EVENTFD
+	c->eventfd = eventfd(0, 0);
+	if (c->eventfd < 0)
+		return -2;
+#else
+	int ret = pipe(c->pipe);
+	if (ret < 0)
+		return -2;
+#endif
+
+	vlist_push(&r->consumers, c);
+
+	return 0;
+}
+
+void broadcast_ring_consumer_detach(struct broadcast_ring_consumer *c)
+{
+	std::atomic_store_explicit(&c->attached, false, std::memory_order_release);
+}
+
+int broadcast_ring_consumer_destroy(struct broadcast_ring_consumer *c)
+{
+	int ret;
+
+	broadcast_ring_consumer_detach(c);
+
+#ifdef HAS_EVENTFD
+	ret = close(c->eventfd);
+#else
+	ret = close(c->pipe[0]) + close(c->pipe[1]);
+#endif
+
+	return ret;
+}
+
+int broadcast_ring_consume(struct broadcast_ring_consumer *c, struct sample *smps[], unsigned cnt)
+{
+	struct broadcast_ring *r = c->ring;
+	size_t cursor, head;
+	unsigned avail;
+
+	/* Announce the access before loading the cursor.
+	 * The producer does not release the slots while we are reading. */
+	std::atomic_store(&c->reading, true);
+
+	while (true) {
+		cursor = std::atomic_load(&c->cursor);
+		head = std::atomic_load(&r->head);
+
+		avail = MIN(head - cursor, cnt);
+
+		for (unsigned i = 0; i < avail; i++) {
+			smps[i] = r->buffer[(cursor + i) & r->buffer_mask];
+
+			sample_incref(smps[i]);
+		}
+
+		/* Allow the producer to reuse the slots */
+		if (avail == 0 || std::atomic_compare_exchange_strong(&c->cursor, &cursor, cursor + avail))
+			break;
+
+		/* We have been overrun by the producer in the meantime */
+		sample_decref_many(smps, avail);
+	}
+
+	std::atomic_store_explicit(&c->reading, false, std::memory_order_release);
+
+	if (avail == 0)
+		return std::atomic_load_explicit(&r->closed, std::memory_order_relaxed) ? -1 : 0;
+
+	return avail;
+}
+
+int broadcast_ring_consume_wait(struct broadcast_ring_consumer *c, struct sample *smps[], unsigned cnt)
+{
+	int ret;
+
+	while (true) {
+		ret = broadcast_ring_consume(c, smps, cnt);
+		if (ret != 0)
+			return ret;
+
+		/* Ask the producer for a notification and check again to avoid a lost wakeup */
+		std::atomic_store(&c->notified, false);
+
+		ret = broadcast_ring_consume(c, smps, cnt);
+		if (ret != 0)
+			return ret;
+
+#ifdef HAS_EVENTFD
+		uint64_t cntr;
+		ret = read(c->eventfd, &cntr, sizeof(cntr));
+#else
+		uint8_t cntr;
+		ret = read(c->pipe[0], &cntr, sizeof(cntr));
+#endif
+		if (ret < 0)
+			return ret;
+	}
+}
+
+int broadcast_ring_consumer_fd(struct broadcast_ring_consumer *c)
+{
+#ifdef HAS_EVENTFD
+	return c->eventfd;
+#else
+	return c->pipe[0];
+#endif
+}
+
+size_t broadcast_ring_consumer_lag(struct broadcast_ring_consumer *c)
+{
+	return std::atomic_load_explicit(&c->ring->head, std::memory_order_relaxed) -
+		std::atomic_load_explicit(&c->cursor, std::memory_order_relaxed);
+}
@@ -0,0 +1,1144 @@
+/** Chunked columnar format for recordings.
+ *
+ * @author Steffen Vogel <stvogel@eonerc.rwth-aachen.de>
+ * @copyright 2014-2020, Institute for Automation of Complex Power Systems, EONERC
+ * @license GNU General Public License (version 3)
+ *
+ * VILLASnode
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *********************************************************************************/
+
+#include <cstring>
+#include <algorithm>
+#include <endian.h>
+
+#include <villas/formats/columnar.hpp>
+#include <villas/sample.h>
+#include <villas/signal.h>
+#include <villas/utils.hpp>
+#include <villas/exceptions.hpp>
+
+using namespace villas;
+using namespace villas::node;
+
+/** Upper limit for the length of a block to detect corrupted files. */
+#define COLUMNAR_BLOCK_MAX	(256 << 20)
+
+/** Upper limit for the number of samples in a chunk. */
+#define COLUMNAR_CHUNK_MAX	(1 << 20)
+
+/* Flags which are stored in the columns of a chunk */
+#define COLUMNAR_FLAGS		((int) SampleFlags::HAS_TS_ORIGIN | (int) SampleFlags::HAS_SEQUENCE | (int) SampleFlags::HAS_DATA)
+
+static uint64_t columnar_mask(unsigned bits)
+{
+	return bits >= 64 ? ~0ULL : (1ULL << bits) - 1;
+}
+
+static uint64_t columnar_zigzag(int64_t v)
+{
+	return ((uint64_t) v << 1) ^ (uint64_t) (v >> 63);
+}
+
+static int64_t columnar_unzigzag(uint64_t v)
+{
+	return (int64_t) (v >> 1) ^ -(int64_t) (v & 1);
+}
+
+/** Writes bit fields MSB first. */
+class ColumnarBitWriter {
+
+protected:
+	std::vector<uint8_t> &out;
+	uint64_t acc;
+	unsigned n;
+
+public:
+	ColumnarBitWriter(std::vector<uint8_t> &o) :
+		out(o),
+		acc(0),
+		n(0)
+	{ }
+
+	void write(uint64_t v, unsigned bits)
+	{
+		if (bits > 32) {
+			write(v >> 32, bits - 32);
+			bits = 32;
+		}
+
+		acc = (acc << bits) | (v & columnar_mask(bits));
+		n += bits;
+
+		while (n >= 8) {
+			n -= 8;
+			out.push_back(acc >> n);
+		}
+
+		acc &= columnar_mask(n);
+	}
+
+	/** Pad the last byte with zeros. */
+	void flush()
+	{
+		if (n > 0)
+			out.push_back(acc << (8 - n));
+
+		acc = 0;
+		n = 0;
+	}
+};
+
+class ColumnarBitReader {
+
+protected:
+	const uint8_t *buf;
+	size_t len;
+	size_t pos;		/**< Position in bits. */
+
+public:
+	bool overrun;
+
+	ColumnarBitReader(const uint8_t *b, size_t l) :
+		buf(b),
+		len(l),
+		pos(0),
+		overrun(false)
+	{ }
+
+	uint64_t read(unsigned bits)
+	{
+		if (bits == 0)
+			return 0;
+
+		if (bits > 32) {
+			uint64_t hi = read(bits - 32);
+
+			return (hi << 32) | read(32);
+		}
+
+		if (pos + bits > len * 8) {
+			overrun = true;
+			return 0;
+		}
+
+		size_t byte = pos / 8;
+		uint64_t w;
+
+		if (byte + 8 <= len) {
+			memcpy(&w, buf + byte, sizeof(w));
+			w = be64toh(w);
+		}
+		else {
+			w = 0;
+			for (size_t i = 0; i < 8; i++)
+				w = (w << 8) | (byte + i < len ? buf[byte + i] : 0);
+		}
+
+		uint64_t v = (w << (pos % 8)) >> (64 - bits);
+
+		pos += bits;
+
+		return v;
+	}
+};
+
+/** Delta-of-delta encoding of integers with variable length buckets. */
+static void columnar_encode_dod(ColumnarBitWriter &w, const int64_t *v, size_t cnt)
+{
+	int64_t prev = 0, prev_delta = 0;
+
+	for (size_t i = 0; i < cnt; i++) {
+		if (i == 0) {
+			w.write(v[0], 64);
+			prev = v[0];
+			continue;
+		}
+
+		int64_t delta = (uint64_t) v[i] - (uint64_t) prev;
+		uint64_t dod = columnar_zigzag((uint64_t) delta - (uint64_t) prev_delta);
+
+		if (dod == 0)
+			w.write(0x0, 1);
+		else if (dod < (1ULL << 8)) {
+			w.write(0x2, 2);
+			w.write(dod, 8);
+		}
+		else if (dod < (1ULL << 16)) {
+			w.write(0x6, 3);
+			w.write(dod, 16);
+		}
+		else if (dod < (1ULL << 32)) {
+			w.write(0xe, 4);
+			w.write(dod, 32);
+		}
+		else {
+			w.write(0xf, 4);
+			w.write(dod, 64);
+		}
+
+		prev = v[i];
+		prev_delta = delta;
+	}
+
+	w.flush();
+}
+
+static void columnar_decode_dod(ColumnarBitReader &r, int64_t *v, size_t cnt)
+{
+	int64_t prev = 0, prev_delta = 0;
+
+	for (size_t i = 0; i < cnt; i++) {
+		if (i == 0) {
+			v[0] = prev = r.read(64);
+			continue;
+		}
+
+		unsigned bits;
+
+		if      (!r.read(1))
+			bits = 0;
+		else if (!r.read(1))
+			bits = 8;
+		else if (!r.read(1))
+			bits = 16;
+		else if (!r.read(1))
+			bits = 32;
+		else
+			bits = 64;
+
+		int64_t delta = (uint64_t) prev_delta + (uint64_t) columnar_unzigzag(bits ? r.read(bits) : 0);
+
+		v[i] = prev = (uint64_t) prev + (uint64_t) delta;
+		prev_delta = delta;
+	}
+}
+
+/** XOR encoding of floating point values against their predecessor. */
+static void columnar_encode_xor(ColumnarBitWriter &w, const uint64_t *v, size_t cnt)
+{
+	uint64_t prev = 0;
+	int lead = -1, trail = 0;
+
+	for (size_t i = 0; i < cnt; i++) {
+		if (i == 0) {
+			w.write(v[0], 64);
+			prev = v[0];
+			continue;
+		}
+
+		uint64_t x = v[i] ^ prev;
+
+		if (x == 0)
+			w.write(0x0, 1);
+		else {
+			int lz = __builtin_clzll(x);
+			int tz = __builtin_ctzll(x);
+
+			/* Reuse the window of meaningful bits of the previous value */
+			if (lead >= 0 && lz >= lead && tz >= trail) {
+				w.write(0x2, 2);
+				w.write(x >> trail, 64 - lead - trail);
+			}
+			else {
+				int meaningful = 64 - lz - tz;
+
+				w.write(0x3, 2);
+				w.write(lz, 6);
+				w.write(meaningful - 1, 6);
+				w.write(x >> tz, meaningful);
+
+				lead = lz;
+				trail = tz;
+			}
+		}
+
+		prev = v[i];
+	}
+
+	w.flush();
+}
+
+static void columnar_decode_xor(ColumnarBitReader &r, uint64_t *v, size_t cnt)
+{
+	uint64_t prev = 0;
+	int lead = 0, trail = 0;
+
+	for (size_t i = 0; i < cnt; i++) {
+		if (i == 0) {
+			v[0] = prev = r.read(64);
+			continue;
+		}
+
+		if (r.read(1)) {
+			if (r.read(1)) {
+				lead = r.read(6);
+				trail = 64 - lead - (r.read(6) + 1);
+
+				if (trail < 0) {
+					r.overrun = true;
+					return;
+				}
+			}
+
+			prev ^= r.read(64 - lead - trail) << trail;
+		}
+
+		v[i] = prev;
+	}
+}
+
+static void columnar_append(std::vector<uint8_t> &out, const void *data, size_t len)
+{
+	out.insert(out.end(), (const uint8_t *) data, (const uint8_t *) data + len);
+}
+
+static void columnar_append_block(std::vector<uint8_t> &out, enum ColumnarBlockType type, size_t len)
+{
+	struct columnar_block b;
+
+	b.magic = htole32(COLUMNAR_MAGIC);
+	b.type = htole16((uint16_t) type);
+	b.version = htole16(COLUMNAR_VERSION);
+	b.length = htole32(len);
+	b.reserved = 0;
+
+	columnar_append(out, &b, sizeof(b));
+}
+
+void ColumnarFormat::Chunk::clear(int fl, unsigned len)
+{
+	count = 0;
+	length = len;
+	flags = fl;
+
+	ts.clear();
+	sequence.clear();
+	types.clear();
+	data.clear();
+}
+
+ColumnarFormat::ColumnarFormat(int fl) :
+	BinaryFormat(fl),
+	chunk_size(COLUMNAR_CHUNK_SIZE),
+	projection(false)
+{
+	wr.chunk.clear(0, 0);
+	wr.header_written = false;
+	wr.offset = 0;
+
+	scratch.clear(0, 0);
+
+	resetReader();
+}
+
+void ColumnarFormat::parse(json_t *json)
+{
+	int ret;
+	json_error_t err;
+	json_t *json_columns = nullptr;
+	int cs = -1;
+
+	ret = json_unpack_ex(json, &err, 0, "{ s?: i, s?: o }",
+		"chunk_size", &cs,
+		"columns", &json_columns
+	);
+	if (ret)
+		throw ConfigError(json, err, "node-config-format-columnar", "Failed to parse format configuration");
+
+	if (cs == 0 || cs > COLUMNAR_CHUNK_MAX)
+		throw ConfigError(json, "node-config-format-columnar-chunk-size", "Setting 'chunk_size' must be between 1 and 1048576");
+	else if (cs > 0)
+		chunk_size = cs;
+
+	if (json_columns) {
+		size_t i;
+		json_t *json_column;
+
+		if (!json_is_array(json_columns))
+			throw ConfigError(json_columns, "node-config-format-columnar-columns", "Setting 'columns' must be a list of signal names or indices");
+
+		json_array_foreach(json_columns, i, json_column) {
+			if (json_is_string(json_column)) {
+				column_names.emplace_back(json_string_value(json_column));
+				column_indices.push_back(-1);
+			}
+			else if (json_is_integer(json_column) && json_integer_value(json_column) >= 0) {
+				column_names.emplace_back();
+				column_indices.push_back(json_integer_value(json_column));
+			}
+			else
+				throw ConfigError(json_column, "node-config-format-columnar-columns", "Setting 'columns' must be a list of signal names or indices");
+		}
+
+		projection = true;
+	}
+
+	Format::parse(json);
+}
+
+void ColumnarFormat::resetReader()
+{
+	rd.chunk.clear(0, 0);
+	rd.pos = 0;
+	rd.fill = 0;
+	rd.stream_pos = -1;
+}
+
+void ColumnarFormat::encodeHeader(std::vector<uint8_t> &out)
+{
+	std::vector<uint8_t> payload;
+	unsigned cnt = signals ? vlist_length(signals) : 0;
+	uint32_t u32;
+
+	u32 = htole32(flags & COLUMNAR_FLAGS);
+	columnar_append(payload, &u32, sizeof(u32));
+
+	u32 = htole32(cnt);
+	columnar_append(payload, &u32, sizeof(u32));
+
+	for (unsigned i = 0; i < cnt; i++) {
+		auto *sig = (struct signal *) vlist_at(signals, i);
+		uint16_t namelen = sig->name ? MIN(strlen(sig->name), UINT16_MAX) : 0;
+		uint8_t type = (uint8_t) sig->type;
+		uint8_t reserved = 0;
+		uint16_t u16 = htole16(namelen);
+
+		columnar_append(payload, &type, sizeof(type));
+		columnar_append(payload, &reserved, sizeof(reserved));
+		columnar_append(payload, &u16, sizeof(u16));
+		columnar_append(payload, sig->name, namelen);
+	}
+
+	columnar_append_block(out, ColumnarBlockType::HEADER, payload.size());
+	columnar_append(out, payload.data(), payload.size());
+}
+
+void ColumnarFormat::encodeChunk(std::vector<uint8_t> &out, const Chunk &c)
+{
+	std::vector<struct columnar_column> dir;
+	std::vector<uint8_t> payload;
+	ColumnarBitWriter w(payload);
+	size_t last = 0;
+
+	auto close_column = [&](enum SignalType type) {
+		struct columnar_column col;
+
+		memset(&col, 0, sizeof(col));
+		col.type = (uint8_t) type;
+		col.length = htole32(payload.size() - last);
+
+		dir.push_back(col);
+		last = payload.size();
+	};
+
+	if (c.flags & (int) SampleFlags::HAS_TS_ORIGIN) {
+		columnar_encode_dod(w, c.ts.data(), c.count);
+		close_column(SignalType::INVALID);
+	}
+
+	if (c.flags & (int) SampleFlags::HAS_SEQUENCE) {
+		columnar_encode_dod(w, (const int64_t *) c.sequence.data(), c.count);
+		close_column(SignalType::INVALID);
+	}
+
+	/* Transpose the values into columns */
+	std::vector<uint64_t> column(c.count);
+
+	for (unsigned j = 0; j < c.length; j++) {
+		enum SignalType type = c.types[j];
+
+		if (type == SignalType::BOOLEAN) {
+			for (unsigned i = 0; i < c.count; i++)
+				w.write(c.data[i * c.length + j].b, 1);
+
+			w.flush();
+		}
+		else if (type == SignalType::INTEGER) {
+			for (unsigned i = 0; i < c.count; i++)
+				column[i] = c.data[i * c.length + j].i;
+
+			columnar_encode_dod(w, (const int64_t *) column.data(), c.count);
+		}
+		else {
+			/* Floating point and complex values are both 64 bit wide */
+			for (unsigned i = 0; i < c.count; i++)
+				memcpy(&column[i], &c.data[i * c.length + j], sizeof(uint64_t));
+
+			columnar_encode_xor(w, column.data(), c.count);
+		}
+
+		close_column(type);
+	}
+
+	struct columnar_chunk hdr;
+
+	hdr.count = htole32(c.count);
+	hdr.flags = htole32(c.flags);
+	hdr.length = htole32(c.length);
+	hdr.columns = htole32(dir.size());
+
+	columnar_append_block(out, ColumnarBlockType::CHUNK, sizeof(hdr) + dir.size() * sizeof(struct columnar_column) + payload.size());
+	columnar_append(out, &hdr, sizeof(hdr));
+	columnar_append(out, dir.data(), dir.size() * sizeof(struct columnar_column));
+	columnar_append(out, payload.data(), payload.size());
+}
+
+int ColumnarFormat::decodeHeader(const uint8_t *buf, size_t len)
+{
+	size_t off = 2 * sizeof(uint32_t);
+	uint32_t cnt;
+
+	if (len < off)
+		return -1;
+
+	memcpy(&cnt, buf + sizeof(uint32_t), sizeof(cnt));
+	cnt = le32toh(cnt);
+
+	rd.names.clear();
+
+	for (unsigned i = 0; i < cnt; i++) {
+		uint16_t namelen;
+
+		if (len - off < 4)
+			return -1;
+
+		memcpy(&namelen, buf + off + 2, sizeof(namelen));
+		namelen = le16toh(namelen);
+		off += 4;
+
+		if (len - off < namelen)
+			return -1;
+
+		rd.names.emplace_back((const char *) buf + off, namelen);
+		off += namelen;
+	}
+
+	/* Resolve the names of the selected columns */
+	for (unsigned i = 0; i < column_names.size(); i++) {
+		if (column_names[i].empty())
+			continue;
+
+		auto it = std::find(rd.names.begin(), rd.names.end(), column_names[i]);
+		if (it == rd.names.end()) {
+			logger->error("Unknown column: {}", column_names[i]);
+			return -1;
+		}
+
+		column_indices[i] = it - rd.names.begin();
+	}
+
+	return 0;
+}
+
+int ColumnarFormat::decodeChunk(const uint8_t *buf, size_t len, Chunk &c)
+{
+	struct columnar_chunk hdr;
+
+	if (len < sizeof(hdr))
+		return -1;
+
+	memcpy(&hdr, buf, sizeof(hdr));
+
+	unsigned count = le32toh(hdr.count);
+	unsigned length = le32toh(hdr.length);
+	unsigned columns = le32toh(hdr.columns);
+	int fl = le32toh(hdr.flags) & COLUMNAR_FLAGS;
+
+	/* All fields are checked against the size of the block before they are used for allocations */
+	if (count > COLUMNAR_CHUNK_MAX)
+		return -1;
+
+	if (columns > (len - sizeof(hdr)) / sizeof(struct columnar_column))
+		return -1;
+
+	const uint8_t *dir = buf + sizeof(hdr);
+	size_t off = sizeof(hdr) + columns * sizeof(struct columnar_column);
+
+	/* Locate all columns */
+	std::vector<const uint8_t *> offsets(columns);
+	std::vector<size_t> lengths(columns);
+	std::vector<enum SignalType> types(columns);
+
+	for (unsigned k = 0; k < columns; k++) {
+		struct columnar_column col;
+
+		memcpy(&col, dir + k * sizeof(col), sizeof(col));
+
+		offsets[k] = buf + off;
+		lengths[k] = le32toh(col.length);
+		types[k] = (enum SignalType) col.type;
+
+		if (lengths[k] > len - off)
+			return -1;
+
+		/* Each value takes at least one bit. The first value of other columns than booleans takes 64 bits. */
+		size_t min_bits = types[k] == SignalType::BOOLEAN
+			? count
+			: (count ? count + 63 : 0);
+
+		if (lengths[k] * 8 < min_bits)
+			return -1;
+
+		off += lengths[k];
+	}
+
+	unsigned k = 0;
+	unsigned first_data = ((fl & (int) SampleFlags::HAS_TS_ORIGIN) ? 1 : 0) + ((fl & (int) SampleFlags::HAS_SEQUENCE) ? 1 : 0);
+
+	if (columns < first_data || length != columns - first_data)
+		return -1;
+
+	/* Only the selected columns are decoded */
+	std::vector<unsigned> selected;
+	if (projection) {
+		for (int idx : column_indices) {
+			if (idx < 0 || (unsigned) idx >= length) {
+				logger->error("Column {} is not available", idx);
+				return -1;
+			}
+
+			selected.push_back(idx);
+		}
+	}
+	else {
+		for (unsigned j = 0; j < length; j++)
+			selected.push_back(j);
+	}
+
+	if (!(flags & (int) SampleFlags::HAS_DATA))
+		selected.clear();
+
+	c.clear(fl & flags, selected.size());
+	c.count = count;
+
+	if (fl & (int) SampleFlags::HAS_TS_ORIGIN) {
+		ColumnarBitReader r(offsets[k], lengths[k]);
+
+		c.ts.resize(count);
+		columnar_decode_dod(r, c.ts.data(), count);
+		if (r.overrun)
+			return -1;
+
+		k++;
+	}
+
+	if (fl & (int) SampleFlags::HAS_SEQUENCE) {
+		ColumnarBitReader r(offsets[k], lengths[k]);
+
+		c.sequence.resize(count);
+		columnar_decode_dod(r, (int64_t *) c.sequence.data(), count);
+		if (r.overrun)
+			return -1;
+
+		k++;
+	}
+
+	std::vector<uint64_t> column(count);
+
+	c.data.resize(count * c.length);
+
+	for (unsigned s = 0; s < selected.size(); s++) {
+		unsigned col = first_data + selected[s];
+		enum SignalType type = types[col];
+		ColumnarBitReader r(offsets[col], lengths[col]);
+
+		c.types.push_back(type);
+
+		if (type == SignalType::BOOLEAN) {
+			for (unsigned i = 0; i < count; i++)
+				c.data[i * c.length + s].b = r.read(1);
+		}
+		else {
+			if (type == SignalType::INTEGER)
+				columnar_decode_dod(r, (int64_t *) column.data(), count);
+			else
+				columnar_decode_xor(r, column.data(), count);
+
+			for (unsigned i = 0; i < count; i++)
+				memcpy((void *) &c.data[i * c.length + s], &column[i], sizeof(uint64_t));
+		}
+
+		if (r.overrun)
+			return -1;
+	}
+
+	return 0;
+}
+
+ssize_t ColumnarFormat::decodeBlock(const uint8_t *buf, size_t len, Chunk &c)
+{
+	struct columnar_block b;
+	int ret;
+
+	if (len < sizeof(b))
+		return 0;
+
+	memcpy(&b, buf, sizeof(b));
+
+	if (le32toh(b.magic) != COLUMNAR_MAGIC || le16toh(b.version) != COLUMNAR_VERSION)
+		return -1;
+
+	size_t total = sizeof(b) + le32toh(b.length);
+	if (le32toh(b.length) > COLUMNAR_BLOCK_MAX)
+		return -1;
+
+	if (len < total)
+		return 0;
+
+	c.count = 0;
+
+	switch ((enum ColumnarBlockType) le16toh(b.type)) {
+		case ColumnarBlockType::HEADER:
+			ret = decodeHeader(buf + sizeof(b), total - sizeof(b));
+			break;
+
+		case ColumnarBlockType::CHUNK:
+			ret = decodeChunk(buf + sizeof(b), total - sizeof(b), c);
+			break;
+
+		default:
+			ret = 0; /* The index is only used by seek() */
+			break;
+	}
+
+	return ret ? ret : total;
+}
+
+void ColumnarFormat::appendSample(Chunk &c, const struct sample *smp)
+{
+	if (c.count == 0) {
+		for (unsigned j = 0; j < c.length; j++)
+			c.types.push_back(sample_format(smp, j));
+	}
+
+	c.ts.push_back((smp->flags & (int) SampleFlags::HAS_TS_ORIGIN)
+		? smp->ts.origin.tv_sec * 1000000000LL + smp->ts.origin.tv_nsec
+		: 0);
+
+	c.sequence.push_back((smp->flags & (int) SampleFlags::HAS_SEQUENCE)
+		? smp->sequence
+		: 0);
+
+	c.data.insert(c.data.end(), smp->data, smp->data + c.length);
+
+	c.count++;
+}
+
+unsigned ColumnarFormat::extractSamples(Chunk &c, unsigned pos, struct sample * const smps[], unsigned cnt)
+{
+	unsigned i;
+
+	for (i = 0; i < cnt && pos + i < c.count; i++) {
+		struct sample *smp = smps[i];
+		unsigned row = pos + i;
+
+		smp->flags = 0;
+		smp->signals = signals;
+
+		if (c.flags & (int) SampleFlags::HAS_TS_ORIGIN) {
+			smp->ts.origin.tv_sec = c.ts[row] / 1000000000LL;
+			smp->ts.origin.tv_nsec = c.ts[row] % 1000000000LL;
+			smp->flags |= (int) SampleFlags::HAS_TS_ORIGIN;
+		}
+
+		if (c.flags & (int) SampleFlags::HAS_SEQUENCE) {
+			smp->sequence = c.sequence[row];
+			smp->flags |= (int) SampleFlags::HAS_SEQUENCE;
+		}
+
+		smp->length = MIN(c.length, smp->capacity);
+		if (smp->length > 0) {
+			memcpy(smp->data, &c.data[row * c.length], smp->length * sizeof(union signal_data));
+			smp->flags |= (int) SampleFlags::HAS_DATA;
+		}
+	}
+
+	return i;
+}
+
+int ColumnarFormat::sprint(char *buf, size_t len, size_t *wbytes, const struct sample * const smps[], unsigned cnt)
+{
+	unsigned n = cnt;
+
+	/* A chunk only contains samples with the same number of values */
+	for (unsigned i = 1; i < cnt; i++) {
+		if (smps[i]->length != smps[0]->length) {
+			n = i;
+			break;
+		}
+	}
+
+	/* Encode less samples if the chunk does not fit into the buffer */
+	while (n > 0) {
+		scratch.clear(flags & COLUMNAR_FLAGS, (flags & (int) SampleFlags::HAS_DATA) ? smps[0]->length : 0);
+
+		for (unsigned i = 0; i < n; i++)
+			appendSample(scratch, smps[i]);
+
+		encoded.clear();
+		encodeChunk(encoded, scratch);
+
+		if (encoded.size() <= len) {
+			memcpy(buf, encoded.data(), encoded.size());
+			break;
+		}
+
+		n /= 2;
+	}
+
+	if (wbytes)
+		*wbytes = n > 0 ? encoded.size() : 0;
+
+	return n;
+}
+
+int ColumnarFormat::sscan(const char *buf, size_t len, size_t *rbytes, struct sample * const smps[], unsigned cnt)
+{
+	size_t off = 0;
+	unsigned i = 0;
+
+	while (off < len && i < cnt) {
+		ssize_t ret = decodeBlock((const uint8_t *) buf + off, len - off, scratch);
+		if (ret < 0)
+			return ret;
+		else if (ret == 0)
+			break;
+
+		off += ret;
+
+		if (scratch.count > cnt - i)
+			logger->warn("Dropped {} samples of a chunk", scratch.count - (cnt - i));
+
+		i += extractSamples(scratch, 0, &smps[i], cnt - i);
+	}
+
+	if (rbytes)
+		*rbytes = off;
+
+	return i;
+}
+
+int ColumnarFormat::writeChunk(FILE *f)
+{
+	Chunk &c = wr.chunk;
+	struct columnar_index_entry e;
+	size_t wlen;
+
+	if (c.count == 0)
+		return 0;
+
+	encoded.clear();
+	encodeChunk(encoded, c);
+
+	wlen = fwrite(encoded.data(), 1, encoded.size(), f);
+	if (wlen != encoded.size())
+		return -1;
+
+	e.offset = htole64(wr.offset);
+	e.count = htole32(c.count);
+	e.length = htole32(encoded.size());
+	e.first = htole64(c.ts.front());
+	e.last = htole64(c.ts.back());
+
+	wr.index.push_back(e);
+	wr.offset += encoded.size();
+
+	c.clear(c.flags, c.length);
+
+	return 0;
+}
+
+int ColumnarFormat::print(FILE *f, const struct sample * const smps[], unsigned cnt)
+{
+	int ret;
+	Chunk &c = wr.chunk;
+
+	if (!wr.header_written) {
+		encoded.clear();
+		encodeHeader(encoded);
+
+		if (fwrite(encoded.data(), 1, encoded.size(), f) != encoded.size())
+			return -1;
+
+		wr.offset += encoded.size();
+		wr.header_written = true;
+	}
+
+	for (unsigned i = 0; i < cnt; i++) {
+		const struct sample *smp = smps[i];
+		unsigned length = (flags & (int) SampleFlags::HAS_DATA) ? smp->length : 0;
+
+		/* A chunk only contains samples with the same number of values */
+		if (c.count > 0 && c.length != length) {
+			ret = writeChunk(f);
+			if (ret)
+				return ret;
+		}
+
+		if (c.count == 0)
+			c.clear(flags & COLUMNAR_FLAGS, length);
+
+		appendSample(c, smp);
+
+		if (c.count >= chunk_size) {
+			ret = writeChunk(f);
+			if (ret)
+				return ret;
+		}
+	}
+
+	return cnt;
+}
+
+int ColumnarFormat::finish(FILE *f)
+{
+	int ret;
+	std::vector<uint8_t> out;
+	struct columnar_index_trailer t;
+
+	if (!wr.header_written)
+		return 0;
+
+	ret = writeChunk(f);
+	if (ret)
+		return ret;
+
+	size_t payload = wr.index.size() * sizeof(struct columnar_index_entry) + sizeof(t);
+
+	t.count = htole64(wr.index.size());
+	t.offset = htole64(wr.offset);
+	t.length = htole32(sizeof(struct columnar_block) + payload);
+	t.magic = htole32(COLUMNAR_INDEX_MAGIC);
+
+	columnar_append_block(out, ColumnarBlockType::INDEX, payload);
+	columnar_append(out, wr.index.data(), wr.index.size() * sizeof(struct columnar_index_entry));
+	columnar_append(out, &t, sizeof(t));
+
+	if (fwrite(out.data(), 1, out.size(), f) != out.size())
+		return -1;
+
+	/* Following samples start a new recording */
+	wr.header_written = false;
+	wr.offset = 0;
+	wr.index.clear();
+
+	return 0;
+}
+
+int ColumnarFormat::scan(FILE *f, struct sample * const smps[], unsigned cnt)
+{
+	/* The stream has been rewound or repositioned */
+	if (ftello(f) != rd.stream_pos)
+		resetReader();
+
+	while (rd.pos >= rd.chunk.count) {
+		size_t need = sizeof(struct columnar_block);
+
+		if (rd.fill >= need) {
+			struct columnar_block b;
+
+			memcpy(&b, rd.block.data(), sizeof(b));
+
+			if (le32toh(b.magic) != COLUMNAR_MAGIC || le32toh(b.length) > COLUMNAR_BLOCK_MAX) {
+				logger->error("Invalid block");
+				return -1;
+			}
+
+			need += le32toh(b.length);
+		}
+
+		if (rd.block.size() < need)
+			rd.block.resize(need);
+
+		/* Incomplete blocks are kept until more data is available */
+		if (rd.fill < need) {
+			rd.fill += fread(rd.block.data() + rd.fill, 1, need - rd.fill, f);
+			rd.stream_pos = ftello(f);
+
+			if (rd.fill < need) {
+				if (feof(f) || ferror(f))
+					return -1;
+
+				continue;
+			}
+
+			if (need == sizeof(struct columnar_block))
+				continue; /* Now we know the length of the payload */
+		}
+
+		ssize_t ret = decodeBlock(rd.block.data(), rd.fill, rd.chunk);
+		if (ret <= 0) {
+			logger->error("Failed to decode block");
+			return -1;
+		}
+
+		rd.fill = 0;
+		rd.pos = 0;
+	}
+
+	unsigned n = extractSamples(rd.chunk, rd.pos, smps, cnt);
+
+	rd.pos += n;
+
+	return n;
+}
+
+int ColumnarFormat::readIndex(FILE *f, std::vector<struct columnar_index_entry> &entries, off_t *header)
+{
+	int ret;
+	struct columnar_index_trailer t;
+	struct columnar_block b;
+	off_t end, start;
+
+	ret = fseeko(f, 0, SEEK_END);
+	if (ret)
+		return ret;
+
+	end = ftello(f);
+	if (end < (off_t) (sizeof(b) + sizeof(t)))
+		return -1;
+
+	ret = fseeko(f, end - sizeof(t), SEEK_SET);
+	if (ret)
+		return ret;
+
+	if (fread(&t, sizeof(t), 1, f) != 1 || le32toh(t.magic) != COLUMNAR_INDEX_MAGIC)
+		return -1;
+
+	start = end - le32toh(t.length);
+	if (start < 0 || (off_t) le64toh(t.offset) > start)
+		return -1;
+
+	ret = fseeko(f, start, SEEK_SET);
+	if (ret)
+		return ret;
+
+	if (fread(&b, sizeof(b), 1, f) != 1 ||
+	    le32toh(b.magic) != COLUMNAR_MAGIC ||
+	    le16toh(b.type) != (uint16_t) ColumnarBlockType::INDEX)
+		return -1;
+
+	entries.resize(le64toh(t.count));
+
+	if (entries.size() * sizeof(struct columnar_index_entry) + sizeof(t) != le32toh(b.length))
+		return -1;
+
+	if (fread(entries.data(), sizeof(struct columnar_index_entry), entries.size(), f) != entries.size())
+		return -1;
+
+	for (auto &e : entries) {
+		e.offset = le64toh(e.offset);
+		e.count = le32toh(e.count);
+		e.length = le32toh(e.length);
+		e.first = le64toh(e.first);
+		e.last = le64toh(e.last);
+	}
+
+	if (header)
+		*header = start - le64toh(t.offset);
+
+	return 0;
+}
+
+/** Read a complete block at the current position of \p f. */
+static int columnar_read_block(FILE *f, std::vector<uint8_t> &buf)
+{
+	struct columnar_block b;
+
+	if (fread(&b, sizeof(b), 1, f) != 1 ||
+	    le32toh(b.magic) != COLUMNAR_MAGIC ||
+	    le32toh(b.length) > COLUMNAR_BLOCK_MAX)
+		return -1;
+
+	buf.resize(sizeof(b) + le32toh(b.length));
+	memcpy(buf.data(), &b, sizeof(b));
+
+	if (fread(buf.data() + sizeof(b), 1, le32toh(b.length), f) != le32toh(b.length))
+		return -1;
+
+	return 0;
+}
+
+int ColumnarFormat::seek(FILE *f, double delta, struct timespec *ts)
+{
+	int ret;
+	off_t header;
+	std::vector<struct columnar_index_entry> entries;
+
+	ret = readIndex(f, entries, &header);
+	if (ret)
+		return -1;
+
+	resetReader();
+
+	/* The header is required to resolve the selected columns */
+	ret = fseeko(f, header, SEEK_SET);
+	if (ret)
+		return ret;
+
+	ret = columnar_read_block(f, rd.block);
+	if (ret || decodeBlock(rd.block.data(), rd.block.size(), rd.chunk) <= 0)
+		return -1;
+
+	if (entries.empty())
+		return fseeko(f, 0, SEEK_END);
+
+	int64_t target = entries.front().first + (int64_t) (delta * 1e9);
+
+	for (auto &e : entries) {
+		/* Timestamps might have been reset within a chunk */
+		if (e.first < target && e.last < target)
+			continue;
+
+		ret = fseeko(f, header + e.offset, SEEK_SET);
+		if (ret)
+			return ret;
+
+		ret = columnar_read_block(f, rd.block);
+		if (ret || decodeBlock(rd.block.data(), rd.block.size(), rd.chunk) <= 0)
+			return -1;
+
+		/* Without decoded timestamps the chunk is replayed from its start */
+		for (rd.pos = 0; rd.pos < rd.chunk.ts.size(); rd.pos++) {
+			if (rd.chunk.ts[rd.pos] >= target)
+				break;
+		}
+
+		if (rd.chunk.ts.empty())
+			rd.pos = 0;
+
+		if (rd.pos < rd.chunk.count) {
+			rd.fill = 0;
+			rd.stream_pos = ftello(f);
+
+			if (ts && !rd.chunk.ts.empty()) {
+				ts->tv_sec = rd.chunk.ts[rd.pos] / 1000000000LL;
+				ts->tv_nsec = rd.chunk.ts[rd.pos] % 1000000000LL;
+			}
+
+			return 0;
+		}
+	}
+
+	/* All samples are older than the target */
+	resetReader();
+
+	return fseeko(f, 0, SEEK_END);
+}
+
+static char n[] = "villas.columnar";
+static char d[] = "Chunked columnar format for recordings";
+static FormatPlugin<ColumnarFormat, n, d, (int) SampleFlags::HAS_TS_ORIGIN | (int) SampleFlags::HAS_SEQUENCE | (int) SampleFlags::HAS_DATA> p;
@@ -0,0 +1,251 @@
+/** High dynamic range (HDR) histogram.
+ *
+ * @author Steffen Vogel <stvogel@eonerc.rwth-aachen.de>
+ * @copyright 2014-2020, Institute for Automation of Complex Power Systems, EONERC
+ * @license GNU General Public License (version 3)
+ *
+ * VILLASnode
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *********************************************************************************/
+
+#include <cmath>
+#include <cinttypes>
+#include <limits>
+#include <string>
+
+#include <villas/hdr_hist.hpp>
+#include <villas/exceptions.hpp>
+#include <villas/utils.hpp>
+
+using namespace villas;
+
+const std::vector<double> HdrHist::percentiles = { 50, 90, 99, 99.9, 99.99 };
+
+HdrHist::HdrHist(double res, double high, int digits) :
+	resolution(res)
+{
+	if (digits < 1 || digits > 5)
+		throw RuntimeError("Invalid number of significant digits for histogram: {}", digits);
+
+	if (res <= 0 || high < 2 * res)
+		throw RuntimeError("Invalid range of histogram: resolution={}, highest={}", res, high);
+
+	/* Number of values within a bucket which must be distinguishable
+	 * in order to achieve the requested precision */
+	int64_t largest_single_unit = 2 * (int64_t) pow(10, digits);
+	int sub_bucket_count_magnitude = (int) ceil(log2(largest_single_unit));
+
+	sub_bucket_half_count_magnitude = MAX(sub_bucket_count_magnitude, 1) - 1;
+	sub_bucket_half_count = INT64_C(1) << sub_bucket_half_count_magnitude;
+	sub_bucket_mask = 2 * sub_bucket_half_count - 1;
+
+	max_index_value = llround(high / res);
+
+	/* Each additional bucket doubles the trackable range */
+	int buckets = 1;
+	for (int64_t untrackable = 2 * sub_bucket_half_count; untrackable <= max_index_value; untrackable <<= 1) {
+		buckets++;
+
+		if (untrackable > std::numeric_limits<int64_t>::max() / 2)
+			break;
+	}
+
+	counts.resize((buckets + 1) * sub_bucket_half_count);
+
+	reset();
+}
+
+size_t HdrHist::getIndex(int64_t value) const
+{
+	int pow2ceiling = 64 - __builtin_clzll(value | sub_bucket_mask);
+	int bucket_index = pow2ceiling - (sub_bucket_half_count_magnitude + 1);
+	int64_t sub_bucket_index = value >> bucket_index;
+
+	return ((bucket_index + 1) << sub_bucket_half_count_magnitude) + (sub_bucket_index - sub_bucket_half_count);
+}
+
+int64_t HdrHist::getValueAt(size_t index) const
+{
+	int bucket_index = (index >> sub_bucket_half_count_magnitude) - 1;
+	int64_t sub_bucket_index = (index & (sub_bucket_half_count - 1)) + sub_bucket_half_count;
+
+	if (bucket_index < 0) {
+		sub_bucket_index -= sub_bucket_half_count;
+		bucket_index = 0;
+	}
+
+	return sub_bucket_index << bucket_index;
+}
+
+int64_t HdrHist::getHighestEquivalent(int64_t value) const
+{
+	int pow2ceiling = 64 - __builtin_clzll(value | sub_bucket_mask);
+	int bucket_index = pow2ceiling - (sub_bucket_half_count_magnitude + 1);
+
+	return ((value >> bucket_index) << bucket_index) + (INT64_C(1) << bucket_index) - 1;
+}
+
+void HdrHist::putIndexed(int64_t value, cnt_t count)
+{
+	counts[getIndex(MIN(value, max_index_value))] += count;
+}
+
+void HdrHist::put(double value)
+{
+	if (value < 0)
+		value = 0;
+
+	if (total == 0 || value > highest)
+		highest = value;
+
+	if (total == 0 || value < lowest)
+		lowest = value;
+
+	total++;
+	sum += value;
+	sum_sq += value * value;
+
+	putIndexed(llround(value / resolution), 1);
+}
+
+void HdrHist::putCorrected(double value, double interval)
+{
+	put(value);
+
+	if (interval <= 0)
+		return;
+
+	/* Multiples are used instead of repeated subtraction to avoid accumulating rounding errors */
+	for (cnt_t k = 1; value - k * interval >= interval; k++)
+		put(value - k * interval);
+}
+
+void HdrHist::merge(const HdrHist &other)
+{
+	if (other.resolution != resolution ||
+	    other.sub_bucket_half_count != sub_bucket_half_count ||
+	    other.counts.size() != counts.size())
+		throw RuntimeError("Histograms with different parameters can not be merged");
+
+	if (other.total == 0)
+		return;
+
+	if (total == 0 || other.highest > highest)
+		highest = other.highest;
+
+	if (total == 0 || other.lowest < lowest)
+		lowest = other.lowest;
+
+	total += other.total;
+	sum += other.sum;
+	sum_sq += other.sum_sq;
+
+	for (size_t i = 0; i < counts.size(); i++)
+		counts[i] += other.counts[i];
+}
+
+void HdrHist::reset()
+{
+	total = 0;
+	sum = 0;
+	sum_sq = 0;
+	highest = 0;
+	lowest = 0;
+
+	std::fill(counts.begin(), counts.end(), 0);
+}
+
+double HdrHist::getPercentile(double percentile) const
+{
+	if (total == 0)
+		return 0;
+
+	percentile = MIN(MAX(percentile, 0.0), 100.0);
+
+	cnt_t target = MAX((cnt_t) llround(percentile / 100 * total), (cnt_t) 1);
+	cnt_t cumulative = 0;
+
+	for (size_t i = 0; i < counts.size(); i++) {
+		cumulative += counts[i];
+
+		if (cumulative >= target) {
+			double value = getHighestEquivalent(getValueAt(i)) * resolution;
+
+			/* The exact extremes are known and more precise than the buckets */
+			return MIN(MAX(value, lowest), highest);
+		}
+	}
+
+	return highest;
+}
+
+double HdrHist::getMean() const
+{
+	return total > 0 ? sum / total : 0;
+}
+
+double HdrHist::getStddev() const
+{
+	if (total < 2)
+		return 0;
+
+	double var = (sum_sq - sum * sum / total) / (total - 1);
+
+	return var > 0 ? sqrt(var) : 0;
+}
+
+void HdrHist::print(Logger logger) const
+{
+	std::string pcts;
+
+	for (double p : percentiles)
+		pcts += fmt::format("{}p{:g}={:g}", pcts.empty() ? "" : ", ", p, getPercentile(p));
+
+	logger->info("Total: {}, Lowest: {:g}, Highest: {:g}, Mean: {:g}, Stddev: {:g}",
+		total, lowest, highest, getMean(), getStddev());
+	logger->info("Percentiles: {}", pcts);
+}
+
+json_t * HdrHist::toJson() const
+{
+	json_t *json = json_pack("{ s: I, s: f, s: f, s: f, s: f }",
+		"total", (json_int_t) total,
+		"lowest", lowest,
+		"highest", highest,
+		"mean", getMean(),
+		"stddev", getStddev()
+	);
+
+	for (double p : percentiles)
+		json_object_set_new(json, fmt::format("p{:g}", p).c_str(), json_real(getPercentile(p)));
+
+	return json;
+}
+
+void HdrHist::printCsvHeader(FILE *f)
+{
+	fprintf(f, "total,lowest,highest,mean,stddev");
+
+	for (double p : percentiles)
+		fprintf(f, ",p%g", p);
+}
+
+void HdrHist::printCsv(FILE *f) const
+{
+	fprintf(f, "%" PRIu64 ",%.9g,%.9g,%.9g,%.9g", total, lowest, highest, getMean(), getStddev());
+
+	for (double p : percentiles)
+		fprintf(f, ",%.9g", getPercentile(p));
+}
@@ -60,6 +60,9 @@ int node_direction_init(struct vnode_direction *nd, enum NodeDir dir, struct vno
 	nd->builtin = 1;
 	nd->path = nullptr;
 
+	nd->secondaries.queuelen = DEFAULT_QUEUE_LENGTH;
+	nd->secondaries.overflow = BroadcastRingOverflow::DROP;
+
 #ifdef WITH_HOOKS
 	ret = hook_list_init(&nd->hooks);
 	if (ret)
@@ -105,19 +108,44 @@ int node_direction_parse(struct vnode_direction *nd, struct vnode *n, json_t *js
 	json_error_t err;
 	json_t *json_hooks = nullptr;
 	json_t *json_signals = nullptr;
+	json_t *json_secondaries = nullptr;
 
 	nd->config = json;
 
-	ret = json_unpack_ex(json, &err, 0, "{ s?: o, s?: o, s?: i, s?: b, s?: b }",
+	ret = json_unpack_ex(json, &err, 0, "{ s?: o, s?: o, s?: i, s?: b, s?: b, s?: o }",
 		"hooks", &json_hooks,
 		"signals", &json_signals,
 		"vectorize", &nd->vectorize,
 		"builtin", &nd->builtin,
-		"enabled", &nd->enabled
+		"enabled", &nd->enabled,
+		"secondaries", &json_secondaries
 	);
 	if (ret)
 		throw ConfigError(json, err, "node-config-node-in");
 
+	if (json_secondaries) {
+		const char *overflow = nullptr;
+
+		if (nd->direction != NodeDir::IN)
+			throw ConfigError(json_secondaries, "node-config-node-in-secondaries", "Setting 'secondaries' is only supported for the input direction");
+
+		ret = json_unpack_ex(json_secondaries, &err, 0, "{ s?: i, s?: s }",
+			"queuelen", &nd->secondaries.queuelen,
+			"overflow", &overflow
+		);
+		if (ret)
+			throw ConfigError(json_secondaries, err, "node-config-node-in-secondaries");
+
+		if (overflow) {
+			if (!strcmp(overflow, "drop"))
+				nd->secondaries.overflow = BroadcastRingOverflow::DROP;
+			else if (!strcmp(overflow, "block"))
+				nd->secondaries.overflow = BroadcastRingOverflow::BLOCK;
+			else
+				throw ConfigError(json_secondaries, "node-config-node-in-secondaries-overflow", "Unknown overflow policy '{}'", overflow);
+		}
+	}
+
 	if (node_type(n)->flags & (int) NodeFlags::PROVIDES_SIGNALS) {
 		/* Do nothing.. Node-type will provide signals */
 	}
@@ -21,6 +21,8 @@
  *********************************************************************************/
 
 #include <cstring>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 
 #include <amqp_ssl_socket.h>
 #include <amqp_tcp_socket.h>
@@ -28,6 +30,8 @@
 #include <villas/node.h>
 #include <villas/nodes/amqp.hpp>
 #include <villas/utils.hpp>
+#include <villas/stats.hpp>
+#include <villas/timing.h>
 #include <villas/exceptions.hpp>
 
 using namespace villas;
@@ -137,7 +141,12 @@ int amqp_parse(struct vnode *n, json_t *json)
 	amqp_default_ssl_info(&a->ssl_info);
 	amqp_default_connection_info(&a->connection_info);
 
-	ret = json_unpack_ex(json, &err, 0, "{ s?: s, s?: s, s?: s, s?: s, s?: s, s?: i, s: s, s: s, s?: o, s?: o }",
+	a->in.prefetch = 0;
+	a->out.samples_per_message = 0;
+	a->out.confirm = 0;
+	a->out.confirm_window = AMQP_DEFAULT_CONFIRM_WINDOW;
+
+	ret = json_unpack_ex(json, &err, 0, "{ s?: s, s?: s, s?: s, s?: s, s?: s, s?: i, s: s, s: s, s?: o, s?: o, s?: { s?: i }, s?: { s?: i, s?: b, s?: i } }",
 		"uri", &uri,
 		"host", &host,
 		"vhost", &vhost,
@@ -147,11 +156,26 @@ int amqp_parse(struct vnode *n, json_t *json)
 		"exchange", &exchange,
 		"routing_key", &routing_key,
 		"format", &json_format,
-		"ssl", &json_ssl
+		"ssl", &json_ssl,
+		"in",
+			"prefetch", &a->in.prefetch,
+		"out",
+			"samples_per_message", &a->out.samples_per_message,
+			"confirm", &a->out.confirm,
+			"confirm_window", &a->out.confirm_window
 	);
 	if (ret)
 		throw ConfigError(json, err, "node-config-node-amqp");
 
+	if (a->in.prefetch < 0 || a->in.prefetch > UINT16_MAX)
+		throw ConfigError(json, "node-config-node-amqp-prefetch", "Setting 'in.prefetch' must be between 0 and {}", UINT16_MAX);
+
+	if (a->out.samples_per_message < 0)
+		throw ConfigError(json, "node-config-node-amqp-samples-per-message", "Setting 'out.samples_per_message' must not be negative");
+
+	if (a->out.confirm_window <= 0)
+		throw ConfigError(json, "node-config-node-amqp-confirm-window", "Setting 'out.confirm_window' must be positive");
+
 	a->exchange = amqp_bytes_strdup(exchange);
 	a->routing_key = amqp_bytes_strdup(routing_key);
 
@@ -216,6 +240,15 @@ char * amqp_print(struct vnode *n)
 		(char *) a->routing_key.bytes
 	);
 
+	if (a->in.prefetch)
+		strcatf(&buf, ", in.prefetch=%d", a->in.prefetch);
+
+	if (a->out.samples_per_message)
+		strcatf(&buf, ", out.samples_per_message=%d", a->out.samples_per_message);
+
+	if (a->out.confirm)
+		strcatf(&buf, ", out.confirm_window=%d", a->out.confirm_window);
+
 	if (a->connection_info.ssl) {
 		strcatf(&buf, ", ssl_info.verify_peer=%s, ssl_info.verify_hostname=%s",
 			a->ssl_info.verify_peer ? "true" : "false",
@@ -250,6 +283,25 @@ int amqp_start(struct vnode *n)
 	if (!a->producer)
 		return -1;
 
+	a->out.buffer_size = AMQP_BUFFER_SIZE;
+	a->out.buffer = new char[a->out.buffer_size];
+	if (!a->out.buffer)
+		throw MemoryAllocationError();
+
+	/* Enable publisher confirms */
+	if (a->out.confirm) {
+		amqp_confirm_select(a->producer, 1);
+		rep = amqp_get_rpc_reply(a->producer);
+		if (rep.reply_type != AMQP_RESPONSE_NORMAL)
+			return -1;
+
+		a->out.next_tag = 1;
+		a->out.oldest_tag = 1;
+		a->out.published = new struct amqp_confirm[a->out.confirm_window]();
+		if (!a->out.published)
+			throw MemoryAllocationError();
+	}
+
 	/* Connect consumer */
 	a->consumer = amqp_connect(&a->connection_info, &a->ssl_info);
 	if (!a->consumer)
@@ -277,8 +329,16 @@ int amqp_start(struct vnode *n)
 	if (rep.reply_type != AMQP_RESPONSE_NORMAL)
 		return -1;
 
-	/* Start consumer */
-	amqp_basic_consume(a->consumer, 1, queue, amqp_empty_bytes, 0, 1, 0, amqp_empty_table);
+	/* Limit the number of unacknowledged deliveries */
+	if (a->in.prefetch) {
+		amqp_basic_qos(a->consumer, 1, 0, a->in.prefetch, 0);
+		rep = amqp_get_rpc_reply(a->consumer);
+		if (rep.reply_type != AMQP_RESPONSE_NORMAL)
+			return -1;
+	}
+
+	/* Start consumer. The prefetch limit only applies to explicit acknowledgements */
+	amqp_basic_consume(a->consumer, 1, queue, amqp_empty_bytes, 0, a->in.prefetch ? 0 : 1, 0, amqp_empty_table);
 	rep = amqp_get_rpc_reply(a->consumer);
 	if (rep.reply_type != AMQP_RESPONSE_NORMAL)
 		return -1;
@@ -288,11 +348,106 @@ int amqp_start(struct vnode *n)
 	return 0;
 }
 
+/** Process publisher confirms of the broker.
+ *
+ * @param tv Maximum time to wait for the first confirm or nullptr to block.
+ */
+static int amqp_confirms(struct vnode *n, struct timeval *tv)
+{
+	int ret;
+	struct amqp *a = (struct amqp *) n->_vd;
+
+	amqp_frame_t frame;
+	struct timeval zero = { 0, 0 };
+
+	while (a->out.oldest_tag < a->out.next_tag) {
+		ret = amqp_simple_wait_frame_noblock(a->producer, &frame, tv);
+		if (ret == AMQP_STATUS_TIMEOUT)
+			break;
+		else if (ret != AMQP_STATUS_OK)
+			return -1;
+
+		/* Do not block for subsequent frames */
+		tv = &zero;
+
+		if (frame.frame_type != AMQP_FRAME_METHOD)
+			continue;
+
+		uint64_t tag;
+		bool multiple, ack;
+
+		switch (frame.payload.method.id) {
+			case AMQP_BASIC_ACK_METHOD: {
+				auto *m = (amqp_basic_ack_t *) frame.payload.method.decoded;
+
+				tag = m->delivery_tag;
+				multiple = m->multiple;
+				ack = true;
+				break;
+			}
+
+			case AMQP_BASIC_NACK_METHOD: {
+				auto *m = (amqp_basic_nack_t *) frame.payload.method.decoded;
+
+				tag = m->delivery_tag;
+				multiple = m->multiple;
+				ack = false;
+				break;
+			}
+
+			case AMQP_CHANNEL_CLOSE_METHOD:
+				n->logger->error("Channel has been closed by broker");
+				return -1;
+
+			default:
+				continue;
+		}
+
+		struct timespec now = time_now();
+
+		for (uint64_t t = multiple ? a->out.oldest_tag : tag; t <= tag && t < a->out.next_tag; t++) {
+			auto *p = &a->out.published[t % a->out.confirm_window];
+			if (!p->pending)
+				continue;
+
+			p->pending = false;
+
+			if (n->stats) {
+				if (ack)
+					n->stats->update(Stats::Metric::AMQP_CONFIRM_LATENCY, time_delta(&p->ts, &now));
+				else
+					n->stats->update(Stats::Metric::AMQP_CONFIRM_NACKS, 1);
+			}
+		}
+
+		if (!ack)
+			n->logger->warn("Broker rejected message(s) up to delivery tag {}", tag);
+
+		while (a->out.oldest_tag < a->out.next_tag && !a->out.published[a->out.oldest_tag % a->out.confirm_window].pending)
+			a->out.oldest_tag++;
+	}
+
+	amqp_maybe_release_buffers(a->producer);
+
+	return 0;
+}
+
 int amqp_stop(struct vnode *n)
 {
 	int ret;
 	struct amqp *a = (struct amqp *) n->_vd;
 
+	if (a->out.confirm) {
+		struct timeval tv = { 1, 0 };
+
+		/* Wait for outstanding confirms */
+		ret = amqp_confirms(n, &tv);
+		if (ret || a->out.oldest_tag < a->out.next_tag)
+			n->logger->warn("{} message(s) have not been confirmed", a->out.next_tag - a->out.oldest_tag);
+
+		delete[] a->out.published;
+	}
+
 	ret = amqp_close(a->consumer);
 	if (ret)
 		return ret;
@@ -301,6 +456,7 @@ int amqp_stop(struct vnode *n)
 	if (ret)
 		return ret;
 
+	delete[] a->out.buffer;
 	delete a->formatter;
 
 	return 0;
@@ -313,43 +469,145 @@ int amqp_read(struct vnode *n, struct sample * const smps[], unsigned cnt)
 	amqp_envelope_t env;
 	amqp_rpc_reply_t rep;
 
-	rep = amqp_consume_message(a->consumer, &env, nullptr, 0);
-	if (rep.reply_type != AMQP_RESPONSE_NORMAL)
-		return -1;
+	uint64_t tag = 0;
+	unsigned read = 0, max = 0, deliveries = 0;
+	struct timeval zero = { 0, 0 };
+
+	/* Only the first delivery is awaited. Afterwards, we take further deliveries
+	 * as long as one of the largest size seen so far still fits. */
+	while (read < cnt && cnt - read >= max) {
+		rep = amqp_consume_message(a->consumer, &env, deliveries > 0 ? &zero : nullptr, 0);
+		if (rep.reply_type != AMQP_RESPONSE_NORMAL) {
+			if (deliveries > 0)
+				break;
+
+			return -1;
+		}
 
-	ret = a->formatter->sscan(static_cast<char *>(env.message.body.bytes), env.message.body.len, nullptr, smps, cnt);
+		ret = a->formatter->sscan(static_cast<char *>(env.message.body.bytes), env.message.body.len, nullptr, &smps[read], cnt - read);
 
-	amqp_destroy_envelope(&env);
+		tag = env.delivery_tag;
+		deliveries++;
 
-	return ret;
+		amqp_destroy_envelope(&env);
+
+		if (ret < 0) {
+			n->logger->warn("Received an invalid message");
+			continue;
+		}
+
+		read += ret;
+		max = MAX(max, (unsigned) ret);
+	}
+
+	/* Acknowledge all deliveries at once */
+	if (a->in.prefetch) {
+		ret = amqp_basic_ack(a->consumer, 1, tag, 1);
+		if (ret != AMQP_STATUS_OK)
+			return -1;
+	}
+
+	amqp_maybe_release_buffers(a->consumer);
+
+	if (n->stats)
+		n->stats->update(Stats::Metric::AMQP_CONSUME_BATCH, deliveries);
+
+	return read;
 }
 
-int amqp_write(struct vnode *n, struct sample * const smps[], unsigned cnt)
+/** Format samples into the send buffer which grows if not all samples fit. */
+static int amqp_format(struct vnode *n, struct sample * const smps[], unsigned cnt, size_t *wbytes)
 {
 	int ret;
 	struct amqp *a = (struct amqp *) n->_vd;
-	char data[1500];
+
+	while (true) {
+		ret = a->formatter->sprint(a->out.buffer, a->out.buffer_size, wbytes, smps, cnt);
+		if (ret < 0)
+			return ret;
+
+		if (ret == (int) cnt && *wbytes <= a->out.buffer_size)
+			return ret;
+
+		if (2 * a->out.buffer_size > AMQP_MAX_MESSAGE_SIZE)
+			return ret > 0 && *wbytes <= a->out.buffer_size ? ret : -1;
+
+		delete[] a->out.buffer;
+
+		a->out.buffer_size *= 2;
+		a->out.buffer = new char[a->out.buffer_size];
+		if (!a->out.buffer)
+			throw MemoryAllocationError();
+	}
+}
+
+int amqp_write(struct vnode *n, struct sample * const smps[], unsigned cnt)
+{
+	int ret, written, fd, cork;
+	struct amqp *a = (struct amqp *) n->_vd;
+
 	size_t wbytes;
+	unsigned sent = 0, messages = 0;
+	unsigned per_message = a->out.samples_per_message ? a->out.samples_per_message : cnt;
+
+	/* Coalesce the frames of all messages into as few TCP segments as possible */
+	fd = amqp_socket_get_sockfd(amqp_get_socket(a->producer));
+	cork = cnt > per_message;
+	if (cork)
+		setsockopt(fd, IPPROTO_TCP, TCP_CORK, &cork, sizeof(cork));
+
+	while (sent < cnt) {
+		/* Wait until there is space in the confirm window */
+		while (a->out.confirm && a->out.next_tag - a->out.oldest_tag >= (unsigned) a->out.confirm_window) {
+			ret = amqp_confirms(n, nullptr);
+			if (ret)
+				goto out;
+		}
+
+		written = amqp_format(n, &smps[sent], MIN(per_message, cnt - sent), &wbytes);
+		if (written <= 0)
+			goto out;
+
+		amqp_bytes_t message = {
+			.len = wbytes,
+			.bytes = a->out.buffer
+		};
+
+		/* Send message */
+		ret = amqp_basic_publish(a->producer, 1,
+			a->exchange,
+			a->routing_key,
+			0, 0, nullptr, message);
+		if (ret != AMQP_STATUS_OK)
+			goto out;
+
+		if (a->out.confirm) {
+			auto *p = &a->out.published[a->out.next_tag++ % a->out.confirm_window];
+
+			p->ts = time_now();
+			p->pending = true;
+		}
+
+		sent += written;
+		messages++;
+	}
 
-	ret = a->formatter->sprint(data, sizeof(data), &wbytes, smps, cnt);
-	if (ret <= 0)
-		return -1;
+out:	if (cork) {
+		cork = 0;
+		setsockopt(fd, IPPROTO_TCP, TCP_CORK, &cork, sizeof(cork));
+	}
 
-	amqp_bytes_t message = {
-		.len = wbytes,
-		.bytes = data
-	};
+	/* Process confirms which are already available without blocking */
+	if (a->out.confirm) {
+		struct timeval zero = { 0, 0 };
 
-	/* Send message */
-	ret = amqp_basic_publish(a->producer, 1,
-		a->exchange,
-		a->routing_key,
-		0, 0, nullptr, message);
+		amqp_confirms(n, &zero);
+	}
 
-	if (ret != AMQP_STATUS_OK)
-		return -1;
+	if (n->stats && messages > 0)
+		n->stats->update(Stats::Metric::AMQP_PUBLISH_BATCH, messages);
 
-	return cnt;
+	return sent > 0 ? (int) sent : -1;
 }
 
 int amqp_poll_fds(struct vnode *n, int fds[])
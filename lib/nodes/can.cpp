@@ -23,6 +23,8 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <algorithm>
+#include <vector>
 #include <unistd.h>
 
 #include <net/if.h>
@@ -60,6 +62,18 @@ int can_init(struct vnode *n)
 	c->in = nullptr;
 	c->out = nullptr;
 
+	c->in_map.ids = nullptr;
+	c->in_map.ids_num = 0;
+	c->in_map.signals = nullptr;
+	c->in_map.sff = nullptr;
+
+	c->out_map.slots = nullptr;
+	c->out_map.frames = nullptr;
+	c->out_map.frames_num = 0;
+
+	c->rx = nullptr;
+	c->tx = nullptr;
+
 	return 0;
 }
 
@@ -80,6 +94,16 @@ int can_destroy(struct vnode *n)
 	if (c->out)
 		free(c->out);
 
+	free(c->in_map.ids);
+	free(c->in_map.signals);
+	free(c->in_map.sff);
+
+	free(c->out_map.slots);
+	free(c->out_map.frames);
+
+	free(c->rx);
+	free(c->tx);
+
 	return 0;
 }
 
@@ -108,6 +132,9 @@ static int can_parse_signal(json_t *json, struct vlist *node_signals, struct can
 	if (can_offset > 8 || can_offset < 0)
 		throw ConfigError(json, "node-config-node-can-can-offset", "can_offset of {} for signal '{}' is invalid. You must satisfy 0 <= can_offset <= 8.", can_offset, name);
 
+	if (can_offset + can_size > 8)
+		throw ConfigError(json, "node-config-node-can-can-offset", "Signal '{}' exceeds the frame payload. You must satisfy can_offset + can_size <= 8.", name);
+
 	sig = (struct signal*)vlist_at(node_signals, signal_index);
 	if ((!name && !sig->name) || (name && strcmp(name, sig->name) == 0)) {
 		can_signals[signal_index].id = can_id;
@@ -127,8 +154,8 @@ int can_parse(struct vnode *n, json_t *json)
 	int ret = 1;
 	struct can *c = (struct can *) n->_vd;
 	size_t i;
-	json_t *json_in_signals;
-	json_t *json_out_signals;
+	json_t *json_in_signals = nullptr;
+	json_t *json_out_signals = nullptr;
 	json_t *json_signal;
 	json_error_t err;
 
@@ -155,7 +182,7 @@ int can_parse(struct vnode *n, json_t *json)
 	c->out = (struct can_signal*)calloc(
 			 json_array_size(json_out_signals),
 			 sizeof(struct can_signal));
-	if (c->out)
+	if (!c->out)
 		throw MemoryAllocationError();
 
 	json_array_foreach(json_in_signals, i, json_signal) {
@@ -192,13 +219,105 @@ int can_check(struct vnode *n)
 	return 0;
 }
 
+static void can_batch_init(struct can_batch *b, bool timestamps)
+{
+	for (unsigned i = 0; i < CAN_BATCH_SIZE; i++) {
+		b->iov[i].iov_base = &b->frames[i];
+		b->iov[i].iov_len = sizeof(struct can_frame);
+
+		memset(&b->msgs[i], 0, sizeof(b->msgs[i]));
+
+		b->msgs[i].msg_hdr.msg_iov = &b->iov[i];
+		b->msgs[i].msg_hdr.msg_iovlen = 1;
+
+		if (timestamps) {
+			b->msgs[i].msg_hdr.msg_control = b->ctrl[i];
+			b->msgs[i].msg_hdr.msg_controllen = sizeof(b->ctrl[i]);
+		}
+	}
+}
+
 int can_prepare(struct vnode *n)
 {
 	struct can *c = (struct can *) n->_vd;
+	unsigned num_in = vlist_length(&n->in.signals);
+	unsigned num_out = vlist_length(&n->out.signals);
+
+	c->sample_buf = (union signal_data*) calloc(num_in + 1, sizeof(union signal_data));
+	if (!c->sample_buf)
+		throw MemoryAllocationError();
+
+	/* Group the input signals by their CAN ID */
+	c->in_map.signals = (unsigned *) calloc(num_in + 1, sizeof(unsigned));
+	c->in_map.ids = (struct can_id_entry *) calloc(num_in + 1, sizeof(struct can_id_entry));
+	c->in_map.sff = (uint16_t *) malloc(CAN_SFF_TABLE_SIZE * sizeof(uint16_t));
+	if (!c->in_map.signals || !c->in_map.ids || !c->in_map.sff)
+		throw MemoryAllocationError();
+
+	if (num_in >= UINT16_MAX)
+		throw RuntimeError("Too many input signals");
+
+	for (unsigned i = 0; i < num_in; i++)
+		c->in_map.signals[i] = i;
+
+	std::stable_sort(c->in_map.signals, c->in_map.signals + num_in, [c](unsigned a, unsigned b) {
+		return c->in[a].id < c->in[b].id;
+	});
+
+	c->in_map.ids_num = 0;
+	for (unsigned i = 0; i < num_in; i++) {
+		uint32_t id = c->in[c->in_map.signals[i]].id;
 
-	c->sample_buf = (union signal_data*) calloc(vlist_length(&n->in.signals), sizeof(union signal_data));
+		if (c->in_map.ids_num == 0 || c->in_map.ids[c->in_map.ids_num - 1].id != id) {
+			struct can_id_entry *e = &c->in_map.ids[c->in_map.ids_num++];
 
-	return (c->sample_buf != 0 ? 0 : 1);
+			e->id = id;
+			e->first = i;
+			e->num = 0;
+			e->received = false;
+		}
+
+		c->in_map.ids[c->in_map.ids_num - 1].num++;
+	}
+
+	std::fill(c->in_map.sff, c->in_map.sff + CAN_SFF_TABLE_SIZE, UINT16_MAX);
+	for (unsigned j = 0; j < c->in_map.ids_num; j++) {
+		uint32_t id = c->in_map.ids[j].id;
+
+		if (!(id & ~CAN_SFF_MASK))
+			c->in_map.sff[id] = j;
+	}
+
+	/* Assign each output signal to the frame carrying its CAN ID */
+	c->out_map.slots = (unsigned *) calloc(num_out + 1, sizeof(unsigned));
+	c->out_map.frames = (struct can_frame *) calloc(num_out + 1, sizeof(struct can_frame));
+	if (!c->out_map.slots || !c->out_map.frames)
+		throw MemoryAllocationError();
+
+	c->out_map.frames_num = 0;
+	for (unsigned i = 0; i < num_out; i++) {
+		unsigned j;
+
+		for (j = 0; j < c->out_map.frames_num; j++) {
+			if (c->out_map.frames[j].can_id == c->out[i].id)
+				break;
+		}
+
+		if (j == c->out_map.frames_num)
+			c->out_map.frames[c->out_map.frames_num++].can_id = c->out[i].id;
+
+		c->out_map.slots[i] = j;
+	}
+
+	c->rx = (struct can_batch *) malloc(sizeof(struct can_batch));
+	c->tx = (struct can_batch *) malloc(sizeof(struct can_batch));
+	if (!c->rx || !c->tx)
+		throw MemoryAllocationError();
+
+	can_batch_init(c->rx, true);
+	can_batch_init(c->tx, false);
+
+	return 0;
 }
 
 int can_start(struct vnode *n)
@@ -214,6 +333,29 @@ int can_start(struct vnode *n)
 	if (c->socket < 0)
 		throw SystemError("Error while opening CAN socket");
 
+	/* Let the kernel drop all frames whose IDs are not mapped to any signal */
+	if (c->in_map.ids_num <= CAN_RAW_FILTER_MAX) {
+		std::vector<struct can_filter> filters(c->in_map.ids_num);
+
+		for (unsigned j = 0; j < c->in_map.ids_num; j++) {
+			uint32_t id = c->in_map.ids[j].id;
+
+			filters[j].can_id = id;
+			filters[j].can_mask = CAN_EFF_FLAG | CAN_RTR_FLAG | (id & CAN_EFF_FLAG ? CAN_EFF_MASK : CAN_SFF_MASK);
+		}
+
+		ret = setsockopt(c->socket, SOL_CAN_RAW, CAN_RAW_FILTER, filters.data(), filters.size() * sizeof(struct can_filter));
+		if (ret)
+			throw SystemError("Failed to set CAN filter");
+	}
+	else
+		n->logger->warn("Too many CAN IDs for a kernel filter. Frames will be filtered in user-space");
+
+	int on = 1;
+	ret = setsockopt(c->socket, SOL_SOCKET, SO_TIMESTAMP, &on, sizeof(on));
+	if (ret)
+		throw SystemError("Failed to enable timestamping of CAN frames");
+
 	strcpy(ifr.ifr_name, c->interface_name);
 
 	ret = ioctl(c->socket, SIOCGIFINDEX, &ifr);
@@ -375,141 +517,184 @@ fail:
 	return 1;
 }
 
+static struct can_id_entry * can_lookup(struct can *c, uint32_t id)
+{
+	if (!(id & ~CAN_SFF_MASK)) {
+		uint16_t j = c->in_map.sff[id];
+
+		return j != UINT16_MAX ? &c->in_map.ids[j] : nullptr;
+	}
+
+	struct can_id_entry *end = c->in_map.ids + c->in_map.ids_num;
+	struct can_id_entry *e = std::lower_bound(c->in_map.ids, end, id, [](const struct can_id_entry &e, uint32_t id) {
+		return e.id < id;
+	});
+
+	return e != end && e->id == id ? e : nullptr;
+}
+
+static void can_timestamp(struct msghdr *mh, struct sample *smp)
+{
+	for (struct cmsghdr *cmsg = CMSG_FIRSTHDR(mh); cmsg; cmsg = CMSG_NXTHDR(mh, cmsg)) {
+		if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SO_TIMESTAMP) {
+			struct timeval tv;
+
+			memcpy(&tv, CMSG_DATA(cmsg), sizeof(tv));
+			TIMEVAL_TO_TIMESPEC(&tv, &smp->ts.received);
+			smp->flags |= (int) SampleFlags::HAS_TS_RECEIVED;
+		}
+	}
+}
+
 int can_read(struct vnode *n, struct sample * const smps[], unsigned cnt)
 {
-	int ret = 0;
-	int nbytes;
-	unsigned nread = 0;
-	struct can_frame frame;
-	struct timeval tv;
-	bool found_id = false;
+	int ret, nframes;
+	unsigned nread = 0, max;
 
 	struct can *c = (struct can *) n->_vd;
+	struct can_batch *b = c->rx;
+	unsigned num_in = vlist_length(&n->in.signals);
+	unsigned ids = MAX(c->in_map.ids_num, 1U);
 
 	assert(cnt >= 1 && smps[0]->capacity >= 1);
 
-	nbytes = read(c->socket, &frame, sizeof(struct can_frame));
-	if (nbytes == -1)
-		throw RuntimeError("CAN read() returned -1. Is the CAN interface up?");
+	/* A sample is complete after a frame for each of its CAN IDs has been
+	 * received. So we never receive more frames than can be assembled into
+	 * the provided samples and no frames need to be kept across calls. */
+	max = c->sample_buf_num > 0
+		? (cnt - 1) * ids + 1
+		: cnt * ids;
+	max = MIN(max, CAN_BATCH_SIZE);
+
+	for (unsigned i = 0; i < max; i++)
+		b->msgs[i].msg_hdr.msg_controllen = sizeof(b->ctrl[i]);
+
+	nframes = recvmmsg(c->socket, b->msgs, max, MSG_WAITFORONE, nullptr);
+	if (nframes < 0)
+		throw SystemError("Failed to receive CAN frames. Is the CAN interface up?");
+
+	for (int i = 0; i < nframes; i++) {
+		struct can_frame *frame = &b->frames[i];
+
+		if (b->msgs[i].msg_len != sizeof(struct can_frame))
+			throw RuntimeError("CAN recvmmsg() error. Returned {} bytes but expected {}", b->msgs[i].msg_len, sizeof(struct can_frame));
+
+		n->logger->debug("Received can message: (id={}, len={}, data={:#x}:{:#x})",
+			frame->can_id,
+			frame->can_dlc,
+			((uint32_t*)&frame->data)[0],
+			((uint32_t*)&frame->data)[1]);
+
+		struct can_id_entry *e = can_lookup(c, frame->can_id);
+		if (!e) {
+			n->logger->debug("Ignoring frame with unknown can id {}", frame->can_id);
+			continue;
+		}
 
-	if ((unsigned)nbytes != sizeof(struct can_frame))
-		throw RuntimeError("CAN read() error. Returned {} bytes but expected {}", nbytes, sizeof(struct can_frame));
+		for (unsigned k = 0; k < e->num; k++) {
+			unsigned j = c->in_map.signals[e->first + k];
 
-	n->logger->debug("Received can message: (id={}, len={}, data={:#x}:{:#x})",
-		frame.can_id,
-		frame.can_dlc,
-		((uint32_t*)&frame.data)[0],
-		((uint32_t*)&frame.data)[1]);
+			ret = can_conv_from_raw(&c->sample_buf[j],
+				((uint8_t*)&frame->data) + c->in[j].offset,
+				c->in[j].size,
+				(struct signal*) vlist_at(&n->in.signals, j));
+			if (ret)
+				return ret;
+		}
 
-	if (ioctl(c->socket, SIOCGSTAMP, &tv) == 0) {
-		TIMEVAL_TO_TIMESPEC(&tv, &smps[nread]->ts.received);
-		smps[nread]->flags |= (int) SampleFlags::HAS_TS_RECEIVED;
-	}
+		if (!e->received) {
+			e->received = true;
+			c->sample_buf_num++;
+		}
 
-	for (size_t i=0; i < vlist_length(&(n->in.signals)); i++) {
-		if (c->in[i].id == frame.can_id) {
-			if (can_conv_from_raw(&c->sample_buf[i],
-				((uint8_t*)&frame.data) + c->in[i].offset,
-				c->in[i].size,
-				(struct signal*) vlist_at(&n->in.signals, i)) != 0) {
-				goto out;
-			}
+		/* Copy signal data to sample only when all signals have been received */
+		if (c->sample_buf_num == c->in_map.ids_num) {
+			struct sample *smp = smps[nread++];
 
-			c->sample_buf_num++;
-			found_id = true;
+			smp->length = num_in;
+			memcpy(smp->data, c->sample_buf, num_in * sizeof(union signal_data));
+			smp->flags |= (int) SampleFlags::HAS_DATA;
+
+			/* Set signals, because other VILLASnode parts expect us to */
+			smp->signals = &n->in.signals;
+
+			can_timestamp(&b->msgs[i].msg_hdr, smp);
+
+			for (unsigned j = 0; j < c->in_map.ids_num; j++)
+				c->in_map.ids[j].received = false;
+
+			c->sample_buf_num = 0;
 		}
 	}
 
-	if (!found_id)
-		throw RuntimeError("Did not find signal for can id {}", frame.can_id);
+	n->logger->debug("Received {} samples from {} frames", nread, nframes);
 
-	n->logger->debug("Received {} signals", c->sample_buf_num);
+	return nread;
+}
 
-	/* Copy signal data to sample only when all signals have been received */
-	if (c->sample_buf_num == vlist_length(&n->in.signals)) {
-		smps[nread]->length = c->sample_buf_num;
-		memcpy(smps[nread]->data, c->sample_buf, c->sample_buf_num*sizeof(union signal_data));
-		c->sample_buf_num = 0;
-		smps[nread]->flags |= (int) SampleFlags::HAS_DATA;
-		ret = 1;
-	}
-	else {
-		smps[nread]->length = 0;
-		ret = 0;
-	}
+static void can_send(struct vnode *n, unsigned nframes)
+{
+	struct can *c = (struct can *) n->_vd;
 
- out:	/* Set signals, because other VILLASnode parts expect us to */
-	smps[nread]->signals = &n->in.signals;
+	for (unsigned sent = 0; sent < nframes; ) {
+		int ret = sendmmsg(c->socket, &c->tx->msgs[sent], nframes - sent, 0);
+		if (ret < 0)
+			throw SystemError("Failed to send CAN frames. Is the CAN interface up?");
 
-	return ret;
+		sent += ret;
+	}
 }
 
 int can_write(struct vnode *n, struct sample * const smps[], unsigned cnt)
 {
-	int nbytes;
 	unsigned nwrite;
-	struct can_frame *frame;
-	size_t fsize = 0; /* number of frames in use */
+	unsigned nframes = 0; /* number of frames in the send batch */
 
 	struct can *c = (struct can *) n->_vd;
+	unsigned num_out = vlist_length(&n->out.signals);
 
 	assert(cnt >= 1 && smps[0]->capacity >= 1);
 
-	frame = (struct can_frame*) calloc(sizeof(struct can_frame), vlist_length(&(n->out.signals)));
-
 	for (nwrite=0; nwrite < cnt; nwrite++) {
-		for (size_t i=0; i < vlist_length(&(n->out.signals)); i++) {
-			if (c->out[i].offset != 0) /* frame is shared */
-				continue;
+		for (size_t j=0; j < c->out_map.frames_num; j++) {
+			c->out_map.frames[j].can_dlc = 0;
+			memset(c->out_map.frames[j].data, 0, sizeof(c->out_map.frames[j].data));
+		}
 
-			frame[fsize].can_dlc = c->out[i].size;
-			frame[fsize].can_id = c->out[i].id;
+		for (size_t i=0; i < num_out; i++) {
+			struct can_frame *frame = &c->out_map.frames[c->out_map.slots[i]];
 
 			can_convert_to_raw(
 				&smps[nwrite]->data[i],
 				(struct signal*)vlist_at(&(n->out.signals), i),
-				&frame[fsize].data,
+				(uint8_t*)&frame->data + c->out[i].offset,
 				c->out[i].size);
 
-			fsize++;
+			frame->can_dlc = MAX(frame->can_dlc, c->out[i].offset + c->out[i].size);
 		}
 
-		for (size_t i=0; i < vlist_length(&(n->out.signals)); i++) {
-			if (c->out[i].offset == 0) { /* frame already stored */
-				continue;
-			}
-
-			for (size_t j=0; j < fsize; j++) {
-				if (c->out[i].id != frame[j].can_id)
-					continue;
+		for (size_t j=0; j < c->out_map.frames_num; j++) {
+			struct can_frame *frame = &c->out_map.frames[j];
 
-				frame[j].can_dlc += c->out[i].size;
-				can_convert_to_raw(
-					&smps[nwrite]->data[i],
-					(struct signal*)vlist_at(&(n->out.signals), i),
-					(uint8_t*)&frame[j].data + c->out[i].offset,
-					c->out[i].size);
-				break;
-			}
-		}
-
-		for (size_t j=0; j < fsize; j++) {
 			n->logger->debug("Writing CAN message: (id={}, dlc={}, data={:#x}:{:#x})",
-				frame[j].can_id,
-				frame[j].can_dlc,
-				((uint32_t*)&frame[j].data)[0],
-				((uint32_t*)&frame[j].data)[1]
+				frame->can_id,
+				frame->can_dlc,
+				((uint32_t*)&frame->data)[0],
+				((uint32_t*)&frame->data)[1]
 			);
 
-			if ((nbytes = write(c->socket, &frame[j], sizeof(struct can_frame))) == -1)
-				throw RuntimeError("CAN write() returned -1. Is the CAN interface up?");
+			if (nframes == CAN_BATCH_SIZE) {
+				can_send(n, nframes);
+				nframes = 0;
+			}
 
-			if ((unsigned)nbytes != sizeof(struct can_frame))
-				throw RuntimeError("CAN write() returned {} bytes but expected {}",
-					nbytes, sizeof(struct can_frame));
+			c->tx->frames[nframes++] = *frame;
 		}
 	}
 
+	if (nframes > 0)
+		can_send(n, nframes);
+
 	return nwrite;
 }
 
@@ -21,6 +21,10 @@
  *********************************************************************************/
 
 #include <string>
+#include <cstring>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
 
 #include <villas/node/config.h>
 #include <villas/node.h>
@@ -44,20 +48,35 @@ int exec_parse(struct vnode *n, json_t *json)
 	json_t *json_format = nullptr;
 
 	const char *wd = nullptr;
+	const char *framing = nullptr;
 	int shell = -1;
+	int pipe_size = 0;
 
-	ret = json_unpack_ex(json, &err, 0, "{ s: o, s?: o, s?: b, s?: o, s?: b, s?: s }",
+	ret = json_unpack_ex(json, &err, 0, "{ s: o, s?: o, s?: b, s?: o, s?: b, s?: s, s?: s, s?: i }",
 		"exec", &json_exec,
 		"format", &json_format,
 		"flush", &flush,
 		"environment", &json_env,
 		"shell", &shell,
-		"working_directory", &wd
+		"working_directory", &wd,
+		"framing", &framing,
+		"pipe_size", &pipe_size
 	);
 	if (ret)
 		throw ConfigError(json, err, "node-config-node-exec");
 
+	if (!framing || !strcmp(framing, "line"))
+		e->framing = exec::Framing::LINE;
+	else if (!strcmp(framing, "length"))
+		e->framing = exec::Framing::LENGTH;
+	else
+		throw ConfigError(json, "node-config-node-exec-framing", "Invalid framing '{}'", framing);
+
+	if (pipe_size < 0)
+		throw ConfigError(json, "node-config-node-exec-pipe-size", "Setting 'pipe_size' must not be negative");
+
 	e->flush = flush;
+	e->pipe_size = pipe_size;
 	e->shell = shell < 0 ? json_is_string(json_exec) : shell;
 
 	e->arguments.clear();
@@ -105,7 +124,7 @@ int exec_parse(struct vnode *n, json_t *json)
 	/* Format */
 	e->formatter = json_format
 			? FormatFactory::make(json_format)
-			: FormatFactory::make("villas.human");
+			: FormatFactory::make(e->framing == exec::Framing::LENGTH ? "villas.binary" : "villas.human");
 	if (!e->formatter)
 		throw ConfigError(json_format, "node-config-node-exec-format", "Invalid format configuration");
 
@@ -126,6 +145,19 @@ int exec_prepare(struct vnode *n)
 	e->proc = std::make_unique<Popen>(e->command, e->arguments, e->environment, e->working_dir, e->shell);
 	n->logger->debug("Started sub-process with pid={}", e->proc->getPid());
 
+	if (e->pipe_size > 0) {
+		int fd = e->proc->getFd();
+
+		/* The sub-process might be connected via a socket pair rather than a pipe */
+		if (fcntl(fd, F_SETPIPE_SZ, e->pipe_size) < 0 &&
+		    (setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &e->pipe_size, sizeof(e->pipe_size)) ||
+		     setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &e->pipe_size, sizeof(e->pipe_size))))
+			n->logger->warn("Failed to set pipe size to {} bytes: {}", e->pipe_size, strerror(errno));
+	}
+
+	e->in.buffer.resize(EXEC_BUFFER_SIZE);
+	e->out.buffer.resize(EXEC_BUFFER_SIZE);
+
 	return 0;
 }
 
@@ -138,6 +170,8 @@ int exec_init(struct vnode *n)
 	new (&e->command) std::string();
 	new (&e->arguments) Popen::arg_list();
 	new (&e->environment) Popen::env_map();
+	new (&e->in.buffer) std::vector<char>();
+	new (&e->out.buffer) std::vector<char>();
 
 	return 0;
 }
@@ -152,12 +186,15 @@ int exec_destroy(struct vnode *n)
 	using str = std::string;
 	using al = Popen::arg_list;
 	using em = Popen::env_map;
+	using buf = std::vector<char>;
 
 	e->proc.~uptr();
 	e->working_dir.~str();
 	e->command.~str();
 	e->arguments.~al();
 	e->environment.~em();
+	e->in.buffer.~buf();
+	e->out.buffer.~buf();
 
 	return 0;
 }
@@ -177,12 +214,67 @@ int exec_stop(struct vnode *n)
 	return 0;
 }
 
+/** Read a single length-prefixed frame into the receive buffer.
+ *
+ * @return The length of the frame or a negative value on errors.
+ */
+static ssize_t exec_read_frame(struct vnode *n)
+{
+	struct exec *e = (struct exec *) n->_vd;
+	auto &in = e->proc->cin();
+
+	uint32_t len;
+
+	if (!in.read((char *) &len, sizeof(len)))
+		return -1;
+
+	len = ntohl(len);
+	if (len > EXEC_MAX_FRAME_SIZE) {
+		n->logger->error("Received frame exceeds maximum size: {} > {}", len, EXEC_MAX_FRAME_SIZE);
+		return -1;
+	}
+
+	if (e->in.buffer.size() < len)
+		e->in.buffer.resize(len);
+
+	if (!in.read(e->in.buffer.data(), len))
+		return -1;
+
+	return len;
+}
+
 int exec_read(struct vnode *n, struct sample * const smps[], unsigned cnt)
 {
 	struct exec *e = (struct exec *) n->_vd;
 
 	size_t rbytes;
 	int avail;
+
+	if (e->framing == exec::Framing::LENGTH) {
+		ssize_t len;
+		unsigned read = 0, max = 0;
+
+		/* Frames which have already been received into the stream buffer
+		 * are consumed without waiting for the pipe to become readable again. */
+		do {
+			len = exec_read_frame(n);
+			if (len < 0)
+				return read > 0 ? (int) read : -1;
+
+			avail = e->formatter->sscan(e->in.buffer.data(), len, nullptr, &smps[read], cnt - read);
+			if (avail < 0) {
+				n->logger->warn("Received an invalid frame");
+				continue;
+			}
+
+			read += avail;
+			max = MAX(max, (unsigned) avail);
+		} while (read < cnt && cnt - read >= max &&
+			 e->proc->cin().rdbuf()->in_avail() >= (std::streamsize) sizeof(uint32_t));
+
+		return read;
+	}
+
 	std::string line;
 
 	std::getline(e->proc->cin(), line);
@@ -194,28 +286,59 @@ int exec_read(struct vnode *n, struct sample * const smps[], unsigned cnt)
 	return avail;
 }
 
+/** Format samples into the send buffer after the first \p off bytes.
+ *
+ * The buffer grows until all samples fit.
+ *
+ * @return The number of formatted samples or a negative value on errors.
+ */
+static int exec_format(struct vnode *n, struct sample * const smps[], unsigned cnt, size_t off, size_t *wbytes)
+{
+	int ret;
+	struct exec *e = (struct exec *) n->_vd;
+
+	while (true) {
+		size_t len = e->out.buffer.size() - off;
+
+		ret = e->formatter->sprint(e->out.buffer.data() + off, len, wbytes, smps, cnt);
+		if (ret < 0)
+			return ret;
+
+		if (ret == (int) cnt && *wbytes <= len)
+			return ret;
+
+		if (2 * e->out.buffer.size() > EXEC_MAX_FRAME_SIZE)
+			return ret > 0 && *wbytes <= len ? ret : -1;
+
+		e->out.buffer.resize(2 * e->out.buffer.size());
+	}
+}
+
 int exec_write(struct vnode *n, struct sample * const smps[], unsigned cnt)
 {
 	struct exec *e = (struct exec *) n->_vd;
 
-	size_t wbytes;
 	int ret;
-	char *line = new char[1024];
-	if (!line)
-		throw MemoryAllocationError();
+	size_t wbytes;
+	size_t off = e->framing == exec::Framing::LENGTH ? sizeof(uint32_t) : 0;
 
-	ret = e->formatter->sprint(line, 1024, &wbytes, smps, cnt);
+	ret = exec_format(n, smps, cnt, off, &wbytes);
 	if (ret < 0)
 		return ret;
 
-	e->proc->cout() << line;
+	if (e->framing == exec::Framing::LENGTH) {
+		uint32_t len = htonl(wbytes);
+
+		memcpy(e->out.buffer.data(), &len, sizeof(len));
+	}
+
+	/* The whole vector is written at once */
+	e->proc->cout().write(e->out.buffer.data(), off + wbytes);
 
 	if (e->flush)
 		e->proc->cout().flush();
 
-	delete[] line;
-
-	return cnt;
+	return ret;
 }
 
 char * exec_print(struct vnode *n)
@@ -223,15 +346,19 @@ char * exec_print(struct vnode *n)
 	struct exec *e = (struct exec *) n->_vd;
 	char *buf = nullptr;
 
-	strcatf(&buf, "exec=%s, shell=%s, flush=%s, #environment=%zu, #arguments=%zu, working_dir=%s",
+	strcatf(&buf, "exec=%s, shell=%s, flush=%s, #environment=%zu, #arguments=%zu, working_dir=%s, framing=%s",
 		e->command.c_str(),
 		e->shell ? "yes" : "no",
 		e->flush ? "yes" : "no",
 		e->environment.size(),
 		e->arguments.size(),
-		e->working_dir.c_str()
+		e->working_dir.c_str(),
+		e->framing == exec::Framing::LENGTH ? "length" : "line"
 	);
 
+	if (e->pipe_size > 0)
+		strcatf(&buf, ", pipe_size=%d", e->pipe_size);
+
 	return buf;
 }
 
@@ -24,8 +24,12 @@
 #include <cstring>
 #include <cinttypes>
 #include <libgen.h>
+#include <fcntl.h>
 #include <sys/stat.h>
+#include <sys/mman.h>
+#include <pthread.h>
 #include <cerrno>
+#include <cmath>
 
 #include <villas/node.h>
 #include <villas/nodes/file.hpp>
@@ -33,7 +37,10 @@
 #include <villas/timing.h>
 #include <villas/queue.h>
 #include <villas/format.hpp>
+#include <villas/formats/villas_binary.hpp>
+#include <villas/formats/columnar.hpp>
 #include <villas/exceptions.hpp>
+#include <villas/stats.hpp>
 
 using namespace villas;
 using namespace villas::node;
@@ -81,6 +88,710 @@ static struct timespec file_calc_offset(const struct timespec *first, const stru
 	}
 }
 
+static int file_mmap_parse(struct file *f, size_t off, size_t len, struct sample *smp, size_t *rbytes)
+{
+	/* Formats might modify their input while parsing (e.g. byte order conversion) */
+	if (len > f->mmap.scratch_len) {
+		delete[] f->mmap.scratch;
+
+		f->mmap.scratch = new char[len];
+		if (!f->mmap.scratch)
+			throw MemoryAllocationError();
+
+		f->mmap.scratch_len = len;
+	}
+
+	memcpy(f->mmap.scratch, f->mmap.base + off, len);
+
+	return f->formatter->sscan(f->mmap.scratch, len, rbytes, smp);
+}
+
+static void file_index_push(struct file *f, const struct file_index_entry *e)
+{
+	if (f->mmap.index_cnt == f->mmap.index_cap) {
+		f->mmap.index_cap = f->mmap.index_cap ? 2 * f->mmap.index_cap : 1024;
+		f->mmap.index = (struct file_index_entry *) realloc(f->mmap.index, f->mmap.index_cap * sizeof(struct file_index_entry));
+		if (!f->mmap.index)
+			throw MemoryAllocationError();
+	}
+
+	f->mmap.index[f->mmap.index_cnt++] = *e;
+}
+
+/** Index all complete records between file::mmap::indexed_len and the end of the mapping. */
+static void file_index_extend(struct vnode *n)
+{
+	struct file *f = (struct file *) n->_vd;
+	struct sample *smp = sample_alloc_mem(MAX(vlist_length(&n->in.signals), 64));
+	size_t guess = 64;
+	int ret;
+
+	while (f->mmap.indexed_len < f->mmap.len) {
+		size_t rbytes = 0;
+		size_t avail = f->mmap.len - f->mmap.indexed_len;
+		size_t len = MIN(guess, avail);
+
+		ret = file_mmap_parse(f, f->mmap.indexed_len, len, smp, &rbytes);
+		if (ret != 1 || rbytes == 0) {
+			/* The record might just be longer than our guess */
+			if (len < avail && len < FILE_MMAP_RECORD_MAX) {
+				guess = 2 * len;
+				continue;
+			}
+
+			n->logger->warn("Stopped indexing at incomplete or invalid record at offset {}", f->mmap.indexed_len);
+			break;
+		}
+
+		struct file_index_entry e = {
+			.offset = f->mmap.indexed_len,
+			.length = (uint32_t) rbytes,
+			.flags = (uint32_t) smp->flags,
+			.sequence = smp->sequence,
+			.ts_sec = smp->ts.origin.tv_sec,
+			.ts_nsec = smp->ts.origin.tv_nsec
+		};
+
+		file_index_push(f, &e);
+
+		f->mmap.indexed_len += rbytes;
+		f->mmap.index_dirty = true;
+
+		/* Records usually have a constant length */
+		guess = rbytes;
+	}
+
+	sample_free(smp);
+}
+
+static char * file_index_path(struct file *f)
+{
+	return strf("%s%s", f->uri, FILE_INDEX_SUFFIX);
+}
+
+static int file_index_load(struct vnode *n, const struct stat *st)
+{
+	struct file *f = (struct file *) n->_vd;
+	struct file_index_header hdr;
+	size_t rbytes;
+	int ret;
+
+	char *path = file_index_path(f);
+	FILE *fi = fopen(path, "r");
+	free(path);
+
+	if (!fi)
+		return -1;
+
+	if (fread(&hdr, sizeof(hdr), 1, fi) != 1)
+		goto invalid;
+
+	if (memcmp(hdr.magic, FILE_INDEX_MAGIC, sizeof(hdr.magic)) ||
+	    hdr.version != FILE_INDEX_VERSION ||
+	    hdr.entry_size != sizeof(struct file_index_entry) ||
+	    hdr.data_len > (uint64_t) st->st_size)
+		goto invalid;
+
+	/* An unchanged recording must still have the same modification time.
+	 * A grown recording is accepted as long as the last indexed record is still valid. */
+	if (hdr.data_len == (uint64_t) st->st_size && hdr.data_mtime != st->st_mtime)
+		goto invalid;
+
+	f->mmap.index_cap = MAX(hdr.count, 1);
+	f->mmap.index = (struct file_index_entry *) realloc(f->mmap.index, f->mmap.index_cap * sizeof(struct file_index_entry));
+	if (!f->mmap.index)
+		throw MemoryAllocationError();
+
+	if (fread(f->mmap.index, sizeof(struct file_index_entry), hdr.count, fi) != hdr.count)
+		goto invalid;
+
+	if (hdr.count > 0) {
+		struct file_index_entry *last = &f->mmap.index[hdr.count - 1];
+		struct sample *smp = sample_alloc_mem(MAX(vlist_length(&n->in.signals), 64));
+
+		ret = last->offset + last->length <= hdr.data_len
+			? file_mmap_parse(f, last->offset, last->length, smp, &rbytes)
+			: -1;
+
+		bool valid = ret == 1 && rbytes == last->length && smp->sequence == last->sequence;
+
+		sample_free(smp);
+
+		if (!valid)
+			goto invalid;
+	}
+
+	fclose(fi);
+
+	f->mmap.index_cnt = hdr.count;
+	f->mmap.indexed_len = hdr.data_len;
+	f->mmap.index_dirty = false;
+
+	return 0;
+
+invalid:
+	n->logger->warn("Ignoring outdated or invalid index for {}", f->uri);
+
+	fclose(fi);
+
+	f->mmap.index_cnt = 0;
+	f->mmap.indexed_len = 0;
+
+	return -1;
+}
+
+static void file_index_save(struct vnode *n)
+{
+	struct file *f = (struct file *) n->_vd;
+	struct file_index_header hdr;
+	struct stat st;
+	int ret;
+
+	ret = fstat(f->mmap.fd, &st);
+	if (ret)
+		throw SystemError("Failed to stat file {}", f->uri);
+
+	memcpy(hdr.magic, FILE_INDEX_MAGIC, sizeof(hdr.magic));
+	hdr.version = FILE_INDEX_VERSION;
+	hdr.entry_size = sizeof(struct file_index_entry);
+	hdr.data_len = f->mmap.indexed_len;
+	hdr.data_mtime = st.st_mtime;
+	hdr.count = f->mmap.index_cnt;
+
+	char *path = file_index_path(f);
+	FILE *fi = fopen(path, "w");
+	if (!fi) {
+		/* The index is only a cache. Recordings might be on read-only storage. */
+		n->logger->warn("Failed to save index to {}: {}", path, strerror(errno));
+		free(path);
+		return;
+	}
+
+	if (fwrite(&hdr, sizeof(hdr), 1, fi) != 1 ||
+	    fwrite(f->mmap.index, sizeof(struct file_index_entry), f->mmap.index_cnt, fi) != f->mmap.index_cnt)
+		n->logger->warn("Failed to save index to {}", path);
+	else
+		f->mmap.index_dirty = false;
+
+	fclose(fi);
+	free(path);
+}
+
+/** (Re-)map the file if it has grown since the last call. */
+static void file_mmap_map(struct vnode *n)
+{
+	struct file *f = (struct file *) n->_vd;
+	struct stat st;
+	int ret;
+
+	ret = fstat(f->mmap.fd, &st);
+	if (ret)
+		throw SystemError("Failed to stat file {}", f->uri);
+
+	if ((size_t) st.st_size <= f->mmap.len)
+		return;
+
+	if (f->mmap.base)
+		munmap(f->mmap.base, f->mmap.len);
+
+	f->mmap.len = st.st_size;
+	f->mmap.base = (char *) mmap(nullptr, f->mmap.len, PROT_READ, MAP_SHARED, f->mmap.fd, 0);
+	if (f->mmap.base == MAP_FAILED) {
+		f->mmap.base = nullptr;
+		f->mmap.len = 0;
+
+		throw SystemError("Failed to map file {}", f->uri);
+	}
+
+	madvise(f->mmap.base, f->mmap.len, MADV_SEQUENTIAL);
+}
+
+/** Index all records which have been appended to the file since the last call. */
+static void file_mmap_update(struct vnode *n)
+{
+	file_mmap_map(n);
+	file_index_extend(n);
+}
+
+static void file_mmap_open(struct vnode *n)
+{
+	struct file *f = (struct file *) n->_vd;
+	struct timespec start = time_now(), end;
+	struct stat st;
+	int ret;
+
+	f->mmap.fd = open(f->uri, O_RDONLY);
+	if (f->mmap.fd < 0)
+		throw SystemError("Failed to open file {}", f->uri);
+
+	ret = fstat(f->mmap.fd, &st);
+	if (ret)
+		throw SystemError("Failed to stat file {}", f->uri);
+
+	f->mmap.base = nullptr;
+	f->mmap.len = 0;
+	f->mmap.index_cnt = 0;
+	f->mmap.indexed_len = 0;
+	f->mmap.index_dirty = false;
+
+	file_mmap_map(n);
+
+	/* A valid index from a previous run saves us from parsing the whole file */
+	ret = st.st_size > 0
+		? file_index_load(n, &st)
+		: -1;
+	if (ret)
+		n->logger->info("Building index for {}", f->uri);
+
+	file_index_extend(n);
+
+	if (f->mmap.index_dirty) {
+		end = time_now();
+
+		n->logger->info("Indexed {} samples in {:.3f} sec", f->mmap.index_cnt, time_delta(&start, &end));
+
+		file_index_save(n);
+	}
+
+	f->mmap.pos = 0;
+	f->mmap.prefetched = 0;
+}
+
+static void file_mmap_close(struct vnode *n)
+{
+	struct file *f = (struct file *) n->_vd;
+
+	if (f->mmap.index_dirty)
+		file_index_save(n);
+
+	if (f->mmap.base)
+		munmap(f->mmap.base, f->mmap.len);
+
+	close(f->mmap.fd);
+
+	free(f->mmap.index);
+	delete[] f->mmap.scratch;
+
+	f->mmap.base = nullptr;
+	f->mmap.index = nullptr;
+	f->mmap.index_cap = 0;
+	f->mmap.scratch = nullptr;
+	f->mmap.scratch_len = 0;
+}
+
+static int file_mmap_read(struct file *f, struct sample * const smps[], unsigned cnt)
+{
+	struct file_index_entry *e;
+	size_t rbytes;
+
+	if (f->mmap.pos >= f->mmap.index_cnt)
+		return 0;
+
+	e = &f->mmap.index[f->mmap.pos++];
+
+	/* Ask the kernel to fetch the following pages before we need them */
+	if (f->mmap.readahead && e->offset + f->mmap.readahead > f->mmap.prefetched) {
+		size_t pagesize = sysconf(_SC_PAGESIZE);
+		size_t from = MAX(f->mmap.prefetched, e->offset) & ~(pagesize - 1);
+		size_t to = MIN(e->offset + 2 * f->mmap.readahead, f->mmap.len);
+
+		if (to > from)
+			madvise(f->mmap.base + from, to - from, MADV_WILLNEED);
+
+		f->mmap.prefetched = to;
+	}
+
+	return file_mmap_parse(f, e->offset, e->length, smps[0], &rbytes);
+}
+
+static void file_mmap_rewind(struct file *f)
+{
+	f->mmap.pos = f->mmap.first;
+	f->mmap.prefetched = 0;
+}
+
+/** Create the parent directory of \p uri if it does not exist yet. */
+static int file_mkdir(const char *uri)
+{
+	int ret;
+	struct stat sb;
+	char *cpy = strdup(uri);
+	char *dir = dirname(cpy);
+
+	ret = stat(dir, &sb);
+	if (ret) {
+		if (errno == ENOENT || errno == ENOTDIR)
+			ret = mkdir(dir, 0644);
+		else if (errno == EISDIR)
+			ret = 0;
+	}
+	else if (!S_ISDIR(sb.st_mode))
+		ret = mkdir(dir, 0644);
+
+	free(cpy);
+
+	return ret;
+}
+
+/** Called by the output stream of the asynchronous writer. */
+static ssize_t file_async_append(void *cookie, const char *buf, size_t len)
+{
+	struct file *f = (struct file *) cookie;
+	struct file_async_buffer *b = f->async.active;
+
+	/* The partial record is removed by file_write() */
+	if (f->async.overflow || b->len + len > f->async.buffer_size) {
+		f->async.overflow = true;
+		return len;
+	}
+
+	memcpy(b->data + b->len, buf, len);
+	b->len += len;
+
+	return len;
+}
+
+/** Complete and close the current output file. */
+static void file_async_close(struct vnode *n)
+{
+	struct file *f = (struct file *) n->_vd;
+
+	if (f->async.fd < 0)
+		return;
+
+	if (f->compression != FileCompression::NONE)
+		file_compressor_write(&f->async.compressor, f->async.fd, nullptr, 0, true);
+
+	if (f->async.fsync != file::FsyncPolicy::NEVER)
+		fdatasync(f->async.fd);
+
+	close(f->async.fd);
+
+	f->async.fd = -1;
+}
+
+/** Open a new output file. */
+static int file_async_open(struct vnode *n, const struct timespec *now)
+{
+	struct file *f = (struct file *) n->_vd;
+	struct stat st;
+	int ret;
+
+	if (f->async.uri)
+		f->async.rotations++;
+
+	delete[] f->async.uri;
+	f->async.uri = file_format_name(f->uri_tmpl, (struct timespec *) now);
+
+	ret = file_mkdir(f->async.uri);
+	if (ret) {
+		n->logger->error("Failed to create directory for {}: {}", f->async.uri, strerror(errno));
+		return ret;
+	}
+
+	f->async.fd = open(f->async.uri, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if (f->async.fd < 0) {
+		n->logger->error("Failed to open {}: {}", f->async.uri, strerror(errno));
+		return -1;
+	}
+
+	/* We might append to an existing file */
+	ret = fstat(f->async.fd, &st);
+	f->async.file_bytes = ret ? 0 : st.st_size;
+
+	/* Rotations happen at multiples of the interval */
+	if (f->async.rotate_interval)
+		f->async.rotate_next = (floor(time_to_double(now) / f->async.rotate_interval) + 1) * f->async.rotate_interval;
+
+	n->logger->debug("Writing to {}", f->async.uri);
+
+	return 0;
+}
+
+/** Write the contents of \p b to the current output file. */
+static void file_async_flush(struct vnode *n, struct file_async_buffer *b)
+{
+	struct file *f = (struct file *) n->_vd;
+	struct timespec start, end;
+	size_t off = 0, written;
+	int ret;
+
+	if (b->len == 0)
+		return;
+
+	start = time_now();
+
+	/* The previous file has been closed by a rotation */
+	if (f->async.fd < 0) {
+		ret = file_async_open(n, &start);
+		if (ret) {
+			f->async.lost += b->len;
+			b->len = 0;
+			return;
+		}
+	}
+
+	if (f->compression != FileCompression::NONE && f->async.fd >= 0) {
+		ssize_t ret = file_compressor_write(&f->async.compressor, f->async.fd, b->data, b->len, false);
+		if (ret < 0)
+			n->logger->error("Failed to write to {}: {}", f->async.uri, strerror(errno));
+
+		written = ret < 0 ? 0 : ret;
+	}
+	else {
+		while (f->async.fd >= 0 && off < b->len) {
+			ssize_t ret = write(f->async.fd, b->data + off, b->len - off);
+			if (ret < 0) {
+				if (errno == EINTR)
+					continue;
+
+				n->logger->error("Failed to write to {}: {}", f->async.uri, strerror(errno));
+				break;
+			}
+
+			off += ret;
+		}
+
+		written = off;
+	}
+
+	if (f->async.fsync == file::FsyncPolicy::FLUSH && f->async.fd >= 0)
+		fdatasync(f->async.fd);
+
+	end = time_now();
+
+	f->async.file_bytes += written;
+	f->async.bytes_written += written;
+
+	if (n->stats) {
+		n->stats->update(Stats::Metric::FILE_FLUSH_BYTES, written);
+		n->stats->update(Stats::Metric::FILE_FLUSH_LATENCY, time_delta(&start, &end));
+	}
+
+	b->len = 0;
+}
+
+/** Check if the current file should be closed after the active buffer has been written. */
+static bool file_async_rotate_due(struct vnode *n)
+{
+	struct file *f = (struct file *) n->_vd;
+	struct timespec now = time_now();
+
+	/* Empty files are kept until samples arrive */
+	if (f->async.fd < 0 || f->async.file_bytes + f->async.active->len == 0)
+		return false;
+
+	return (f->async.rotate_size && f->async.file_bytes + f->async.active->len >= f->async.rotate_size) ||
+	       (f->async.rotate_interval && time_to_double(&now) >= f->async.rotate_next);
+}
+
+static void * file_async_writer(void *ctx)
+{
+	struct vnode *n = (struct vnode *) ctx;
+	struct file *f = (struct file *) n->_vd;
+	bool stop, rotate;
+	int ret;
+
+	pthread_mutex_lock(&f->async.mutex);
+
+	do {
+		if (!f->async.pending && !f->async.stop) {
+			struct timespec now = time_now();
+			struct timespec interval = time_from_double(f->async.flush_interval);
+			struct timespec deadline = time_add(&now, &interval);
+
+			pthread_cond_timedwait(&f->async.cond, &f->async.mutex, &deadline);
+		}
+
+		stop = f->async.stop;
+
+		/* Files are split between buffers. The formatter appends its trailer to the
+		 * current file and prints a new header before the following samples. */
+		rotate = !stop && file_async_rotate_due(n);
+		if (rotate) {
+			ret = f->formatter->finish(f->stream_out);
+			if (ret || f->async.overflow)
+				n->logger->warn("Failed to complete output file {}", f->async.uri);
+
+			f->async.overflow = false;
+		}
+
+		/* The spare buffer is always empty here */
+		std::swap(f->async.active, f->async.spare);
+
+		f->async.pending = false;
+
+		pthread_mutex_unlock(&f->async.mutex);
+
+		file_async_flush(n, f->async.spare);
+
+		if (rotate)
+			file_async_close(n);
+
+		pthread_mutex_lock(&f->async.mutex);
+	} while (!stop);
+
+	pthread_mutex_unlock(&f->async.mutex);
+
+	return nullptr;
+}
+
+static void file_async_start(struct vnode *n, const struct timespec *now)
+{
+	struct file *f = (struct file *) n->_vd;
+	int ret;
+
+	cookie_io_functions_t funcs = {
+		.read = nullptr,
+		.write = file_async_append,
+		.seek = nullptr,
+		.close = nullptr
+	};
+
+	for (unsigned i = 0; i < ARRAY_LEN(f->async.buffers); i++) {
+		struct file_async_buffer *b = &f->async.buffers[i];
+
+		b->data = new char[f->async.buffer_size];
+		if (!b->data)
+			throw MemoryAllocationError();
+
+		/* Avoid page faults in file_write() */
+		memset(b->data, 0, f->async.buffer_size);
+
+		b->len = 0;
+	}
+
+	f->async.active = &f->async.buffers[0];
+	f->async.spare = &f->async.buffers[1];
+	f->async.pending = false;
+	f->async.overflow = false;
+	f->async.stop = false;
+	f->async.fd = -1;
+	f->async.bytes_written = 0;
+	f->async.rotations = 0;
+	f->async.dropped = 0;
+	f->async.lost = 0;
+
+	if (f->compression != FileCompression::NONE) {
+		ret = file_compressor_init(&f->async.compressor, f->compression, f->compression_level);
+		if (ret)
+			throw RuntimeError("Failed to initialize {} compression", file_compression_name(f->compression));
+	}
+
+	/* Open the first file synchronously so that it can be read by file::stream_in */
+	ret = file_async_open(n, now);
+	if (ret)
+		throw SystemError("Failed to open file");
+
+	/* Formatted samples are appended to the active buffer */
+	f->stream_out = fopencookie(f, "w", funcs);
+	if (!f->stream_out)
+		throw SystemError("Failed to open output stream");
+
+	setvbuf(f->stream_out, nullptr, _IONBF, 0);
+
+	ret = pthread_mutex_init(&f->async.mutex, nullptr);
+	if (ret)
+		throw SystemError("Failed to initialize mutex");
+
+	ret = pthread_cond_init(&f->async.cond, nullptr);
+	if (ret)
+		throw SystemError("Failed to initialize condition variable");
+
+	ret = pthread_create(&f->async.thread, nullptr, file_async_writer, n);
+	if (ret)
+		throw SystemError("Failed to create writer thread");
+}
+
+static void file_async_stop(struct vnode *n)
+{
+	struct file *f = (struct file *) n->_vd;
+	int ret;
+
+	pthread_mutex_lock(&f->async.mutex);
+
+	/* Write buffered samples and trailers of the format */
+	ret = f->formatter->finish(f->stream_out);
+	if (ret || f->async.overflow)
+		n->logger->warn("Failed to complete output file");
+
+	f->async.stop = true;
+	pthread_cond_signal(&f->async.cond);
+	pthread_mutex_unlock(&f->async.mutex);
+
+	/* The writer thread flushes the remaining data before terminating */
+	pthread_join(f->async.thread, nullptr);
+
+	file_async_close(n);
+
+	if (f->compression != FileCompression::NONE) {
+		ret = file_compressor_destroy(&f->async.compressor);
+		if (ret)
+			n->logger->warn("Failed to destroy compressor");
+	}
+
+	if (f->async.dropped)
+		n->logger->warn("Dropped {} samples as the writer could not keep up", f->async.dropped);
+
+	if (f->async.lost)
+		n->logger->warn("Discarded {} bytes as no output file could be opened", f->async.lost);
+
+	n->logger->info("Written {} bytes to {} files", f->async.bytes_written, f->async.rotations + 1);
+
+	for (unsigned i = 0; i < ARRAY_LEN(f->async.buffers); i++)
+		delete[] f->async.buffers[i].data;
+
+	delete[] f->async.uri;
+	f->async.uri = nullptr;
+
+	pthread_cond_destroy(&f->async.cond);
+	pthread_mutex_destroy(&f->async.mutex);
+}
+
+int file_seek(struct vnode *n, const struct timespec *ts)
+{
+	struct file *f = (struct file *) n->_vd;
+	size_t lo = 0, hi;
+
+	if (!f->mmap.enabled)
+		return -1;
+
+	/* Binary search for the first entry with a timestamp not earlier than ts */
+	hi = f->mmap.index_cnt;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		struct file_index_entry *e = &f->mmap.index[mid];
+
+		if (e->ts_sec < ts->tv_sec || (e->ts_sec == ts->tv_sec && e->ts_nsec < ts->tv_nsec))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	f->mmap.pos = lo;
+	f->mmap.prefetched = 0;
+
+	return 0;
+}
+
+/** Skip to the start of the replay via the index of a columnar recording. */
+static void file_columnar_seek(struct vnode *n)
+{
+	struct file *f = (struct file *) n->_vd;
+	auto *cf = dynamic_cast<ColumnarFormat *>(f->formatter);
+	struct timespec first = f->first;
+	int ret;
+
+	ret = cf->seek(f->stream_in, f->mmap.seek, &first);
+	if (ret)
+		throw RuntimeError("Failed to seek in '{}': the recording has no index", f->uri);
+
+	if (f->epoch_mode != file::EpochMode::ORIGINAL) {
+		f->first = first;
+		f->offset = file_calc_offset(&f->first, &f->epoch, f->epoch_mode);
+	}
+}
+
 int file_parse(struct vnode *n, json_t *json)
 {
 	struct file *f = (struct file *) n->_vd;
@@ -93,10 +804,17 @@ int file_parse(struct vnode *n, json_t *json)
 	const char *eof = nullptr;
 	const char *epoch = nullptr;
 	double epoch_flt = 0;
+	json_int_t readahead = -1;
+	json_int_t rotate_size = 0;
+	const char *fsync = nullptr;
+	const char *compression = nullptr;
+	json_t *json_compression_level = nullptr;
 
-	ret = json_unpack_ex(json, &err, 0, "{ s: s, s?: o, s?: { s?: s, s?: F, s?: s, s?: F, s?: i, s?: i }, s?: { s?: b, s?: i } }",
+	ret = json_unpack_ex(json, &err, 0, "{ s: s, s?: o, s?: s, s?: o, s?: { s?: s, s?: F, s?: s, s?: F, s?: i, s?: i, s?: b, s?: F, s?: I }, s?: { s?: b, s?: i, s?: b, s?: F, s?: s, s?: I, s?: F } }",
 		"uri", &uri_tmpl,
 		"format", &json_format,
+		"compression", &compression,
+		"compression_level", &json_compression_level,
 		"in",
 			"eof", &eof,
 			"rate", &f->rate,
@@ -104,9 +822,17 @@ int file_parse(struct vnode *n, json_t *json)
 			"epoch", &epoch_flt,
 			"buffer_size", &f->buffer_size_in,
 			"skip", &f->skip_lines,
+			"mmap", &f->mmap.enabled,
+			"seek", &f->mmap.seek,
+			"readahead", &readahead,
 		"out",
 			"flush", &f->flush,
-			"buffer_size", &f->buffer_size_out
+			"buffer_size", &f->buffer_size_out,
+			"async", &f->async.enabled,
+			"flush_interval", &f->async.flush_interval,
+			"fsync", &fsync,
+			"rotate_size", &rotate_size,
+			"rotate_interval", &f->async.rotate_interval
 	);
 	if (ret)
 		throw ConfigError(json, err, "node-config-node-file");
@@ -121,6 +847,80 @@ int file_parse(struct vnode *n, json_t *json)
 	if (!f->formatter)
 		throw ConfigError(json_format, "node-config-node-file-format", "Invalid format configuration");
 
+	if (readahead >= 0)
+		f->mmap.readahead = readahead;
+
+	/* Only the VILLAS binary formats (villas.binary, villas.web) are self-delimiting and can be indexed */
+	if (f->mmap.enabled && !dynamic_cast<VillasBinaryFormat *>(f->formatter))
+		throw ConfigError(json, "node-config-node-file-mmap", "Indexed replay via 'in.mmap' requires the 'villas.binary' or 'villas.web' format");
+
+	/* Columnar recordings are seeked via the index at their end */
+	if (!f->mmap.enabled && f->mmap.seek && !dynamic_cast<ColumnarFormat *>(f->formatter))
+		throw ConfigError(json, "node-config-node-file-seek", "Setting 'in.seek' requires 'in.mmap' or the 'villas.columnar' format");
+
+	/* Compression */
+	if (compression) {
+		ret = file_compression_lookup(compression, &f->compression);
+		if (ret)
+			throw ConfigError(json, "node-config-node-file-compression", "Invalid value '{}' for setting 'compression'", compression);
+	}
+	else
+		f->compression = file_compression_detect(f->uri_tmpl);
+
+	if (!file_compression_available(f->compression))
+		throw ConfigError(json, "node-config-node-file-compression", "VILLASnode has been built without support for {} compression", file_compression_name(f->compression));
+
+	if (json_compression_level) {
+		if (!json_is_integer(json_compression_level))
+			throw ConfigError(json_compression_level, "node-config-node-file-compression", "Setting 'compression_level' must be an integer");
+
+		f->compression_level = json_integer_value(json_compression_level);
+	}
+	else
+		f->compression_level = file_compression_default_level(f->compression);
+
+	if (f->compression != FileCompression::NONE) {
+		if (f->mmap.enabled)
+			throw ConfigError(json, "node-config-node-file-mmap", "Indexed replay via 'in.mmap' does not support compressed files");
+
+		if (f->mmap.seek)
+			throw ConfigError(json, "node-config-node-file-seek", "Setting 'in.seek' does not support compressed files");
+
+		/* Compression runs in the writer thread */
+		f->async.enabled = 1;
+	}
+
+	if (!f->async.enabled && (fsync || rotate_size || f->async.rotate_interval))
+		throw ConfigError(json, "node-config-node-file-async", "Settings 'out.fsync', 'out.rotate_size' and 'out.rotate_interval' require 'out.async'");
+
+	if (f->async.enabled) {
+		if (f->buffer_size_out)
+			f->async.buffer_size = f->buffer_size_out;
+
+		if (f->async.flush_interval <= 0)
+			throw ConfigError(json, "node-config-node-file-flush-interval", "Setting 'out.flush_interval' must be positive");
+
+		if (rotate_size < 0 || f->async.rotate_interval < 0)
+			throw ConfigError(json, "node-config-node-file-rotate", "Rotation settings must not be negative");
+
+		f->async.rotate_size = rotate_size;
+
+		/* Without conversions all rotated files would get the same name */
+		if ((f->async.rotate_size || f->async.rotate_interval) && !strchr(f->uri_tmpl, '%'))
+			throw ConfigError(json, "node-config-node-file-rotate", "Rotation requires a 'uri' with strftime(3) format tokens");
+	}
+
+	if (fsync) {
+		if      (!strcmp(fsync, "never"))
+			f->async.fsync = file::FsyncPolicy::NEVER;
+		else if (!strcmp(fsync, "flush"))
+			f->async.fsync = file::FsyncPolicy::FLUSH;
+		else if (!strcmp(fsync, "rotate"))
+			f->async.fsync = file::FsyncPolicy::ROTATE;
+		else
+			throw ConfigError(json, "node-config-node-file-fsync", "Invalid value '{}' for setting 'out.fsync'", fsync);
+	}
+
 	if (eof) {
 		if      (!strcmp(eof, "exit") || !strcmp(eof, "stop"))
 			f->eof_mode = file::EOFBehaviour::STOP;
@@ -216,6 +1016,27 @@ char * file_print(struct vnode *n)
 	if (f->rate)
 		strcatf(&buf, ", in.rate=%.1f", f->rate);
 
+	if (f->mmap.enabled) {
+		strcatf(&buf, ", in.mmap=yes, in.seek=%.2f, in.readahead=%zu", f->mmap.seek, f->mmap.readahead);
+
+		if (f->mmap.index)
+			strcatf(&buf, ", in.indexed=%zu, in.pos=%zu", f->mmap.index_cnt, f->mmap.pos);
+	}
+
+	if (f->compression != FileCompression::NONE)
+		strcatf(&buf, ", compression=%s, compression_level=%d", file_compression_name(f->compression), f->compression_level);
+
+	if (f->async.enabled) {
+		strcatf(&buf, ", out.async=yes, out.buffer_size=%zu, out.flush_interval=%.2f",
+			f->async.buffer_size, f->async.flush_interval);
+
+		if (f->async.rotate_size)
+			strcatf(&buf, ", out.rotate_size=%zu", f->async.rotate_size);
+
+		if (f->async.rotate_interval)
+			strcatf(&buf, ", out.rotate_interval=%.2f", f->async.rotate_interval);
+	}
+
 	if (f->first.tv_sec || f->first.tv_nsec)
 		strcatf(&buf, ", first=%.2f", time_to_double(&f->first));
 
@@ -247,38 +1068,33 @@ int file_start(struct vnode *n)
 	f->uri = file_format_name(f->uri_tmpl, &now);
 
 	/* Check if directory exists */
-	struct stat sb;
-	char *cpy = strdup(f->uri);
-	char *dir = dirname(cpy);
-
-	ret = stat(dir, &sb);
-	if (ret) {
-		if (errno == ENOENT || errno == ENOTDIR) {
-			ret = mkdir(dir, 0644);
-			if (ret)
-				throw SystemError("Failed to create directory");
-		}
-		else if (errno != EISDIR)
-			throw SystemError("Failed to stat");
-	}
-	else if (!S_ISDIR(sb.st_mode)) {
-		ret = mkdir(dir, 0644);
-		if (ret)
-			throw SystemError("Failed to create directory");
-	}
-
-	free(cpy);
+	ret = file_mkdir(f->uri);
+	if (ret)
+		throw SystemError("Failed to create directory");
 
 	f->formatter->start(&n->in.signals);
 
 	/* Open file */
-	f->stream_out = fopen(f->uri, "a+");
-	if (!f->stream_out)
-		return -1;
+	if (f->async.enabled)
+		file_async_start(n, &now);
+	else {
+		f->stream_out = fopen(f->uri, "a+");
+		if (!f->stream_out)
+			return -1;
+	}
 
-	f->stream_in = fopen(f->uri, "r");
-	if (!f->stream_in)
-		return -1;
+	if (f->compression != FileCompression::NONE) {
+		f->decompressor = file_decompressor_open(f->uri, f->compression);
+		if (!f->decompressor)
+			return -1;
+
+		f->stream_in = f->decompressor->stream;
+	}
+	else {
+		f->stream_in = fopen(f->uri, "r");
+		if (!f->stream_in)
+			return -1;
+	}
 
 	if (f->buffer_size_in) {
 		ret = setvbuf(f->stream_in, nullptr, _IOFBF, f->buffer_size_in);
@@ -286,7 +1102,7 @@ int file_start(struct vnode *n)
 			return ret;
 	}
 
-	if (f->buffer_size_out) {
+	if (f->buffer_size_out && !f->async.enabled) {
 		ret = setvbuf(f->stream_out, nullptr, _IOFBF, f->buffer_size_out);
 		if (ret)
 			return ret;
@@ -295,6 +1111,41 @@ int file_start(struct vnode *n)
 	/* Create timer */
 	f->task.setRate(f->rate);
 
+	if (f->mmap.enabled) {
+		file_mmap_open(n);
+
+		if (f->mmap.index_cnt == 0)
+			n->logger->warn("Empty file");
+		else {
+			struct file_index_entry *e = &f->mmap.index[0];
+
+			if (f->mmap.seek) {
+				struct timespec target = {
+					.tv_sec = e->ts_sec,
+					.tv_nsec = e->ts_nsec
+				};
+				struct timespec delta = time_from_double(f->mmap.seek);
+
+				target = time_add(&target, &delta);
+
+				file_seek(n, &target);
+			}
+
+			f->mmap.pos = MIN(f->mmap.pos + f->skip_lines, f->mmap.index_cnt);
+			f->mmap.first = f->mmap.pos;
+
+			if (f->mmap.pos < f->mmap.index_cnt) {
+				e = &f->mmap.index[f->mmap.pos];
+
+				f->first.tv_sec = e->ts_sec;
+				f->first.tv_nsec = e->ts_nsec;
+				f->offset = file_calc_offset(&f->first, &f->epoch, f->epoch_mode);
+			}
+		}
+
+		return 0;
+	}
+
 	/* Get timestamp of first line */
 	if (f->epoch_mode != file::EpochMode::ORIGINAL) {
 		rewind(f->stream_in);
@@ -319,6 +1170,9 @@ int file_start(struct vnode *n)
 
 	rewind(f->stream_in);
 
+	if (f->mmap.seek)
+		file_columnar_seek(n);
+
 	/* Fast-forward */
 	struct sample *smp = sample_alloc_mem(vlist_length(&n->in.signals));
 	for (unsigned i = 0; i < f->skip_lines; i++)
@@ -331,13 +1185,30 @@ int file_start(struct vnode *n)
 
 int file_stop(struct vnode *n)
 {
+	int ret;
 	struct file *f = (struct file *) n->_vd;
 
 	f->task.stop();
 
+	if (f->mmap.enabled)
+		file_mmap_close(n);
+
+	/* The writer thread must not use the output stream anymore when it is closed */
+	if (f->async.enabled)
+		file_async_stop(n);
+	else {
+		/* Write buffered samples and trailers of the format */
+		ret = f->formatter->finish(f->stream_out);
+		if (ret)
+			n->logger->warn("Failed to complete output file");
+	}
+
+	/* Also releases the decompressor */
 	fclose(f->stream_in);
 	fclose(f->stream_out);
 
+	f->decompressor = nullptr;
+
 	delete f->formatter;
 	delete f->uri;
 
@@ -352,15 +1223,27 @@ int file_read(struct vnode *n, struct sample * const smps[], unsigned cnt)
 
 	assert(cnt == 1);
 
-retry:	ret = f->formatter->scan(f->stream_in, smps, cnt);
+retry:	ret = f->mmap.enabled
+		? file_mmap_read(f, smps, cnt)
+		: f->formatter->scan(f->stream_in, smps, cnt);
 	if (ret <= 0) {
-		if (feof(f->stream_in)) {
+		bool eof = f->mmap.enabled
+			? f->mmap.pos >= f->mmap.index_cnt
+			: feof(f->stream_in);
+
+		if (eof) {
 			switch (f->eof_mode) {
 				case file::EOFBehaviour::REWIND:
 					n->logger->info("Rewind input file");
 
 					f->offset = file_calc_offset(&f->first, &f->epoch, f->epoch_mode);
-					rewind(f->stream_in);
+
+					if (f->mmap.enabled)
+						file_mmap_rewind(f);
+					else if (f->mmap.seek)
+						file_columnar_seek(n);
+					else
+						rewind(f->stream_in);
 					goto retry;
 
 				case file::EOFBehaviour::SUSPEND:
@@ -368,7 +1251,10 @@ retry:	ret = f->formatter->scan(f->stream_in, smps, cnt);
 					usleep(100000);
 
 					/* Try to download more data if this is a remote file. */
-					clearerr(f->stream_in);
+					if (f->mmap.enabled)
+						file_mmap_update(n);
+					else
+						clearerr(f->stream_in);
 					goto retry;
 
 				case file::EOFBehaviour::STOP:
@@ -419,6 +1305,35 @@ int file_write(struct vnode *n, struct sample * const smps[], unsigned cnt)
 
 	assert(cnt == 1);
 
+	if (f->async.enabled) {
+		pthread_mutex_lock(&f->async.mutex);
+
+		size_t mark = f->async.active->len;
+
+		ret = f->formatter->print(f->stream_out, smps, cnt);
+
+		/* Drop the samples rather than blocking until the writer thread caught up */
+		if (f->async.overflow) {
+			f->async.active->len = mark;
+			f->async.overflow = false;
+
+			if (f->async.dropped == 0)
+				n->logger->warn("Dropping samples as the writer thread can not keep up");
+
+			f->async.dropped += cnt;
+		}
+
+		/* Wake up the writer early to leave enough room for the next samples */
+		if (!f->async.pending && (f->flush || f->async.active->len > f->async.buffer_size / 2)) {
+			f->async.pending = true;
+			pthread_cond_signal(&f->async.cond);
+		}
+
+		pthread_mutex_unlock(&f->async.mutex);
+
+		return ret < 0 ? ret : cnt;
+	}
+
 	ret = f->formatter->print(f->stream_out, smps, cnt);
 	if (ret < 0)
 		return ret;
@@ -439,7 +1354,9 @@ int file_poll_fds(struct vnode *n, int fds[])
 		return 1;
 	}
 	else if (f->epoch_mode == file::EpochMode::ORIGINAL) {
-		fds[0] = fileno(f->stream_in);
+		fds[0] = f->decompressor
+			? f->decompressor->fd
+			: fileno(f->stream_in);
 
 		return 1;
 	}
@@ -461,6 +1378,25 @@ int file_init(struct vnode *n)
 	f->buffer_size_in = 0;
 	f->buffer_size_out = 0;
 	f->skip_lines = 0;
+	f->compression = FileCompression::NONE;
+	f->compression_level = 0;
+	f->decompressor = nullptr;
+
+	f->mmap.enabled = 0;
+	f->mmap.seek = 0;
+	f->mmap.readahead = FILE_MMAP_READAHEAD;
+	f->mmap.index = nullptr;
+	f->mmap.index_cap = 0;
+	f->mmap.scratch = nullptr;
+	f->mmap.scratch_len = 0;
+
+	f->async.enabled = 0;
+	f->async.buffer_size = FILE_ASYNC_BUFFER_SIZE;
+	f->async.flush_interval = FILE_ASYNC_FLUSH_INTERVAL;
+	f->async.fsync = file::FsyncPolicy::NEVER;
+	f->async.rotate_size = 0;
+	f->async.rotate_interval = 0;
+	f->async.uri = nullptr;
 
 	return 0;
 }
@@ -0,0 +1,531 @@
+/** Streaming compression for the file node-type.
+ *
+ * @author Steffen Vogel <stvogel@eonerc.rwth-aachen.de>
+ * @copyright 2014-2020, Institute for Automation of Complex Power Systems, EONERC
+ * @license GNU General Public License (version 3)
+ *
+ * VILLASnode
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *********************************************************************************/
+
+#include <cstring>
+#include <cerrno>
+
+#include <unistd.h>
+#include <fcntl.h>
+
+#ifdef ZLIB_FOUND
+  #include <zlib.h>
+#endif
+
+#ifdef ZSTD_FOUND
+  #include <zstd.h>
+#endif
+
+#include <villas/nodes/file_compression.hpp>
+#include <villas/utils.hpp>
+
+/* gzip header and trailer instead of the zlib ones */
+#define FILE_COMPRESSION_GZIP_WINDOW	(15 + 16)
+
+int file_compression_lookup(const char *name, enum FileCompression *type)
+{
+	if      (!strcmp(name, "none"))
+		*type = FileCompression::NONE;
+	else if (!strcmp(name, "gzip"))
+		*type = FileCompression::GZIP;
+	else if (!strcmp(name, "zstd"))
+		*type = FileCompression::ZSTD;
+	else
+		return -1;
+
+	return 0;
+}
+
+enum FileCompression file_compression_detect(const char *uri)
+{
+	const char *ext = strrchr(uri, '.');
+	if (!ext)
+		return FileCompression::NONE;
+
+	if      (!strcmp(ext, ".gz"))
+		return FileCompression::GZIP;
+	else if (!strcmp(ext, ".zst") || !strcmp(ext, ".zstd"))
+		return FileCompression::ZSTD;
+
+	return FileCompression::NONE;
+}
+
+const char * file_compression_name(enum FileCompression type)
+{
+	switch (type) {
+		case FileCompression::GZIP:
+			return "gzip";
+
+		case FileCompression::ZSTD:
+			return "zstd";
+
+		default:
+			return "none";
+	}
+}
+
+bool file_compression_available(enum FileCompression type)
+{
+	switch (type) {
+		case FileCompression::NONE:
+			return true;
+
+#ifdef ZLIB_FOUND
+		case FileCompression::GZIP:
+			return true;
+#endif
+
+#ifdef ZSTD_FOUND
+		case FileCompression::ZSTD:
+			return true;
+#endif
+
+		default:
+			return false;
+	}
+}
+
+int file_compression_default_level(enum FileCompression type)
+{
+	switch (type) {
+		case FileCompression::GZIP:
+			return 6;
+
+		case FileCompression::ZSTD:
+			return 3;
+
+		default:
+			return 0;
+	}
+}
+
+#if defined(ZLIB_FOUND) || defined(ZSTD_FOUND)
+static ssize_t file_compression_write_all(int fd, const char *buf, size_t len)
+{
+	size_t off = 0;
+
+	while (off < len) {
+		ssize_t ret = write(fd, buf + off, len - off);
+		if (ret < 0) {
+			if (errno == EINTR)
+				continue;
+
+			return ret;
+		}
+
+		off += ret;
+	}
+
+	return off;
+}
+#endif
+
+int file_compressor_init(struct file_compressor *c, enum FileCompression type, int level)
+{
+	c->type = type;
+	c->level = level;
+	c->ctx = nullptr;
+
+	switch (type) {
+#ifdef ZLIB_FOUND
+		case FileCompression::GZIP: {
+			z_stream *zs = new z_stream;
+			if (!zs)
+				return -1;
+
+			memset(zs, 0, sizeof(z_stream));
+
+			int ret = deflateInit2(zs, level, Z_DEFLATED, FILE_COMPRESSION_GZIP_WINDOW, 8, Z_DEFAULT_STRATEGY);
+			if (ret != Z_OK) {
+				delete zs;
+				return -1;
+			}
+
+			c->ctx = zs;
+			c->buflen = FILE_COMPRESSION_BUFFER_SIZE;
+			break;
+		}
+#endif
+
+#ifdef ZSTD_FOUND
+		case FileCompression::ZSTD: {
+			ZSTD_CCtx *cctx = ZSTD_createCCtx();
+			if (!cctx)
+				return -1;
+
+			int ret = ZSTD_isError(ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level));
+			if (ret) {
+				ZSTD_freeCCtx(cctx);
+				return -1;
+			}
+
+			c->ctx = cctx;
+			c->buflen = MAX(ZSTD_CStreamOutSize(), FILE_COMPRESSION_BUFFER_SIZE);
+			break;
+		}
+#endif
+
+		default:
+			return -1;
+	}
+
+	c->buffer = new char[c->buflen];
+	if (!c->buffer)
+		return -1;
+
+	return 0;
+}
+
+int file_compressor_destroy(struct file_compressor *c)
+{
+	switch (c->type) {
+#ifdef ZLIB_FOUND
+		case FileCompression::GZIP: {
+			z_stream *zs = (z_stream *) c->ctx;
+
+			deflateEnd(zs);
+			delete zs;
+			break;
+		}
+#endif
+
+#ifdef ZSTD_FOUND
+		case FileCompression::ZSTD:
+			ZSTD_freeCCtx((ZSTD_CCtx *) c->ctx);
+			break;
+#endif
+
+		default:
+			return -1;
+	}
+
+	delete[] c->buffer;
+
+	return 0;
+}
+
+ssize_t file_compressor_write(struct file_compressor *c, int fd, const char *buf, size_t len, bool finish)
+{
+	size_t written = 0;
+
+	switch (c->type) {
+#ifdef ZLIB_FOUND
+		case FileCompression::GZIP: {
+			z_stream *zs = (z_stream *) c->ctx;
+			ssize_t ret;
+			int zret;
+
+			zs->next_in = (Bytef *) buf;
+			zs->avail_in = len;
+
+			/* Until all input has been consumed and the output buffer did not fill up */
+			do {
+				zs->next_out = (Bytef *) c->buffer;
+				zs->avail_out = c->buflen;
+
+				zret = deflate(zs, finish ? Z_FINISH : Z_SYNC_FLUSH);
+				if (zret == Z_STREAM_ERROR)
+					return -1;
+
+				ret = file_compression_write_all(fd, c->buffer, c->buflen - zs->avail_out);
+				if (ret < 0)
+					return ret;
+
+				written += ret;
+			} while (zs->avail_out == 0);
+
+			if (finish)
+				deflateReset(zs);
+
+			break;
+		}
+#endif
+
+#ifdef ZSTD_FOUND
+		case FileCompression::ZSTD: {
+			ZSTD_CCtx *cctx = (ZSTD_CCtx *) c->ctx;
+			ZSTD_inBuffer in = { buf, len, 0 };
+			size_t remaining;
+			ssize_t ret;
+
+			do {
+				ZSTD_outBuffer out = { c->buffer, c->buflen, 0 };
+
+				remaining = ZSTD_compressStream2(cctx, &out, &in, finish ? ZSTD_e_end : ZSTD_e_flush);
+				if (ZSTD_isError(remaining))
+					return -1;
+
+				ret = file_compression_write_all(fd, c->buffer, out.pos);
+				if (ret < 0)
+					return ret;
+
+				written += ret;
+			} while (remaining > 0);
+
+			break;
+		}
+#endif
+
+		default:
+			return -1;
+	}
+
+	return written;
+}
+
+static ssize_t file_decompressor_read(void *cookie, char *buf, size_t size)
+{
+	struct file_decompressor *d = (struct file_decompressor *) cookie;
+	size_t produced = 0;
+
+	while (produced == 0 && size > 0) {
+		if (d->pos == d->len) {
+			ssize_t ret = read(d->fd, d->buffer, d->buflen);
+			if (ret < 0) {
+				if (errno == EINTR)
+					continue;
+
+				return ret;
+			}
+			else if (ret == 0)
+				return 0; /* The writer might still append more data */
+
+			d->len = ret;
+			d->pos = 0;
+		}
+
+		switch (d->type) {
+#ifdef ZLIB_FOUND
+			case FileCompression::GZIP: {
+				z_stream *zs = (z_stream *) d->ctx;
+				int ret;
+
+				zs->next_in = (Bytef *) d->buffer + d->pos;
+				zs->avail_in = d->len - d->pos;
+				zs->next_out = (Bytef *) buf;
+				zs->avail_out = size;
+
+				ret = inflate(zs, Z_NO_FLUSH);
+				if (ret == Z_STREAM_END)
+					inflateReset(zs); /* Continue with the next member of a concatenated file */
+				else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+					errno = EIO;
+					return -1;
+				}
+
+				d->pos = d->len - zs->avail_in;
+				produced = size - zs->avail_out;
+				break;
+			}
+#endif
+
+#ifdef ZSTD_FOUND
+			case FileCompression::ZSTD: {
+				ZSTD_inBuffer in = { d->buffer, d->len, d->pos };
+				ZSTD_outBuffer out = { buf, size, 0 };
+
+				/* Concatenated frames are handled transparently */
+				size_t ret = ZSTD_decompressStream((ZSTD_DCtx *) d->ctx, &out, &in);
+				if (ZSTD_isError(ret)) {
+					errno = EIO;
+					return -1;
+				}
+
+				d->pos = in.pos;
+				produced = out.pos;
+				break;
+			}
+#endif
+
+			default:
+				errno = EINVAL;
+				return -1;
+		}
+	}
+
+	d->offset += produced;
+
+	return produced;
+}
+
+/** Decompressed streams can only be rewound. */
+static int file_decompressor_seek(void *cookie, off64_t *offset, int whence)
+{
+	struct file_decompressor *d = (struct file_decompressor *) cookie;
+
+	if (whence == SEEK_CUR && *offset == 0) {
+		*offset = d->offset;
+		return 0;
+	}
+	else if (whence != SEEK_SET || *offset != 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (lseek(d->fd, 0, SEEK_SET) < 0)
+		return -1;
+
+	switch (d->type) {
+#ifdef ZLIB_FOUND
+		case FileCompression::GZIP:
+			inflateReset((z_stream *) d->ctx);
+			break;
+#endif
+
+#ifdef ZSTD_FOUND
+		case FileCompression::ZSTD:
+			ZSTD_DCtx_reset((ZSTD_DCtx *) d->ctx, ZSTD_reset_session_only);
+			break;
+#endif
+
+		default: { }
+	}
+
+	d->len = 0;
+	d->pos = 0;
+	d->offset = 0;
+
+	return 0;
+}
+
+static int file_decompressor_close(void *cookie)
+{
+	struct file_decompressor *d = (struct file_decompressor *) cookie;
+	int ret;
+
+	switch (d->type) {
+#ifdef ZLIB_FOUND
+		case FileCompression::GZIP: {
+			z_stream *zs = (z_stream *) d->ctx;
+
+			inflateEnd(zs);
+			delete zs;
+			break;
+		}
+#endif
+
+#ifdef ZSTD_FOUND
+		case FileCompression::ZSTD:
+			ZSTD_freeDCtx((ZSTD_DCtx *) d->ctx);
+			break;
+#endif
+
+		default: { }
+	}
+
+	ret = close(d->fd);
+
+	delete[] d->buffer;
+	delete d;
+
+	return ret;
+}
+
+struct file_decompressor * file_decompressor_open(const char *uri, enum FileCompression type)
+{
+	cookie_io_functions_t funcs = {
+		.read = file_decompressor_read,
+		.write = nullptr,
+		.seek = file_decompressor_seek,
+		.close = file_decompressor_close
+	};
+
+	auto *d = new struct file_decompressor;
+	if (!d)
+		return nullptr;
+
+	d->type = type;
+	d->ctx = nullptr;
+
+	switch (type) {
+#ifdef ZLIB_FOUND
+		case FileCompression::GZIP: {
+			z_stream *zs = new z_stream;
+			if (!zs)
+				goto err;
+
+			memset(zs, 0, sizeof(z_stream));
+
+			if (inflateInit2(zs, FILE_COMPRESSION_GZIP_WINDOW) != Z_OK) {
+				delete zs;
+				goto err;
+			}
+
+			d->ctx = zs;
+			break;
+		}
+#endif
+
+#ifdef ZSTD_FOUND
+		case FileCompression::ZSTD:
+			d->ctx = ZSTD_createDCtx();
+			if (!d->ctx)
+				goto err;
+			break;
+#endif
+
+		default:
+			goto err;
+	}
+
+	d->fd = open(uri, O_RDONLY | O_CLOEXEC);
+	if (d->fd < 0)
+		goto err_ctx;
+
+	d->buflen = FILE_COMPRESSION_BUFFER_SIZE;
+	d->buffer = new char[d->buflen];
+	d->len = 0;
+	d->pos = 0;
+	d->offset = 0;
+
+	d->stream = fopencookie(d, "r", funcs);
+	if (!d->stream)
+		goto err_fd;
+
+	return d;
+
+err_fd:
+	close(d->fd);
+	delete[] d->buffer;
+
+err_ctx:
+	switch (type) {
+#ifdef ZLIB_FOUND
+		case FileCompression::GZIP:
+			inflateEnd((z_stream *) d->ctx);
+			delete (z_stream *) d->ctx;
+			break;
+#endif
+
+#ifdef ZSTD_FOUND
+		case FileCompression::ZSTD:
+			ZSTD_freeDCtx((ZSTD_DCtx *) d->ctx);
+			break;
+#endif
+
+		default: { }
+	}
+
+err:
+	delete d;
+
+	return nullptr;
+}
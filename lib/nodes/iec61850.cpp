@@ -21,6 +21,8 @@
  *********************************************************************************/
 
 #include <cstring>
+#include <algorithm>
+#include <map>
 #include <pthread.h>
 #include <unistd.h>
 
@@ -28,7 +30,9 @@
 #include <villas/nodes/iec61850_sv.hpp>
 #include <villas/signal.h>
 #include <villas/utils.hpp>
+#include <villas/super_node.hpp>
 #include <villas/exceptions.hpp>
+#include <villas/kernel/rt.hpp>
 
 #define CONFIG_SV_DEFAULT_APPID 0x4000
 #define CONFIG_SV_DEFAULT_DST_ADDRESS CONFIG_GOOSE_DEFAULT_DST_ADDRESS
@@ -65,32 +69,82 @@ const struct iec61850_type_descriptor type_descriptors[] = {
 
 /** Each network interface needs a separate receiver */
 static struct vlist receivers;
-static pthread_t thread;
-static EthernetHandleSet hset;
 static int users = 0;
 
+/** Receive threads, either a single one or one per interface */
+static std::vector<struct iec61850_thread *> threads;
+static bool per_interface_threads = false;
+static int default_affinity = 0;
+static std::map<std::string, int> affinities;
+
 static void * iec61850_thread(void *ctx)
 {
 	int ret;
+	bool busy;
+	struct iec61850_thread *t = (struct iec61850_thread *) ctx;
 
-	while (1) {
-		ret = EthernetHandleSet_waitReady(hset, 1000);
-		if (ret < 0)
-			continue;
+	while (!t->stop) {
+		ret = EthernetHandleSet_waitReady(t->hset, IEC61850_WAIT_TIMEOUT);
 
-		for (unsigned i = 0; i < vlist_length(&receivers); i++) {
-			struct iec61850_receiver *r = (struct iec61850_receiver *) vlist_at(&receivers, i);
+		std::lock_guard<std::mutex> guard(t->mutex);
 
-			switch (r->type) {
-				case iec61850_receiver::Type::GOOSE:	GooseReceiver_tick(r->goose); break;
-				case iec61850_receiver::Type::SAMPLED_VALUES:	SVReceiver_tick(r->sv); break;
-			}
+		/* Only this thread modifies the handle set while waiting on it */
+		for (auto *r : t->pending) {
+			EthernetHandleSet_addSocket(t->hset, r->socket);
+			t->receivers.push_back(r);
 		}
+
+		t->pending.clear();
+
+		if (ret <= 0)
+			continue;
+
+		/* Drain all frames. Receivers are ticked in a round-robin
+		 * fashion, so that a busy one can not starve the others. */
+		do {
+			busy = false;
+
+			for (auto *r : t->receivers)
+				busy |= iec61850_receiver_tick(r);
+		} while (busy && !t->stop);
 	}
 
 	return nullptr;
 }
 
+/** Get the receive thread for an interface and start it if necessary */
+static struct iec61850_thread * iec61850_thread_get(const char *intf)
+{
+	int ret;
+
+	for (auto *t : threads) {
+		if (!t->interface || !strcmp(t->interface, intf))
+			return t;
+	}
+
+	auto *t = new struct iec61850_thread;
+	if (!t)
+		throw MemoryAllocationError();
+
+	t->interface = per_interface_threads ? strdup(intf) : nullptr;
+	t->hset = EthernetHandleSet_new();
+	t->stop = false;
+
+	auto it = t->interface ? affinities.find(t->interface) : affinities.end();
+	t->affinity = it != affinities.end() ? it->second : default_affinity;
+
+	ret = pthread_create(&t->thread, nullptr, iec61850_thread, t);
+	if (ret)
+		throw RuntimeError("Failed to create IEC 61850 receive thread: {}", strerror(ret));
+
+	if (t->affinity)
+		kernel::rt::setThreadAffinity(t->thread, t->affinity);
+
+	threads.push_back(t);
+
+	return t;
+}
+
 const struct iec61850_type_descriptor * iec61850_lookup_type(const char *name)
 {
 	for (unsigned i = 0; i < ARRAY_LEN(type_descriptors); i++) {
@@ -179,18 +233,52 @@ int iec61850_parse_signals(json_t *json_signals, struct vlist *signals, struct v
 int iec61850_type_start(villas::node::SuperNode *sn)
 {
 	int ret;
+	json_error_t err;
 
 	/* Check if already initialized */
-	if (users > 0)
+	if (users++ > 0)
 		return 0;
 
-	ret = vlist_init(&receivers);
-	if (ret)
-		return ret;
+	json_t *json = sn ? sn->getConfig() : nullptr;
+	if (json) {
+		const char *mode = nullptr;
+		json_t *json_affinity = nullptr;
+
+		ret = json_unpack_ex(json, &err, 0, "{ s?: { s?: s, s?: o } }",
+			"iec61850",
+				"threads", &mode,
+				"affinity", &json_affinity
+		);
+		if (ret)
+			throw ConfigError(json, err, "node-config-node-iec61850");
+
+		if (mode) {
+			if (!strcmp(mode, "single"))
+				per_interface_threads = false;
+			else if (!strcmp(mode, "interface"))
+				per_interface_threads = true;
+			else
+				throw ConfigError(json, "node-config-node-iec61850-threads", "Invalid thread mode '{}'", mode);
+		}
+
+		if (json_is_integer(json_affinity))
+			default_affinity = json_integer_value(json_affinity);
+		else if (json_is_object(json_affinity)) {
+			const char *intf;
+			json_t *json_mask;
 
-	hset = EthernetHandleSet_new();
+			json_object_foreach(json_affinity, intf, json_mask) {
+				if (!json_is_integer(json_mask))
+					throw ConfigError(json_mask, "node-config-node-iec61850-affinity", "Affinity of interface {} must be an integer", intf);
 
-	ret = pthread_create(&thread, nullptr, iec61850_thread, nullptr);
+				affinities[intf] = json_integer_value(json_mask);
+			}
+		}
+		else if (json_affinity)
+			throw ConfigError(json_affinity, "node-config-node-iec61850-affinity", "Setting 'affinity' must be an integer or an object");
+	}
+
+	ret = vlist_init(&receivers);
 	if (ret)
 		return ret;
 
@@ -204,23 +292,32 @@ int iec61850_type_stop()
 	if (--users > 0)
 		return 0;
 
+	for (auto *t : threads) {
+		t->stop = true;
+
+		ret = pthread_join(t->thread, nullptr);
+		if (ret)
+			return ret;
+	}
+
 	for (unsigned i = 0; i < vlist_length(&receivers); i++) {
 		struct iec61850_receiver *r = (struct iec61850_receiver *) vlist_at(&receivers, i);
 
 		iec61850_receiver_stop(r);
 	}
 
-	ret = pthread_cancel(thread);
-	if (ret)
-		return ret;
+	for (auto *t : threads) {
+		EthernetHandleSet_destroy(t->hset);
 
-	ret = pthread_join(thread, nullptr);
-	if (ret)
-		return ret;
+		if (t->interface)
+			free(t->interface);
+
+		delete t;
+	}
 
-	EthernetHandleSet_destroy(hset);
+	threads.clear();
 
-	ret = vlist_destroy(&receivers, (dtor_cb_t) iec61850_receiver_destroy, true);
+	ret = vlist_destroy(&receivers, (dtor_cb_t) iec61850_receiver_destroy, false);
 	if (ret)
 		return ret;
 
@@ -239,14 +336,18 @@ int iec61850_receiver_start(struct iec61850_receiver *r)
 			break;
 	}
 
-	EthernetHandleSet_addSocket(hset, r->socket);
+	r->thread = iec61850_thread_get(r->interface);
+
+	std::lock_guard<std::mutex> guard(r->thread->mutex);
+
+	r->thread->pending.push_back(r);
 
 	return 0;
 }
 
 int iec61850_receiver_stop(struct iec61850_receiver *r)
 {
-	EthernetHandleSet_removeSocket(hset, r->socket);
+	EthernetHandleSet_removeSocket(r->thread->hset, r->socket);
 
 	switch (r->type) {
 		case iec61850_receiver::Type::GOOSE:
@@ -261,6 +362,43 @@ int iec61850_receiver_stop(struct iec61850_receiver *r)
 	return 0;
 }
 
+bool iec61850_receiver_tick(struct iec61850_receiver *r)
+{
+	bool received = false;
+
+	switch (r->type) {
+		case iec61850_receiver::Type::GOOSE:
+			received = GooseReceiver_tick(r->goose);
+			break;
+
+		case iec61850_receiver::Type::SAMPLED_VALUES:
+			received = SVReceiver_tick(r->sv);
+			break;
+	}
+
+	if (received) {
+		for (auto &f : r->flushers)
+			f.cb(f.ctx);
+	}
+
+	return received;
+}
+
+void iec61850_receiver_add_flush(struct iec61850_receiver *r, void (*cb)(void *ctx), void *ctx)
+{
+	std::lock_guard<std::mutex> guard(r->thread->mutex);
+
+	r->flushers.push_back({ cb, ctx });
+}
+
+void iec61850_receiver_remove_flush(struct iec61850_receiver *r, void *ctx)
+{
+	std::lock_guard<std::mutex> guard(r->thread->mutex);
+
+	r->flushers.erase(std::remove_if(r->flushers.begin(), r->flushers.end(),
+		[ctx](const struct iec61850_flush &f) { return f.ctx == ctx; }), r->flushers.end());
+}
+
 int iec61850_receiver_destroy(struct iec61850_receiver *r)
 {
 	switch (r->type) {
@@ -275,6 +413,8 @@ int iec61850_receiver_destroy(struct iec61850_receiver *r)
 
 	free(r->interface);
 
+	delete r;
+
 	return 0;
 }
 
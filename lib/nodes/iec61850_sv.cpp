@@ -37,6 +37,26 @@ using namespace villas;
 using namespace villas::utils;
 using namespace villas::node;
 
+/** Enqueue the samples of all ASDUs of a frame at once */
+static void iec61850_sv_flush(void *ctx)
+{
+	int pushed;
+	struct vnode *n = (struct vnode *) ctx;
+	struct iec61850_sv *i = (struct iec61850_sv *) n->_vd;
+
+	if (!i->in.batched)
+		return;
+
+	pushed = queue_signalled_push_many(&i->in.queue, (void **) i->in.batch, i->in.batched);
+	if (pushed < (int) i->in.batched) {
+		n->logger->warn("Failed to enqueue samples");
+
+		sample_decref_many(&i->in.batch[pushed], i->in.batched - pushed);
+	}
+
+	i->in.batched = 0;
+}
+
 static void iec61850_sv_listener(SVSubscriber subscriber, void *ctx, SVSubscriber_ASDU asdu)
 {
 	struct vnode *n = (struct vnode *) ctx;
@@ -52,7 +72,7 @@ static void iec61850_sv_listener(SVSubscriber subscriber, void *ctx, SVSubscribe
 
 	sz = SVSubscriber_ASDU_getDataSize(asdu);
 	if (sz < i->in.total_size) {
-		n->node->warn("Received truncated ASDU: size={}, expected={}", SVSubscriber_ASDU_getDataSize(asdu), i->in.total_size);
+		n->logger->warn("Received truncated ASDU: size={}, expected={}", SVSubscriber_ASDU_getDataSize(asdu), i->in.total_size);
 		return;
 	}
 
@@ -133,8 +153,10 @@ static void iec61850_sv_listener(SVSubscriber subscriber, void *ctx, SVSubscribe
 		smp->length++;
 	}
 
-	int pushed __attribute__((unused));
-	pushed = queue_signalled_push(&i->in.queue, smp);
+	/* The samples are enqueued by iec61850_sv_flush() once the whole frame has been processed */
+	i->in.batch[i->in.batched++] = smp;
+	if (i->in.batched == IEC61850_SV_MAX_ASDUS)
+		iec61850_sv_flush(n);
 }
 
 int iec61850_sv_parse(struct vnode *n, json_t *json)
@@ -160,6 +182,7 @@ int iec61850_sv_parse(struct vnode *n, json_t *json)
 	i->out.confrev = 1;
 	i->out.vlan_priority = CONFIG_SV_DEFAULT_PRIORITY;
 	i->out.vlan_id = CONFIG_SV_DEFAULT_VLAN_ID;
+	i->out.asdus_per_frame = 1;
 
 	i->app_id = CONFIG_SV_DEFAULT_APPID;
 
@@ -191,18 +214,22 @@ int iec61850_sv_parse(struct vnode *n, json_t *json)
 	if (json_out) {
 		i->out.enabled = true;
 
-		ret = json_unpack_ex(json_out, &err, 0, "{ s: o, s: s, s?: i, s?: s, s?: i, s?: i, s?: i }",
+		ret = json_unpack_ex(json_out, &err, 0, "{ s: o, s: s, s?: i, s?: s, s?: i, s?: i, s?: i, s?: i }",
 			"signals", &json_signals,
 			"svid", &svid,
 			"confrev", &i->out.confrev,
 			"smpmod", &smpmod,
 			"smprate", &i->out.smprate,
 			"vlan_id", &i->out.vlan_id,
-			"vlan_priority", &i->out.vlan_priority
+			"vlan_priority", &i->out.vlan_priority,
+			"asdus_per_frame", &i->out.asdus_per_frame
 		);
 		if (ret)
 			throw ConfigError(json_out, err, "node-config-node-iec61850-sv-out");
 
+		if (i->out.asdus_per_frame < 1 || i->out.asdus_per_frame > IEC61850_SV_MAX_ASDUS)
+			throw ConfigError(json_out, "node-config-node-iec61850-sv-out", "Setting 'asdus_per_frame' must be between 1 and {}", IEC61850_SV_MAX_ASDUS);
+
 		if (smpmod) {
 			if      (!strcmp(smpmod, "per_nominal_period"))
 				i->out.smpmod = IEC61850_SV_SMPMOD_PER_NOMINAL_PERIOD;
@@ -252,12 +279,13 @@ char * iec61850_sv_print(struct vnode *n)
 
 	/* Publisher part */
 	if (i->out.enabled) {
-		strcatf(&buf, ", pub.svid=%s, pub.vlan_prio=%d, pub.vlan_id=%#x, pub.confrev=%d, pub.#fields=%zu",
+		strcatf(&buf, ", pub.svid=%s, pub.vlan_prio=%d, pub.vlan_id=%#x, pub.confrev=%d, pub.#fields=%zu, pub.asdus_per_frame=%d",
 			i->out.svid,
 			i->out.vlan_priority,
 			i->out.vlan_id,
 			i->out.confrev,
-			vlist_length(&i->out.signals)
+			vlist_length(&i->out.signals),
+			i->out.asdus_per_frame
 		);
 	}
 
@@ -276,39 +304,47 @@ int iec61850_sv_start(struct vnode *n)
 	/* Initialize publisher */
 	if (i->out.enabled) {
 		i->out.publisher = SVPublisher_create(nullptr, i->interface);
-		i->out.asdu = SVPublisher_addASDU(i->out.publisher, i->out.svid, node_name_short(n), i->out.confrev);
+		i->out.asdus = new SVPublisher_ASDU[i->out.asdus_per_frame];
+		i->out.filled = 0;
 
-		for (unsigned k = 0; k < vlist_length(&i->out.signals); k++) {
-			struct iec61850_type_descriptor *td = (struct iec61850_type_descriptor *) vlist_at(&i->out.signals, k);
+		/* All ASDUs of a frame share the same data set */
+		for (int a = 0; a < i->out.asdus_per_frame; a++) {
+			SVPublisher_ASDU asdu = SVPublisher_addASDU(i->out.publisher, i->out.svid, node_name_short(n), i->out.confrev);
 
-			switch (td->iec_type) {
-				case IEC61850Type::INT8:
-					SVPublisher_ASDU_addINT8(i->out.asdu);
-					break;
+			for (unsigned k = 0; k < vlist_length(&i->out.signals); k++) {
+				struct iec61850_type_descriptor *td = (struct iec61850_type_descriptor *) vlist_at(&i->out.signals, k);
 
-				case IEC61850Type::INT32:
-					SVPublisher_ASDU_addINT32(i->out.asdu);
-					break;
+				switch (td->iec_type) {
+					case IEC61850Type::INT8:
+						SVPublisher_ASDU_addINT8(asdu);
+						break;
 
-				case IEC61850Type::FLOAT32:
-					SVPublisher_ASDU_addFLOAT(i->out.asdu);
-					break;
+					case IEC61850Type::INT32:
+						SVPublisher_ASDU_addINT32(asdu);
+						break;
 
-				case IEC61850Type::FLOAT64:
-					SVPublisher_ASDU_addFLOAT64(i->out.asdu);
-					break;
+					case IEC61850Type::FLOAT32:
+						SVPublisher_ASDU_addFLOAT(asdu);
+						break;
 
-				default: { }
+					case IEC61850Type::FLOAT64:
+						SVPublisher_ASDU_addFLOAT64(asdu);
+						break;
+
+					default: { }
+				}
 			}
-		}
 
-		if (i->out.smpmod >= 0)
-			SVPublisher_ASDU_setSmpMod(i->out.asdu, i->out.smpmod);
+			if (i->out.smpmod >= 0)
+				SVPublisher_ASDU_setSmpMod(asdu, i->out.smpmod);
 
-		SVPublisher_ASDU_enableRefrTm(i->out.asdu);
+			SVPublisher_ASDU_enableRefrTm(asdu);
 
-//		if (s->out.smprate >= 0)
-//			SV_ASDU_setSmpRate(i->out.asdu, i->out.smprate);
+//			if (s->out.smprate >= 0)
+//				SV_ASDU_setSmpRate(asdu, i->out.smprate);
+
+			i->out.asdus[a] = asdu;
+		}
 
 		/* Start publisher */
 		SVPublisher_setupComplete(i->out.publisher);
@@ -318,15 +354,6 @@ int iec61850_sv_start(struct vnode *n)
 	if (i->in.enabled) {
 		struct iec61850_receiver *r = iec61850_receiver_create(iec61850_receiver::Type::SAMPLED_VALUES, i->interface);
 
-		i->in.receiver = r->sv;
-		i->in.subscriber = SVSubscriber_create(i->dst_address.ether_addr_octet, i->app_id);
-
-		/* Install a callback handler for the subscriber */
-		SVSubscriber_setListener(i->in.subscriber, iec61850_sv_listener, n);
-
-		/* Connect the subscriber to the receiver */
-		SVReceiver_addSubscriber(i->in.receiver, i->in.subscriber);
-
 		/* Initialize pool and queue to pass samples between threads */
 		ret = pool_init(&i->in.pool, 1024, SAMPLE_LENGTH(vlist_length(&n->in.signals)));
 		if (ret)
@@ -336,6 +363,19 @@ int iec61850_sv_start(struct vnode *n)
 		if (ret)
 			return ret;
 
+		i->in.batched = 0;
+		i->in.receiver = r->sv;
+		i->in.subscriber = SVSubscriber_create(i->dst_address.ether_addr_octet, i->app_id);
+
+		/* Install a callback handler for the subscriber */
+		SVSubscriber_setListener(i->in.subscriber, iec61850_sv_listener, n);
+
+		/* Enqueue the samples of all ASDUs once a frame has been processed */
+		iec61850_receiver_add_flush(r, iec61850_sv_flush, n);
+
+		/* Connect the subscriber to the receiver */
+		SVReceiver_addSubscriber(i->in.receiver, i->in.subscriber);
+
 		for (unsigned k = 0; k < vlist_length(&i->in.signals); k++) {
 			struct iec61850_type_descriptor *td = (struct iec61850_type_descriptor *) vlist_at(&i->in.signals, k);
 			struct signal *sig = (struct signal *) vlist_at(&n->in.signals, k);
@@ -354,9 +394,15 @@ int iec61850_sv_stop(struct vnode *n)
 {
 	struct iec61850_sv *i = (struct iec61850_sv *) n->_vd;
 
-	if (i->in.enabled)
+	if (i->in.enabled) {
+		struct iec61850_receiver *r = iec61850_receiver_lookup(iec61850_receiver::Type::SAMPLED_VALUES, i->interface);
+
 		SVReceiver_removeSubscriber(i->in.receiver, i->in.subscriber);
 
+		if (r)
+			iec61850_receiver_remove_flush(r, n);
+	}
+
 	return 0;
 }
 
@@ -366,9 +412,12 @@ int iec61850_sv_destroy(struct vnode *n)
 	struct iec61850_sv *i = (struct iec61850_sv *) n->_vd;
 
 	/* Deinitialize publisher */
-	if (i->out.enabled && i->out.publisher)
+	if (i->out.enabled && i->out.publisher) {
 		SVPublisher_destroy(i->out.publisher);
 
+		delete[] i->out.asdus;
+	}
+
 	/* Deinitialise subscriber */
 	if (i->in.enabled) {
 		ret = queue_signalled_destroy(&i->in.queue);
@@ -408,6 +457,8 @@ int iec61850_sv_write(struct vnode *n, struct sample * const smps[], unsigned cn
 		return -1;
 
 	for (unsigned j = 0; j < cnt; j++) {
+		SVPublisher_ASDU asdu = i->out.asdus[i->out.filled];
+
 		unsigned offset = 0;
 		for (unsigned k = 0; k < MIN(smps[j]->length, vlist_length(&i->out.signals)); k++) {
 			struct iec61850_type_descriptor *td = (struct iec61850_type_descriptor *) vlist_at(&i->out.signals, k);
@@ -431,19 +482,19 @@ int iec61850_sv_write(struct vnode *n, struct sample * const smps[], unsigned cn
 
 			switch (td->iec_type) {
 				case IEC61850Type::INT8:
-					SVPublisher_ASDU_setINT8(i->out.asdu,    offset, ival);
+					SVPublisher_ASDU_setINT8(asdu,    offset, ival);
 					break;
 
 				case IEC61850Type::INT32:
-					SVPublisher_ASDU_setINT32(i->out.asdu,   offset, ival);
+					SVPublisher_ASDU_setINT32(asdu,   offset, ival);
 					break;
 
 				case IEC61850Type::FLOAT32:
-					SVPublisher_ASDU_setFLOAT(i->out.asdu,   offset, fval);
+					SVPublisher_ASDU_setFLOAT(asdu,   offset, fval);
 					break;
 
 				case IEC61850Type::FLOAT64:
-					SVPublisher_ASDU_setFLOAT64(i->out.asdu, offset, fval);
+					SVPublisher_ASDU_setFLOAT64(asdu, offset, fval);
 					break;
 
 				default: { }
@@ -452,15 +503,20 @@ int iec61850_sv_write(struct vnode *n, struct sample * const smps[], unsigned cn
 			offset += td->size;
 		}
 
-		SVPublisher_ASDU_setSmpCnt(i->out.asdu, smps[j]->sequence);
+		SVPublisher_ASDU_setSmpCnt(asdu, smps[j]->sequence);
 
 		if (smps[j]->flags & (int) SampleFlags::HAS_TS_ORIGIN) {
 			uint64_t refrtm = smps[j]->ts.origin.tv_sec * 1000 + smps[j]->ts.origin.tv_nsec / 1000000;
 
-			SVPublisher_ASDU_setRefrTm(i->out.asdu, refrtm);
+			SVPublisher_ASDU_setRefrTm(asdu, refrtm);
 		}
 
-		SVPublisher_publish(i->out.publisher);
+		/* Send a frame once all of its ASDUs have been filled */
+		if (++i->out.filled == i->out.asdus_per_frame) {
+			SVPublisher_publish(i->out.publisher);
+
+			i->out.filled = 0;
+		}
 	}
 
 	return cnt;
@@ -483,8 +539,8 @@ static void register_plugin() {
 	p.description	= "IEC 61850-9-2 (Sampled Values)";
 	p.vectorize	= 0;
 	p.size		= sizeof(struct iec61850_sv);
-	p.start	= iec61850_type_start;
-	p.stop	= iec61850_type_stop;
+	p.type.start	= iec61850_type_start;
+	p.type.stop	= iec61850_type_stop;
 	p.destroy	= iec61850_sv_destroy;
 	p.parse		= iec61850_sv_parse;
 	p.print		= iec61850_sv_print;
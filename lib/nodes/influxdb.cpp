@@ -21,13 +21,19 @@
  *********************************************************************************/
 
 #include <cstring>
+#include <cstdarg>
 #include <cinttypes>
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <netinet/in.h>
 #include <netdb.h>
 
+#include <curl/curl.h>
+
 #include <villas/signal.h>
 #include <villas/sample.h>
+#include <villas/stats.hpp>
+#include <villas/timing.h>
 #include <villas/node/config.h>
 #include <villas/node.h>
 #include <villas/nodes/influxdb.hpp>
@@ -39,38 +45,157 @@ using namespace villas;
 using namespace villas::node;
 using namespace villas::utils;
 
-int influxdb_parse(struct vnode *n, json_t *json)
+static void influxdb_buffer_init(struct influxdb_buffer *b, size_t size)
 {
-	struct influxdb *i = (struct influxdb *) n->_vd;
+	b->data = new char[size];
+	if (!b->data)
+		throw MemoryAllocationError();
 
-	json_error_t err;
-	int ret;
+	/* Avoid page faults in influxdb_write() */
+	memset(b->data, 0, size);
 
-	char *tmp, *host, *port, *lasts;
-	const char *server, *key;
+	b->size = size;
+	b->len = 0;
+	b->lines = 0;
+}
 
-	ret = json_unpack_ex(json, &err, 0, "{ s: s, s: s }",
-		"server", &server,
-		"key", &key
-	);
+static void influxdb_buffer_clear(struct influxdb_buffer *b)
+{
+	b->len = 0;
+	b->lines = 0;
+}
+
+static void influxdb_buffer_destroy(struct influxdb_buffer *b)
+{
+	delete[] b->data;
+
+	b->data = nullptr;
+	b->size = 0;
+}
+
+/** Append to the buffer.
+ *
+ * @retval 0 Success.
+ * @retval -1 The buffer is full. Its contents are not changed.
+ */
+__attribute__((format(printf, 2, 3)))
+static int influxdb_buffer_printf(struct influxdb_buffer *b, const char *fmt, ...)
+{
+	va_list ap;
+	size_t avail = b->size - b->len;
+
+	va_start(ap, fmt);
+	int ret = vsnprintf(b->data + b->len, avail, fmt, ap);
+	va_end(ap);
+
+	if (ret < 0 || (size_t) ret >= avail)
+		return -1;
+
+	b->len += ret;
+
+	return 0;
+}
+
+/** Format a sample as a single line of the InfluxDB line protocol.
+ *
+ * @retval 0 Success.
+ * @retval -1 The line did not fit into the buffer.
+ */
+static int influxdb_format(struct vnode *n, struct influxdb_buffer *b, const struct sample *smp)
+{
+	struct influxdb *i = (struct influxdb *) n->_vd;
+	size_t mark = b->len;
+	unsigned fields = 0;
+	int ret;
+
+	/* Key */
+	ret = influxdb_buffer_printf(b, "%s", i->key);
 	if (ret)
-		throw ConfigError(json, err, "node-config-node-influx");
+		goto overflow;
+
+	/* Fields */
+	for (unsigned j = 0; j < smp->length; j++) {
+		struct signal *sig = (struct signal *) vlist_at_safe(smp->signals, j);
+		const union signal_data *data = &smp->data[j];
+
+		if (!sig)
+			break;
+
+		if (
+			sig->type != SignalType::BOOLEAN &&
+			sig->type != SignalType::FLOAT &&
+			sig->type != SignalType::INTEGER &&
+			sig->type != SignalType::COMPLEX
+		) {
+			n->logger->warn("Unsupported signal format. Skipping");
+			continue;
+		}
 
-	tmp = strdup(server);
+		ret = influxdb_buffer_printf(b, "%c", fields++ == 0 ? ' ' : ',');
+		if (ret)
+			goto overflow;
 
-	host = strtok_r(tmp, ":", &lasts);
-	port = strtok_r(nullptr, "", &lasts);
+		char name[32];
+		if (sig->name)
+			snprintf(name, sizeof(name), "%s", sig->name);
+		else
+			snprintf(name, sizeof(name), "value%u", j);
 
-	i->key = strdup(key);
-	i->host = strdup(host);
-	i->port = strdup(port ? port : "8089");
+		switch (sig->type) {
+			case SignalType::COMPLEX:
+				ret = influxdb_buffer_printf(b, "%s_re=%f,%s_im=%f",
+					name, std::real(data->z),
+					name, std::imag(data->z)
+				);
+				break;
 
-	free(tmp);
+			case SignalType::BOOLEAN:
+				ret = influxdb_buffer_printf(b, "%s=%s", name, data->b ? "true" : "false");
+				break;
+
+			case SignalType::FLOAT:
+				ret = influxdb_buffer_printf(b, "%s=%f", name, data->f);
+				break;
+
+			case SignalType::INTEGER:
+				ret = influxdb_buffer_printf(b, "%s=%" PRIi64, name, data->i);
+				break;
+
+			default: { }
+		}
+
+		if (ret)
+			goto overflow;
+	}
+
+	/* Timestamp */
+	ret = influxdb_buffer_printf(b, " %lld%09lld\n", (long long) smp->ts.origin.tv_sec,
+							 (long long) smp->ts.origin.tv_nsec);
+	if (ret)
+		goto overflow;
+
+	if (b->lines++ == 0)
+		b->first = time_now();
 
 	return 0;
+
+overflow:
+	b->len = mark;
+
+	return -1;
 }
 
-int influxdb_open(struct vnode *n)
+static void influxdb_disconnect(struct vnode *n)
+{
+	struct influxdb *i = (struct influxdb *) n->_vd;
+
+	if (i->sd >= 0) {
+		close(i->sd);
+		i->sd = -1;
+	}
+}
+
+static int influxdb_connect(struct vnode *n)
 {
 	int ret;
 	struct influxdb *i = (struct influxdb *) n->_vd;
@@ -82,19 +207,24 @@ int influxdb_open(struct vnode *n)
 	hints.ai_socktype = SOCK_DGRAM;
 
 	ret = getaddrinfo(i->host, i->port, &hints, &servinfo);
-	if (ret)
-		throw RuntimeError("Failed to lookup server: {}", gai_strerror(ret));
+	if (ret) {
+		n->logger->warn("Failed to lookup server: {}", gai_strerror(ret));
+		return -1;
+	}
 
 	/* Loop through all the results and connect to the first we can */
 	for (p = servinfo; p != nullptr; p = p->ai_next) {
 		i->sd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
-		if (i->sd == -1)
+		if (i->sd == -1) {
+			freeaddrinfo(servinfo);
 			throw SystemError("Failed to create socket");
+		}
 
 		ret = connect(i->sd, p->ai_addr, p->ai_addrlen);
 		if (ret == -1) {
 			n->logger->warn("Connect failed: {}", strerror(errno));
 			close(i->sd);
+			i->sd = -1;
 			continue;
 		}
 
@@ -102,14 +232,303 @@ int influxdb_open(struct vnode *n)
 		break;
 	}
 
-	return p ? 0 : -1;
+	freeaddrinfo(servinfo);
+
+	if (i->sd < 0)
+		return -1;
+
+	return 0;
 }
 
-int influxdb_close(struct vnode *n)
+static size_t influxdb_http_response(void *contents, size_t size, size_t nmemb, void *userp)
+{
+	struct influxdb_response *r = (struct influxdb_response *) userp;
+	size_t realsize = size * nmemb;
+	size_t len = MIN(realsize, sizeof(r->data) - r->len - 1);
+
+	/* Only the beginning of the body is kept for error messages */
+	memcpy(r->data + r->len, contents, len);
+	r->len += len;
+	r->data[r->len] = '\0';
+
+	return realsize;
+}
+
+static void influxdb_http_init(struct vnode *n)
+{
+	struct influxdb *i = (struct influxdb *) n->_vd;
+
+	/* The easy handle is reused for all requests, so libcurl keeps the connection alive */
+	i->curl = curl_easy_init();
+	if (!i->curl)
+		throw RuntimeError("Failed to initialize libcurl handle");
+
+	char *db = curl_easy_escape(i->curl, i->database, 0);
+	if (!db)
+		throw MemoryAllocationError();
+
+	i->url = strf("http://%s:%s/write?db=%s&precision=ns", i->host, i->port, db);
+
+	curl_free(db);
+
+	i->headers = curl_slist_append(i->headers, "Content-Type: text/plain; charset=utf-8");
+
+	/* Avoid the additional round trip of "Expect: 100-continue" for large batches */
+	i->headers = curl_slist_append(i->headers, "Expect:");
+
+	if (i->token) {
+		char *auth = strf("Authorization: Token %s", i->token);
+		i->headers = curl_slist_append(i->headers, auth);
+		free(auth);
+	}
+
+	curl_easy_setopt(i->curl, CURLOPT_URL, i->url);
+	curl_easy_setopt(i->curl, CURLOPT_HTTPHEADER, i->headers);
+	curl_easy_setopt(i->curl, CURLOPT_USERAGENT, HTTP_USER_AGENT);
+	curl_easy_setopt(i->curl, CURLOPT_TIMEOUT, (long) INFLUXDB_TIMEOUT);
+	curl_easy_setopt(i->curl, CURLOPT_TCP_NODELAY, 1L);
+	curl_easy_setopt(i->curl, CURLOPT_NOSIGNAL, 1L);
+	curl_easy_setopt(i->curl, CURLOPT_WRITEFUNCTION, influxdb_http_response);
+}
+
+static void influxdb_http_destroy(struct vnode *n)
+{
+	struct influxdb *i = (struct influxdb *) n->_vd;
+
+	if (i->curl) {
+		curl_easy_cleanup(i->curl);
+		i->curl = nullptr;
+	}
+
+	curl_slist_free_all(i->headers);
+	i->headers = nullptr;
+
+	free(i->url);
+	i->url = nullptr;
+}
+
+/** Send a request to the /write endpoint and wait for its response.
+ *
+ * @retval 0 The server accepted the lines.
+ * @retval 1 The server rejected the lines. Retrying will not help.
+ * @retval -1 The request failed. It can be retried.
+ */
+static int influxdb_http_write(struct vnode *n, const char *buf, size_t len)
+{
+	struct influxdb *i = (struct influxdb *) n->_vd;
+	struct influxdb_response resp = { .len = 0 };
+	long status;
+
+	resp.data[0] = '\0';
+
+	curl_easy_setopt(i->curl, CURLOPT_WRITEDATA, (void *) &resp);
+	curl_easy_setopt(i->curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t) len);
+	curl_easy_setopt(i->curl, CURLOPT_POSTFIELDS, buf);
+
+	CURLcode ret = curl_easy_perform(i->curl);
+	if (ret) {
+		n->logger->warn("HTTP request failed: {}", curl_easy_strerror(ret));
+		return -1;
+	}
+
+	curl_easy_getinfo(i->curl, CURLINFO_RESPONSE_CODE, &status);
+
+	if (status / 100 == 2)
+		return 0;
+
+	n->logger->warn("Server responded with status {}: {}", status, resp.data);
+
+	/* Client errors except rate limiting are caused by the data itself */
+	return status / 100 == 4 && status != 429 ? 1 : -1;
+}
+
+/** Send the lines of \p buf in chunks of at most \p max bytes.
+ *
+ * Lines are never split.
+ *
+ * @see influxdb_http_write() for the return values.
+ */
+static int influxdb_send(struct vnode *n, const char *buf, size_t len)
+{
+	struct influxdb *i = (struct influxdb *) n->_vd;
+	int ret, result = 0;
+	size_t max = i->protocol == influxdb::Protocol::UDP
+			? MIN(i->batch.max_bytes, INFLUXDB_UDP_PAYLOAD)
+			: i->batch.max_bytes;
+
+	while (len > 0) {
+		size_t chunk = len;
+
+		if (chunk > max) {
+			const char *nl = (const char *) memrchr(buf, '\n', max);
+
+			chunk = nl ? nl - buf + 1 : max;
+		}
+
+		if (i->protocol == influxdb::Protocol::HTTP) {
+			ret = influxdb_http_write(n, buf, chunk);
+			if (ret < 0)
+				return ret;
+			else if (ret > 0)
+				result = ret;
+		}
+		else {
+			if (i->sd < 0) {
+				ret = influxdb_connect(n);
+				if (ret)
+					return -1;
+			}
+
+			ssize_t sentlen = send(i->sd, buf, chunk, 0);
+			if (sentlen < 0) {
+				n->logger->warn("Failed to send: {}", strerror(errno));
+				return -1;
+			}
+		}
+
+		buf += chunk;
+		len -= chunk;
+	}
+
+	return result;
+}
+
+/** Send a batch and retry with an exponential backoff on failures.
+ *
+ * A batch is dropped if it is rejected by the server, if the node is stopped
+ * or if newer lines are dropped while waiting for the server.
+ */
+static void influxdb_batch_flush(struct vnode *n, struct influxdb_buffer *b)
+{
+	struct influxdb *i = (struct influxdb *) n->_vd;
+	double backoff = INFLUXDB_BACKOFF_MIN;
+	int ret;
+
+	while (true) {
+		struct timespec start = time_now();
+
+		ret = influxdb_send(n, b->data, b->len);
+		if (ret == 0) {
+			struct timespec end = time_now();
+
+			i->batch.flushed++;
+
+			if (n->stats) {
+				n->stats->update(Stats::Metric::INFLUXDB_BATCH_LINES, b->lines);
+				n->stats->update(Stats::Metric::INFLUXDB_FLUSH_LATENCY, time_delta(&start, &end));
+			}
+
+			return;
+		}
+		else if (ret > 0)
+			break;
+
+		pthread_mutex_lock(&i->batch.mutex);
+
+		if (i->batch.stop || i->batch.overflow) {
+			i->batch.overflow = false;
+			pthread_mutex_unlock(&i->batch.mutex);
+			break;
+		}
+
+		struct timespec now = time_now();
+		struct timespec delay = time_from_double(backoff);
+		struct timespec deadline = time_add(&now, &delay);
+
+		pthread_cond_timedwait(&i->batch.cond, &i->batch.mutex, &deadline);
+		pthread_mutex_unlock(&i->batch.mutex);
+
+		backoff = MIN(backoff * 2, INFLUXDB_BACKOFF_MAX);
+		i->batch.reconnects++;
+	}
+
+	if (i->batch.dropped == 0)
+		n->logger->warn("Dropping batches as the server is not available");
+
+	i->batch.dropped++;
+	i->batch.dropped_lines += b->lines;
+
+	if (n->stats)
+		n->stats->update(Stats::Metric::INFLUXDB_DROPPED_LINES, b->lines);
+}
+
+static void * influxdb_flusher(void *ctx)
+{
+	struct vnode *n = (struct vnode *) ctx;
+	struct influxdb *i = (struct influxdb *) n->_vd;
+	bool stop;
+
+	pthread_mutex_lock(&i->batch.mutex);
+
+	do {
+		/* Wait until the batch is full or its linger time is over */
+		while (!i->batch.pending && !i->batch.stop) {
+			if (i->batch.active->lines == 0)
+				pthread_cond_wait(&i->batch.cond, &i->batch.mutex);
+			else {
+				struct timespec now = time_now();
+				struct timespec linger = time_from_double(i->batch.linger);
+				struct timespec deadline = time_add(&i->batch.active->first, &linger);
+
+				if (time_delta(&now, &deadline) <= 0)
+					break;
+
+				pthread_cond_timedwait(&i->batch.cond, &i->batch.mutex, &deadline);
+			}
+		}
+
+		/* The spare buffer is always empty here */
+		std::swap(i->batch.active, i->batch.spare);
+
+		i->batch.pending = false;
+		i->batch.overflow = false;
+		stop = i->batch.stop;
+
+		pthread_mutex_unlock(&i->batch.mutex);
+
+		if (i->batch.spare->lines > 0)
+			influxdb_batch_flush(n, i->batch.spare);
+
+		influxdb_buffer_clear(i->batch.spare);
+
+		pthread_mutex_lock(&i->batch.mutex);
+	} while (!stop);
+
+	pthread_mutex_unlock(&i->batch.mutex);
+
+	return nullptr;
+}
+
+int influxdb_type_start(villas::node::SuperNode *sn)
+{
+	return curl_global_init(CURL_GLOBAL_ALL);
+}
+
+int influxdb_type_stop()
+{
+	curl_global_cleanup();
+
+	return 0;
+}
+
+int influxdb_init(struct vnode *n)
 {
 	struct influxdb *i = (struct influxdb *) n->_vd;
 
-	close(i->sd);
+	i->protocol = influxdb::Protocol::UDP;
+	i->sd = -1;
+
+	i->batch.enabled = false;
+	i->batch.max_lines = INFLUXDB_BATCH_MAX_LINES;
+	i->batch.max_bytes = INFLUXDB_BATCH_MAX_BYTES;
+	i->batch.linger = INFLUXDB_BATCH_LINGER;
+
+	return 0;
+}
+
+int influxdb_destroy(struct vnode *n)
+{
+	struct influxdb *i = (struct influxdb *) n->_vd;
 
 	if (i->host)
 		free(i->host);
@@ -117,6 +536,190 @@ int influxdb_close(struct vnode *n)
 		free(i->port);
 	if (i->key)
 		free(i->key);
+	if (i->database)
+		free(i->database);
+	if (i->token)
+		free(i->token);
+
+	return 0;
+}
+
+int influxdb_parse(struct vnode *n, json_t *json)
+{
+	struct influxdb *i = (struct influxdb *) n->_vd;
+
+	json_error_t err;
+	int ret;
+
+	char *tmp, *host, *port, *lasts;
+	const char *server, *key;
+	const char *protocol = nullptr;
+	const char *database = nullptr;
+	const char *token = nullptr;
+
+	json_t *json_batch = nullptr;
+
+	ret = json_unpack_ex(json, &err, 0, "{ s: s, s: s, s?: s, s?: s, s?: s, s?: o }",
+		"server", &server,
+		"key", &key,
+		"protocol", &protocol,
+		"database", &database,
+		"token", &token,
+		"batch", &json_batch
+	);
+	if (ret)
+		throw ConfigError(json, err, "node-config-node-influx");
+
+	if (protocol) {
+		if (!strcmp(protocol, "udp"))
+			i->protocol = influxdb::Protocol::UDP;
+		else if (!strcmp(protocol, "http"))
+			i->protocol = influxdb::Protocol::HTTP;
+		else
+			throw ConfigError(json, "node-config-node-influx-protocol", "Invalid protocol '{}'. Must be one of 'udp' or 'http'", protocol);
+	}
+
+	if (i->protocol == influxdb::Protocol::HTTP) {
+		if (!database)
+			throw ConfigError(json, "node-config-node-influx-database", "Setting 'database' is required for protocol 'http'");
+
+		i->database = strdup(database);
+		i->token = token ? strdup(token) : nullptr;
+	}
+
+	if (json_batch) {
+		int enabled = 1;
+		int max_lines = -1;
+		json_int_t max_bytes = -1;
+		double linger = -1;
+
+		ret = json_unpack_ex(json_batch, &err, 0, "{ s?: b, s?: i, s?: I, s?: F }",
+			"enabled", &enabled,
+			"max_lines", &max_lines,
+			"max_bytes", &max_bytes,
+			"linger", &linger
+		);
+		if (ret)
+			throw ConfigError(json_batch, err, "node-config-node-influx-batch");
+
+		i->batch.enabled = enabled;
+
+		if (max_lines == 0)
+			throw ConfigError(json_batch, "node-config-node-influx-batch", "Setting 'max_lines' must be positive");
+		else if (max_lines > 0)
+			i->batch.max_lines = max_lines;
+
+		if (max_bytes == 0)
+			throw ConfigError(json_batch, "node-config-node-influx-batch", "Setting 'max_bytes' must be positive");
+		else if (max_bytes > 0)
+			i->batch.max_bytes = max_bytes;
+
+		if (linger >= 0)
+			i->batch.linger = linger;
+	}
+
+	tmp = strdup(server);
+
+	host = strtok_r(tmp, ":", &lasts);
+	port = strtok_r(nullptr, "", &lasts);
+
+	i->key = strdup(key);
+	i->host = strdup(host);
+	i->port = strdup(port ? port : i->protocol == influxdb::Protocol::HTTP ? "8086" : "8089");
+
+	free(tmp);
+
+	return 0;
+}
+
+int influxdb_open(struct vnode *n)
+{
+	int ret;
+	struct influxdb *i = (struct influxdb *) n->_vd;
+
+	if (i->protocol == influxdb::Protocol::HTTP)
+		/* libcurl connects on the first request */
+		influxdb_http_init(n);
+	else {
+		ret = influxdb_connect(n);
+		if (ret) {
+			/* The flusher thread reconnects once the server is available */
+			if (!i->batch.enabled)
+				return ret;
+
+			n->logger->warn("Server is not available yet");
+		}
+	}
+
+	if (!i->batch.enabled) {
+		/* A single sample must always fit */
+		influxdb_buffer_init(&i->buffer, INFLUXDB_UDP_PAYLOAD);
+
+		return 0;
+	}
+
+	/* Lines are only dropped if the server does not keep up with twice the batch size */
+	for (unsigned j = 0; j < ARRAY_LEN(i->batch.buffers); j++)
+		influxdb_buffer_init(&i->batch.buffers[j], 2 * i->batch.max_bytes);
+
+	i->batch.active = &i->batch.buffers[0];
+	i->batch.spare = &i->batch.buffers[1];
+
+	i->batch.pending = false;
+	i->batch.overflow = false;
+	i->batch.stop = false;
+
+	i->batch.flushed = 0;
+	i->batch.dropped = 0;
+	i->batch.dropped_lines = 0;
+	i->batch.reconnects = 0;
+
+	ret = pthread_mutex_init(&i->batch.mutex, nullptr);
+	if (ret)
+		throw SystemError("Failed to initialize mutex");
+
+	ret = pthread_cond_init(&i->batch.cond, nullptr);
+	if (ret)
+		throw SystemError("Failed to initialize condition variable");
+
+	ret = pthread_create(&i->batch.thread, nullptr, influxdb_flusher, n);
+	if (ret)
+		throw SystemError("Failed to create flusher thread");
+
+	return 0;
+}
+
+int influxdb_close(struct vnode *n)
+{
+	struct influxdb *i = (struct influxdb *) n->_vd;
+
+	if (i->batch.enabled) {
+		pthread_mutex_lock(&i->batch.mutex);
+		i->batch.stop = true;
+		pthread_cond_signal(&i->batch.cond);
+		pthread_mutex_unlock(&i->batch.mutex);
+
+		/* The flusher thread sends the remaining lines before terminating */
+		pthread_join(i->batch.thread, nullptr);
+
+		if (i->batch.dropped_lines)
+			n->logger->warn("Dropped {} lines in {} batches", i->batch.dropped_lines, i->batch.dropped);
+
+		n->logger->info("Sent {} batches with {} reconnection attempts", i->batch.flushed, i->batch.reconnects);
+
+		for (unsigned j = 0; j < ARRAY_LEN(i->batch.buffers); j++)
+			influxdb_buffer_destroy(&i->batch.buffers[j]);
+
+		pthread_cond_destroy(&i->batch.cond);
+		pthread_mutex_destroy(&i->batch.mutex);
+	}
+	else
+		influxdb_buffer_destroy(&i->buffer);
+
+	if (i->protocol == influxdb::Protocol::HTTP)
+		influxdb_http_destroy(n);
+	else
+		influxdb_disconnect(n);
 
 	return 0;
 }
@@ -124,83 +727,66 @@ int influxdb_close(struct vnode *n)
 int influxdb_write(struct vnode *n, struct sample * const smps[], unsigned cnt)
 {
 	struct influxdb *i = (struct influxdb *) n->_vd;
+	int ret;
 
-	char *buf = nullptr;
-	ssize_t sentlen, buflen;
+	if (i->batch.enabled) {
+		pthread_mutex_lock(&i->batch.mutex);
 
-	for (unsigned k = 0; k < cnt; k++) {
-		const struct sample *smp = smps[k];
-
-		/* Key */
-		strcatf(&buf, "%s", i->key);
-
-		/* Fields */
-		for (unsigned j = 0; j < smp->length; j++) {
-			struct signal *sig = (struct signal *) vlist_at(smp->signals, j);
-			const union signal_data *data = &smp->data[j];
-
-			if (
-				sig->type != SignalType::BOOLEAN &&
-				sig->type != SignalType::FLOAT &&
-				sig->type != SignalType::INTEGER &&
-				sig->type != SignalType::COMPLEX
-			) {
-				n->logger->warn("Unsupported signal format. Skipping");
-				continue;
+		struct influxdb_buffer *b = i->batch.active;
+		unsigned lines = b->lines;
+
+		for (unsigned k = 0; k < cnt; k++) {
+			/* Drop the lines rather than blocking until the flusher thread caught up */
+			ret = influxdb_format(n, b, smps[k]);
+			if (ret) {
+				if (!i->batch.overflow && i->batch.dropped_lines == 0)
+					n->logger->warn("Dropping lines as the flusher thread can not keep up");
+
+				i->batch.overflow = true;
+				i->batch.dropped_lines++;
 			}
+		}
 
-			strcatf(&buf, "%c", j == 0 ? ' ' : ',');
+		/* Wake up the flusher to start the linger timer or to send a full batch */
+		if (!i->batch.pending) {
+			if (b->lines >= i->batch.max_lines || b->len >= i->batch.max_bytes) {
+				i->batch.pending = true;
+				pthread_cond_signal(&i->batch.cond);
+			}
+			else if (lines == 0 && b->lines > 0)
+				pthread_cond_signal(&i->batch.cond);
+		}
 
-			sig = (struct signal *) vlist_at(smp->signals, j);
-			if (!sig)
-				return -1;
+		pthread_mutex_unlock(&i->batch.mutex);
 
-			char name[32];
-			if (sig->name)
-				strncpy(name, sig->name, sizeof(name)-1);
-			else
-				snprintf(name, sizeof(name), "value%u", j);
+		return cnt;
+	}
 
-			if (sig->type == SignalType::COMPLEX) {
-				strcatf(&buf, "%s_re=%f, %s_im=%f",
-					name, std::real(data->z),
-					name, std::imag(data->z)
-				);
-			}
-			else {
-				strcatf(&buf, "%s=", name);
+	struct influxdb_buffer *b = &i->buffer;
 
-				switch (sig->type) {
-					case SignalType::BOOLEAN:
-						strcatf(&buf, "%s", data->b ? "true" : "false");
-						break;
+	influxdb_buffer_clear(b);
 
-					case SignalType::FLOAT:
-						strcatf(&buf, "%f", data->f);
-						break;
+	for (unsigned k = 0; k < cnt; k++) {
+		ret = influxdb_format(n, b, smps[k]);
+		if (ret) {
+			/* Send what we have so far and start over */
+			ret = influxdb_send(n, b->data, b->len);
+			if (ret < 0)
+				return -1;
 
-					case SignalType::INTEGER:
-						strcatf(&buf, "%" PRIi64, data->i);
-						break;
+			influxdb_buffer_clear(b);
 
-					default: { }
-				}
+			ret = influxdb_format(n, b, smps[k]);
+			if (ret) {
+				n->logger->warn("Sample is too large. Skipping");
+				continue;
 			}
 		}
-
-		/* Timestamp */
-		strcatf(&buf, " %lld%09lld\n", (long long) smp->ts.origin.tv_sec,
-					       (long long) smp->ts.origin.tv_nsec);
 	}
 
-	buflen = strlen(buf) + 1;
-	sentlen = send(i->sd, buf, buflen, 0);
-	if (sentlen < 0)
+	ret = influxdb_send(n, b->data, b->len);
+	if (ret < 0)
 		return -1;
-	else if (sentlen < buflen)
-		n->logger->warn("Partial sent");
-
-	free(buf);
 
 	return cnt;
 }
@@ -210,7 +796,16 @@ char * influxdb_print(struct vnode *n)
 	struct influxdb *i = (struct influxdb *) n->_vd;
 	char *buf = nullptr;
 
-	strcatf(&buf, "host=%s, port=%s, key=%s", i->host, i->port, i->key);
+	strcatf(&buf, "protocol=%s, host=%s, port=%s, key=%s",
+		i->protocol == influxdb::Protocol::HTTP ? "http" : "udp",
+		i->host, i->port, i->key);
+
+	if (i->protocol == influxdb::Protocol::HTTP)
+		strcatf(&buf, ", database=%s", i->database);
+
+	if (i->batch.enabled)
+		strcatf(&buf, ", batch.max_lines=%u, batch.max_bytes=%zu, batch.linger=%.3f",
+			i->batch.max_lines, i->batch.max_bytes, i->batch.linger);
 
 	return buf;
 }
@@ -223,6 +818,10 @@ static void register_plugin() {
 	p.description	= "Write results to InfluxDB";
 	p.vectorize	= 0;
 	p.size		= sizeof(struct influxdb);
+	p.type.start	= influxdb_type_start;
+	p.type.stop	= influxdb_type_stop;
+	p.init		= influxdb_init;
+	p.destroy	= influxdb_destroy;
 	p.parse		= influxdb_parse;
 	p.print		= influxdb_print;
 	p.start		= influxdb_open;
@@ -21,12 +21,16 @@
  *********************************************************************************/
 
 #include <cstring>
+#include <algorithm>
 #include <sys/syslog.h>
 #include <librdkafka/rdkafkacpp.h>
 
 #include <villas/node.h>
 #include <villas/nodes/kafka.hpp>
 #include <villas/utils.hpp>
+#include <villas/stats.hpp>
+#include <villas/timing.h>
+#include <villas/signal.h>
 #include <villas/exceptions.hpp>
 
 using namespace villas;
@@ -65,37 +69,91 @@ static void kafka_logger_cb(const rd_kafka_t *rk, int level, const char *fac, co
 	}
 }
 
-static void kafka_message_cb(void *ctx, const rd_kafka_message_t *msg)
+static void kafka_delivery_cb(rd_kafka_t *rk, const rd_kafka_message_t *msg, void *opaque)
 {
-	int ret;
-	struct vnode *n = (struct vnode *) ctx;
+	struct vnode *n = (struct vnode *) opaque;
 	struct kafka *k = (struct kafka *) n->_vd;
-	struct sample *smps[n->in.vectorize];
 
-	n->logger->debug("Received a message of {} bytes from broker {}", msg->len, k->server);
+	/* Buffers from the pool are not released by librdkafka itself */
+	if (msg->_private) {
+		pool_put(&k->producer.pool, msg->payload);
+		k->producer.inflight--;
+	}
+
+	if (msg->err) {
+		n->logger->warn("Failed to deliver message: {}", rd_kafka_err2str(msg->err));
+
+		if (n->stats)
+			n->stats->update(Stats::Metric::KAFKA_DELIVERY_ERRORS, 1);
 
-	ret = sample_alloc_many(&k->pool, smps, n->in.vectorize);
-	if (ret <= 0) {
-		n->logger->warn("Pool underrun in consumer");
 		return;
 	}
 
-	ret = k->formatter->sscan((char *) msg->payload, msg->len, nullptr, smps, n->in.vectorize);
-	if (ret < 0) {
-		n->logger->warn("Received an invalid message");
-		n->logger->warn("  Payload: {}", (char *) msg->payload);
+	int64_t latency = rd_kafka_message_latency(msg);
+	if (n->stats && latency >= 0)
+		n->stats->update(Stats::Metric::KAFKA_DELIVERY_LATENCY, latency * 1e-6);
+}
+
+/** Consume a batch of messages and enqueue the samples contained in them. */
+static void kafka_consume(struct vnode *n)
+{
+	int ret, alloced, scanned = 0, enqueued;
+	struct kafka *k = (struct kafka *) n->_vd;
+
+	ssize_t cnt;
+	rd_kafka_message_t *msgs[k->consumer.batch_size];
+
+	cnt = rd_kafka_consume_batch_queue(k->consumer.queue, k->timeout * 1000, msgs, k->consumer.batch_size);
+	if (cnt < 0) {
+		n->logger->warn("Failed to consume messages: {}", rd_kafka_err2str(rd_kafka_last_error()));
 		return;
 	}
-
-	if (ret == 0) {
-		n->logger->debug("Skip empty message");
-		sample_decref_many(smps, n->in.vectorize);
+	else if (cnt == 0)
 		return;
+
+	n->logger->debug("Received a batch of {} messages from broker {}", cnt, k->server);
+
+	if (n->stats)
+		n->stats->update(Stats::Metric::KAFKA_CONSUME_BATCH, cnt);
+
+	/* Each message may contain up to n->in.vectorize samples */
+	unsigned max = cnt * n->in.vectorize;
+	struct sample *smps[max];
+
+	alloced = sample_alloc_many(&k->pool, smps, max);
+	if (alloced <= 0)
+		n->logger->warn("Pool underrun in consumer");
+
+	for (ssize_t i = 0; i < cnt; i++) {
+		rd_kafka_message_t *msg = msgs[i];
+
+		if (msg->err) {
+			if (msg->err != RD_KAFKA_RESP_ERR__PARTITION_EOF)
+				n->logger->warn("Consumer error: {}", rd_kafka_message_errstr(msg));
+		}
+		else if (scanned < alloced) {
+			ret = k->formatter->sscan((char *) msg->payload, msg->len, nullptr, &smps[scanned], MIN(n->in.vectorize, (unsigned) (alloced - scanned)));
+			if (ret < 0) {
+				n->logger->warn("Received an invalid message");
+				n->logger->warn("  Payload: {}", (char *) msg->payload);
+			}
+			else if (ret == 0)
+				n->logger->debug("Skip empty message");
+			else
+				scanned += ret;
+		}
+
+		rd_kafka_message_destroy(msg);
 	}
 
-	ret = queue_signalled_push_many(&k->queue, (void **) smps, n->in.vectorize);
-	if (ret < (int) n->in.vectorize)
+	enqueued = scanned > 0
+		? queue_signalled_push_many(&k->queue, (void **) smps, scanned)
+		: 0;
+	if (enqueued < scanned)
 		n->logger->warn("Failed to enqueue samples");
+
+	if (alloced > enqueued)
+		sample_decref_many(&smps[enqueued], alloced - enqueued);
 }
 
 static void * kafka_loop_thread(void *ctx)
@@ -113,13 +171,12 @@ static void * kafka_loop_thread(void *ctx)
 			struct kafka *k = (struct kafka *) n->_vd;
 
 			// Execute kafka loop for this client
-			if (k->consumer.client) {
-				rd_kafka_message_t *msg = rd_kafka_consumer_poll(k->consumer.client, k->timeout * 1000);
-				if (msg) {
-					kafka_message_cb((void *) n, msg);
-					rd_kafka_message_destroy(msg);
-				}
-			}
+			if (k->consumer.client)
+				kafka_consume(n);
+
+			// Serve delivery reports of the producer
+			if (k->producer.client)
+				rd_kafka_poll(k->producer.client, k->consumer.client ? 0 : k->timeout * 1000);
 		}
 	}
 
@@ -148,10 +205,23 @@ int kafka_init(struct vnode *n)
 	k->client_id = nullptr;
 	k->timeout = 1.0;
 
+	k->properties = nullptr;
+
 	k->consumer.client = nullptr;
+	k->consumer.queue = nullptr;
 	k->consumer.group_id = nullptr;
+	k->consumer.batch_size = 64;
+
 	k->producer.client = nullptr;
 	k->producer.topic = nullptr;
+	k->producer.linger = -1;
+	k->producer.batch_size = 0;
+	k->producer.compression = nullptr;
+	k->producer.key = kafka::PartitionKey::NONE;
+	k->producer.key_signal = nullptr;
+	k->producer.key_index = -1;
+	k->producer.buffer_size = KAFKA_BUFFER_SIZE;
+	k->producer.inflight = 0;
 
 	k->sasl.mechanism = nullptr;
 	k->sasl.username = nullptr;
@@ -175,29 +245,83 @@ int kafka_parse(struct vnode *n, json_t *json)
 	const char *protocol;
 	const char *client_id = "villas-node";
 	const char *group_id = nullptr;
+	const char *compression = nullptr;
+	const char *key = nullptr;
+	const char *key_signal = nullptr;
+	int buffer_size = KAFKA_BUFFER_SIZE;
 
 	json_error_t err;
 	json_t *json_ssl = nullptr;
 	json_t *json_sasl = nullptr;
 	json_t *json_format = nullptr;
+	json_t *json_properties = nullptr;
 
-	ret = json_unpack_ex(json, &err, 0, "{ s?: { s?: s }, s?: { s?: s, s?: s }, s?: o, s: s, s?: F, s: s, s?: s, s?: o, s?: o }",
+	ret = json_unpack_ex(json, &err, 0, "{ s?: { s?: s, s?: F, s?: i, s?: s, s?: s, s?: s, s?: i }, s?: { s?: s, s?: s, s?: i }, s?: o, s: s, s?: F, s: s, s?: s, s?: o, s?: o, s?: o }",
 		"out",
 			"produce", &produce,
+			"linger", &k->producer.linger,
+			"batch_size", &k->producer.batch_size,
+			"compression", &compression,
+			"key", &key,
+			"key_signal", &key_signal,
+			"buffer_size", &buffer_size,
 		"in",
 			"consume", &consume,
 			"group_id", &group_id,
+			"batch_size", &k->consumer.batch_size,
 		"format", &json_format,
 		"server", &server,
 		"timeout", &k->timeout,
 		"protocol", &protocol,
 		"client_id", &client_id,
 		"ssl", &json_ssl,
-		"sasl", &json_sasl
+		"sasl", &json_sasl,
+		"properties", &json_properties
 	);
 	if (ret)
 		throw ConfigError(json, err, "node-config-node-kafka");
 
+	if (buffer_size <= 0 || buffer_size > KAFKA_MAX_FRAME_SIZE)
+		throw ConfigError(json, "node-config-node-kafka-buffer-size", "Setting 'out.buffer_size' must be between 1 and {}", KAFKA_MAX_FRAME_SIZE);
+
+	if (k->consumer.batch_size <= 0)
+		throw ConfigError(json, "node-config-node-kafka-batch-size", "Setting 'in.batch_size' must be positive");
+
+	if (k->producer.batch_size < 0)
+		throw ConfigError(json, "node-config-node-kafka-batch-size", "Setting 'out.batch_size' must not be negative");
+
+	k->producer.buffer_size = buffer_size;
+	k->producer.compression = compression ? strdup(compression) : nullptr;
+
+	if (!key || !strcmp(key, "none"))
+		k->producer.key = kafka::PartitionKey::NONE;
+	else if (!strcmp(key, "node"))
+		k->producer.key = kafka::PartitionKey::NODE;
+	else if (!strcmp(key, "signal")) {
+		if (!key_signal)
+			throw ConfigError(json, "node-config-node-kafka-key", "Setting 'out.key_signal' is required for partition key 'signal'");
+
+		k->producer.key = kafka::PartitionKey::SIGNAL;
+		k->producer.key_signal = strdup(key_signal);
+	}
+	else
+		throw ConfigError(json, "node-config-node-kafka-key", "Invalid partition key: {}", key);
+
+	if (json_properties) {
+		const char *name;
+		json_t *json_value;
+
+		if (!json_is_object(json_properties))
+			throw ConfigError(json_properties, "node-config-node-kafka-properties", "Setting 'properties' must be an object");
+
+		json_object_foreach(json_properties, name, json_value) {
+			if (!json_is_string(json_value) && !json_is_number(json_value) && !json_is_boolean(json_value))
+				throw ConfigError(json_value, "node-config-node-kafka-properties", "Invalid value for property '{}'", name);
+		}
+
+		k->properties = json_incref(json_properties);
+	}
+
 	k->server = strdup(server);
 	k->produce = produce ? strdup(produce) : nullptr;
 	k->consume = consume ? strdup(consume) : nullptr;
@@ -268,6 +392,12 @@ int kafka_prepare(struct vnode *n)
 	if (ret)
 		return ret;
 
+	if (k->produce) {
+		ret = pool_init(&k->producer.pool, KAFKA_POOL_LENGTH, k->producer.buffer_size);
+		if (ret)
+			return ret;
+	}
+
 	return 0;
 }
 
@@ -284,11 +414,33 @@ char * kafka_print(struct vnode *n)
 	);
 
 	/* Only show if not default */
-	if (k->produce)
+	if (k->produce) {
 		strcatf(&buf, ", out.produce=%s", k->produce);
 
+		if (k->producer.linger >= 0)
+			strcatf(&buf, ", out.linger=%.3f", k->producer.linger);
+
+		if (k->producer.batch_size > 0)
+			strcatf(&buf, ", out.batch_size=%d", k->producer.batch_size);
+
+		if (k->producer.compression)
+			strcatf(&buf, ", out.compression=%s", k->producer.compression);
+
+		switch (k->producer.key) {
+			case kafka::PartitionKey::NODE:
+				strcatf(&buf, ", out.key=node");
+				break;
+
+			case kafka::PartitionKey::SIGNAL:
+				strcatf(&buf, ", out.key=signal(%s)", k->producer.key_signal);
+				break;
+
+			default: { }
+		}
+	}
+
 	if (k->consume)
-		strcatf(&buf, ", in.consume=%s", k->consume);
+		strcatf(&buf, ", in.consume=%s, in.batch_size=%d", k->consume, k->consumer.batch_size);
 
 	return buf;
 }
@@ -298,9 +450,15 @@ int kafka_destroy(struct vnode *n)
 	int ret;
 	struct kafka *k = (struct kafka *) n->_vd;
 
+	if (k->producer.topic)
+		rd_kafka_topic_destroy(k->producer.topic);
+
 	if (k->producer.client)
 		rd_kafka_destroy(k->producer.client);
 
+	if (k->consumer.queue)
+		rd_kafka_queue_destroy(k->consumer.queue);
+
 	if (k->consumer.client)
 		rd_kafka_destroy(k->consumer.client);
 
@@ -310,6 +468,13 @@ int kafka_destroy(struct vnode *n)
 	if (ret)
 		return ret;
 
+	/* Must be destroyed after the producer as librdkafka might still refer to its buffers */
+	if (k->produce) {
+		ret = pool_destroy(&k->producer.pool);
+		if (ret)
+			return ret;
+	}
+
 	ret = queue_signalled_destroy(&k->queue);
 	if (ret)
 		return ret;
@@ -326,6 +491,15 @@ int kafka_destroy(struct vnode *n)
 	if (k->client_id)
 		free(k->client_id);
 
+	if (k->producer.compression)
+		free(k->producer.compression);
+
+	if (k->producer.key_signal)
+		free(k->producer.key_signal);
+
+	if (k->properties)
+		json_decref(k->properties);
+
 	free(k->server);
 
 	return 0;
@@ -337,6 +511,17 @@ int kafka_start(struct vnode *n)
 	char errstr[1024];
 	struct kafka *k = (struct kafka *) n->_vd;
 
+	/* Resolve the key signal here rather than failing in the path thread */
+	if (k->producer.key == kafka::PartitionKey::SIGNAL) {
+		struct vlist *signals = node_output_signals(n);
+		if (!signals)
+			signals = &n->out.signals;
+
+		k->producer.key_index = vlist_lookup_index<struct signal>(signals, k->producer.key_signal);
+		if (k->producer.key_index < 0)
+			throw ConfigError(n->config, "node-config-node-kafka-key", "Key signal '{}' is not an output signal of node {}", k->producer.key_signal, *n);
+	}
+
 	rd_kafka_conf_t *rdkconf = rd_kafka_conf_new();
 	if (!rdkconf)
 		throw MemoryAllocationError();
@@ -361,6 +546,32 @@ int kafka_start(struct vnode *n)
 			goto kafka_config_error;
 	}
 
+	if (k->properties) {
+		const char *name;
+		json_t *json_value;
+
+		json_object_foreach(k->properties, name, json_value) {
+			std::string value;
+
+			// libconfig does not allow dots in setting names
+			std::string property = name;
+			std::replace(property.begin(), property.end(), '_', '.');
+
+			if (json_is_string(json_value))
+				value = json_string_value(json_value);
+			else if (json_is_integer(json_value))
+				value = std::to_string(json_integer_value(json_value));
+			else if (json_is_real(json_value))
+				value = fmt::format("{}", json_real_value(json_value));
+			else
+				value = json_is_true(json_value) ? "true" : "false";
+
+			ret = rd_kafka_conf_set(rdkconf, property.c_str(), value.c_str(), errstr, sizeof(errstr));
+			if (ret != RD_KAFKA_CONF_OK)
+				goto kafka_config_error;
+		}
+	}
+
 	if (!strcmp(k->protocol, "SASL_PLAINTEXT") || !strcmp(k->protocol, "SASL_SSL")) {
 		ret = rd_kafka_conf_set(rdkconf, "sasl.mechanisms", k->sasl.mechanism, errstr, sizeof(errstr));
 		if (ret != RD_KAFKA_CONF_OK)
@@ -382,6 +593,31 @@ int kafka_start(struct vnode *n)
 		if (!rdkconf_prod)
 			throw MemoryAllocationError();
 
+		rd_kafka_conf_set_opaque(rdkconf_prod, n);
+		rd_kafka_conf_set_dr_msg_cb(rdkconf_prod, kafka_delivery_cb);
+
+		if (k->producer.linger >= 0) {
+			auto linger = fmt::format("{}", k->producer.linger * 1e3);
+
+			ret = rd_kafka_conf_set(rdkconf_prod, "linger.ms", linger.c_str(), errstr, sizeof(errstr));
+			if (ret != RD_KAFKA_CONF_OK)
+				goto kafka_config_error;
+		}
+
+		if (k->producer.batch_size > 0) {
+			auto batch_size = std::to_string(k->producer.batch_size);
+
+			ret = rd_kafka_conf_set(rdkconf_prod, "batch.num.messages", batch_size.c_str(), errstr, sizeof(errstr));
+			if (ret != RD_KAFKA_CONF_OK)
+				goto kafka_config_error;
+		}
+
+		if (k->producer.compression) {
+			ret = rd_kafka_conf_set(rdkconf_prod, "compression.codec", k->producer.compression, errstr, sizeof(errstr));
+			if (ret != RD_KAFKA_CONF_OK)
+				goto kafka_config_error;
+		}
+
 		k->producer.client = rd_kafka_new(RD_KAFKA_PRODUCER, rdkconf_prod, errstr, sizeof(errstr));
 		if (!k->producer.client)
 			goto kafka_config_error;
@@ -428,6 +664,14 @@ int kafka_start(struct vnode *n)
 		if (ret != RD_KAFKA_RESP_ERR_NO_ERROR)
 			throw RuntimeError("Error subscribing to {} at {}: {}", k->consume, k->server, rd_kafka_err2str((rd_kafka_resp_err_t) ret));
 
+		// Redirect the main queue to the consumer queue so that
+		// a single rd_kafka_consume_batch_queue() serves all events
+		rd_kafka_poll_set_consumer(k->consumer.client);
+
+		k->consumer.queue = rd_kafka_queue_get_consumer(k->consumer.client);
+		if (!k->consumer.queue)
+			throw RuntimeError("Failed to get consumer queue");
+
 		n->logger->info("Subscribed consumer from bootstrap server {}", k->server);
 	}
 
@@ -459,8 +703,13 @@ int kafka_stop(struct vnode *n)
 
 		/* If the output queue is still not empty there is an issue
 		 * with producing messages to the clusters. */
-		if (rd_kafka_outq_len(k->producer.client) > 0)
+		if (rd_kafka_outq_len(k->producer.client) > 0) {
 			n->logger->warn("{} message(s) were not delivered", rd_kafka_outq_len(k->producer.client));
+
+			// Return the remaining buffers to the pool
+			rd_kafka_purge(k->producer.client, RD_KAFKA_PURGE_F_QUEUE | RD_KAFKA_PURGE_F_INFLIGHT);
+			rd_kafka_poll(k->producer.client, 0);
+		}
 	}
 
 	// Unregister client from global kafka client list
@@ -539,32 +788,143 @@ int kafka_read(struct vnode *n, struct sample * const smps[], unsigned cnt)
 	return pulled;
 }
 
+/** Format samples into a buffer which is handed over to librdkafka.
+ *
+ * If possible, the samples are formatted into a buffer of the pool which
+ * is returned by the delivery report callback. Larger messages are formatted
+ * into a heap buffer which is released by librdkafka (RD_KAFKA_MSG_F_FREE).
+ *
+ * @return The number of samples in the buffer or a negative value on errors.
+ */
+static int kafka_format(struct vnode *n, struct sample * const smps[], unsigned cnt, char **buf, size_t *wbytes, bool *pooled)
+{
+	int written;
+	struct kafka *k = (struct kafka *) n->_vd;
+
+	*buf = (char *) pool_get(&k->producer.pool);
+	if (*buf) {
+		written = k->formatter->sprint(*buf, k->producer.buffer_size, wbytes, smps, cnt);
+		if (written == (int) cnt && *wbytes <= k->producer.buffer_size) {
+			*pooled = true;
+			return written;
+		}
+
+		pool_put(&k->producer.pool, *buf);
+	}
+
+	/* Pool exhausted or buffer too small */
+	*pooled = false;
+
+	for (size_t size = 2 * k->producer.buffer_size; size <= KAFKA_MAX_FRAME_SIZE; size *= 2) {
+		*buf = (char *) malloc(size);
+		if (!*buf)
+			throw MemoryAllocationError();
+
+		written = k->formatter->sprint(*buf, size, wbytes, smps, cnt);
+		if (written < 0) {
+			free(*buf);
+			return written;
+		}
+
+		/* Split the vector only if we hit the maximum message size */
+		if (written > 0 && *wbytes <= size && (written == (int) cnt || 2 * size > KAFKA_MAX_FRAME_SIZE))
+			return written;
+
+		free(*buf);
+	}
+
+	*buf = nullptr;
+
+	return -1;
+}
+
+/** Get the message key for a vector of samples.
+ *
+ * @return The length of the key or 0 if messages are not keyed.
+ */
+static size_t kafka_key(struct vnode *n, struct sample *smp, char *buf, size_t len)
+{
+	struct kafka *k = (struct kafka *) n->_vd;
+
+	switch (k->producer.key) {
+		case kafka::PartitionKey::NODE:
+			return snprintf(buf, len, "%s", n->name);
+
+		case kafka::PartitionKey::SIGNAL: {
+			/* The index has been resolved by kafka_start() */
+			unsigned index = k->producer.key_index;
+			if (index >= smp->length)
+				return 0;
+
+			struct signal *sig = (struct signal *) vlist_at_safe(smp->signals, index);
+			if (!sig)
+				return 0;
+
+			return signal_data_print_str(&smp->data[index], sig->type, buf, len);
+		}
+
+		default:
+			return 0;
+	}
+}
+
 int kafka_write(struct vnode *n, struct sample * const smps[], unsigned cnt)
 {
-	int ret;
+	int ret, written;
 	struct kafka *k = (struct kafka *) n->_vd;
 
+	if (!k->produce) {
+		n->logger->warn("No produce possible because no produce topic is configured");
+		return cnt;
+	}
+
+	char *buf;
+	bool pooled;
 	size_t wbytes;
 
-	char data[4096];
+	written = kafka_format(n, smps, cnt, &buf, &wbytes, &pooled);
+	if (written <= 0) {
+		n->logger->warn("Failed to format message");
+		return -1;
+	}
+
+	char key[128];
+	size_t keylen = kafka_key(n, smps[0], key, sizeof(key));
 
-	ret = k->formatter->sprint(data, sizeof(data), &wbytes, smps, cnt);
-	if (ret < 0)
-		return ret;
+	if (pooled)
+		k->producer.inflight++;
 
-	if (k->produce) {
-		ret = rd_kafka_produce(k->producer.topic, RD_KAFKA_PARTITION_UA, RD_KAFKA_MSG_F_COPY,
-			data, wbytes, NULL, 0, NULL);
+	struct timespec start = time_now();
+
+	while (true) {
+		/* The message opaque marks buffers which must be returned to the pool */
+		ret = rd_kafka_produce(k->producer.topic, RD_KAFKA_PARTITION_UA, pooled ? 0 : RD_KAFKA_MSG_F_FREE,
+			buf, wbytes, keylen ? key : nullptr, MIN(keylen, sizeof(key) - 1), pooled ? buf : nullptr);
+		if (ret == 0)
+			break;
+
+		rd_kafka_resp_err_t err = rd_kafka_last_error();
+		struct timespec now = time_now();
+		if (err == RD_KAFKA_RESP_ERR__QUEUE_FULL && time_delta(&start, &now) < k->timeout) {
+			/* Wait for delivery reports to free up space in the local queue */
+			rd_kafka_poll(k->producer.client, 10);
+			continue;
+		}
 
-		if (ret != RD_KAFKA_RESP_ERR_NO_ERROR) {
-			n->logger->warn("Publish failed");
-			return -abs(ret);
+		/* On failure the buffer is still owned by us */
+		if (pooled) {
+			pool_put(&k->producer.pool, buf);
+			k->producer.inflight--;
 		}
+		else
+			free(buf);
+
+		n->logger->warn("Publish failed: {}", rd_kafka_err2str(err));
+
+		return -1;
 	}
-	else
-		n->logger->warn("No produce possible because no produce topic is configured");
 
-	return cnt;
+	return written;
 }
 
 int kafka_poll_fds(struct vnode *n, int fds[])
@@ -25,6 +25,7 @@
 #include <villas/node/config.h>
 #include <villas/node.h>
 #include <villas/nodes/loopback.hpp>
+#include <villas/nodes/loopback_internal.hpp>
 #include <villas/exceptions.hpp>
 #include <villas/memory.h>
 #include <villas/utils.hpp>
@@ -41,6 +42,7 @@ int loopback_init(struct vnode *n)
 
 	l->mode = QueueSignalledMode::AUTO;
 	l->queuelen = DEFAULT_QUEUE_LENGTH;
+	l->zero_copy = 0;
 
 	return 0;
 }
@@ -53,9 +55,10 @@ int loopback_parse(struct vnode *n, json_t *json)
 	json_error_t err;
 	int ret;
 
-	ret = json_unpack_ex(json, &err, 0, "{ s?: i, s?: s }",
+	ret = json_unpack_ex(json, &err, 0, "{ s?: i, s?: s, s?: b }",
 		"queuelen", &l->queuelen,
-		"mode", &mode_str
+		"mode", &mode_str,
+		"zero_copy", &l->zero_copy
 	);
 	if (ret)
 		throw ConfigError(json, err, "node-config-node-loopback");
@@ -75,6 +78,10 @@ int loopback_parse(struct vnode *n, json_t *json)
 		else if (!strcmp(mode_str, "pipe"))
 			l->mode = QueueSignalledMode::PIPE;
 #endif /* __APPLE__ */
+#ifdef __linux__
+		else if (!strcmp(mode_str, "futex"))
+			l->mode = QueueSignalledMode::FUTEX;
+#endif /* __linux__ */
 		else
 			throw ConfigError(json, "node-config-node-loopback-mode", "Unknown mode '{}'", mode_str);
 	}
@@ -105,10 +112,7 @@ int loopback_read(struct vnode *n, struct sample * const smps[], unsigned cnt)
 
 	avail = queue_signalled_pull_many(&l->queue, (void **) cpys, cnt);
 
-	for (int i = 0; i < avail; i++) {
-		sample_copy(smps[i], cpys[i]);
-		sample_decref(cpys[i]);
-	}
+	loopback_internal_pass(n, smps, cpys, avail, l->zero_copy);
 
 	return avail;
 }
@@ -127,7 +131,7 @@ char * loopback_print(struct vnode *n)
 	struct loopback *l = (struct loopback *) n->_vd;
 	char *buf = nullptr;
 
-	strcatf(&buf, "queuelen=%d", l->queuelen);
+	strcatf(&buf, "queuelen=%d, zero_copy=%s", l->queuelen, l->zero_copy ? "yes" : "no");
 
 	return buf;
 }
@@ -37,7 +37,7 @@ int loopback_internal_init(struct vnode *n)
 {
 	struct loopback_internal *l = (struct loopback_internal *) n->_vd;
 
-	l->queuelen = DEFAULT_QUEUE_LENGTH;
+	l->zero_copy = 1;
 
 	return 0;
 }
@@ -51,14 +51,27 @@ int loopback_internal_prepare(struct vnode *n)
 	if (ret)
 		return -1;
 
-	return queue_signalled_init(&l->queue, l->queuelen, memory_default, QueueSignalledMode::EVENTFD);
+	return broadcast_ring_consumer_init(&l->consumer, l->ring);
+}
+
+int loopback_internal_stop(struct vnode *n)
+{
+	struct loopback_internal *l = (struct loopback_internal *) n->_vd;
+
+	/* Do not hold back the master path source anymore */
+	broadcast_ring_consumer_detach(&l->consumer);
+
+	if (l->consumer.overruns > 0)
+		n->logger->warn("Missed {} samples of node {}", l->consumer.overruns, *l->source);
+
+	return 0;
 }
 
 int loopback_internal_destroy(struct vnode *n)
 {
 	struct loopback_internal *l= (struct loopback_internal *) n->_vd;
 
-	return queue_signalled_destroy(&l->queue);
+	return broadcast_ring_consumer_destroy(&l->consumer);
 }
 
 int loopback_internal_read(struct vnode *n, struct sample * const smps[], unsigned cnt)
@@ -68,33 +81,47 @@ int loopback_internal_read(struct vnode *n, struct sample * const smps[], unsign
 	struct loopback_internal *l = (struct loopback_internal *) n->_vd;
 	struct sample *cpys[cnt];
 
-	avail = queue_signalled_pull_many(&l->queue, (void **) cpys, cnt);
+	avail = broadcast_ring_consume_wait(&l->consumer, cpys, cnt);
+	if (avail < 0)
+		return avail;
 
-	sample_copy_many(smps, cpys, avail);
-	sample_decref_many(cpys, avail);
+	loopback_internal_pass(n, smps, cpys, avail, l->zero_copy);
 
 	return avail;
 }
 
-int loopback_internal_write(struct vnode *n, struct sample * const smps[], unsigned cnt)
+void loopback_internal_pass(struct vnode *n, struct sample * const smps[], struct sample * const pulled[], unsigned cnt, bool zero_copy)
 {
-	struct loopback_internal *l = (struct loopback_internal *) n->_vd;
-
-	sample_incref_many(smps, cnt);
-
-	return queue_signalled_push_many(&l->queue, (void **) smps, cnt);
+	/* The caller of node_read() owns a mutable array */
+	struct sample **dsts = const_cast<struct sample **>(smps);
+
+	bool may_modify = false;
+#ifdef WITH_HOOKS
+	may_modify = vlist_length(&n->in.hooks) > 0;
+#endif /* WITH_HOOKS */
+
+	for (unsigned i = 0; i < cnt; i++) {
+		if (zero_copy && (!may_modify || atomic_load(&pulled[i]->refcnt) == 1)) {
+			sample_decref(dsts[i]);
+			dsts[i] = pulled[i];
+		}
+		else {
+			sample_copy(dsts[i], pulled[i]);
+			sample_decref(pulled[i]);
+		}
+	}
 }
 
 int loopback_internal_poll_fds(struct vnode *n, int fds[])
 {
 	struct loopback_internal *l = (struct loopback_internal *) n->_vd;
 
-	fds[0] = queue_signalled_fd(&l->queue);
+	fds[0] = broadcast_ring_consumer_fd(&l->consumer);
 
 	return 1;
 }
 
-struct vnode * loopback_internal_create(struct vnode *orig)
+struct vnode * loopback_internal_create(struct vnode *orig, struct broadcast_ring *ring)
 {
 	int ret;
 	struct vnode *n;
@@ -111,6 +138,11 @@ struct vnode * loopback_internal_create(struct vnode *orig)
 	l = (struct loopback_internal *) n->_vd;
 
 	l->source = orig;
+	l->ring = ring;
+
+	/* The builtin read hooks have already been applied by the master path source.
+	 * Skipping them here also keeps the shared samples read-only for zero-copy. */
+	n->in.builtin = 0;
 
 	asprintf(&n->name, "%s_lo%zu", node_name_short(orig), vlist_length(&orig->sources));
 
@@ -126,9 +158,9 @@ static void register_plugin() {
 	p.size		= sizeof(struct loopback_internal);
 	p.prepare	= loopback_internal_prepare;
 	p.init		= loopback_internal_init;
+	p.stop		= loopback_internal_stop;
 	p.destroy	= loopback_internal_destroy;
 	p.read		= loopback_internal_read;
-	p.write		= loopback_internal_write;
 	p.poll_fds	= loopback_internal_poll_fds;
 
 	if (!node_types)
@@ -21,52 +21,179 @@
  *********************************************************************************/
 
 #include <cstring>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <mosquitto.h>
 
 #include <villas/node.h>
 #include <villas/nodes/mqtt.hpp>
 #include <villas/utils.hpp>
+#include <villas/timing.h>
+#include <villas/stats.hpp>
 #include <villas/exceptions.hpp>
 
 using namespace villas;
 using namespace villas::node;
 using namespace villas::utils;
 
-// Each process has a list of clients for which a thread invokes the mosquitto loop
+// Each process has a list of clients which are serviced by a single event loop thread
 static struct vlist clients;
 static pthread_t thread;
+static pthread_mutex_t clients_lock = PTHREAD_MUTEX_INITIALIZER;
+static int epoll_fd = -1;
+static int wakeup_fd = -1;
+static std::atomic<bool> stop;
 static Logger logger;
 
-static void * mosquitto_loop_thread(void *ctx)
+/** The message which is currently published by mqtt_write() in this thread.
+ *
+ * libmosquitto assigns the message id and invokes the publish callback
+ * of QoS 0 messages within mosquitto_publish().
+ */
+static thread_local struct {
+	const struct timespec *ts;
+	const int *mid;
+} mqtt_publishing;
+
+/** Wake up the event loop thread, e.g. for sending queued messages */
+static void mqtt_wakeup()
+{
+	ssize_t ret;
+	uint64_t incr = 1;
+
+	ret = write(wakeup_fd, &incr, sizeof(incr));
+	if (ret != sizeof(incr))
+		logger->warn("Failed to wake up event loop: {}", strerror(errno));
+}
+
+/** Register the current socket of the client with epoll and update the requested events */
+static void mqtt_loop_update(struct vnode *n)
+{
+	int ret, fd;
+	uint32_t events;
+	struct mqtt *m = (struct mqtt *) n->_vd;
+	struct epoll_event ev;
+
+	fd = mosquitto_socket(m->client);
+	events = EPOLLIN | (mosquitto_want_write(m->client) ? EPOLLOUT : 0);
+
+	/* The socket changes after a reconnect */
+	if (fd != m->loop.fd) {
+		if (m->loop.fd >= 0)
+			epoll_ctl(epoll_fd, EPOLL_CTL_DEL, m->loop.fd, nullptr);
+
+		m->loop.fd = -1;
+
+		if (fd >= 0) {
+			ev.events = events;
+			ev.data.ptr = n;
+
+			ret = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev);
+			if (ret)
+				n->logger->warn("Failed to register socket with event loop: {}", strerror(errno));
+			else {
+				m->loop.fd = fd;
+				m->loop.events = events;
+			}
+		}
+	}
+	else if (fd >= 0 && events != m->loop.events) {
+		ev.events = events;
+		ev.data.ptr = n;
+
+		ret = epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev);
+		if (ret)
+			n->logger->warn("Failed to update socket of event loop: {}", strerror(errno));
+		else
+			m->loop.events = events;
+	}
+}
+
+static void mqtt_loop_reconnect(struct vnode *n, int reason)
 {
 	int ret;
+	struct mqtt *m = (struct mqtt *) n->_vd;
+	struct timespec now = time_now();
+
+	/* Limit reconnection attempts to one per second */
+	if (time_delta(&m->loop.reconnect, &now) < 1)
+		return;
+
+	m->loop.reconnect = now;
+
+	n->logger->warn("Connection error: {}, attempting reconnect", mosquitto_strerror(reason));
+
+	ret = mosquitto_reconnect(m->client);
+	if (ret != MOSQ_ERR_SUCCESS)
+		n->logger->warn("Reconnection to broker failed: {}", mosquitto_strerror(ret));
+	else
+		n->logger->warn("Successfully reconnected to broker: {}", mosquitto_strerror(ret));
+}
+
+static void * mosquitto_loop_thread(void *ctx)
+{
+	int ret, nfds;
+	struct epoll_event evs[32];
+
+	while (!stop) {
+		nfds = epoll_wait(epoll_fd, evs, ARRAY_LEN(evs), 1000);
+		if (nfds < 0) {
+			if (errno == EINTR)
+				continue;
+
+			logger->error("Failed to wait for events: {}", strerror(errno));
+			break;
+		}
+
+		pthread_mutex_lock(&clients_lock);
+
+		for (int i = 0; i < nfds; i++) {
+			if (evs[i].data.ptr == nullptr) {
+				uint64_t cnt;
+				ssize_t bytes __attribute__((unused)) = read(wakeup_fd, &cnt, sizeof(cnt));
+				continue;
+			}
+
+			struct vnode *n = (struct vnode *) evs[i].data.ptr;
+			struct mqtt *m = (struct mqtt *) n->_vd;
 
-	// Set the cancel type of this thread to async
-	ret = pthread_setcanceltype(PTHREAD_CANCEL_ASYNCHRONOUS, nullptr);
-	if (ret != 0)
-		throw RuntimeError("Unable to set cancel type of MQTT communication thread to asynchronous.");
+			/* The client might have been stopped in the meantime */
+			if (!m->loop.registered)
+				continue;
 
-	while (true) {
-		for (unsigned i = 0; i < vlist_length(&clients); i++) {
+			ret = MOSQ_ERR_SUCCESS;
+
+			if (evs[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+				ret = mosquitto_loop_read(m->client, MQTT_MAX_PACKETS);
+
+			if (ret == MOSQ_ERR_SUCCESS && evs[i].events & EPOLLOUT)
+				ret = mosquitto_loop_write(m->client, MQTT_MAX_PACKETS);
+
+			if (ret != MOSQ_ERR_SUCCESS)
+				mqtt_loop_reconnect(n, ret);
+		}
+
+		/* Send queued messages, keep-alive pings and retries */
+		for (size_t i = 0; i < vlist_length(&clients); i++) {
 			struct vnode *n = (struct vnode *) vlist_at(&clients, i);
 			struct mqtt *m = (struct mqtt *) n->_vd;
 
-			// Execute mosquitto loop for this client
-			ret = mosquitto_loop(m->client, 0, 1);
-			if (ret) {
-				n->logger->warn("Connection error: {}, attempting reconnect", mosquitto_strerror(ret));
+			ret = MOSQ_ERR_SUCCESS;
 
-				ret = mosquitto_reconnect(m->client);
-				if (ret != MOSQ_ERR_SUCCESS)
-					n->logger->warn("Reconnection to broker failed: {}", mosquitto_strerror(ret));
-				else
-					n->logger->warn("Successfully reconnected to broker: {}", mosquitto_strerror(ret));
+			if (mosquitto_want_write(m->client))
+				ret = mosquitto_loop_write(m->client, MQTT_MAX_PACKETS);
 
-				ret = mosquitto_loop(m->client, 0, 1);
-				if (ret != MOSQ_ERR_SUCCESS)
-					n->logger->warn("Persisting connection error: {}", mosquitto_strerror(ret));
-			}
+			if (ret == MOSQ_ERR_SUCCESS)
+				ret = mosquitto_loop_misc(m->client);
+
+			if (ret != MOSQ_ERR_SUCCESS)
+				mqtt_loop_reconnect(n, ret);
+
+			mqtt_loop_update(n);
 		}
+
+		pthread_mutex_unlock(&clients_lock);
 	}
 
 	return nullptr;
@@ -151,9 +278,41 @@ static void mqtt_message_cb(struct mosquitto *mosq, void *ctx, const struct mosq
 		return;
 	}
 
-	ret = queue_signalled_push_many(&m->queue, (void **) smps, n->in.vectorize);
-	if (ret < (int) n->in.vectorize)
+	int parsed = ret;
+
+	ret = queue_signalled_push_many(&m->queue, (void **) smps, parsed);
+	if (ret < parsed)
 		n->logger->warn("Failed to enqueue samples");
+
+	/* Release unused samples back to pool */
+	if (ret < (int) n->in.vectorize)
+		sample_decref_many(&smps[ret], n->in.vectorize - ret);
+}
+
+static void mqtt_publish_cb(struct mosquitto *mosq, void *ctx, int mid)
+{
+	struct vnode *n = (struct vnode *) ctx;
+	struct mqtt *m = (struct mqtt *) n->_vd;
+	struct timespec now = time_now();
+	const struct timespec *start;
+
+	if (!n->stats)
+		return;
+
+	/* QoS 0 messages are usually written before mosquitto_publish() returns */
+	if (mqtt_publishing.ts && *mqtt_publishing.mid == mid)
+		start = mqtt_publishing.ts;
+	else {
+		auto &p = m->published[mid & (MQTT_LATENCY_SLOTS - 1)];
+
+		/* The slot might have been reused already */
+		if (p.mid.load(std::memory_order_acquire) != mid)
+			return;
+
+		start = &p.ts;
+	}
+
+	n->stats->update(Stats::Metric::MQTT_PUBLISH_LATENCY, time_delta(start, &now));
 }
 
 static void mqtt_subscribe_cb(struct mosquitto *mosq, void *ctx, int mid, int qos_count, const int *granted_qos)
@@ -191,6 +350,7 @@ int mqtt_init(struct vnode *n)
 	mosquitto_disconnect_callback_set(m->client, mqtt_disconnect_cb);
 	mosquitto_message_callback_set(m->client, mqtt_message_cb);
 	mosquitto_subscribe_callback_set(m->client, mqtt_subscribe_cb);
+	mosquitto_publish_callback_set(m->client, mqtt_publish_cb);
 
 	/* Default values */
 	m->port = 1883;
@@ -198,6 +358,14 @@ int mqtt_init(struct vnode *n)
 	m->retain = 0;
 	m->keepalive = 5; /* 5 second, minimum required for libmosquitto */
 
+	m->loop.fd = -1;
+	m->loop.events = 0;
+	m->loop.registered = false;
+	m->loop.reconnect = { 0, 0 };
+
+	for (unsigned i = 0; i < MQTT_LATENCY_SLOTS; i++)
+		m->published[i].mid = -1;
+
 	m->host = nullptr;
 	m->username = nullptr;
 	m->password = nullptr;
@@ -338,11 +506,12 @@ char * mqtt_print(struct vnode *n)
 
 	char *buf = nullptr;
 
-	strcatf(&buf, "host=%s, port=%d, keepalive=%d, ssl=%s",
+	strcatf(&buf, "host=%s, port=%d, keepalive=%d, ssl=%s, qos=%d",
 		m->host,
 		m->port,
 		m->keepalive,
-		m->ssl.enabled ? "yes" : "no"
+		m->ssl.enabled ? "yes" : "no",
+		m->qos
 	);
 
 	/* Only show if not default */
@@ -415,8 +584,14 @@ int mqtt_start(struct vnode *n)
 		goto mosquitto_error;
 
 	// Add client to global list of MQTT clients
-	// so that thread can call mosquitto loop for this client
+	// so that the event loop services this client
+	pthread_mutex_lock(&clients_lock);
+
+	m->loop.registered = true;
 	vlist_push(&clients, n);
+	mqtt_loop_update(n);
+
+	pthread_mutex_unlock(&clients_lock);
 
 	return 0;
 
@@ -434,12 +609,25 @@ int mqtt_stop(struct vnode *n)
 	// Unregister client from global MQTT client list
 	// so that mosquitto loop is no longer invoked  for this client
 	// important to do that before disconnecting from broker, otherwise, mosquitto thread will attempt to reconnect
+	pthread_mutex_lock(&clients_lock);
+
+	m->loop.registered = false;
 	vlist_remove(&clients, vlist_index(&clients, n));
 
+	if (m->loop.fd >= 0) {
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, m->loop.fd, nullptr);
+		m->loop.fd = -1;
+	}
+
+	pthread_mutex_unlock(&clients_lock);
+
 	ret = mosquitto_disconnect(m->client);
 	if (ret != MOSQ_ERR_SUCCESS)
 		goto mosquitto_error;
 
+	/* Nobody else sends the DISCONNECT packet for us */
+	mosquitto_loop_write(m->client, 1);
+
 	return 0;
 
 mosquitto_error:
@@ -462,6 +650,24 @@ int mqtt_type_start(villas::node::SuperNode *sn)
 	if (ret != MOSQ_ERR_SUCCESS)
 		goto mosquitto_error;
 
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (epoll_fd < 0)
+		throw SystemError("Failed to create epoll instance");
+
+	wakeup_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (wakeup_fd < 0)
+		throw SystemError("Failed to create eventfd");
+
+	struct epoll_event ev;
+	ev.events = EPOLLIN;
+	ev.data.ptr = nullptr;
+
+	ret = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, wakeup_fd, &ev);
+	if (ret)
+		throw SystemError("Failed to register eventfd");
+
+	stop = false;
+
 	// Start thread here to run mosquitto loop for registered clients
 	ret = pthread_create(&thread, nullptr, mosquitto_loop_thread, nullptr);
 	if (ret)
@@ -480,16 +686,18 @@ int mqtt_type_stop()
 	int ret;
 
 	// Stop thread here that executes mosquitto loop
-	ret = pthread_cancel(thread);
-	if (ret)
-		return ret;
-
-	logger->debug("Called pthread_cancel() on MQTT communication management thread.");
+	stop = true;
+	mqtt_wakeup();
 
 	ret = pthread_join(thread, nullptr);
 	if (ret)
 		return ret;
 
+	logger->debug("Stopped MQTT event loop thread.");
+
+	close(wakeup_fd);
+	close(epoll_fd);
+
 	ret = mosquitto_lib_cleanup();
 	if (ret != MOSQ_ERR_SUCCESS)
 		goto mosquitto_error;
@@ -526,28 +734,76 @@ int mqtt_read(struct vnode *n, struct sample * const smps[], unsigned cnt)
 
 int mqtt_write(struct vnode *n, struct sample * const smps[], unsigned cnt)
 {
-	int ret;
+	int ret, mid;
 	struct mqtt *m = (struct mqtt *) n->_vd;
 
 	size_t wbytes;
+	unsigned sent = 0, batch = cnt;
 
-	char data[1500];
+	char data[MQTT_BUFFER_SIZE];
 
-	ret = m->formatter->sprint(data, sizeof(data), &wbytes, smps, cnt);
-	if (ret < 0)
-		return ret;
+	if (!m->publish) {
+		n->logger->warn("No publish possible because no publish topic is configured");
+		return cnt;
+	}
+
+	/* Publish the samples in as few messages as possible */
+	while (sent < cnt) {
+		ret = m->formatter->sprint(data, sizeof(data), &wbytes, &smps[sent], MIN(batch, cnt - sent));
+		if (ret < 0)
+			return ret;
+
+		/* Some formats do not stop at the end of the buffer */
+		if (wbytes > sizeof(data) || ret == 0) {
+			if (batch > 1) {
+				batch = MAX(1u, MIN(batch, cnt - sent) / 2);
+				continue;
+			}
+
+			n->logger->warn("Sample does not fit into a message of {} bytes", sizeof(data));
+
+			if (sent == 0)
+				return -1;
+
+			break;
+		}
+
+		struct timespec start = time_now();
+
+		mid = -1;
+		mqtt_publishing.ts = &start;
+		mqtt_publishing.mid = &mid;
+
+		ret = mosquitto_publish(m->client, &mid, m->publish, wbytes, data, m->qos, m->retain);
+
+		mqtt_publishing.ts = nullptr;
 
-	if (m->publish) {
-		ret = mosquitto_publish(m->client, nullptr /* mid */, m->publish, wbytes, data, m->qos, m->retain);
 		if (ret != MOSQ_ERR_SUCCESS) {
 			n->logger->warn("Publish failed: {}", mosquitto_strerror(ret));
-			return -abs(ret);
+
+			if (sent == 0)
+				return -abs(ret);
+
+			break;
 		}
+
+		/* Acknowledgements and messages which could not be written right away are handled by the event loop */
+		auto &p = m->published[mid & (MQTT_LATENCY_SLOTS - 1)];
+		p.ts = start;
+		p.mid.store(mid, std::memory_order_release);
+
+		if (n->stats)
+			n->stats->update(Stats::Metric::MQTT_PUBLISH_SAMPLES, ret);
+
+		sent += ret;
 	}
-	else
-		n->logger->warn("No publish possible because no publish topic is configured");
 
-	return cnt;
+	/* libmosquitto writes messages directly if the socket accepts them.
+	 * The event loop only needs to wait for the socket to become writable for the remainder. */
+	if (mosquitto_want_write(m->client))
+		mqtt_wakeup();
+
+	return sent;
 }
 
 int mqtt_poll_fds(struct vnode *n, int fds[])
@@ -91,6 +91,8 @@ int nanomsg_parse(struct vnode *n, json_t *json)
 	json_t *json_out_endpoints = nullptr;
 	json_t *json_in_endpoints = nullptr;
 
+	m->out.buffer_size = NANOMSG_MAX_PACKET_LEN;
+
 	ret = vlist_init(&m->out.endpoints);
 	if (ret)
 		return ret;
@@ -226,16 +228,38 @@ int nanomsg_type_stop()
 
 int nanomsg_read(struct vnode *n, struct sample * const smps[], unsigned cnt)
 {
+	int ret, bytes;
 	struct nanomsg *m = (struct nanomsg *) n->_vd;
-	int bytes;
-	char data[NANOMSG_MAX_PACKET_LEN];
 
-	/* Receive payload */
-	bytes = nn_recv(m->in.socket, data, sizeof(data), 0);
-	if (bytes < 0)
-		return -1;
+	void *buf;
+	unsigned read = 0, max = 0;
+
+	/* Only the first receive blocks. Afterwards, we drain pending messages
+	 * as long as a message of the largest size seen so far still fits. */
+	while (read < cnt && cnt - read >= max) {
+		/* Receive payload into a buffer owned by nanomsg */
+		bytes = nn_recv(m->in.socket, &buf, NN_MSG, read > 0 ? NN_DONTWAIT : 0);
+		if (bytes < 0) {
+			if (read > 0 && errno == EAGAIN)
+				break;
+
+			return read > 0 ? (int) read : -1;
+		}
+
+		ret = m->formatter->sscan((char *) buf, bytes, nullptr, &smps[read], cnt - read);
+
+		nn_freemsg(buf);
 
-	return m->formatter->sscan(data, bytes, nullptr, smps, cnt);
+		if (ret < 0) {
+			n->logger->warn("Received an invalid message");
+			continue;
+		}
+
+		read += ret;
+		max = MAX(max, (unsigned) ret);
+	}
+
+	return read;
 }
 
 int nanomsg_write(struct vnode *n, struct sample * const smps[], unsigned cnt)
@@ -244,18 +268,54 @@ int nanomsg_write(struct vnode *n, struct sample * const smps[], unsigned cnt)
 	struct nanomsg *m = (struct nanomsg *) n->_vd;
 
 	size_t wbytes;
+	size_t len = m->out.buffer_size;
 
-	char data[NANOMSG_MAX_PACKET_LEN];
+	/* Allocate the message by nanomsg so that it can be sent without copying */
+	void *buf = nn_allocmsg(len, 0);
+	if (!buf)
+		throw MemoryAllocationError();
 
-	ret = m->formatter->sprint(data, sizeof(data), &wbytes, smps, cnt);
-	if (ret <= 0)
-		return -1;
+	while (true) {
+		ret = m->formatter->sprint((char *) buf, len, &wbytes, smps, cnt);
+		if (ret < 0)
+			goto fail;
 
-	ret = nn_send(m->out.socket, data, wbytes, 0);
-	if (ret < 0)
-		return ret;
+		if (ret == (int) cnt && wbytes <= len)
+			break;
+
+		/* Grow message until all samples fit */
+		if (2 * len > NANOMSG_MAX_MSG_SIZE) {
+			if (ret > 0 && wbytes <= len)
+				break;
+
+			goto fail;
+		}
+
+		len *= 2;
+
+		buf = nn_reallocmsg(buf, len);
+		if (!buf)
+			throw MemoryAllocationError();
+
+		/* Start with the larger size next time */
+		m->out.buffer_size = len;
+	}
+
+	/* The length of NN_MSG messages is determined by their allocation */
+	buf = nn_reallocmsg(buf, wbytes);
+	if (!buf)
+		throw MemoryAllocationError();
+
+	/* nanomsg takes ownership of the message on success */
+	if (nn_send(m->out.socket, &buf, NN_MSG, 0) < 0)
+		goto fail;
+
+	return ret;
+
+fail:
+	nn_freemsg(buf);
 
-	return cnt;
+	return -1;
 }
 
 int nanomsg_poll_fds(struct vnode *n, int fds[])
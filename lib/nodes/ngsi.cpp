@@ -37,6 +37,8 @@
 #include <villas/super_node.hpp>
 #include <villas/exceptions.hpp>
 #include <villas/timing.h>
+#include <villas/sample.h>
+#include <villas/stats.hpp>
 #include <villas/node/config.h>
 
 using namespace villas;
@@ -236,11 +238,6 @@ public:
 	}
 };
 
-struct ngsi_response {
-	char *data;
-	size_t len;
-};
-
 static json_t* ngsi_build_entity(struct vnode *n, const struct sample * const smps[], unsigned cnt, int flags)
 {
 	struct ngsi *i = (struct ngsi *) n->_vd;
@@ -570,6 +567,257 @@ out:	json_decref(json_request);
 	return ret;
 }
 
+/** Coalesce samples into a single update request and add it to the multi handle. */
+static void ngsi_async_submit(struct vnode *n, struct ngsi_inflight *r, struct sample * const smps[], unsigned cnt)
+{
+	struct ngsi *i = (struct ngsi *) n->_vd;
+
+	json_t *json_elements = json_array();
+
+	/* The context broker applies the elements in order */
+	for (unsigned k = 0; k < cnt; k++)
+		json_array_append_new(json_elements, ngsi_build_entity(n, &smps[k], 1, NGSI_ENTITY_ATTRIBUTES_OUT | NGSI_ENTITY_VALUES));
+
+	json_t *json_request = json_pack("{ s: s, s: o }",
+		"updateAction", "UPDATE",
+		"contextElements", json_elements
+	);
+
+	r->post = json_dumps(json_request, JSON_COMPACT);
+	r->response.len = 0;
+	r->cnt = cnt;
+	r->started = time_now();
+
+	json_decref(json_request);
+
+	curl_easy_setopt(r->curl, CURLOPT_POSTFIELDSIZE, strlen(r->post));
+	curl_easy_setopt(r->curl, CURLOPT_POSTFIELDS, r->post);
+
+	curl_multi_add_handle(i->async.multi, r->curl);
+}
+
+/** Check the response of a completed update request. */
+static void ngsi_async_complete(struct vnode *n, struct ngsi_inflight *r, CURLcode result)
+{
+	struct ngsi *i = (struct ngsi *) n->_vd;
+	int ret, code;
+	char *reason;
+	json_t *json_response, *json_rentity;
+	json_error_t err;
+
+	curl_multi_remove_handle(i->async.multi, r->curl);
+
+	free(r->post);
+	r->post = nullptr;
+
+	if (result != CURLE_OK) {
+		n->logger->warn("HTTP request failed: {}", curl_easy_strerror(result));
+		goto fail;
+	}
+
+	json_response = r->response.len > 0 ? json_loadb(r->response.data, r->response.len, 0, &err) : nullptr;
+	if (!json_response) {
+		n->logger->warn("Received invalid response from context broker");
+		goto fail;
+	}
+
+	ret = ngsi_parse_context_response(json_response, &code, &reason, &json_rentity, n->logger);
+	if (ret == 0)
+		json_decref(json_rentity);
+
+	json_decref(json_response);
+
+	if (ret || code != 200)
+		goto fail;
+
+	i->async.sent += r->cnt;
+
+	if (n->stats) {
+		struct timespec now = time_now();
+
+		n->stats->update(Stats::Metric::NGSI_LATENCY, time_delta(&r->started, &now));
+		n->stats->update(Stats::Metric::NGSI_BATCH_SIZE, r->cnt);
+	}
+
+	return;
+
+fail:
+	i->async.failed += r->cnt;
+}
+
+static void * ngsi_async_worker(void *ctx)
+{
+	struct vnode *n = (struct vnode *) ctx;
+	struct ngsi *i = (struct ngsi *) n->_vd;
+
+	int running;
+	unsigned nidle = i->async.max_inflight;
+	struct ngsi_inflight *idle[i->async.max_inflight];
+	struct sample *smps[i->async.max_batch];
+
+	for (unsigned j = 0; j < i->async.max_inflight; j++)
+		idle[j] = &i->async.requests[j];
+
+	struct curl_waitfd wfd;
+
+	wfd.fd = queue_signalled_fd(&i->async.queue);
+	wfd.events = CURL_WAIT_POLLIN;
+
+	while (true) {
+		/* Samples which have been queued before ngsi_stop() are still sent */
+		bool stop = i->async.stop;
+
+		/* Start new requests as long as the in-flight window permits */
+		while (nidle > 0) {
+			int pulled = queue_pull_many(&i->async.queue.queue, (void **) smps, i->async.max_batch);
+			if (pulled <= 0)
+				break;
+
+			ngsi_async_submit(n, idle[--nidle], smps, pulled);
+
+			sample_decref_many(smps, pulled);
+		}
+
+		if (stop && nidle == i->async.max_inflight && queue_signalled_available(&i->async.queue) == 0)
+			break;
+
+		curl_multi_perform(i->async.multi, &running);
+
+		CURLMsg *msg;
+		int left;
+		while ((msg = curl_multi_info_read(i->async.multi, &left))) {
+			struct ngsi_inflight *r;
+
+			if (msg->msg != CURLMSG_DONE)
+				continue;
+
+			curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **) &r);
+
+			ngsi_async_complete(n, r, msg->data.result);
+
+			idle[nidle++] = r;
+		}
+
+		/* Wait for network activity or new samples */
+		wfd.revents = 0;
+		curl_multi_wait(i->async.multi, &wfd, 1, 100, nullptr);
+
+		if (wfd.revents) {
+			uint64_t cntr;
+
+			if (read(wfd.fd, &cntr, sizeof(cntr)) < 0)
+				n->logger->warn("Failed to read from queue: {}", strerror(errno));
+		}
+	}
+
+	return nullptr;
+}
+
+static void ngsi_async_start(struct vnode *n)
+{
+	struct ngsi *i = (struct ngsi *) n->_vd;
+	int ret;
+	char url[128];
+
+	ret = pool_init(&i->async.pool, i->async.queue_length, SAMPLE_LENGTH(vlist_length(&n->out.signals)));
+	if (ret)
+		throw RuntimeError("Failed to allocate memory for pool");
+
+	ret = queue_signalled_init(&i->async.queue, i->async.queue_length);
+	if (ret)
+		throw RuntimeError("Failed to initialize queue");
+
+	if (queue_signalled_fd(&i->async.queue) < 0)
+		throw RuntimeError("Asynchronous mode requires a queue with file descriptor");
+
+	i->async.multi = curl_multi_init();
+	if (!i->async.multi)
+		throw RuntimeError("Failed to initialize libcurl multi handle");
+
+	/* Reuse up to max_inflight connections. Use HTTP/2 multiplexing if available. */
+	curl_multi_setopt(i->async.multi, CURLMOPT_MAX_HOST_CONNECTIONS, (long) i->async.max_inflight);
+	curl_multi_setopt(i->async.multi, CURLMOPT_MAXCONNECTS, (long) i->async.max_inflight);
+#ifdef CURLPIPE_MULTIPLEX
+	curl_multi_setopt(i->async.multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+#endif
+
+	snprintf(url, sizeof(url), "%s/v1/updateContext", i->endpoint);
+
+	i->async.requests = new struct ngsi_inflight[i->async.max_inflight];
+	if (!i->async.requests)
+		throw MemoryAllocationError();
+
+	for (unsigned j = 0; j < i->async.max_inflight; j++) {
+		struct ngsi_inflight *r = &i->async.requests[j];
+
+		r->curl = curl_easy_init();
+		if (!r->curl)
+			throw RuntimeError("Failed to initialize libcurl handle");
+
+		r->post = nullptr;
+		r->response.data = nullptr;
+		r->response.len = 0;
+
+		curl_easy_setopt(r->curl, CURLOPT_URL, url);
+		curl_easy_setopt(r->curl, CURLOPT_PRIVATE, r);
+		curl_easy_setopt(r->curl, CURLOPT_WRITEFUNCTION, ngsi_request_writer);
+		curl_easy_setopt(r->curl, CURLOPT_WRITEDATA, (void *) &r->response);
+		curl_easy_setopt(r->curl, CURLOPT_SSL_VERIFYPEER, i->ssl_verify);
+		curl_easy_setopt(r->curl, CURLOPT_TIMEOUT_MS, (long) (i->timeout * 1e3));
+		curl_easy_setopt(r->curl, CURLOPT_HTTPHEADER, i->headers);
+		curl_easy_setopt(r->curl, CURLOPT_USERAGENT, HTTP_USER_AGENT);
+		curl_easy_setopt(r->curl, CURLOPT_PIPEWAIT, 1L);
+		curl_easy_setopt(r->curl, CURLOPT_NOSIGNAL, 1L);
+	}
+
+	i->async.stop = false;
+	i->async.sent = 0;
+	i->async.failed = 0;
+	i->async.dropped = 0;
+
+	ret = pthread_create(&i->async.thread, nullptr, ngsi_async_worker, n);
+	if (ret)
+		throw SystemError("Failed to create worker thread");
+}
+
+static void ngsi_async_stop(struct vnode *n)
+{
+	struct ngsi *i = (struct ngsi *) n->_vd;
+	int ret;
+
+	/* The worker sends the remaining samples before terminating */
+	i->async.stop = true;
+
+	pthread_join(i->async.thread, nullptr);
+
+	if (i->async.dropped)
+		n->logger->warn("Dropped {} samples as the context broker did not keep up", i->async.dropped);
+
+	if (i->async.failed)
+		n->logger->warn("Failed to update {} samples", i->async.failed);
+
+	n->logger->info("Updated {} samples", i->async.sent);
+
+	for (unsigned j = 0; j < i->async.max_inflight; j++) {
+		struct ngsi_inflight *r = &i->async.requests[j];
+
+		curl_easy_cleanup(r->curl);
+		free(r->response.data);
+	}
+
+	delete[] i->async.requests;
+
+	curl_multi_cleanup(i->async.multi);
+
+	ret = queue_signalled_destroy(&i->async.queue);
+	if (ret)
+		throw RuntimeError("Failed to destroy queue");
+
+	ret = pool_destroy(&i->async.pool);
+	if (ret)
+		throw RuntimeError("Failed to destroy pool");
+}
+
 int ngsi_type_start(villas::node::SuperNode *sn)
 {
 #ifdef CURL_SSL_REQUIRES_LOCKING
@@ -620,8 +868,12 @@ int ngsi_parse(struct vnode *n, json_t *json)
 
 	int create = 1;
 	int remove = 1;
+	int async = 0;
+	int max_batch = -1;
+	int max_inflight = -1;
+	int queue_length = -1;
 
-	ret = json_unpack_ex(json, &err, 0, "{ s?: s, s: s, s: s, s: s, s?: b, s?: F, s?: F, s?: b, s?: b, s?: { s?: o }, s?: { s?: o } }",
+	ret = json_unpack_ex(json, &err, 0, "{ s?: s, s: s, s: s, s: s, s?: b, s?: F, s?: F, s?: b, s?: b, s?: { s?: o }, s?: { s?: o, s?: b, s?: i, s?: i, s?: i } }",
 		"access_token", &i->access_token,
 		"endpoint", &i->endpoint,
 		"entity_id", &i->entity_id,
@@ -634,7 +886,11 @@ int ngsi_parse(struct vnode *n, json_t *json)
 		"in",
 			"signals", &json_signals_in,
 		"out",
-			"signals", &json_signals_out
+			"signals", &json_signals_out,
+			"async", &async,
+			"max_batch", &max_batch,
+			"max_inflight", &max_inflight,
+			"queue_length", &queue_length
 	);
 	if (ret)
 		throw ConfigError(json, err, "node-config-node-ngsi");
@@ -642,6 +898,20 @@ int ngsi_parse(struct vnode *n, json_t *json)
 	i->create = create;
 	i->remove = remove;
 
+	i->async.enabled = async;
+
+	if (max_batch == 0 || max_inflight == 0 || queue_length == 0)
+		throw ConfigError(json, "node-config-node-ngsi-async", "Settings 'out.max_batch', 'out.max_inflight' and 'out.queue_length' must be positive");
+
+	if (max_batch > 0)
+		i->async.max_batch = max_batch;
+
+	if (max_inflight > 0)
+		i->async.max_inflight = max_inflight;
+
+	if (queue_length > 0)
+		i->async.queue_length = queue_length;
+
 	if (json_signals_in) {
 		ret = ngsi_parse_signals(json_signals_in, &i->in.signals, &n->in.signals);
 		if (ret)
@@ -661,8 +931,14 @@ char * ngsi_print(struct vnode *n)
 {
 	struct ngsi *i = (struct ngsi *) n->_vd;
 
-	return strf("endpoint=%s, timeout=%.3f secs",
+	char *buf = strf("endpoint=%s, timeout=%.3f secs",
 		i->endpoint, i->timeout);
+
+	if (i->async.enabled)
+		strcatf(&buf, ", async.max_batch=%u, async.max_inflight=%u, async.queue_length=%u",
+			i->async.max_batch, i->async.max_inflight, i->async.queue_length);
+
+	return buf;
 }
 
 int ngsi_start(struct vnode *n)
@@ -708,6 +984,9 @@ int ngsi_start(struct vnode *n)
 		json_decref(json_entity);
 	}
 
+	if (i->async.enabled)
+		ngsi_async_start(n);
+
 	return 0;
 }
 
@@ -718,6 +997,9 @@ int ngsi_stop(struct vnode *n)
 
 	i->task.stop();
 
+	if (i->async.enabled)
+		ngsi_async_stop(n);
+
 	/* Delete complete entity (not just attributes) */
 	json_t *json_entity = ngsi_build_entity(n, nullptr, 0, 0);
 
@@ -762,6 +1044,35 @@ int ngsi_write(struct vnode *n, struct sample * const smps[], unsigned cnt)
 	struct ngsi *i = (struct ngsi *) n->_vd;
 	int ret;
 
+	if (i->async.enabled) {
+		int avail, enqueued;
+		struct sample *cpys[cnt];
+
+		/* Make copies as the samples are sent after returning */
+		avail = sample_alloc_many(&i->async.pool, cpys, cnt);
+		if (avail < 0)
+			return avail;
+
+		sample_copy_many(cpys, smps, avail);
+
+		enqueued = queue_signalled_push_many(&i->async.queue, (void **) cpys, avail);
+		if (enqueued < 0)
+			enqueued = 0;
+
+		/* Release unused samples back to pool */
+		if (enqueued < avail)
+			sample_decref_many(&cpys[enqueued], avail - enqueued);
+
+		if (enqueued < (int) cnt) {
+			if (i->async.dropped == 0)
+				n->logger->warn("Dropping samples as the context broker does not keep up");
+
+			i->async.dropped += cnt - enqueued;
+		}
+
+		return cnt;
+	}
+
 	json_t *json_entity = ngsi_build_entity(n, smps, cnt, NGSI_ENTITY_ATTRIBUTES_OUT | NGSI_ENTITY_VALUES);
 
 	ret = ngsi_request_context_update(i->out.curl, i->endpoint, "UPDATE", json_entity, n->logger);
@@ -801,6 +1112,11 @@ int ngsi_init(struct vnode *n)
 	i->timeout = 1; /* default value */
 	i->rate = 1; /* default value */
 
+	i->async.enabled = false;
+	i->async.max_batch = NGSI_ASYNC_MAX_BATCH;
+	i->async.max_inflight = NGSI_ASYNC_MAX_INFLIGHT;
+	i->async.queue_length = NGSI_ASYNC_QUEUE_LENGTH;
+
 	return 0;
 }
 
@@ -55,26 +55,34 @@ int shmem_parse(struct vnode *n, json_t *json)
 	/* Default values */
 	shm->conf.queuelen = MAX(DEFAULT_SHMEM_QUEUELEN, n->in.vectorize);
 	shm->conf.samplelen = len;
-	shm->conf.polling = false;
+	shm->conf.mode = QueueSignalledMode::AUTO;
+	shm->conf.mailbox = 0;
 	shm->exec = nullptr;
 
-	ret = json_unpack_ex(json, &err, 0, "{ s: { s: s }, s: { s: s }, s?: i, s?: o, s?: s }",
+	ret = json_unpack_ex(json, &err, 0, "{ s: { s: s }, s: { s: s }, s?: i, s?: o, s?: s, s?: b }",
 		"out",
 			"name", &shm->out_name,
 		"in",
 			"name", &shm->in_name,
 		"queuelen", &shm->conf.queuelen,
 		"exec", &json_exec,
-		"mode", &mode_str
+		"mode", &mode_str,
+		"mailbox", &shm->conf.mailbox
 	);
 	if (ret)
 		throw ConfigError(json, err, "node-config-node-shmem");
 
 	if (mode_str) {
-		if (!strcmp(mode_str, "polling"))
-			shm->conf.polling = true;
+		if (!strcmp(mode_str, "auto"))
+			shm->conf.mode = QueueSignalledMode::AUTO;
+		else if (!strcmp(mode_str, "polling"))
+			shm->conf.mode = QueueSignalledMode::POLLING;
 		else if (!strcmp(mode_str, "pthread"))
-			shm->conf.polling = false;
+			shm->conf.mode = QueueSignalledMode::PTHREAD;
+#ifdef __linux__
+		else if (!strcmp(mode_str, "futex"))
+			shm->conf.mode = QueueSignalledMode::FUTEX;
+#endif /* __linux__ */
 		else
 			throw SystemError("Unknown mode '{}'", mode_str);
 	}
@@ -127,6 +135,13 @@ int shmem_stop(struct vnode *n)
 {
 	struct shmem* shm = (struct shmem *) n->_vd;
 
+	if (shm->conf.mailbox) {
+		struct shmem_mailbox *mb = &shm->intf.write.shared->latest;
+
+		n->logger->info("Mailbox statistics: overwrites={}, torn_reads={}",
+			atomic_load(&mb->overwrites), atomic_load(&mb->torn_reads));
+	}
+
 	return shmem_int_close(&shm->intf);
 }
 
@@ -134,11 +149,21 @@ int shmem_read(struct vnode *n, struct sample * const smps[], unsigned cnt)
 {
 	struct shmem *shm = (struct shmem *) n->_vd;
 	int recv;
+	bool mailbox = shm->intf.read.shared->mailbox;
 	struct sample *shared_smps[cnt];
 
-	do {
-		recv = shmem_int_read(&shm->intf, shared_smps, cnt);
-	} while (recv == 0);
+	/* The latest sample is directly copied without using the shared pool.
+	 * Like the queue, the mailbox only returns without a sample in the polling mode. */
+	if (mailbox) {
+		do {
+			recv = shmem_int_read_latest(&shm->intf, smps[0]);
+		} while (recv == 0);
+	}
+	else {
+		do {
+			recv = shmem_int_read(&shm->intf, shared_smps, cnt);
+		} while (recv == 0);
+	}
 
 	if (recv < 0) {
 		/* This can only really mean that the other process has exited, so close
@@ -151,8 +176,10 @@ int shmem_read(struct vnode *n, struct sample * const smps[], unsigned cnt)
 		return recv;
 	}
 
-	sample_copy_many(smps, shared_smps, recv);
-	sample_decref_many(shared_smps, recv);
+	if (!mailbox) {
+		sample_copy_many(smps, shared_smps, recv);
+		sample_decref_many(shared_smps, recv);
+	}
 
 	/** @todo: signal descriptions are currently not shared between processes */
 	for (int i = 0; i < recv; i++)
@@ -167,6 +194,9 @@ int shmem_write(struct vnode *n, struct sample * const smps[], unsigned cnt)
 	struct sample *shared_smps[cnt]; /* Samples need to be copied to the shared pool first */
 	int avail, pushed, copied;
 
+	if (shm->conf.mailbox)
+		return shmem_int_write_latest(&shm->intf, smps, cnt);
+
 	avail = sample_alloc_many(&shm->intf.write.shared->pool, shared_smps, cnt);
 	if (avail != (int) cnt)
 		n->logger->warn("Pool underrun for shmem node {}", shm->out_name);
@@ -187,8 +217,9 @@ char * shmem_print(struct vnode *n)
 	struct shmem *shm = (struct shmem *) n->_vd;
 	char *buf = nullptr;
 
-	strcatf(&buf, "out_name=%s, in_name=%s, queuelen=%d, polling=%s",
-		shm->out_name, shm->in_name, shm->conf.queuelen, shm->conf.polling ? "yes" : "no");
+	strcatf(&buf, "out_name=%s, in_name=%s, queuelen=%d, polling=%s, mailbox=%s",
+		shm->out_name, shm->in_name, shm->conf.queuelen, shm->conf.mode == QueueSignalledMode::POLLING ? "yes" : "no",
+		shm->conf.mailbox ? "yes" : "no");
 
 	if (shm->exec) {
 		strcatf(&buf, ", exec='");
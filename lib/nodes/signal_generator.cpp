@@ -104,6 +104,7 @@ int signal_generator_init(struct vnode *n)
 	s->values = 1;
 	s->rate = 10;
 	s->monitor_missed = 1;
+	s->catch_up = 0;
 
 	s->frequency = nullptr;
 	s->amplitude = nullptr;
@@ -172,7 +173,7 @@ int signal_generator_parse(struct vnode *n, json_t *json)
 	json_t *json_pulse_low = nullptr;
 	json_t *json_phase = nullptr;
 
-	ret = json_unpack_ex(json, &err, 0, "{ s: o, s?: b, s?: i, s?: i, s?: F, s?: o, s?: o, s?: o, s?: o, s?: o, s?: o, s?: o, s?: o, s?: b }",
+	ret = json_unpack_ex(json, &err, 0, "{ s: o, s?: b, s?: i, s?: i, s?: F, s?: o, s?: o, s?: o, s?: o, s?: o, s?: o, s?: o, s?: o, s?: b, s?: b }",
 		"signal", &json_type,
 		"realtime", &s->rt,
 		"limit", &s->limit,
@@ -186,7 +187,8 @@ int signal_generator_parse(struct vnode *n, json_t *json)
 		"pulse_low", &json_pulse_low,
 		"pulse_high", &json_pulse_high,
 		"phase", &json_phase,
-		"monitor_missed", &s->monitor_missed
+		"monitor_missed", &s->monitor_missed,
+		"catch_up", &s->catch_up
 	);
 	if (ret)
 		throw ConfigError(json, err, "node-config-node-signal");
@@ -294,11 +296,17 @@ int signal_generator_start(struct vnode *n)
 
 	s->missed_steps = 0;
 	s->counter = 0;
+	s->pending = 1;
 	s->started = time_now();
 	s->last = new double[s->values];
 	if (!s->last)
 		throw MemoryAllocationError();
 
+	s->scratch_len = MAX(n->in.vectorize, 1);
+	s->scratch = new double[s->scratch_len];
+	if (!s->scratch)
+		throw MemoryAllocationError();
+
 	for (unsigned i = 0; i < s->values; i++)
 		s->last[i] = s->offset[i];
 
@@ -320,102 +328,220 @@ int signal_generator_stop(struct vnode *n)
 		n->logger->warn("Missed a total of {} steps.", s->missed_steps);
 
 	delete[] s->last;
+	delete[] s->scratch;
 
 	return 0;
 }
 
+/** Number of phasors which are rotated in parallel by the sine kernel. */
+#define SIGNAL_GENERATOR_LANES 8
+
+/** Generate the values of signal \p i for \p cnt consecutive steps.
+ *
+ * Each signal type has its own branch-free loop over the steps, so that the
+ * compiler can vectorize it.
+ *
+ * @param running Time in seconds since the node was started of the first step.
+ */
+static void signal_generator_kernel(struct signal_generator *s, unsigned i, double running, double *v, unsigned cnt)
+{
+	const double dt = 1.0 / s->rate;
+	const double off = s->offset[i];
+	const double amp = s->amplitude[i];
+	const double freq = s->frequency[i];
+	const double phase = s->phase[i] / (2 * M_PI);
+
+	switch (s->type[i]) {
+		case signal_generator::SignalType::CONSTANT:
+			for (unsigned k = 0; k < cnt; k++)
+				v[k] = off + amp;
+			break;
+
+		case signal_generator::SignalType::SINE: {
+			/* Instead of calling sin() for each step, we rotate phasors by
+			 * a constant angle. The phasors are initialized on every call,
+			 * so rounding errors do not accumulate across reads. */
+			const double w = 2 * M_PI * freq * dt;
+			const double theta = 2 * M_PI * freq * running + s->phase[i];
+			const double c = cos(SIGNAL_GENERATOR_LANES * w);
+			const double d = sin(SIGNAL_GENERATOR_LANES * w);
+
+			double re[SIGNAL_GENERATOR_LANES], im[SIGNAL_GENERATOR_LANES];
+
+			for (unsigned l = 0; l < SIGNAL_GENERATOR_LANES; l++) {
+				re[l] = cos(theta + l * w);
+				im[l] = sin(theta + l * w);
+			}
+
+			unsigned k;
+			for (k = 0; k + SIGNAL_GENERATOR_LANES <= cnt; k += SIGNAL_GENERATOR_LANES) {
+				for (unsigned l = 0; l < SIGNAL_GENERATOR_LANES; l++) {
+					double r = re[l] * c - im[l] * d;
+
+					v[k + l] = off + amp * im[l];
+
+					im[l] = re[l] * d + im[l] * c;
+					re[l] = r;
+				}
+			}
+
+			for (unsigned l = 0; k + l < cnt; l++)
+				v[k + l] = off + amp * im[l];
+
+			break;
+		}
+
+		case signal_generator::SignalType::TRIANGLE:
+			for (unsigned k = 0; k < cnt; k++) {
+				double x = (running + k * dt) * freq + phase;
+
+				v[k] = off + amp * (fabs(x - trunc(x) - .5) - 0.25) * 4;
+			}
+			break;
+
+		case signal_generator::SignalType::SQUARE:
+			for (unsigned k = 0; k < cnt; k++) {
+				double x = (running + k * dt) * freq + phase;
+
+				v[k] = off + amp * (x - trunc(x) < .5 ? -1 : 1);
+			}
+			break;
+
+		case signal_generator::SignalType::RAMP:
+			for (unsigned k = 0; k < cnt; k++) {
+				double t = running + k * dt;
+
+				v[k] = off + amp * (t - trunc(t / freq) * freq);
+			}
+			break;
+
+		case signal_generator::SignalType::COUNTER:
+			for (unsigned k = 0; k < cnt; k++)
+				v[k] = off + amp * (s->counter + k);
+			break;
+
+		case signal_generator::SignalType::RANDOM:
+			for (unsigned k = 0; k < cnt; k++) {
+				s->last[i] += box_muller(0, s->stddev[i]);
+				v[k] = s->last[i];
+			}
+			break;
+
+		case signal_generator::SignalType::MIXED:
+			for (unsigned k = 0; k < cnt; k++)
+				v[k] = 0;
+			break;
+
+		case signal_generator::SignalType::PULSE: {
+			const double width = s->pulse_width[i] / s->rate;
+
+			for (unsigned k = 0; k < cnt; k++) {
+				double x = (running + k * dt) * freq + phase;
+
+				v[k] = off + (fabs(x - trunc(x)) <= width
+					? s->pulse_high[i]
+					: s->pulse_low[i]);
+			}
+			break;
+		}
+	}
+}
+
 int signal_generator_read(struct vnode *n, struct sample * const smps[], unsigned cnt)
 {
 	struct signal_generator *s = (struct signal_generator *) n->_vd;
-	struct sample *t = smps[0];
 
 	struct timespec ts;
-	int steps;
+	unsigned generated;
 
-	assert(cnt == 1);
+	if (s->rt && s->catch_up) {
+		/* Block until at least one step is due */
+		if (s->pending == 0)
+			s->pending = s->task.wait();
 
-	if (s->rt)
-		ts = time_now();
-	else {
-		struct timespec offset = time_from_double(s->counter * 1.0 / s->rate);
+		generated = MIN(s->pending, cnt);
+	}
+	else if (s->rt)
+		generated = 1;
+	else
+		generated = cnt;
 
-		ts = time_add(&s->started, &offset);
+	if (s->limit > 0) {
+		if (s->counter >= (unsigned) s->limit) {
+			n->logger->info("Reached limit.");
 
-		steps = 1;
-	}
+			n->state = State::STOPPING;
 
-	double running = time_delta(&s->started, &ts);
+			return -1;
+		}
 
-	t->flags = (int) SampleFlags::HAS_TS_ORIGIN | (int) SampleFlags::HAS_DATA | (int) SampleFlags::HAS_SEQUENCE;
-	t->ts.origin = ts;
-	t->sequence = s->counter;
-	t->length = MIN(s->values, t->capacity);
-	t->signals = &n->in.signals;
+		generated = MIN(generated, s->limit - s->counter);
+	}
 
-	for (unsigned i = 0; i < t->length; i++) {
-		switch (s->type[i]) {
-			case signal_generator::SignalType::CONSTANT:
-				t->data[i].f = s->offset[i] + s->amplitude[i];
-				break;
+	if (generated > s->scratch_len) {
+		delete[] s->scratch;
+
+		s->scratch_len = generated;
+		s->scratch = new double[s->scratch_len];
+		if (!s->scratch)
+			throw MemoryAllocationError();
+	}
 
-			case signal_generator::SignalType::SINE:
-				t->data[i].f = s->offset[i] + s->amplitude[i] *        sin(running * s->frequency[i] * 2 * M_PI + s->phase[i]);
-				break;
+	/* Outside of catch-up mode, real-time samples are stamped with the current time */
+	bool nominal = !s->rt || s->catch_up;
+	if (nominal) {
+		struct timespec offset = time_from_double(s->counter * 1.0 / s->rate);
 
-			case signal_generator::SignalType::TRIANGLE:
-				t->data[i].f = s->offset[i] + s->amplitude[i] * (fabs(fmod(running * s->frequency[i] + (s->phase[i] / (2 * M_PI)), 1) - .5) - 0.25) * 4;
-				break;
+		ts = time_add(&s->started, &offset);
+	}
+	else
+		ts = time_now();
 
-			case signal_generator::SignalType::SQUARE:
-				t->data[i].f = s->offset[i] + s->amplitude[i] * (    (fmod(running * s->frequency[i] + (s->phase[i] / (2 * M_PI)), 1) < .5) ? -1 : 1);
-				break;
+	double running = time_delta(&s->started, &ts);
 
-			case signal_generator::SignalType::RAMP:
-				t->data[i].f = s->offset[i] + s->amplitude[i] *       fmod(running, s->frequency[i]);
-				break;
+	for (unsigned k = 0; k < generated; k++) {
+		struct sample *t = smps[k];
 
-			case signal_generator::SignalType::COUNTER:
-				t->data[i].f = s->offset[i] + s->amplitude[i] * s->counter;
-				break;
+		if (nominal && k > 0) {
+			struct timespec offset = time_from_double((s->counter + k) * 1.0 / s->rate);
 
-			case signal_generator::SignalType::RANDOM:
-				s->last[i] += box_muller(0, s->stddev[i]);
-				t->data[i].f = s->last[i];
-				break;
-
-			case signal_generator::SignalType::MIXED:
-				break;
-
-			case signal_generator::SignalType::PULSE:
-				t->data[i].f = abs(fmod(running * s->frequency[i] + (s->phase[i] / (2 * M_PI)) , 1)) <= (s->pulse_width[i] / s->rate)
-						? s->pulse_high[i]
-						: s->pulse_low[i];
-				t->data[i].f += s->offset[i];
-				break;
+			ts = time_add(&s->started, &offset);
 		}
-	}
 
-	if (s->limit > 0 && s->counter >= (unsigned) s->limit) {
-		n->logger->info("Reached limit.");
+		t->flags = (int) SampleFlags::HAS_TS_ORIGIN | (int) SampleFlags::HAS_DATA | (int) SampleFlags::HAS_SEQUENCE;
+		t->ts.origin = ts;
+		t->sequence = s->counter + k;
+		t->length = MIN(s->values, t->capacity);
+		t->signals = &n->in.signals;
+	}
 
-		n->state = State::STOPPING;
+	for (unsigned i = 0; i < s->values; i++) {
+		signal_generator_kernel(s, i, running, s->scratch, generated);
 
-		return -1;
+		for (unsigned k = 0; k < generated; k++) {
+			if (i < smps[k]->length)
+				smps[k]->data[i].f = s->scratch[k];
+		}
 	}
 
-	/* Throttle output if desired */
-	if (s->rt) {
+	if (s->rt && s->catch_up)
+		s->pending -= generated;
+	else if (s->rt) {
 		/* Block until 1/p->rate seconds elapsed */
-		steps = s->task.wait();
+		uint64_t steps = s->task.wait();
 		if (steps > 1 && s->monitor_missed) {
 			n->logger->debug("Missed steps: {}", steps-1);
 			s->missed_steps += steps-1;
 		}
+
+		s->counter += steps;
+
+		return generated;
 	}
 
-	s->counter += steps;
+	s->counter += generated;
 
-	return 1;
+	return generated;
 }
 
 char * signal_generator_print(struct vnode *n)
@@ -425,6 +551,9 @@ char * signal_generator_print(struct vnode *n)
 
 	strcatf(&buf, "rt=%s, rate=%.2f, values=%d", s->rt ? "yes" : "no", s->rate, s->values);
 
+	if (s->rt && s->catch_up)
+		strcatf(&buf, ", catch_up=yes");
+
 	if (s->limit > 0)
 		strcatf(&buf, ", limit=%d", s->limit);
 
@@ -450,7 +579,7 @@ __attribute__((constructor(110)))
 static void register_plugin() {
 	p.name		= "signal";
 	p.description	= "Signal generator";
-	p.vectorize	= 1;
+	p.vectorize	= 0;
 	p.flags		= (int) NodeFlags::PROVIDES_SIGNALS;
 	p.size		= sizeof(struct signal_generator);
 	p.init		= signal_generator_init;
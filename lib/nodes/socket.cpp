@@ -43,6 +43,11 @@
   #include <villas/kernel/nl.hpp>
 #endif /* WITH_NETEM */
 
+#ifdef WITH_SOCKET_UDP_OFFLOAD
+  #include <sys/epoll.h>
+  #include <sys/eventfd.h>
+#endif /* WITH_SOCKET_UDP_OFFLOAD */
+
 /* Forward declartions */
 static struct vnode_type p;
 
@@ -100,6 +105,11 @@ char * socket_print(struct vnode *n)
 
 	buf = strf("layer=%s, in.address=%s, out.address=%s", layer, local, remote);
 
+	if (s->layer == SocketLayer::UDP) {
+		strcatf(&buf, ", in.gro=%s", s->in.offload ? "yes" : "no");
+		strcatf(&buf, ", out.gso=%s", s->out.offload ? "yes" : "no");
+	}
+
 	if (s->multicast.enabled) {
 		char group[INET_ADDRSTRLEN];
 		char interface[INET_ADDRSTRLEN];
@@ -144,6 +154,15 @@ int socket_check(struct vnode *n)
 	}
 #endif /* WITH_SOCKET_LAYER_ETH */
 
+	if (s->in.offload || s->out.offload) {
+#ifdef WITH_SOCKET_UDP_OFFLOAD
+		if (s->layer != SocketLayer::UDP)
+			throw RuntimeError("UDP segmentation / receive offloading is only supported by the UDP layer");
+#else
+		throw RuntimeError("UDP segmentation / receive offloading is not supported on this platform");
+#endif /* WITH_SOCKET_UDP_OFFLOAD */
+	}
+
 	if (s->multicast.enabled) {
 		if (s->in.saddr.sa.sa_family != AF_INET)
 			throw RuntimeError("Multicast is only supported by IPv4");
@@ -240,6 +259,40 @@ int socket_start(struct vnode *n)
 			throw SystemError("Failed to join multicast group");
 	}
 
+#ifdef WITH_SOCKET_UDP_OFFLOAD
+	/* Let the kernel coalesce equally sized datagrams into super-buffers */
+	if (s->in.offload) {
+		int enabled = 1;
+
+		ret = setsockopt(s->sd, IPPROTO_UDP, UDP_GRO, &enabled, sizeof(enabled));
+		if (ret)
+			throw SystemError("Failed to enable UDP receive offloading");
+
+		/* Pending datagrams must wake up the path just like the socket itself */
+		s->gro.off = 0;
+		s->gro.len = 0;
+
+		s->gro.efd = eventfd(0, EFD_NONBLOCK);
+		if (s->gro.efd < 0)
+			throw SystemError("Failed to create eventfd");
+
+		s->gro.pfd = epoll_create1(0);
+		if (s->gro.pfd < 0)
+			throw SystemError("Failed to create epoll instance");
+
+		for (int fd : { s->sd, s->gro.efd }) {
+			struct epoll_event ev;
+
+			ev.events = EPOLLIN;
+			ev.data.fd = fd;
+
+			ret = epoll_ctl(s->gro.pfd, EPOLL_CTL_ADD, fd, &ev);
+			if (ret)
+				throw SystemError("Failed to add file descriptor to epoll instance");
+		}
+	}
+#endif /* WITH_SOCKET_UDP_OFFLOAD */
+
 	/* Set socket priority, QoS or TOS IP options */
 	int prio;
 	switch (s->layer) {
@@ -307,6 +360,18 @@ int socket_stop(struct vnode *n)
 			return ret;
 	}
 
+#ifdef WITH_SOCKET_UDP_OFFLOAD
+	if (s->in.offload) {
+		ret = close(s->gro.pfd);
+		if (ret)
+			return ret;
+
+		ret = close(s->gro.efd);
+		if (ret)
+			return ret;
+	}
+#endif /* WITH_SOCKET_UDP_OFFLOAD */
+
 	delete s->formatter;
 	delete[] s->in.buf;
 	delete[] s->out.buf;
@@ -314,6 +379,136 @@ int socket_stop(struct vnode *n)
 	return 0;
 }
 
+#ifdef WITH_SOCKET_UDP_OFFLOAD
+/** Receive a (possibly coalesced) GRO super-buffer.
+ *
+ * @param segsize[out] The size of the individual datagrams in the buffer or zero if not coalesced.
+ */
+static ssize_t socket_recvmsg_gro(struct socket *s, union sockaddr_union *src, socklen_t *srclen, size_t *segsize)
+{
+	ssize_t bytes;
+	char control[CMSG_SPACE(sizeof(int))];
+
+	struct iovec iov;
+	struct msghdr mh;
+	struct cmsghdr *cmsg;
+
+	iov.iov_base = s->in.buf;
+	iov.iov_len = s->in.buflen;
+
+	memset(&mh, 0, sizeof(mh));
+	mh.msg_name = &src->sa;
+	mh.msg_namelen = *srclen;
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+	mh.msg_control = control;
+	mh.msg_controllen = sizeof(control);
+
+	bytes = recvmsg(s->sd, &mh, 0);
+	if (bytes < 0)
+		return bytes;
+
+	*srclen = mh.msg_namelen;
+	*segsize = 0;
+
+	for (cmsg = CMSG_FIRSTHDR(&mh); cmsg; cmsg = CMSG_NXTHDR(&mh, cmsg)) {
+		if (cmsg->cmsg_level == IPPROTO_UDP && cmsg->cmsg_type == UDP_GRO) {
+			int gso_size;
+
+			memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+
+			*segsize = gso_size;
+		}
+	}
+
+	return bytes;
+}
+
+/** Send a GSO super-datagram which will be split by the kernel into datagrams of \p segsize bytes. */
+static ssize_t socket_sendmsg_gso(struct socket *s, const char *buf, size_t len, size_t segsize, socklen_t addrlen)
+{
+	char control[CMSG_SPACE(sizeof(uint16_t))];
+	uint16_t gso_size = segsize;
+
+	struct iovec iov;
+	struct msghdr mh;
+	struct cmsghdr *cmsg;
+
+	iov.iov_base = (void *) buf;
+	iov.iov_len = len;
+
+	memset(&mh, 0, sizeof(mh));
+	mh.msg_name = &s->out.saddr.sa;
+	mh.msg_namelen = addrlen;
+	mh.msg_iov = &iov;
+	mh.msg_iovlen = 1;
+
+	/* A single datagram does not need to be segmented */
+	if (len > segsize) {
+		memset(control, 0, sizeof(control));
+
+		mh.msg_control = control;
+		mh.msg_controllen = sizeof(control);
+
+		cmsg = CMSG_FIRSTHDR(&mh);
+		cmsg->cmsg_level = IPPROTO_UDP;
+		cmsg->cmsg_type = UDP_SEGMENT;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(gso_size));
+
+		memcpy(CMSG_DATA(cmsg), &gso_size, sizeof(gso_size));
+	}
+
+	return sendmsg(s->sd, &mh, 0);
+}
+
+/** Signal whether datagrams of a GRO super-buffer are pending for the next read. */
+static void socket_gro_signal(struct socket *s, bool pending)
+{
+	int ret;
+	uint64_t cntr = 1;
+
+	if (pending)
+		ret = write(s->gro.efd, &cntr, sizeof(cntr));
+	else
+		ret = read(s->gro.efd, &cntr, sizeof(cntr));
+
+	if (ret < 0)
+		throw SystemError("Failed to signal pending datagrams");
+}
+
+/** Parse the pending datagrams of a GRO super-buffer individually.
+ *
+ * Datagrams which do not fit into \p smps are kept for the next read.
+ */
+static int socket_scan_segments(struct vnode *n, struct sample * const smps[], unsigned cnt)
+{
+	struct socket *s = (struct socket *) n->_vd;
+
+	int ret;
+	unsigned scanned = 0;
+	size_t rbytes, seglen;
+
+	for (; s->gro.off < s->gro.len && scanned < cnt; s->gro.off += seglen) {
+		seglen = MIN(s->gro.segsize, s->gro.len - s->gro.off);
+
+		ret = s->formatter->sscan(s->in.buf + s->gro.off, seglen, &rbytes, smps + scanned, cnt - scanned);
+
+		/* The datagram contains more samples than we have room for */
+		if (ret == (int) (cnt - scanned) && rbytes < seglen && scanned > 0)
+			break;
+
+		if (ret < 0 || seglen != rbytes) {
+			n->logger->warn("Received invalid datagram: ret={}, bytes={}, rbytes={}", ret, seglen, rbytes);
+			continue;
+		}
+
+		scanned += ret;
+	}
+
+	return scanned;
+}
+#endif /* WITH_SOCKET_UDP_OFFLOAD */
+
 int socket_read(struct vnode *n, struct sample * const smps[], unsigned cnt)
 {
 	int ret;
@@ -326,8 +521,28 @@ int socket_read(struct vnode *n, struct sample * const smps[], unsigned cnt)
 	union sockaddr_union src;
 	socklen_t srclen = sizeof(src);
 
+	/* Size of the individual datagrams within the received buffer */
+	size_t segsize = 0;
+
+#ifdef WITH_SOCKET_UDP_OFFLOAD
+	/* Serve the remaining datagrams of the last super-buffer first */
+	if (s->in.offload && s->gro.off < s->gro.len) {
+		ret = socket_scan_segments(n, smps, cnt);
+
+		if (s->gro.off >= s->gro.len)
+			socket_gro_signal(s, false);
+
+		return ret;
+	}
+#endif /* WITH_SOCKET_UDP_OFFLOAD */
+
 	/* Receive next sample */
-	bytes = recvfrom(s->sd, s->in.buf, s->in.buflen, 0, &src.sa, &srclen);
+#ifdef WITH_SOCKET_UDP_OFFLOAD
+	if (s->in.offload)
+		bytes = socket_recvmsg_gro(s, &src, &srclen, &segsize);
+	else
+#endif /* WITH_SOCKET_UDP_OFFLOAD */
+		bytes = recvfrom(s->sd, s->in.buf, s->in.buflen, 0, &src.sa, &srclen);
 	if (bytes < 0)
 		throw SystemError("Failed recvfrom()");
 	else if (bytes == 0)
@@ -365,6 +580,24 @@ int socket_read(struct vnode *n, struct sample * const smps[], unsigned cnt)
 		return 0;
 	}
 
+#ifdef WITH_SOCKET_UDP_OFFLOAD
+	if (segsize > 0 && segsize < (size_t) bytes) {
+		s->gro.off = ptr - s->in.buf;
+		s->gro.len = s->gro.off + bytes;
+		s->gro.segsize = segsize;
+
+		ret = socket_scan_segments(n, smps, cnt);
+
+		if (s->gro.off < s->gro.len) {
+			n->logger->debug("Keeping {} bytes of coalesced datagrams for the next read", s->gro.len - s->gro.off);
+
+			socket_gro_signal(s, true);
+		}
+
+		return ret;
+	}
+#endif /* WITH_SOCKET_UDP_OFFLOAD */
+
 	ret = s->formatter->sscan(ptr, bytes, &rbytes, smps, cnt);
 	if (ret < 0 || (size_t) bytes != rbytes)
 		n->logger->warn("Received invalid packet: ret={}, bytes={}, rbytes={}", ret, bytes, rbytes);
@@ -372,6 +605,93 @@ int socket_read(struct vnode *n, struct sample * const smps[], unsigned cnt)
 	return ret;
 }
 
+#ifdef WITH_SOCKET_UDP_OFFLOAD
+static void socket_flush_gso(struct vnode *n, size_t len, size_t segsize)
+{
+	struct socket *s = (struct socket *) n->_vd;
+	ssize_t bytes;
+
+	socklen_t addrlen = s->out.saddr.sa.sa_family == AF_INET6
+		? sizeof(struct sockaddr_in6)
+		: sizeof(struct sockaddr_in);
+
+retry:	bytes = socket_sendmsg_gso(s, s->out.buf, len, segsize, addrlen);
+	if (bytes < 0) {
+		if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+			n->logger->warn("Blocking sendmsg()");
+			goto retry;
+		}
+		else
+			n->logger->warn("Failed sendmsg(): {}", strerror(errno));
+	}
+	else if ((size_t) bytes < len)
+		n->logger->warn("Partial sendmsg()");
+}
+
+/** Send each sample as an individual datagram by passing them as few GSO super-datagrams to the kernel. */
+static int socket_write_gso(struct vnode *n, struct sample * const smps[], unsigned cnt)
+{
+	struct socket *s = (struct socket *) n->_vd;
+
+	int ret;
+	unsigned segs = 0;
+	size_t wbytes, len = 0, segsize = 0;
+
+	for (unsigned i = 0; i < cnt; i++) {
+retry:		ret = s->formatter->sprint(s->out.buf + len, s->out.buflen - len, &wbytes, &smps[i], 1);
+		if (ret < 0) {
+			n->logger->warn("Failed to format payload: reason={}", ret);
+			return ret;
+		}
+
+		/* Sample did not fit into the remaining buffer */
+		if (ret == 0 || wbytes > s->out.buflen - len) {
+			if (len > 0) {
+				socket_flush_gso(n, len, segsize);
+
+				len = 0;
+				segs = 0;
+			}
+			else if (wbytes > s->out.buflen) {
+				s->out.buflen = wbytes;
+
+				delete[] s->out.buf;
+				s->out.buf = new char[s->out.buflen];
+				if (!s->out.buf)
+					throw MemoryAllocationError();
+			}
+			else {
+				n->logger->warn("Failed to format payload: wbytes={}", wbytes);
+				return -1;
+			}
+
+			goto retry;
+		}
+
+		/* All segments of a GSO send must have the same size */
+		if (segs > 0 && (wbytes != segsize || segs >= SOCKET_GSO_MAX_SEGMENTS || len + wbytes > SOCKET_GSO_MAX_LEN)) {
+			socket_flush_gso(n, len, segsize);
+
+			memmove(s->out.buf, s->out.buf + len, wbytes);
+
+			len = 0;
+			segs = 0;
+		}
+
+		if (segs == 0)
+			segsize = wbytes;
+
+		len += wbytes;
+		segs++;
+	}
+
+	if (len > 0)
+		socket_flush_gso(n, len, segsize);
+
+	return cnt;
+}
+#endif /* WITH_SOCKET_UDP_OFFLOAD */
+
 int socket_write(struct vnode *n, struct sample * const smps[], unsigned cnt)
 {
 	struct socket *s = (struct socket *) n->_vd;
@@ -380,6 +700,11 @@ int socket_write(struct vnode *n, struct sample * const smps[], unsigned cnt)
 	ssize_t bytes;
 	size_t wbytes;
 
+#ifdef WITH_SOCKET_UDP_OFFLOAD
+	if (s->out.offload)
+		return socket_write_gso(n, smps, cnt);
+#endif /* WITH_SOCKET_UDP_OFFLOAD */
+
 retry:	ret = s->formatter->sprint(s->out.buf, s->out.buflen, &wbytes, smps, cnt);
 	if (ret < 0) {
 		n->logger->warn("Failed to format payload: reason={}", ret);
@@ -459,16 +784,20 @@ int socket_parse(struct vnode *n, json_t *json)
 	/* Default values */
 	s->layer = SocketLayer::UDP;
 	s->verify_source = 0;
+	s->in.offload = 0;
+	s->out.offload = 0;
 
-	ret = json_unpack_ex(json, &err, 0, "{ s?: s, s?: o, s: { s: s }, s: { s: s, s?: b, s?: o } }",
+	ret = json_unpack_ex(json, &err, 0, "{ s?: s, s?: o, s: { s: s, s?: b }, s: { s: s, s?: b, s?: o, s?: b } }",
 		"layer", &layer,
 		"format", &json_format,
 		"out",
 			"address", &remote,
+			"gso", &s->out.offload,
 		"in",
 			"address", &local,
 			"verify_source", &s->verify_source,
-			"multicast", &json_multicast
+			"multicast", &json_multicast,
+			"gro", &s->in.offload
 	);
 	if (ret)
 		throw ConfigError(json, err, "node-config-node-socket");
@@ -541,6 +870,15 @@ int socket_fds(struct vnode *n, int fds[])
 {
 	struct socket *s = (struct socket *) n->_vd;
 
+#ifdef WITH_SOCKET_UDP_OFFLOAD
+	/* The path supports only a single file descriptor per node */
+	if (s->in.offload) {
+		fds[0] = s->gro.pfd;
+
+		return 1;
+	}
+#endif /* WITH_SOCKET_UDP_OFFLOAD */
+
 	fds[0] = s->sd;
 
 	return 1;
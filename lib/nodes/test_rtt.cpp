@@ -49,9 +49,11 @@ static int test_rtt_case_start(struct vnode *n, int id)
 	n->logger->info("Starting case #{}: filename={}, rate={}, values={}, limit={}", t->current, c->filename_formatted, c->rate, c->values, c->limit);
 
 	/* Open file */
-	t->stream = fopen(c->filename_formatted, "a+");
-	if (!t->stream)
-		return -1;
+	if (t->log_samples) {
+		t->stream = fopen(c->filename_formatted, "a+");
+		if (!t->stream)
+			return -1;
+	}
 
 	/* Start timer. */
 	t->task.setRate(c->rate);
@@ -67,15 +69,79 @@ static int test_rtt_case_stop(struct vnode *n, int id)
 	int ret;
 	struct test_rtt *t = (struct test_rtt *) n->_vd;
 
+	struct test_rtt_case *c = (struct test_rtt_case *) vlist_at(&t->cases, id);
+
 	/* Stop timer */
 	t->task.stop();
 
-	ret = fclose(t->stream);
-	if (ret)
-		throw SystemError("Failed to close file");
+	if (t->stream) {
+		ret = fclose(t->stream);
+		if (ret)
+			throw SystemError("Failed to close file");
+
+		t->stream = nullptr;
+	}
 
 	n->logger->info("Stopping case #{}", id);
 
+	c->hist->print(n->logger);
+
+	return 0;
+}
+
+static int test_rtt_write_summary(struct vnode *n)
+{
+	int ret;
+	struct test_rtt *t = (struct test_rtt *) n->_vd;
+
+	FILE *f = fopen(t->summary, "w");
+	if (!f)
+		throw SystemError("Failed to open summary file: {}", t->summary);
+
+	if (t->summary_format == test_rtt::SummaryFormat::JSON) {
+		json_t *json_cases = json_array();
+
+		for (size_t i = 0; i < vlist_length(&t->cases); i++) {
+			struct test_rtt_case *c = (struct test_rtt_case *) vlist_at(&t->cases, i);
+
+			json_array_append_new(json_cases, json_pack("{ s: f, s: i, s: i, s: o }",
+				"rate", c->rate,
+				"values", c->values,
+				"limit", c->limit,
+				"rtt", c->hist->toJson()
+			));
+		}
+
+		json_t *json_summary = json_pack("{ s: b, s: o }",
+			"corrected", t->correct_omission,
+			"cases", json_cases
+		);
+
+		ret = json_dumpf(json_summary, f, JSON_INDENT(4));
+
+		json_decref(json_summary);
+	}
+	else {
+		fprintf(f, "rate,values,limit,");
+		HdrHist::printCsvHeader(f);
+		fprintf(f, "\n");
+
+		for (size_t i = 0; i < vlist_length(&t->cases); i++) {
+			struct test_rtt_case *c = (struct test_rtt_case *) vlist_at(&t->cases, i);
+
+			fprintf(f, "%f,%u,%u,", c->rate, c->values, c->limit);
+			c->hist->printCsv(f);
+			fprintf(f, "\n");
+		}
+
+		ret = 0;
+	}
+
+	if (fclose(f) || ret)
+		throw SystemError("Failed to write summary file: {}", t->summary);
+
+	n->logger->info("Wrote summary of all cases to {}", t->summary);
+
 	return 0;
 }
 
@@ -85,7 +151,10 @@ static int test_rtt_case_destroy(struct test_rtt_case *c)
 		free(c->filename);
 
 	if (c->filename_formatted)
-		free(c->filename_formatted);
+		delete[] c->filename_formatted;
+
+	if (c->hist)
+		delete c->hist;
 
 	return 0;
 }
@@ -115,6 +184,18 @@ int test_rtt_prepare(struct vnode *n)
 		strftime(c->filename_formatted, NAME_MAX, c->filename, &tm);
 	}
 
+	if (t->summary_format != test_rtt::SummaryFormat::NONE) {
+		char *summary = strf("%s/%s_summary.%s", t->output, t->prefix,
+			t->summary_format == test_rtt::SummaryFormat::JSON ? "json" : "csv");
+
+		t->summary = new char[PATH_MAX];
+		if (!t->summary)
+			throw MemoryAllocationError();
+
+		strftime(t->summary, PATH_MAX, summary, &tm);
+		free(summary);
+	}
+
 	ret = signal_list_generate(&n->in.signals, max_values, SignalType::FLOAT);
 	if (ret)
 		return ret;
@@ -134,27 +215,43 @@ int test_rtt_parse(struct vnode *n, json_t *json)
 	std::vector<int> values;
 
 	size_t i;
+	const char *summary_format = "json";
+
 	json_t *json_cases, *json_case, *json_val, *json_format = nullptr;
 	json_t *json_rates = nullptr, *json_values = nullptr;
 	json_error_t err;
 
 	t->cooldown = 0;
+	t->log_samples = 1;
+	t->correct_omission = 1;
 
 	/* Generate list of test cases */
 	ret = vlist_init(&t->cases);
 	if (ret)
 		return ret;
 
-	ret = json_unpack_ex(json, &err, 0, "{ s?: s, s?: s, s?: o, s?: F, s: o }",
+	ret = json_unpack_ex(json, &err, 0, "{ s?: s, s?: s, s?: o, s?: F, s: o, s?: b, s?: b, s?: s }",
 		"prefix", &prefix,
 		"output", &output,
 		"format", &json_format,
 		"cooldown", &t->cooldown,
-		"cases", &json_cases
+		"cases", &json_cases,
+		"log_samples", &t->log_samples,
+		"correct_omission", &t->correct_omission,
+		"summary_format", &summary_format
 	);
 	if (ret)
 		throw ConfigError(json, err, "node-config-node-test-rtt");
 
+	if      (!strcmp(summary_format, "json"))
+		t->summary_format = test_rtt::SummaryFormat::JSON;
+	else if (!strcmp(summary_format, "csv"))
+		t->summary_format = test_rtt::SummaryFormat::CSV;
+	else if (!strcmp(summary_format, "none"))
+		t->summary_format = test_rtt::SummaryFormat::NONE;
+	else
+		throw ConfigError(json, "node-config-node-test-rtt-summary-format", "Invalid value '{}' for setting 'summary_format'", summary_format);
+
 	t->output = strdup(output);
 	t->prefix = strdup(prefix);
 
@@ -227,6 +324,10 @@ int test_rtt_parse(struct vnode *n, json_t *json)
 				c->filename_formatted = nullptr;
 				c->node = n;
 
+				c->hist = new HdrHist();
+				if (!c->hist)
+					throw MemoryAllocationError();
+
 				c->rate = rate;
 				c->values = value;
 
@@ -253,6 +354,11 @@ int test_rtt_init(struct vnode *n)
 
 	new (&t->task) Task(CLOCK_MONOTONIC);
 
+	t->stream = nullptr;
+	t->summary = nullptr;
+	t->output = nullptr;
+	t->prefix = nullptr;
+
 	return 0;
 }
 
@@ -273,6 +379,9 @@ int test_rtt_destroy(struct vnode *n)
 	if (t->prefix)
 		free(t->prefix);
 
+	if (t->summary)
+		delete[] t->summary;
+
 	return 0;
 }
 
@@ -280,7 +389,9 @@ char * test_rtt_print(struct vnode *n)
 {
 	struct test_rtt *t = (struct test_rtt *) n->_vd;
 
-	return strf("output=%s, prefix=%s, cooldown=%f, #cases=%zu", t->output, t->prefix, t->cooldown, vlist_length(&t->cases));
+	return strf("output=%s, prefix=%s, cooldown=%f, #cases=%zu, log_samples=%s, correct_omission=%s", t->output, t->prefix, t->cooldown, vlist_length(&t->cases),
+		t->log_samples ? "yes" : "no",
+		t->correct_omission ? "yes" : "no");
 }
 
 int test_rtt_start(struct vnode *n)
@@ -319,6 +430,12 @@ int test_rtt_stop(struct vnode *n)
 			return ret;
 	}
 
+	if (t->summary) {
+		ret = test_rtt_write_summary(n);
+		if (ret)
+			return ret;
+	}
+
 	delete t->formatter;
 
 	return 0;
@@ -404,6 +521,7 @@ int test_rtt_write(struct vnode *n, struct sample * const smps[], unsigned cnt)
 		return 0;
 
 	struct test_rtt_case *c = (struct test_rtt_case *) vlist_at(&t->cases, t->current);
+	struct timespec now = time_now();
 
 	unsigned i;
 	for (i = 0; i < cnt; i++) {
@@ -412,7 +530,17 @@ int test_rtt_write(struct vnode *n, struct sample * const smps[], unsigned cnt)
 			continue;
 		}
 
-		t->formatter->print(t->stream, smps[i]);
+		if (smps[i]->flags & (int) SampleFlags::HAS_TS_ORIGIN) {
+			double rtt = time_delta(&smps[i]->ts.origin, &now);
+
+			if (t->correct_omission)
+				c->hist->putCorrected(rtt, 1.0 / c->rate);
+			else
+				c->hist->put(rtt);
+		}
+
+		if (t->stream)
+			t->formatter->print(t->stream, smps[i]);
 	}
 
 	return i;
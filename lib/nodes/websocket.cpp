@@ -39,6 +39,7 @@ using namespace villas::node;
 using namespace villas::utils;
 
 #define DEFAULT_WEBSOCKET_BUFFER_SIZE (1 << 12)
+#define WEBSOCKET_MAX_FRAME_SIZE (1 << 24)
 
 /* Private static storage */
 static struct vlist connections;	/**< List of active libwebsocket connections which receive samples from all nodes (catch all) */
@@ -57,6 +58,37 @@ static void websocket_destination_destroy(struct websocket_destination *d)
 	free((char *) d->info.address);
 }
 
+static struct websocket_frame * websocket_frame_alloc(const char *payload, size_t len, bool binary)
+{
+	char *mem = new char[sizeof(struct websocket_frame) + LWS_PRE + len];
+	if (!mem)
+		throw MemoryAllocationError();
+
+	auto *f = new (mem) struct websocket_frame;
+
+	f->refcnt = 1;
+	f->binary = binary;
+	f->len = len;
+
+	memcpy((char *) (f + 1) + LWS_PRE, payload, len);
+
+	return f;
+}
+
+static unsigned char * websocket_frame_payload(struct websocket_frame *f)
+{
+	return (unsigned char *) (f + 1) + LWS_PRE;
+}
+
+static void websocket_frame_decref(struct websocket_frame *f)
+{
+	if (--f->refcnt > 0)
+		return;
+
+	f->~websocket_frame();
+	delete[] (char *) f;
+}
+
 static int websocket_connection_init(struct websocket_connection *c)
 {
 	int ret;
@@ -84,17 +116,17 @@ static int websocket_connection_destroy(struct websocket_connection *c)
 
 	assert(c->state != websocket_connection::State::DESTROYED);
 
-	/* Return all samples to pool */
-	int avail;
-	struct sample *smp;
-	while ((avail = queue_pull(&c->queue, (void **) &smp)))
-		sample_decref(smp);
+	/* Release all queued frames */
+	struct websocket_frame *f;
+	while (queue_pull(&c->queue, (void **) &f) == 1)
+		websocket_frame_decref(f);
 
 	ret = queue_destroy(&c->queue);
 	if (ret)
 		return ret;
 
 	delete c->formatter;
+	free(c->format);
 	delete c->buffers.recv;
 	delete c->buffers.send;
 
@@ -105,20 +137,42 @@ static int websocket_connection_destroy(struct websocket_connection *c)
 	return 0;
 }
 
-static int websocket_connection_write(struct websocket_connection *c, struct sample * const smps[], unsigned cnt)
+static int websocket_connection_write(struct websocket_connection *c, const std::vector<struct websocket_frame *> &frames)
 {
 	int pushed;
+	struct websocket *w = (struct websocket *) c->node->_vd;
 
 	if (c->state != websocket_connection::State::INITIALIZED)
 		return -1;
 
-	pushed = queue_push_many(&c->queue, (void **) smps, cnt);
-	if (pushed < (int) cnt)
+	/* Slow clients lose frames instead of piling them up */
+	if (queue_available(&c->queue) + frames.size() > (size_t) w->max_lag) {
+		if (!c->lagging)
+			c->node->logger->warn("WebSocket connection is lagging behind. Dropping frames: {}", *c);
+
+		c->lagging = true;
+		c->dropped += frames.size();
+
+		return 0;
+	}
+
+	if (c->lagging)
+		c->node->logger->info("WebSocket connection caught up after dropping {} frames: {}", c->dropped, *c);
+
+	c->lagging = false;
+
+	for (auto *f : frames)
+		f->refcnt++;
+
+	pushed = queue_push_many(&c->queue, (void **) frames.data(), frames.size());
+	if (pushed < (int) frames.size()) {
 		c->node->logger->warn("Queue overrun in WebSocket connection: {}", *c);
 
-	sample_incref_many(smps, pushed);
+		for (size_t i = pushed; i < frames.size(); i++)
+			websocket_frame_decref(frames[i]);
+	}
 
-	c->node->logger->debug("Enqueued {} samples to {}", pushed, *c);
+	c->node->logger->debug("Enqueued {} frames to {}", pushed, *c);
 
 	/* Client connections which are currently conecting don't have an associate c->wsi yet */
 	if (c->wsi)
@@ -195,6 +249,8 @@ int websocket_protocol_cb(struct lws *wsi, enum lws_callback_reasons reason, voi
 					c->node->logger->warn("Failed to find format: format={}", format);
 					return -1;
 				}
+
+				c->format = strdup(format);
 			}
 
 			ret = websocket_connection_init(c);
@@ -237,21 +293,34 @@ int websocket_protocol_cb(struct lws *wsi, enum lws_callback_reasons reason, voi
 
 		case LWS_CALLBACK_CLIENT_WRITEABLE:
 		case LWS_CALLBACK_SERVER_WRITEABLE: {
-			struct sample *smps[cnt];
+			struct websocket_frame *f;
+
+			pulled = queue_pull(&c->queue, (void **) &f);
+			if (pulled == 1) {
+				unsigned char *payload = websocket_frame_payload(f);
+
+				/* Frames are shared between connections. As libwebsockets
+				 * masks the payload of client connections in-place, we
+				 * send a private copy. Server connections use the frame
+				 * directly. This is safe as all connections are serviced
+				 * by the same thread. */
+				if (c->mode == websocket_connection::Mode::CLIENT) {
+					if (c->buffers.send->size() < LWS_PRE + f->len)
+						c->buffers.send->resize(LWS_PRE + f->len);
 
-			pulled = queue_pull_many(&c->queue, (void **) smps, cnt);
-			if (pulled > 0) {
-				size_t wbytes;
-				c->formatter->sprint(c->buffers.send->data() + LWS_PRE, c->buffers.send->size() - LWS_PRE, &wbytes, smps, pulled);
+					memcpy(c->buffers.send->data() + LWS_PRE, payload, f->len);
+
+					payload = (unsigned char *) c->buffers.send->data() + LWS_PRE;
+				}
 
-				ret = lws_write(wsi, (unsigned char *) c->buffers.send->data() + LWS_PRE, wbytes, c->formatter->isBinaryPayload() ? LWS_WRITE_BINARY : LWS_WRITE_TEXT);
+				ret = lws_write(wsi, payload, f->len, f->binary ? LWS_WRITE_BINARY : LWS_WRITE_TEXT);
 
-				sample_decref_many(smps, pulled);
+				websocket_frame_decref(f);
 
 				if (ret < 0)
 					return ret;
 
-				c->node->logger->debug("Send {} samples to connection: {}, bytes={}", pulled, *c, ret);
+				c->node->logger->debug("Send frame to connection: {}, bytes={}", *c, ret);
 			}
 
 			if (queue_available(&c->queue) > 0)
@@ -351,6 +420,11 @@ int websocket_start(struct vnode *n)
 	if (ret)
 		return ret;
 
+	w->encoders = new std::map<std::string, struct websocket_encoder>;
+	w->buffer = new Buffer(DEFAULT_WEBSOCKET_BUFFER_SIZE);
+	if (!w->encoders || !w->buffer)
+		throw MemoryAllocationError();
+
 	for (size_t i = 0; i < vlist_length(&w->destinations); i++) {
 		const char *format;
 		auto *d = (struct websocket_destination *) vlist_at(&w->destinations, i);
@@ -359,6 +433,9 @@ int websocket_start(struct vnode *n)
 			throw MemoryAllocationError();
 
 		c->state = websocket_connection::State::CONNECTING;
+		c->wsi = nullptr;
+		c->dropped = 0;
+		c->lagging = false;
 
 		format = strchr(d->info.path, '.');
 		if (format)
@@ -370,6 +447,7 @@ int websocket_start(struct vnode *n)
 		if (!c->formatter)
 			return -1;
 
+		c->format = strdup(format);
 		c->node = n;
 		c->destination = d;
 
@@ -424,6 +502,12 @@ int websocket_stop(struct vnode *n)
 	if (ret)
 		return ret;
 
+	for (auto &it : *w->encoders)
+		delete it.second.formatter;
+
+	delete w->encoders;
+	delete w->buffer;
+
 	return 0;
 }
 
@@ -456,28 +540,93 @@ int websocket_read(struct vnode *n, struct sample * const smps[], unsigned cnt)
 	return avail;
 }
 
-int websocket_write(struct vnode *n, struct sample * const smps[], unsigned cnt)
+/** Serialize samples into one or more frames.
+ *
+ * The scratch buffer grows until at least a single sample fits into a frame.
+ */
+static int websocket_encode(struct vnode *n, struct websocket_encoder *e, struct sample * const smps[], unsigned cnt)
 {
-	int avail;
+	struct websocket *w = (struct websocket *) n->_vd;
+
+	for (unsigned i = 0; i < cnt; ) {
+		int ret;
+		size_t wbytes;
 
+		ret = e->formatter->sprint(w->buffer->data(), w->buffer->size(), &wbytes, &smps[i], cnt - i);
+		if (ret < 0)
+			return ret;
+
+		if (ret == 0 || wbytes > w->buffer->size()) {
+			if (w->buffer->size() >= WEBSOCKET_MAX_FRAME_SIZE)
+				return -1;
+
+			w->buffer->resize(w->buffer->size() * 2);
+			continue;
+		}
+
+		e->frames.push_back(websocket_frame_alloc(w->buffer->data(), wbytes, e->formatter->isBinaryPayload()));
+
+		i += ret;
+	}
+
+	return 0;
+}
+
+static struct websocket_encoder * websocket_encoder_get(struct vnode *n, const char *format)
+{
 	struct websocket *w = (struct websocket *) n->_vd;
-	struct sample *cpys[cnt];
 
-	/* Make copies of all samples */
-	avail = sample_alloc_many(&w->pool, cpys, cnt);
-	if (avail < (int) cnt)
-		n->logger->warn("Pool underrun: avail={}", avail);
+	auto it = w->encoders->find(format);
+	if (it != w->encoders->end())
+		return &it->second;
+
+	auto *fmt = FormatFactory::make(format);
+	if (!fmt)
+		return nullptr;
 
-	sample_copy_many(cpys, smps, avail);
+	fmt->start(&n->in.signals, ~(int) SampleFlags::HAS_OFFSET);
 
+	auto &e = (*w->encoders)[format];
+	e.formatter = fmt;
+
+	return &e;
+}
+
+int websocket_write(struct vnode *n, struct sample * const smps[], unsigned cnt)
+{
+	int ret;
+	struct websocket *w = (struct websocket *) n->_vd;
+
+	/* Samples are serialized only once per format and the resulting
+	 * frames are shared between all connections of this node. */
 	for (size_t i = 0; i < vlist_length(&connections); i++) {
 		struct websocket_connection *c = (struct websocket_connection *) vlist_at(&connections, i);
 
-		if (c->node == n)
-			websocket_connection_write(c, cpys, cnt);
+		if (c->node != n || !c->format)
+			continue;
+
+		auto *e = websocket_encoder_get(n, c->format);
+		if (!e)
+			continue;
+
+		if (e->frames.empty()) {
+			ret = websocket_encode(n, e, smps, cnt);
+			if (ret) {
+				n->logger->warn("Failed to encode samples: format={}", c->format);
+				continue;
+			}
+		}
+
+		websocket_connection_write(c, e->frames);
 	}
 
-	sample_decref_many(cpys, avail);
+	/* Release our own references */
+	for (auto &it : *w->encoders) {
+		for (auto *f : it.second.frames)
+			websocket_frame_decref(f);
+
+		it.second.frames.clear();
+	}
 
 	return cnt;
 }
@@ -496,10 +645,18 @@ int websocket_parse(struct vnode *n, json_t *json)
 	if (ret)
 		return ret;
 
-	ret = json_unpack_ex(json, &err, 0, "{ s?: o }", "destinations", &json_dests);
+	w->max_lag = DEFAULT_WEBSOCKET_MAX_LAG;
+
+	ret = json_unpack_ex(json, &err, 0, "{ s?: o, s?: i }",
+		"destinations", &json_dests,
+		"max_lag", &w->max_lag
+	);
 	if (ret)
 		throw ConfigError(json, err, "node-config-node-websocket");
 
+	if (w->max_lag <= 0 || w->max_lag > (int) DEFAULT_QUEUE_LENGTH)
+		throw ConfigError(json, "node-config-node-websocket-max-lag", "The 'max_lag' setting must be between 1 and {}", DEFAULT_QUEUE_LENGTH);
+
 	if (json_dests) {
 		if (!json_is_array(json_dests))
 			throw ConfigError(json_dests, err, "node-config-node-websocket-destinations", "The 'destinations' setting must be an array of URLs");
@@ -557,7 +714,7 @@ char * websocket_print(struct vnode *n)
 		);
 	}
 
-	buf = strcatf(&buf, "]");
+	buf = strcatf(&buf, "], max_lag=%d", w->max_lag);
 
 	return buf;
 }
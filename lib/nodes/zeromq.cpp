@@ -21,6 +21,7 @@
  *********************************************************************************/
 
 #include <cstring>
+#include <unistd.h>
 #include <zmq.h>
 
 #if ZMQ_VERSION_MAJOR < 4 || (ZMQ_VERSION_MAJOR == 4 && ZMQ_VERSION_MINOR <= 1)
@@ -108,6 +109,11 @@ int zeromq_init(struct vnode *n)
 	z->in.pending = 0;
 	z->out.pending = 0;
 
+	z->send.zerocopy = 1;
+	z->send.multipart = 0;
+	z->send.buffer_size = ZEROMQ_BUFFER_SIZE;
+	z->send.inflight = 0;
+
 	ret = vlist_init(&z->in.endpoints);
 	if (ret)
 		return ret;
@@ -162,8 +168,9 @@ int zeromq_parse(struct vnode *n, json_t *json)
 	json_t *json_out_ep = nullptr;
 	json_t *json_curve = nullptr;
 	json_t *json_format = nullptr;
+	int buffer_size = z->send.buffer_size;
 
-	ret = json_unpack_ex(json, &err, 0, "{ s?: { s?: o, s?: s, s?: b }, s?: { s?: o, s?: s, s?: b }, s?: o, s?: s, s?: b, s?: o }",
+	ret = json_unpack_ex(json, &err, 0, "{ s?: { s?: o, s?: s, s?: b }, s?: { s?: o, s?: s, s?: b, s?: b, s?: b, s?: i }, s?: o, s?: s, s?: b, s?: o }",
 		"in",
 			"subscribe", &json_in_ep,
 			"filter", &in_filter,
@@ -172,6 +179,9 @@ int zeromq_parse(struct vnode *n, json_t *json)
 			"publish", &json_out_ep,
 			"filter", &out_filter,
 			"bind", &z->out.bind,
+			"zerocopy", &z->send.zerocopy,
+			"multipart", &z->send.multipart,
+			"buffer_size", &buffer_size,
 		"curve", &json_curve,
 		"pattern", &type,
 		"ipv6", &z->ipv6,
@@ -180,6 +190,11 @@ int zeromq_parse(struct vnode *n, json_t *json)
 	if (ret)
 		throw ConfigError(json, err, "node-config-node-zeromq");
 
+	if (buffer_size <= 0)
+		throw ConfigError(json, "node-config-node-zeromq-buffer-size", "Setting 'out.buffer_size' must be positive");
+
+	z->send.buffer_size = buffer_size;
+
 	z->in.filter = in_filter ? strdup(in_filter) : nullptr;
 	z->out.filter = out_filter ? strdup(out_filter) : nullptr;
 
@@ -240,6 +255,12 @@ int zeromq_parse(struct vnode *n, json_t *json)
 			throw ConfigError(json, "node-config-node-zeromq-type", "Invalid type for ZeroMQ node: {}", node_name_short(n));
 	}
 
+#ifdef ZMQ_BUILD_DISH
+	/* Radio and dish sockets do not support multipart messages */
+	if (z->send.multipart && z->pattern == zeromq::Pattern::RADIODISH)
+		throw ConfigError(json, "node-config-node-zeromq-multipart", "Multipart messages are not supported by the radiodish pattern");
+#endif
+
 	return 0;
 }
 
@@ -292,6 +313,12 @@ char * zeromq_print(struct vnode *n)
 	if (z->out.filter)
 		strcatf(&buf, ", out.filter=%s", z->out.filter);
 
+	strcatf(&buf, ", out.zerocopy=%s, out.multipart=%s, out.buffer_size=%zu",
+		z->send.zerocopy ? "yes" : "no",
+		z->send.multipart ? "yes" : "no",
+		z->send.buffer_size
+	);
+
 	return buf;
 }
 
@@ -327,6 +354,16 @@ int zeromq_start(struct vnode *n)
 
 	z->formatter->start(&n->in.signals, ~(int) SampleFlags::HAS_OFFSET);
 
+	if (z->send.zerocopy) {
+		ret = pool_init(&z->send.pool, ZEROMQ_POOL_LENGTH, z->send.buffer_size);
+		if (ret)
+			return ret;
+	}
+
+	z->send.buffer = new char[z->send.buffer_size];
+	if (!z->send.buffer)
+		throw MemoryAllocationError();
+
 	switch (z->pattern) {
 #ifdef ZMQ_BUILD_DISH
 		case zeromq::Pattern::RADIODISH:
@@ -492,6 +529,21 @@ int zeromq_stop(struct vnode *n)
 			return ret;
 	}
 
+	if (z->send.zerocopy) {
+		/* ZeroMQ releases the remaining buffers within the linger period */
+		for (int i = 0; i < 200 && z->send.inflight > 0; i++)
+			usleep(10000);
+
+		if (z->send.inflight > 0)
+			n->logger->warn("{} buffers are still owned by ZeroMQ. Not releasing pool", z->send.inflight);
+		else {
+			ret = pool_destroy(&z->send.pool);
+			if (ret)
+				return ret;
+		}
+	}
+
+	delete[] z->send.buffer;
 	delete z->formatter;
 
 	return 0;
@@ -517,7 +569,7 @@ int zeromq_destroy(struct vnode *n)
 
 int zeromq_read(struct vnode *n, struct sample * const smps[], unsigned cnt)
 {
-	int recv, ret;
+	int recv = 0, ret;
 	struct zeromq *z = (struct zeromq *) n->_vd;
 
 	zmq_msg_t m;
@@ -537,12 +589,24 @@ int zeromq_read(struct vnode *n, struct sample * const smps[], unsigned cnt)
 		}
 	}
 
-	/* Receive payload */
-	ret = zmq_msg_recv(&m, z->in.socket, 0);
-	if (ret < 0)
-		return ret;
+	/* Receive payload. Multipart messages contain one or more samples per part. */
+	do {
+		ret = zmq_msg_recv(&m, z->in.socket, 0);
+		if (ret < 0) {
+			zmq_msg_close(&m);
+			return ret;
+		}
 
-	recv = z->formatter->sscan((const char *) zmq_msg_data(&m), zmq_msg_size(&m), nullptr, smps, cnt);
+		if ((unsigned) recv < cnt) {
+			ret = z->formatter->sscan((const char *) zmq_msg_data(&m), zmq_msg_size(&m), nullptr, &smps[recv], cnt - recv);
+			if (ret < 0)
+				n->logger->warn("Failed to parse message part");
+			else
+				recv += ret;
+		}
+		else
+			n->logger->warn("Discarding part of multipart message. Too many samples.");
+	} while (zmq_msg_more(&m));
 
 	ret = zmq_msg_close(&m);
 	if (ret)
@@ -551,21 +615,75 @@ int zeromq_read(struct vnode *n, struct sample * const smps[], unsigned cnt)
 	return recv;
 }
 
-int zeromq_write(struct vnode *n, struct sample * const smps[], unsigned cnt)
+static void zeromq_free(void *data, void *hint)
 {
-	int ret;
+	struct zeromq *z = (struct zeromq *) hint;
+
+	pool_put(&z->send.pool, data);
+
+	z->send.inflight--;
+}
+
+/** Format samples into a new message.
+ *
+ * If possible, the samples are formatted into a buffer of the pool which
+ * is handed over to ZeroMQ without copying.
+ *
+ * @return The number of samples in the message or a negative value on errors.
+ */
+static int zeromq_format(struct vnode *n, zmq_msg_t *m, struct sample * const smps[], unsigned cnt)
+{
+	int ret, written;
 	struct zeromq *z = (struct zeromq *) n->_vd;
 
 	size_t wbytes;
-	zmq_msg_t m;
+	char *buf = z->send.zerocopy
+			? (char *) pool_get(&z->send.pool)
+			: nullptr;
 
-	char data[4096];
+	written = z->formatter->sprint(buf ? buf : z->send.buffer, z->send.buffer_size, &wbytes, smps, cnt);
+	if (written <= 0 || wbytes > z->send.buffer_size) {
+		if (buf)
+			pool_put(&z->send.pool, buf);
 
-	ret = z->formatter->sprint(data, sizeof(data), &wbytes, smps, cnt);
-	if (ret <= 0)
 		return -1;
+	}
+
+	if (buf) {
+		z->send.inflight++;
+
+		ret = zmq_msg_init_data(m, buf, wbytes, zeromq_free, z);
+		if (ret) {
+			z->send.inflight--;
+			pool_put(&z->send.pool, buf);
 
-	ret = zmq_msg_init_size(&m, wbytes);
+			return ret;
+		}
+	}
+	else {
+		/* Pool exhausted or zero-copy disabled */
+		ret = zmq_msg_init_size(m, wbytes);
+		if (ret)
+			return ret;
+
+		memcpy(zmq_msg_data(m), z->send.buffer, wbytes);
+	}
+
+	return written;
+}
+
+int zeromq_write(struct vnode *n, struct sample * const smps[], unsigned cnt)
+{
+	int ret, written, sent = 0;
+	struct zeromq *z = (struct zeromq *) n->_vd;
+
+	zmq_msg_t m;
+
+	/* The first part contains as many samples as fit into a message.
+	 * In multipart mode, each sample is sent in a part on its own. */
+	written = zeromq_format(n, &m, smps, z->send.multipart ? 1 : cnt);
+	if (written <= 0)
+		return -1;
 
 	if (z->out.filter) {
 		switch (z->pattern) {
@@ -583,17 +701,35 @@ int zeromq_write(struct vnode *n, struct sample * const smps[], unsigned cnt)
 		}
 	}
 
-	memcpy(zmq_msg_data(&m), data, wbytes);
+	if (!z->send.multipart) {
+		ret = zmq_msg_send(&m, z->out.socket, 0);
+		if (ret < 0)
+			goto fail;
 
-	ret = zmq_msg_send(&m, z->out.socket, 0);
-	if (ret < 0)
-		goto fail;
+		return written;
+	}
 
-	ret = zmq_msg_close(&m);
-	if (ret < 0)
-		return ret;
+	while (true) {
+		sent++;
+
+		ret = zmq_msg_send(&m, z->out.socket, (unsigned) sent < cnt ? ZMQ_SNDMORE : 0);
+		if (ret < 0)
+			goto fail;
+
+		if ((unsigned) sent == cnt)
+			break;
+
+		ret = zeromq_format(n, &m, &smps[sent], 1);
+		if (ret <= 0) {
+			/* We can not leave the multipart message incomplete */
+			zmq_msg_init_size(&m, 0);
+			zmq_msg_send(&m, z->out.socket, 0);
+
+			return -1;
+		}
+	}
 
-	return cnt;
+	return sent;
 
 fail:
 	zmq_msg_close(&m);
@@ -43,6 +43,7 @@ int path_source_init_master(struct vpath_source *ps, struct vnode *n)
 	ps->node = n;
 	ps->masked = false;
 	ps->type = PathSourceType::MASTER;
+	ps->ring.state = State::DESTROYED;
 
 	ret = vlist_init(&ps->mappings);
 	if (ret)
@@ -76,7 +77,18 @@ int path_source_init_secondary(struct vpath_source *ps, struct vnode *n)
 
 	ps->type = PathSourceType::SECONDARY;
 
-	ps->node = loopback_internal_create(n);
+	mps = (struct vpath_source *) vlist_at_safe(&n->sources, 0);
+	if (!mps)
+		return -1;
+
+	/* The ring is shared by all secondaries and created along with the first one */
+	if (mps->ring.state == State::DESTROYED) {
+		ret = broadcast_ring_init(&mps->ring, n->in.secondaries.queuelen, n->in.secondaries.overflow);
+		if (ret)
+			return ret;
+	}
+
+	ps->node = loopback_internal_create(n, &mps->ring);
 	if (!ps->node)
 		return -1;
 
@@ -88,10 +100,6 @@ int path_source_init_secondary(struct vpath_source *ps, struct vnode *n)
 	if (ret)
 		return -1;
 
-	mps = (struct vpath_source *) vlist_at_safe(&n->sources, 0);
-	if (!mps)
-		return -1;
-
 	vlist_push(&mps->secondaries, ps);
 
 	return 0;
@@ -101,6 +109,11 @@ int path_source_destroy(struct vpath_source *ps)
 {
 	int ret;
 
+	/* The ring still holds references to samples of the pool */
+	ret = broadcast_ring_destroy(&ps->ring);
+	if (ret)
+		return ret;
+
 	ret = pool_destroy(&ps->pool);
 	if (ret)
 		return ret;
@@ -153,14 +166,12 @@ int path_source_read(struct vpath_source *ps, struct vpath *p, int i)
 		p->logger->warn("Partial read for path {}: read={}, expected={}", *p, recv, allocated);
 
 	/* Forward samples to secondary path sources */
-	for (size_t i = 0; i < vlist_length(&ps->secondaries); i++) {
-		auto *sps = (struct vpath_source *) vlist_at(&ps->secondaries, i);
-
-		int sent;
+	if (vlist_length(&ps->secondaries) > 0) {
+		int published;
 
-		sent = node_write(sps->node, read_smps, recv);
-		if (sent < recv)
-			p->logger->warn("Partial write to secondary path source {} of path {}", *sps->node, *p);
+		published = broadcast_ring_publish(&ps->ring, read_smps, recv);
+		if (published >= 0 && published < recv)
+			p->logger->warn("Dropped {} samples for secondary path sources of path {}: slowest secondary did not catch up", recv - published, *p);
 	}
 
 	p->received.set(i);
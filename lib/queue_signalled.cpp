@@ -21,6 +21,8 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *********************************************************************************/
 
+#include <cerrno>
+
 #include <villas/node/config.h>
 #include <villas/queue_signalled.h>
 
@@ -28,6 +30,12 @@
   #include <sys/eventfd.h>
 #endif
 
+#ifdef __linux__
+  #include <climits>
+  #include <linux/futex.h>
+  #include <sys/syscall.h>
+#endif
+
 static void queue_signalled_cleanup(void *p)
 {
 	struct queue_signalled *qs = (struct queue_signalled *) p;
@@ -36,16 +44,80 @@ static void queue_signalled_cleanup(void *p)
 		pthread_mutex_unlock(&qs->pthread.mutex);
 }
 
+#ifdef __linux__
+static int queue_signalled_futex_op(struct queue_signalled *qs)
+{
+	/* Private futexes are cheaper but only work within a single process */
+	return (int) qs->flags & (int) QueueSignalledFlags::PROCESS_SHARED
+		? 0
+		: FUTEX_PRIVATE_FLAG;
+}
+
+static void queue_signalled_futex_wake(struct queue_signalled *qs)
+{
+	std::atomic_fetch_add(&qs->futex.seq, 1u);
+
+	/* Avoid the syscall if no reader is sleeping */
+	if (std::atomic_load(&qs->futex.waiters) > 0)
+		syscall(SYS_futex, &qs->futex.seq, FUTEX_WAKE | queue_signalled_futex_op(qs), INT_MAX, nullptr, nullptr, 0);
+}
+
+static void queue_signalled_futex_cleanup(void *p)
+{
+	struct queue_signalled *qs = (struct queue_signalled *) p;
+
+	std::atomic_fetch_sub(&qs->futex.waiters, 1u);
+}
+
+/** Wait until the futex word has been changed from \p seq by a writer. */
+static int queue_signalled_futex_wait(struct queue_signalled *qs, uint32_t seq)
+{
+	int ret = 0;
+
+	for (unsigned i = 0; i < qs->futex.spin; i++) {
+		if (std::atomic_load_explicit(&qs->futex.seq, std::memory_order_acquire) != seq)
+			return 0;
+
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+#endif
+	}
+
+	std::atomic_fetch_add(&qs->futex.waiters, 1u);
+
+	pthread_cleanup_push(queue_signalled_futex_cleanup, qs);
+
+	/* The futex syscall is not a cancellation point.
+	 * Hence we wake up periodically to check for pending cancellation requests. */
+	struct timespec timeout = {
+		.tv_sec = 0,
+		.tv_nsec = QUEUE_SIGNALLED_FUTEX_TIMEOUT
+	};
+
+	/* The kernel only puts us to sleep if the word still equals seq */
+	if (syscall(SYS_futex, &qs->futex.seq, FUTEX_WAIT | queue_signalled_futex_op(qs), seq, &timeout, nullptr, 0) < 0 &&
+	    errno != EAGAIN && errno != EINTR && errno != ETIMEDOUT)
+		ret = -1;
+
+	pthread_testcancel();
+
+	pthread_cleanup_pop(1);
+
+	return ret;
+}
+#endif /* __linux__ */
+
 int queue_signalled_init(struct queue_signalled *qs, size_t size, struct memory_type *mem, enum QueueSignalledMode mode, int flags)
 {
 	int ret;
 
 	qs->mode = mode;
+	qs->flags = (enum QueueSignalledFlags) flags;
 
 	if (qs->mode == QueueSignalledMode::AUTO) {
 #ifdef __linux__
 		if (flags & (int) QueueSignalledFlags::PROCESS_SHARED)
-			qs->mode = QueueSignalledMode::PTHREAD;
+			qs->mode = QueueSignalledMode::FUTEX;
 		else {
 #ifdef HAS_EVENTFD
 			qs->mode = QueueSignalledMode::EVENTFD;
@@ -100,6 +172,17 @@ int queue_signalled_init(struct queue_signalled *qs, size_t size, struct memory_
 		if (ret < 0)
 			return -2;
 	}
+#endif
+#ifdef __linux__
+	else if (qs->mode == QueueSignalledMode::FUTEX) {
+		std::atomic_init(&qs->futex.seq, 0u);
+		std::atomic_init(&qs->futex.waiters, 0u);
+
+		/* Spinning is only useful if the writer can run in parallel */
+		qs->futex.spin = sysconf(_SC_NPROCESSORS_ONLN) > 1
+			? QUEUE_SIGNALLED_FUTEX_SPIN
+			: 0;
+	}
 #endif
 	else
 		return -1;
@@ -134,6 +217,11 @@ int queue_signalled_destroy(struct queue_signalled *qs)
 		if (ret)
 			return ret;
 	}
+#endif
+#ifdef __linux__
+	else if (qs->mode == QueueSignalledMode::FUTEX) {
+		/* Nothing todo */
+	}
 #endif
 	else
 		return -1;
@@ -173,6 +261,10 @@ int queue_signalled_push(struct queue_signalled *qs, void *ptr)
 		if (ret < 0)
 			return ret;
 	}
+#endif
+#ifdef __linux__
+	else if (qs->mode == QueueSignalledMode::FUTEX)
+		queue_signalled_futex_wake(qs);
 #endif
 	else
 		return -1;
@@ -212,6 +304,10 @@ int queue_signalled_push_many(struct queue_signalled *qs, void *ptr[], size_t cn
 		if (ret < 0)
 			return ret;
 	}
+#endif
+#ifdef __linux__
+	else if (qs->mode == QueueSignalledMode::FUTEX)
+		queue_signalled_futex_wake(qs);
 #endif
 	else
 		return -1;
@@ -230,6 +326,13 @@ int queue_signalled_pull(struct queue_signalled *qs, void **ptr)
 		pthread_mutex_lock(&qs->pthread.mutex);
 
 	while (!pulled) {
+#ifdef __linux__
+		/* Remember the futex word before checking the queue to avoid lost wakeups */
+		uint32_t seq = qs->mode == QueueSignalledMode::FUTEX
+			? std::atomic_load_explicit(&qs->futex.seq, std::memory_order_acquire)
+			: 0;
+#endif
+
 		pulled = queue_pull(&qs->queue, ptr);
 		if (pulled < 0)
 			break;
@@ -254,6 +357,14 @@ int queue_signalled_pull(struct queue_signalled *qs, void **ptr)
 				if (ret < 0)
 					break;
 			}
+#endif
+#ifdef __linux__
+			else if (qs->mode == QueueSignalledMode::FUTEX) {
+				int ret;
+				ret = queue_signalled_futex_wait(qs, seq);
+				if (ret < 0)
+					break;
+			}
 #endif
 			else
 				break;
@@ -279,6 +390,13 @@ int queue_signalled_pull_many(struct queue_signalled *qs, void *ptr[], size_t cn
 		pthread_mutex_lock(&qs->pthread.mutex);
 
 	while (!pulled) {
+#ifdef __linux__
+		/* Remember the futex word before checking the queue to avoid lost wakeups */
+		uint32_t seq = qs->mode == QueueSignalledMode::FUTEX
+			? std::atomic_load_explicit(&qs->futex.seq, std::memory_order_acquire)
+			: 0;
+#endif
+
 		pulled = queue_pull_many(&qs->queue, ptr, cnt);
 		if (pulled < 0)
 			break;
@@ -303,6 +421,14 @@ int queue_signalled_pull_many(struct queue_signalled *qs, void *ptr[], size_t cn
 				if (ret < 0)
 					break;
 			}
+#endif
+#ifdef __linux__
+			else if (qs->mode == QueueSignalledMode::FUTEX) {
+				int ret;
+				ret = queue_signalled_futex_wait(qs, seq);
+				if (ret < 0)
+					break;
+			}
 #endif
 			else
 				break;
@@ -351,6 +477,10 @@ int queue_signalled_close(struct queue_signalled *qs)
 		if (ret < 0)
 			return ret;
 	}
+#endif
+#ifdef __linux__
+	else if (qs->mode == QueueSignalledMode::FUTEX)
+		queue_signalled_futex_wake(qs);
 #endif
 	else
 		return -1;
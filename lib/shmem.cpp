@@ -24,9 +24,16 @@
 #include <cerrno>
 #include <fcntl.h>
 #include <semaphore.h>
+#include <pthread.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 
+#ifdef __linux__
+  #include <climits>
+  #include <linux/futex.h>
+  #include <sys/syscall.h>
+#endif
+
 #include <villas/kernel/kernel.hpp>
 #include <villas/memory.h>
 #include <villas/utils.hpp>
@@ -35,6 +42,203 @@
 
 using namespace villas;
 
+#define shmem_mailbox_slot(mb, i) ((struct shmem_mailbox_slot *) ((char *) (mb) + (mb)->slots_off + (i) * (mb)->slot_len))
+
+int shmem_mailbox_init(struct shmem_mailbox *mb, int samplelen, struct memory_type *m)
+{
+	char *slots;
+
+	mb->capacity = samplelen;
+	mb->slot_len = sizeof(struct shmem_mailbox_slot) + SAMPLE_DATA_LENGTH(samplelen);
+
+	slots = (char *) memory_alloc(2 * mb->slot_len, m);
+	if (!slots)
+		return -1;
+
+	mb->slots_off = slots - (char *) mb;
+
+	for (int i = 0; i < 2; i++)
+		std::atomic_init(&shmem_mailbox_slot(mb, i)->lock, (uint64_t) 0);
+
+	std::atomic_init(&mb->written, (uint64_t) 0);
+	std::atomic_init(&mb->consumed, (uint64_t) 0);
+	std::atomic_init(&mb->closed, 0);
+	std::atomic_init(&mb->overwrites, (uint64_t) 0);
+	std::atomic_init(&mb->torn_reads, (uint64_t) 0);
+	std::atomic_init(&mb->seq, 0u);
+	std::atomic_init(&mb->waiters, 0u);
+
+	return 0;
+}
+
+int shmem_mailbox_destroy(struct shmem_mailbox *mb)
+{
+	return memory_free(shmem_mailbox_slot(mb, 0));
+}
+
+static void shmem_mailbox_wake(struct shmem_mailbox *mb)
+{
+	std::atomic_fetch_add(&mb->seq, 1u);
+
+#ifdef __linux__
+	/* Avoid the syscall if no reader is sleeping.
+	 * The mailbox is shared between processes, so we can not use a private futex. */
+	if (std::atomic_load(&mb->waiters) > 0)
+		syscall(SYS_futex, &mb->seq, FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+#endif /* __linux__ */
+}
+
+static void shmem_mailbox_wait_cleanup(void *p)
+{
+	struct shmem_mailbox *mb = (struct shmem_mailbox *) p;
+
+	std::atomic_fetch_sub(&mb->waiters, 1u);
+}
+
+/** Wait until the futex word has been changed from \p seq by the writer. */
+static int shmem_mailbox_sleep(struct shmem_mailbox *mb, uint32_t seq)
+{
+	int ret = 0;
+
+	for (unsigned i = 0; i < QUEUE_SIGNALLED_FUTEX_SPIN; i++) {
+		if (std::atomic_load_explicit(&mb->seq, std::memory_order_acquire) != seq)
+			return 0;
+
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+#endif
+	}
+
+	std::atomic_fetch_add(&mb->waiters, 1u);
+
+	pthread_cleanup_push(shmem_mailbox_wait_cleanup, mb);
+
+	/* Wake up periodically to check for pending cancellation requests */
+	struct timespec timeout = {
+		.tv_sec = 0,
+		.tv_nsec = QUEUE_SIGNALLED_FUTEX_TIMEOUT
+	};
+
+#ifdef __linux__
+	if (syscall(SYS_futex, &mb->seq, FUTEX_WAIT, seq, &timeout, nullptr, 0) < 0 &&
+	    errno != EAGAIN && errno != EINTR && errno != ETIMEDOUT)
+		ret = -1;
+#else
+	timeout.tv_nsec /= 100;
+
+	nanosleep(&timeout, nullptr);
+#endif /* __linux__ */
+
+	pthread_testcancel();
+
+	pthread_cleanup_pop(1);
+
+	return ret;
+}
+
+static void shmem_mailbox_put_one(struct shmem_mailbox *mb, const struct sample *smp)
+{
+	uint64_t written = std::atomic_load_explicit(&mb->written, std::memory_order_relaxed) + 1;
+	struct shmem_mailbox_slot *slot = shmem_mailbox_slot(mb, written % 2);
+	uint64_t lock = std::atomic_load_explicit(&slot->lock, std::memory_order_relaxed);
+
+	/* An odd counter tells readers that the slot is inconsistent */
+	std::atomic_store_explicit(&slot->lock, lock + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot->sequence = smp->sequence;
+	slot->flags = smp->flags;
+	slot->ts.origin = smp->ts.origin;
+	slot->ts.received = smp->ts.received;
+	slot->length = MIN(smp->length, mb->capacity);
+
+	memcpy(slot->data, smp->data, SAMPLE_DATA_LENGTH(slot->length));
+
+	std::atomic_store_explicit(&slot->lock, lock + 2, std::memory_order_release);
+
+	/* The previous sample has been replaced before anyone read it */
+	if (written > 1 && std::atomic_load_explicit(&mb->consumed, std::memory_order_relaxed) < written - 1)
+		std::atomic_fetch_add_explicit(&mb->overwrites, (uint64_t) 1, std::memory_order_relaxed);
+
+	std::atomic_store_explicit(&mb->written, written, std::memory_order_release);
+
+	shmem_mailbox_wake(mb);
+}
+
+int shmem_mailbox_put(struct shmem_mailbox *mb, const struct sample * const smps[], unsigned cnt)
+{
+	if (cnt == 0)
+		return 0;
+
+	/* Only the last sample will ever be visible to the reader */
+	if (cnt > 1)
+		std::atomic_fetch_add_explicit(&mb->overwrites, (uint64_t) cnt - 1, std::memory_order_relaxed);
+
+	shmem_mailbox_put_one(mb, smps[cnt - 1]);
+
+	return cnt;
+}
+
+int shmem_mailbox_get(struct shmem_mailbox *mb, struct sample *smp)
+{
+	while (true) {
+		uint64_t written = std::atomic_load_explicit(&mb->written, std::memory_order_acquire);
+		if (written == std::atomic_load_explicit(&mb->consumed, std::memory_order_relaxed))
+			return std::atomic_load_explicit(&mb->closed, std::memory_order_relaxed) ? -1 : 0;
+
+		struct shmem_mailbox_slot *slot = shmem_mailbox_slot(mb, written % 2);
+
+		uint64_t lock = std::atomic_load_explicit(&slot->lock, std::memory_order_acquire);
+		if (lock & 1)
+			goto torn;
+
+		smp->sequence = slot->sequence;
+		smp->flags = slot->flags;
+		smp->ts.origin = slot->ts.origin;
+		smp->ts.received = slot->ts.received;
+		smp->length = MIN(slot->length, smp->capacity);
+
+		memcpy(smp->data, slot->data, SAMPLE_DATA_LENGTH(smp->length));
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		/* Retry if the writer modified the slot in the meantime */
+		if (std::atomic_load_explicit(&slot->lock, std::memory_order_relaxed) != lock)
+			goto torn;
+
+		std::atomic_store_explicit(&mb->consumed, written, std::memory_order_relaxed);
+
+		return 1;
+
+torn:		std::atomic_fetch_add_explicit(&mb->torn_reads, (uint64_t) 1, std::memory_order_relaxed);
+	}
+}
+
+int shmem_mailbox_wait(struct shmem_mailbox *mb, struct sample *smp)
+{
+	int ret;
+
+	while (true) {
+		/* Load the futex word before checking to avoid a lost wakeup */
+		uint32_t seq = std::atomic_load(&mb->seq);
+
+		ret = shmem_mailbox_get(mb, smp);
+		if (ret != 0)
+			return ret;
+
+		ret = shmem_mailbox_sleep(mb, seq);
+		if (ret)
+			return ret;
+	}
+}
+
+void shmem_mailbox_close(struct shmem_mailbox *mb)
+{
+	std::atomic_store(&mb->closed, 1);
+
+	shmem_mailbox_wake(mb);
+}
+
 size_t shmem_total_size(int queuelen, int samplelen)
 {
 	/* We have the constant const of the memory_type header */
@@ -45,8 +249,10 @@ size_t shmem_total_size(int queuelen, int samplelen)
 		+ queuelen * (2 * sizeof(struct queue_cell))
 		/* the size of the pool */
 		+ queuelen * kernel::getCachelineSize() * CEIL(SAMPLE_LENGTH(samplelen), kernel::getCachelineSize())
-		/* a memblock for each allocation (1 shmem_shared, 2 queues, 1 pool) */
-		+ 4 * sizeof(struct memory_block)
+		/* the two slots of the mailbox */
+		+ 2 * (sizeof(struct shmem_mailbox_slot) + SAMPLE_DATA_LENGTH(samplelen))
+		/* a memblock for each allocation (1 shmem_shared, 2 queues, 1 pool, 1 mailbox) */
+		+ 5 * sizeof(struct memory_block)
 		/* and some extra buffer for alignment */
 		+ 1024;
 }
@@ -102,14 +308,12 @@ retry:	fd = shm_open(wname, O_RDWR|O_CREAT|O_EXCL, 0600);
 		return -5;
 	}
 
-	shared->polling = conf->polling;
+	shared->polling = conf->mode == QueueSignalledMode::POLLING;
 
+	/* AUTO selects the futex mode on Linux and POSIX CVs otherwise */
 	int flags = (int) QueueSignalledFlags::PROCESS_SHARED;
-	enum QueueSignalledMode mode = conf->polling
-					? QueueSignalledMode::POLLING
-					: QueueSignalledMode::PTHREAD;
 
-	ret = queue_signalled_init(&shared->queue, conf->queuelen, manager, mode, flags);
+	ret = queue_signalled_init(&shared->queue, conf->queuelen, manager, conf->mode, flags);
 	if (ret) {
 		errno = ENOMEM;
 		return -6;
@@ -121,6 +325,14 @@ retry:	fd = shm_open(wname, O_RDWR|O_CREAT|O_EXCL, 0600);
 		return -7;
 	}
 
+	shared->mailbox = conf->mailbox;
+
+	ret = shmem_mailbox_init(&shared->latest, conf->samplelen, manager);
+	if (ret) {
+		errno = ENOMEM;
+		return -13;
+	}
+
 	shm->write.base = base;
 	shm->write.name = wname;
 	shm->write.len = len;
@@ -168,6 +380,8 @@ int shmem_int_close(struct shmem_int *shm)
 
 	atomic_store(&shm->closed, 1);
 
+	shmem_mailbox_close(&shm->write.shared->latest);
+
 	ret = queue_signalled_close(&shm->write.shared->queue);
 	if (ret)
 		return ret;
@@ -189,7 +403,23 @@ int shmem_int_read(struct shmem_int *shm, struct sample * const smps[], unsigned
 
 	atomic_fetch_add(&shm->readers, 1);
 
-	ret = queue_signalled_pull_many(&shm->read.shared->queue, (void **) smps, cnt);
+	if (shm->read.shared->mailbox) {
+		/* The sample is released by the reader as in the queue mode */
+		struct sample *smp = sample_alloc(&shm->read.shared->pool);
+		if (smp) {
+			ret = shm->read.shared->polling
+				? shmem_mailbox_get(&shm->read.shared->latest, smp)
+				: shmem_mailbox_wait(&shm->read.shared->latest, smp);
+			if (ret == 1 && cnt > 0)
+				*const_cast<struct sample **>(smps) = smp;
+			else
+				sample_decref(smp);
+		}
+		else
+			ret = 0;
+	}
+	else
+		ret = queue_signalled_pull_many(&shm->read.shared->queue, (void **) smps, cnt);
 
 	if (atomic_fetch_sub(&shm->readers, 1) == 1 && atomic_load(&shm->closed) == 1)
 		munmap(shm->read.base, shm->read.len);
@@ -203,7 +433,14 @@ int shmem_int_write(struct shmem_int *shm, const struct sample * const smps[], u
 
 	atomic_fetch_add(&shm->writers, 1);
 
-	ret = queue_signalled_push_many(&shm->write.shared->queue, (void **) smps, cnt);
+	if (shm->write.shared->mailbox) {
+		ret = shmem_mailbox_put(&shm->write.shared->latest, smps, cnt);
+
+		/* Nobody else will release the samples in mailbox mode */
+		sample_decref_many(const_cast<struct sample **>(smps), cnt);
+	}
+	else
+		ret = queue_signalled_push_many(&shm->write.shared->queue, (void **) smps, cnt);
 
 	if (atomic_fetch_sub(&shm->writers, 1) == 1 && atomic_load(&shm->closed) == 1)
 		munmap(shm->write.base, shm->write.len);
@@ -215,3 +452,34 @@ int shmem_int_alloc(struct shmem_int *shm, struct sample *smps[], unsigned cnt)
 {
 	return sample_alloc_many(&shm->write.shared->pool, smps, cnt);
 }
+
+int shmem_int_read_latest(struct shmem_int *shm, struct sample *smp)
+{
+	int ret;
+
+	atomic_fetch_add(&shm->readers, 1);
+
+	/* Like the queue, the mailbox only blocks if the other process does not poll */
+	ret = shm->read.shared->polling
+		? shmem_mailbox_get(&shm->read.shared->latest, smp)
+		: shmem_mailbox_wait(&shm->read.shared->latest, smp);
+
+	if (atomic_fetch_sub(&shm->readers, 1) == 1 && atomic_load(&shm->closed) == 1)
+		munmap(shm->read.base, shm->read.len);
+
+	return ret;
+}
+
+int shmem_int_write_latest(struct shmem_int *shm, const struct sample * const smps[], unsigned cnt)
+{
+	int ret;
+
+	atomic_fetch_add(&shm->writers, 1);
+
+	ret = shmem_mailbox_put(&shm->write.shared->latest, smps, cnt);
+
+	if (atomic_fetch_sub(&shm->writers, 1) == 1 && atomic_load(&shm->closed) == 1)
+		munmap(shm->write.base, shm->write.len);
+
+	return ret;
+}
@@ -20,6 +20,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *********************************************************************************/
 
+#include <cmath>
 #include <cstring>
 
 #include <villas/stats.hpp>
@@ -42,6 +43,22 @@ std::unordered_map<Stats::Metric, Stats::MetricDescription> Stats::metrics = {
 	{ Stats::Metric::RTP_LOSS_FRACTION, 	{ "rtp.loss_fraction",	"percent", "Fraction lost since last RTP SR/RR."			}},
 	{ Stats::Metric::RTP_PKTS_LOST, 	{ "rtp.pkts_lost",	"packets", "Cumulative number of packtes lost" 				}},
 	{ Stats::Metric::RTP_JITTER, 		{ "rtp.jitter",		"seconds", "Interarrival jitter" 					}},
+	{ Stats::Metric::FILE_FLUSH_BYTES, 	{ "file.flush_bytes",	"bytes",   "Bytes written per flush of the asynchronous file writer"	}},
+	{ Stats::Metric::FILE_FLUSH_LATENCY, 	{ "file.flush_latency",	"seconds", "Time needed to write a buffer to the file"			}},
+	{ Stats::Metric::INFLUXDB_BATCH_LINES,	{ "influxdb.batch_lines", "lines", "Number of lines per batch sent to InfluxDB"		}},
+	{ Stats::Metric::INFLUXDB_FLUSH_LATENCY, { "influxdb.flush_latency", "seconds", "Time needed to send a batch to InfluxDB"		}},
+	{ Stats::Metric::INFLUXDB_DROPPED_LINES, { "influxdb.dropped_lines", "lines", "Number of lines per batch dropped by the InfluxDB node" }},
+	{ Stats::Metric::NGSI_LATENCY,		{ "ngsi.latency",	"seconds", "Round-trip time of NGSI update requests"			}},
+	{ Stats::Metric::NGSI_BATCH_SIZE,	{ "ngsi.batch_size",	"samples", "Number of samples per NGSI update request"			}},
+	{ Stats::Metric::MQTT_PUBLISH_LATENCY,	{ "mqtt.publish_latency", "seconds", "Time until a published MQTT message has been sent or acknowledged" }},
+	{ Stats::Metric::MQTT_PUBLISH_SAMPLES,	{ "mqtt.publish_samples", "samples", "Number of samples per published MQTT message"		}},
+	{ Stats::Metric::KAFKA_DELIVERY_LATENCY, { "kafka.delivery_latency", "seconds", "Time from producing a Kafka message until its delivery report" }},
+	{ Stats::Metric::KAFKA_DELIVERY_ERRORS,	{ "kafka.delivery_errors", "messages", "Number of Kafka messages which could not be delivered"	}},
+	{ Stats::Metric::KAFKA_CONSUME_BATCH,	{ "kafka.consume_batch", "messages", "Number of Kafka messages per consumed batch"		}},
+	{ Stats::Metric::AMQP_PUBLISH_BATCH,	{ "amqp.publish_batch",	"messages", "Number of AMQP messages published per write"		}},
+	{ Stats::Metric::AMQP_CONSUME_BATCH,	{ "amqp.consume_batch",	"messages", "Number of AMQP deliveries consumed per read"		}},
+	{ Stats::Metric::AMQP_CONFIRM_LATENCY,	{ "amqp.confirm_latency", "seconds", "Time until a published AMQP message has been confirmed"	}},
+	{ Stats::Metric::AMQP_CONFIRM_NACKS,	{ "amqp.confirm_nacks",	"messages", "Number of AMQP messages rejected by the broker"		}},
 };
 
 std::unordered_map<Stats::Type, Stats::TypeDescription> Stats::types = {
@@ -100,27 +117,158 @@ enum Stats::Type Stats::lookupType(const std::string &str)
 	throw std::invalid_argument("Invalid stats type");
 }
 
-Stats::Stats(int buckets, int warmup) :
+void Stats::Slot::put(double val)
+{
+	if (!owned.test_and_set()) {
+		apply(&val);
+		owned.clear();
+	}
+	else {
+		/* Another writer is updating the histogram: hand the value over to it */
+		bool handed = false;
+
+		for (auto &p : pending) {
+			Cell expected = Cell::EMPTY;
+
+			if (p.state.compare_exchange_strong(expected, Cell::FILLING, std::memory_order_acquire)) {
+				p.value = val;
+				p.state.store(Cell::FULL);
+
+				handed = true;
+				break;
+			}
+		}
+
+		if (!handed) {
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+	}
+
+	flush();
+}
+
+void Stats::Slot::reset()
+{
+	clear.store(true);
+
+	flush();
+}
+
+bool Stats::Slot::hasWork() const
+{
+	if (clear.load())
+		return true;
+
+	for (auto &p : pending) {
+		if (p.state.load() == Cell::FULL)
+			return true;
+	}
+
+	return false;
+}
+
+void Stats::Slot::flush()
+{
+	/* The owner of the slot checks for handed over work after giving up its
+	 * ownership. Hence work is never left behind: either we claim the slot
+	 * here, or its current owner is going to apply our work. */
+	while (hasWork() && !owned.test_and_set()) {
+		apply(nullptr);
+		owned.clear();
+	}
+}
+
+void Stats::Slot::apply(const double *val)
+{
+	uint64_t cnt = std::atomic_load_explicit(&seq, std::memory_order_relaxed);
+
+	/* An odd counter tells readers that the histogram is inconsistent */
+	std::atomic_store_explicit(&seq, cnt + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	if (clear.exchange(false))
+		hist.reset();
+
+	for (auto &p : pending) {
+		if (p.state.load(std::memory_order_acquire) == Cell::FULL) {
+			hist.put(p.value);
+			p.state.store(Cell::EMPTY, std::memory_order_release);
+		}
+	}
+
+	if (val)
+		hist.put(*val);
+
+	summary.last = hist.getLast();
+	summary.highest = hist.getHighest();
+	summary.lowest = hist.getLowest();
+	summary.mean = hist.getMean();
+	summary.var = hist.getVar();
+	summary.total = hist.getTotal();
+
+	std::atomic_store_explicit(&seq, cnt + 2, std::memory_order_release);
+}
+
+Stats::Summary Stats::Slot::read() const
+{
+	Summary copy;
+	uint64_t cnt;
+
+	do {
+		do {
+			cnt = std::atomic_load_explicit(&seq, std::memory_order_acquire);
+		} while (cnt & 1);
+
+		copy = summary;
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+	} while (std::atomic_load_explicit(&seq, std::memory_order_relaxed) != cnt);
+
+	return copy;
+}
+
+void Stats::Slot::read(Hist &h) const
+{
+	uint64_t cnt;
+
+	do {
+		do {
+			cnt = std::atomic_load_explicit(&seq, std::memory_order_acquire);
+		} while (cnt & 1);
+
+		/* Hist keeps its buckets in place across put() and reset(),
+		 * so the assignment only copies them and never allocates. */
+		h = hist;
+
+		std::atomic_thread_fence(std::memory_order_acquire);
+	} while (std::atomic_load_explicit(&seq, std::memory_order_relaxed) != cnt);
+}
+
+Stats::Stats(int b, int w) :
+	buckets(b),
+	warmup(w),
 	logger(logging.get("stats"))
 {
-	for (auto m : metrics) {
-		histograms.emplace(
-			std::piecewise_construct,
-			std::forward_as_tuple(m.first),
-			std::forward_as_tuple(buckets, warmup)
-		);
+	/* Each metric requires a description */
+	assert(metrics.size() == NUM_METRICS);
+
+	for (auto &s : slots) {
+		s.hist = Hist(buckets, warmup);
+		s.summary = Summary();
+		s.reset();
 	}
 }
 
 void Stats::update(enum Metric m, double val)
 {
-	histograms[m].put(val);
+	slots[(size_t) m].put(val);
 }
 
 void Stats::reset()
 {
-	for (auto m : metrics)
-		histograms[m.first].reset();
+	for (auto &s : slots)
+		s.reset();
 }
 
 json_t * Stats::toJson() const
@@ -128,7 +276,7 @@ json_t * Stats::toJson() const
 	json_t *obj = json_object();
 
 	for (auto m : metrics) {
-		const Hist &h = histograms.at(m.first);
+		Hist h = getHistogram(m.first);
 
 		json_object_set_new(obj, m.second.name, h.toJson());
 	}
@@ -158,37 +306,47 @@ void Stats::setupTable()
 
 void Stats::printPeriodic(FILE *f, enum Format fmt, struct vnode *n) const
 {
+	Summary owd = getSummary(Metric::OWD);
+	Summary age = getSummary(Metric::AGE);
+	Summary reordered = getSummary(Metric::SMPS_REORDERED);
+	Summary skipped = getSummary(Metric::SMPS_SKIPPED);
+
 	switch (fmt) {
-		case Format::HUMAN:
+		case Format::HUMAN: {
+			Summary gap = getSummary(Metric::GAP_RECEIVED);
+
 			setupTable();
 			table->row(11,
 				node_name_short(n),
-				(uintmax_t)    histograms.at(Metric::OWD).getTotal(),
-				(uintmax_t)    histograms.at(Metric::AGE).getTotal(),
-				(uintmax_t)    histograms.at(Metric::SMPS_REORDERED).getTotal(),
-				(uintmax_t)    histograms.at(Metric::SMPS_SKIPPED).getTotal(),
-				(double)       histograms.at(Metric::OWD).getLast(),
-				(double)       histograms.at(Metric::OWD).getMean(),
-				(double) 1.0 / histograms.at(Metric::GAP_RECEIVED).getLast(),
-				(double) 1.0 / histograms.at(Metric::GAP_RECEIVED).getMean(),
-				(double)       histograms.at(Metric::AGE).getMean(),
-				(double)       histograms.at(Metric::AGE).getHighest()
+				(uintmax_t)    owd.total,
+				(uintmax_t)    age.total,
+				(uintmax_t)    reordered.total,
+				(uintmax_t)    skipped.total,
+				(double)       owd.last,
+				(double)       owd.mean,
+				(double) 1.0 / gap.last,
+				(double) 1.0 / gap.mean,
+				(double)       age.mean,
+				(double)       age.highest
 			);
 			break;
+		}
 
 		case Format::JSON: {
+			Summary gap = getSummary(Metric::GAP_SAMPLE);
+
 			json_t *json_stats = json_pack("{ s: s, s: i, s: i, s: i, s: i, s: f, s: f, s: f, s: f, s: f, s: f }",
 				"node", node_name(n),
-				"recv",            histograms.at(Metric::OWD).getTotal(),
-				"sent",            histograms.at(Metric::AGE).getTotal(),
-				"dropped",         histograms.at(Metric::SMPS_REORDERED).getTotal(),
-				"skipped",         histograms.at(Metric::SMPS_SKIPPED).getTotal(),
-				"owd_last",  1.0 / histograms.at(Metric::OWD).getLast(),
-				"owd_mean",  1.0 / histograms.at(Metric::OWD).getMean(),
-				"rate_last", 1.0 / histograms.at(Metric::GAP_SAMPLE).getLast(),
-				"rate_mean", 1.0 / histograms.at(Metric::GAP_SAMPLE).getMean(),
-				"age_mean",        histograms.at(Metric::AGE).getMean(),
-				"age_max",         histograms.at(Metric::AGE).getHighest()
+				"recv",            owd.total,
+				"sent",            age.total,
+				"dropped",         reordered.total,
+				"skipped",         skipped.total,
+				"owd_last",  1.0 / owd.last,
+				"owd_mean",  1.0 / owd.mean,
+				"rate_last", 1.0 / gap.last,
+				"rate_mean", 1.0 / gap.mean,
+				"age_mean",        age.mean,
+				"age_max",         age.highest
 			);
 			json_dumpf(json_stats, f, 0);
 			break;
@@ -203,8 +361,13 @@ void Stats::print(FILE *f, enum Format fmt, int verbose) const
 	switch (fmt) {
 		case Format::HUMAN:
 			for (auto m : metrics) {
+				auto dropped = slots[(size_t) m.first].dropped.load(std::memory_order_relaxed);
+
 				logger->info("{}: {}", m.second.name, m.second.desc);
-				histograms.at(m.first).print(logger, verbose);
+				if (dropped)
+					logger->warn("Dropped {} values due to concurrent updates", dropped);
+
+				getHistogram(m.first).print(logger, verbose);
 			}
 			break;
 
@@ -219,36 +382,36 @@ void Stats::print(FILE *f, enum Format fmt, int verbose) const
 
 union signal_data Stats::getValue(enum Metric sm, enum Type st) const
 {
-	const Hist &h = histograms.at(sm);
+	Summary sum = getSummary(sm);
 	union signal_data d;
 
 	switch (st) {
 		case Type::TOTAL:
-			d.i = h.getTotal();
+			d.i = sum.total;
 			break;
 
 		case Type::LAST:
-			d.f = h.getLast();
+			d.f = sum.last;
 			break;
 
 		case Type::HIGHEST:
-			d.f = h.getHighest();
+			d.f = sum.highest;
 			break;
 
 		case Type::LOWEST:
-			d.f = h.getLowest();
+			d.f = sum.lowest;
 			break;
 
 		case Type::MEAN:
-			d.f = h.getMean();
+			d.f = sum.mean;
 			break;
 
 		case Type::STDDEV:
-			d.f = h.getStddev();
+			d.f = sqrt(sum.var);
 			break;
 
 		case Type::VAR:
-			d.f = h.getVar();
+			d.f = sum.var;
 			break;
 
 		default:
@@ -258,9 +421,19 @@ union signal_data Stats::getValue(enum Metric sm, enum Type st) const
 	return d;
 }
 
-const Hist & Stats::getHistogram(enum Metric sm) const
+Stats::Summary Stats::getSummary(enum Metric sm) const
+{
+	return slots[(size_t) sm].read();
+}
+
+Hist Stats::getHistogram(enum Metric sm) const
 {
-	return histograms.at(sm);
+	/* The buckets are allocated up front, so the copy in read() does not allocate */
+	Hist h(buckets, warmup);
+
+	slots[(size_t) sm].read(h);
+
+	return h;
 }
 
 std::shared_ptr<Table> Stats::table = std::shared_ptr<Table>();
@@ -155,6 +155,10 @@ protected:
 			dirs[1].formatter->print(stdout, smp);
 		}
 
+		ret = dirs[1].formatter->finish(stdout);
+		if (ret)
+			throw RuntimeError("Failed to complete output");
+
 		for (unsigned i = 0; i < ARRAY_LEN(dirs); i++)
 			delete dirs[i].formatter;
 
@@ -22,7 +22,6 @@
 
 #include <iostream>
 #include <map>
-#include <queue>
 #include <string>
 #include <utility>
 
@@ -48,6 +47,9 @@ namespace villas {
 namespace node {
 namespace tools {
 
+/** Index of the service thread which is running the current callback */
+static thread_local int currentThread = 0;
+
 RelaySession::RelaySession(Relay *r, Identifier sid) :
 	identifier(sid),
 	connects(0)
@@ -103,10 +105,12 @@ RelaySession * RelaySession::get(Relay *r, lws *wsi)
 	}
 }
 
-json_t * RelaySession::toJson() const
+json_t * RelaySession::toJson()
 {
 	json_t *json_connections = json_array();
 
+	std::shared_lock<std::shared_mutex> lock(mutex);
+
 	for (auto it : connections) {
 		auto conn = it.second;
 
@@ -125,69 +129,161 @@ json_t * RelaySession::toJson() const
 	);
 }
 
+std::mutex RelaySession::sessionsMutex;
 std::map<std::string, RelaySession *> RelaySession::sessions;
 
 RelayConnection::RelayConnection(Relay *r, lws *w, bool lo) :
 	wsi(w),
-	currentFrame(std::make_shared<Frame>()),
-	outgoingFrames(),
+	relay(r),
+	tsi(currentThread),
+	currentFrame(new Frame),
+	scheduled(false),
 	bytes_recv(0),
 	bytes_sent(0),
 	frames_recv(0),
 	frames_sent(0),
+	frames_dropped(0),
 	loopback(lo)
 {
-	session = RelaySession::get(r, wsi);
+	int ret;
+
+	ret = queue_init(&outgoingFrames, r->queueLength);
+	if (ret)
+		throw RuntimeError("Failed to initialize queue");
+
+	std::lock_guard<std::mutex> guard(RelaySession::sessionsMutex);
+
+	try {
+		session = RelaySession::get(r, wsi);
+	} catch (...) {
+		ret = queue_destroy(&outgoingFrames);
+		currentFrame->put();
+		throw;
+	}
+
+	std::unique_lock<std::shared_mutex> lock(session->mutex);
+
 	session->connections[wsi] = this;
 	session->connects++;
 
+	r->services[tsi]->connections.insert(this);
+
 	lws_get_peer_addresses(wsi, lws_get_socket_fd(wsi), name, sizeof(name), ip, sizeof(ip));
 
 	created = time(nullptr);
 
-	session->logger->info("New connection established: {} ({})", name, ip);
+	session->logger->info("New connection established: {} ({}), thread={}", name, ip, tsi);
 }
 
 RelayConnection::~RelayConnection()
 {
+	int ret;
+
 	session->logger->info("RelayConnection closed: {} ({})", name, ip);
 
-	session->connections.erase(wsi);
+	{
+		std::lock_guard<std::mutex> guard(RelaySession::sessionsMutex);
+
+		{
+			std::unique_lock<std::shared_mutex> lock(session->mutex);
+
+			session->connections.erase(wsi);
+		}
+
+		if (session->connections.empty())
+			delete session;
+	}
 
-	if (session->connections.empty())
-		delete session;
+	/* From here on no other thread will enqueue frames or schedule us */
+	auto &s = relay->services[tsi];
+
+	s->connections.erase(this);
+	s->process(this);
+
+	Frame *fr;
+	while (queue_pull(&outgoingFrames, (void **) &fr) == 1)
+		fr->put();
+
+	ret = queue_destroy(&outgoingFrames);
+	if (ret)
+		relay->logger->warn("Failed to destroy queue");
+
+	currentFrame->put();
 }
 
 json_t * RelayConnection::toJson() const
 {
-	return json_pack("{ s: s, s: s, s: I, s: I, s: I, s: I, s: I }",
+	return json_pack("{ s: s, s: s, s: I, s: I, s: I, s: I, s: I, s: I, s: I, s: i }",
 		"name", name,
 		"ip", ip,
 		"created", created,
 		"bytes_recv", bytes_recv,
 		"bytes_sent", bytes_sent,
 		"frames_recv", frames_recv,
-		"frames_sent", frames_sent
+		"frames_sent", frames_sent,
+		"frames_dropped", frames_dropped.load(),
+		"frames_queued", queue_available((struct queue *) &outgoingFrames),
+		"thread", tsi
 	);
 }
 
 void RelayConnection::write()
 {
 	int ret;
+	Frame *fr;
+	uint8_t *payload;
 
-	std::shared_ptr<Frame> fr = outgoingFrames.front();
-
-	ret = lws_write(wsi, fr->data(), fr->size(), LWS_WRITE_BINARY);
-	if (ret < 0)
+	ret = queue_pull(&outgoingFrames, (void **) &fr);
+	if (ret != 1)
 		return;
 
-	bytes_sent += fr->size();
-	frames_sent++;
+	payload = fr->data();
 
-	outgoingFrames.pop();
+	/* lws_write() puts the WebSocket header in front of the payload.
+	 * Frames are shared by all connections of a session, so we
+	 * must not let multiple service threads do this concurrently. */
+	if (relay->threads > 1) {
+		sendBuffer.resize(LWS_PRE + fr->size());
+		memcpy(sendBuffer.data() + LWS_PRE, fr->data(), fr->size());
 
-	if (outgoingFrames.size() > 0)
+		payload = sendBuffer.data() + LWS_PRE;
+	}
+
+	ret = lws_write(wsi, payload, fr->size(), LWS_WRITE_BINARY);
+	if (ret >= 0) {
+		bytes_sent += fr->size();
+		frames_sent++;
+	}
+
+	fr->put();
+
+	if (queue_available(&outgoingFrames) > 0)
+		lws_callback_on_writable(wsi);
+}
+
+bool RelayConnection::enqueue(Frame *fr)
+{
+	int ret;
+
+	fr->get();
+
+	ret = queue_push(&outgoingFrames, fr);
+	if (ret != 1) {
+		fr->put();
+
+		if (frames_dropped++ == 0)
+			session->logger->warn("Connection is lagging behind. Dropping frames: {} ({})", name, ip);
+
+		return false;
+	}
+
+	/* lws_callback_on_writable() must only be called from the thread servicing the connection */
+	if (tsi == currentThread)
 		lws_callback_on_writable(wsi);
+	else
+		relay->services[tsi]->schedule(this);
+
+	return true;
 }
 
 void RelayConnection::read(void *in, size_t len)
@@ -198,6 +294,9 @@ void RelayConnection::read(void *in, size_t len)
 
 	if (lws_is_final_fragment(wsi)) {
 		frames_recv++;
+
+		std::shared_lock<std::shared_mutex> lock(session->mutex);
+
 		session->logger->debug("Received frame, relaying to {} connections", session->connections.size() - (loopback ? 0 : 1));
 
 		for (auto p : session->connections) {
@@ -208,12 +307,69 @@ void RelayConnection::read(void *in, size_t len)
 			if (loopback == false && c == this)
 				continue;
 
-			c->outgoingFrames.push(currentFrame);
+			/* All connections share a reference to the same frame */
+			c->enqueue(currentFrame);
+		}
 
+		lock.unlock();
+
+		currentFrame->put();
+		currentFrame = new Frame;
+		currentFrame->reserve(LWS_PRE + relay->rxBufferSize);
+	}
+}
+
+RelayServiceThread::RelayServiceThread(int i) :
+	tsi(i),
+	rescan(false)
+{
+	int ret;
+
+	ret = queue_init(&pending, DEFAULT_QUEUE_LENGTH * 16);
+	if (ret)
+		throw RuntimeError("Failed to initialize queue");
+}
+
+RelayServiceThread::~RelayServiceThread()
+{
+	int ret __attribute__((unused));
+
+	ret = queue_destroy(&pending);
+}
+
+void RelayServiceThread::schedule(RelayConnection *c)
+{
+	int ret;
+
+	/* Connections are added at most once to the pending queue */
+	if (c->scheduled.exchange(true))
+		return;
+
+	ret = queue_push(&pending, c);
+	if (ret != 1)
+		rescan = true;
+
+	lws_cancel_service_pt(c->wsi);
+}
+
+void RelayServiceThread::process(RelayConnection *skip)
+{
+	RelayConnection *c;
+
+	while (queue_pull(&pending, (void **) &c) == 1) {
+		c->scheduled = false;
+
+		if (c != skip)
 			lws_callback_on_writable(c->wsi);
-		}
+	}
+
+	if (rescan.exchange(false)) {
+		for (auto *c : connections) {
+			c->scheduled = false;
 
-		currentFrame = std::make_shared<Frame>();
+			if (queue_available(&c->outgoingFrames) > 0)
+				lws_callback_on_writable(c->wsi);
+		}
 	}
 }
 
@@ -224,6 +380,9 @@ Relay::Relay(int argc, char *argv[]) :
 	vhost(nullptr),
 	loopback(false),
 	port(8088),
+	queueLength(DEFAULT_QUEUE_LENGTH),
+	threads(1),
+	rxBufferSize(4096),
 	protocol("live")
 {
 	int ret;
@@ -331,16 +490,21 @@ int Relay::httpProtocolCallback(lws *wsi, enum lws_callback_reasons reason, void
 		case LWS_CALLBACK_HTTP_WRITEABLE:
 
 			json_sessions = json_array();
+
+			RelaySession::sessionsMutex.lock();
+
 			for (auto it : RelaySession::sessions) {
 				auto &session = it.second;
 
 				json_array_append(json_sessions, session->toJson());
 			}
 
+			RelaySession::sessionsMutex.unlock();
+
 			uuid_string_t uuid_str;
 			uuid_unparse(r->uuid, uuid_str);
 
-			json_body = json_pack("{ s: o, s: s, s: s, s: s, s: { s: b, s: i, s: s } }",
+			json_body = json_pack("{ s: o, s: s, s: s, s: s, s: { s: b, s: i, s: s, s: I, s: i, s: I } }",
 				"sessions", json_sessions,
 				"version", PROJECT_VERSION_STR,
 				"hostname", r->hostname.c_str(),
@@ -348,7 +512,10 @@ int Relay::httpProtocolCallback(lws *wsi, enum lws_callback_reasons reason, void
 				"options",
 					"loopback", r->loopback,
 					"port", r->port,
-					"protocol", r->protocol.c_str()
+					"protocol", r->protocol.c_str(),
+					"queue_length", r->queueLength,
+					"threads", r->threads,
+					"rx_buffer_size", r->rxBufferSize
 			);
 
 			json_len = json_dumpb(json_body, (char *) buf + LWS_PRE, sizeof(buf) - LWS_PRE, JSON_INDENT(4));
@@ -402,6 +569,11 @@ int Relay::protocolCallback(lws *wsi, enum lws_callback_reasons reason, void *us
 			c->read(in, len);
 			break;
 
+		case LWS_CALLBACK_EVENT_WAIT_CANCELLED:
+			/* Another service thread has queued frames for our connections */
+			r->services[currentThread]->process();
+			break;
+
 		default:
 			break;
 	}
@@ -417,6 +589,9 @@ void Relay::usage()
 		<< "    -p PORT   the port number to listen on" << std::endl
 		<< "    -P PROT   the websocket protocol" << std::endl
 		<< "    -l        enable loopback of own data" << std::endl
+		<< "    -q LEN    maximum number of queued frames per connection" << std::endl
+		<< "    -t NUM    number of service threads" << std::endl
+		<< "    -b SIZE   size of the receive buffer per connection in bytes" << std::endl
 		<< "    -u UUID   unique instance id" << std::endl
 		<< "    -V        show version and exit" << std::endl
 		<< "    -h        show usage and exit" << std::endl << std::endl;
@@ -428,7 +603,7 @@ void Relay::parse()
 {
 	int ret;
 	char c, *endptr;
-	while ((c = getopt (argc, argv, "hVp:P:ld:u:")) != -1) {
+	while ((c = getopt (argc, argv, "hVp:P:ld:u:q:t:b:")) != -1) {
 		switch (c) {
 			case 'd':
 				logging.setLevel(optarg);
@@ -442,6 +617,18 @@ void Relay::parse()
 				protocol = optarg;
 				break;
 
+			case 'q':
+				queueLength = strtoul(optarg, &endptr, 10);
+				goto check;
+
+			case 't':
+				threads = strtoul(optarg, &endptr, 10);
+				goto check;
+
+			case 'b':
+				rxBufferSize = strtoul(optarg, &endptr, 10);
+				goto check;
+
 			case 'l':
 				loopback = true;
 				break;
@@ -476,6 +663,15 @@ check:		if (optarg == endptr) {
 		usage();
 		exit(EXIT_FAILURE);
 	}
+
+	if (threads < 1 || queueLength < 1) {
+		usage();
+		exit(EXIT_FAILURE);
+	}
+
+	/* The queues require a power of two */
+	if (!IS_POW2(queueLength))
+		queueLength = LOG2_CEIL(queueLength);
 }
 
 int Relay::main() {
@@ -483,6 +679,7 @@ int Relay::main() {
 	lws_context_creation_info ctx_info = { 0 };
 
 	protocols[2].name = protocol.c_str();
+	protocols[2].rx_buffer_size = rxBufferSize;
 
 	ctx_info.options = LWS_SERVER_OPTION_EXPLICIT_VHOSTS | LWS_SERVER_OPTION_DO_SSL_GLOBAL_INIT;
 	ctx_info.gid = -1;
@@ -492,6 +689,7 @@ int Relay::main() {
 	ctx_info.port = port;
 	ctx_info.mounts = &mount;
 	ctx_info.user = (void *) this;
+	ctx_info.count_threads = threads;
 
 	auto lwsLogger = logging.get("lws");
 
@@ -507,12 +705,37 @@ int Relay::main() {
 		exit(EXIT_FAILURE);
 	}
 
-	while (!stop)
-		lws_service(context, 100);
+	/* libwebsockets might support less threads than requested */
+	int count_threads = lws_get_count_threads(context);
+	if (count_threads < threads) {
+		logger->warn("libwebsockets supports only {} service threads", count_threads);
+		threads = count_threads;
+	}
+
+	for (int i = 0; i < threads; i++)
+		services.emplace_back(new RelayServiceThread(i));
+
+	for (int i = 1; i < threads; i++)
+		services[i]->thread = std::thread(&Relay::service, this, i);
+
+	service(0);
+
+	for (int i = 1; i < threads; i++)
+		services[i]->thread.join();
 
 	return 0;
 }
 
+void Relay::service(int tsi)
+{
+	currentThread = tsi;
+
+	logger->debug("Started service thread: {}", tsi);
+
+	while (!stop)
+		lws_service_tsi(context, 100, tsi);
+}
+
 const std::vector<lws_extension> Relay::extensions = {
 #ifdef LWS_DEFLATE_FOUND
 	{
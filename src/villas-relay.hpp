@@ -23,12 +23,19 @@
 
 #include <vector>
 #include <memory>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+#include <set>
+#include <map>
 
 #include <uuid/uuid.h>
 
 #include <libwebsockets.h>
 
 #include <villas/log.hpp>
+#include <villas/queue.h>
 
 namespace villas {
 namespace node {
@@ -38,14 +45,26 @@ namespace tools {
 class Relay;
 class RelaySession;
 class RelayConnection;
+class RelayServiceThread;
 
 class InvalidUrlException { };
 
 typedef std::string Identifier;
 
+/** A received message which is shared by all connections of a session.
+ *
+ * Frames are reference counted so that they can be passed between
+ * service threads through lock-free queues.
+ */
 class Frame : public std::vector<uint8_t> {
+
+protected:
+	std::atomic<int> refcnt;
+
 public:
-	Frame() {
+	Frame() :
+		refcnt(1)
+	{
 		/* lws_write() requires LWS_PRE bytes in front of the payload */
 		insert(end(), LWS_PRE, 0);
 	}
@@ -57,6 +76,17 @@ public:
 	size_type size() {
 		return std::vector<uint8_t>::size() - LWS_PRE;
 	}
+
+	void get()
+	{
+		refcnt++;
+	}
+
+	void put()
+	{
+		if (--refcnt == 0)
+			delete this;
+	}
 };
 
 class RelaySession {
@@ -71,30 +101,59 @@ protected:
 	Identifier identifier;
 	Logger logger;
 
+	/** Protects the list of connections.
+	 *
+	 * Received frames are relayed while holding a shared lock.
+	 * Connections are only added and removed with an exclusive lock. */
+	std::shared_mutex mutex;
+
 	std::map<lws *, RelayConnection *> connections;
 
 	int connects;
 
+	/** Protects the list of sessions. Must be acquired before RelaySession::mutex. */
+	static std::mutex sessionsMutex;
+
 	static std::map<std::string, RelaySession *> sessions;
 
 public:
+	/** Find or create a session. The caller must hold RelaySession::sessionsMutex. */
 	static RelaySession * get(Relay *r, lws *wsi);
 
 	RelaySession(Relay *r, Identifier sid);
 
 	~RelaySession();
 
-	json_t * toJson() const;
+	json_t * toJson();
 };
 
 class RelayConnection {
 
+	friend Relay;
+	friend RelayServiceThread;
+
 protected:
 	lws *wsi;
 
-	std::shared_ptr<Frame> currentFrame;
+	Relay *relay;
+
+	/** Index of the service thread handling this connection. */
+	int tsi;
+
+	Frame *currentFrame;
+
+	/** Frames waiting to be sent (Frame *).
+	 *
+	 * Other connections of the session push into this queue
+	 * from any service thread. Slow connections drop new frames
+	 * once it is full. */
+	struct queue outgoingFrames;
+
+	/** Set while the connection is waiting to be woken up by its service thread. */
+	std::atomic<bool> scheduled;
 
-	std::queue<std::shared_ptr<Frame>> outgoingFrames;
+	/** Private copy of a frame. Only used with multiple service threads. */
+	std::vector<uint8_t> sendBuffer;
 
 	RelaySession *session;
 
@@ -107,9 +166,16 @@ protected:
 
 	size_t frames_recv;
 	size_t frames_sent;
+	std::atomic<size_t> frames_dropped;	/**< Frames which have been dropped as the connection was lagging behind. */
 
 	bool loopback;
 
+	/** Enqueue a frame for sending. May be called from any service thread.
+	 *
+	 * @retval false The frame was dropped.
+	 */
+	bool enqueue(Frame *fr);
+
 public:
 	RelayConnection(Relay *r, lws *w, bool lo);
 	~RelayConnection();
@@ -120,10 +186,45 @@ public:
 	void read(void *in, size_t len);
 };
 
+/** State of a libwebsockets service thread. */
+class RelayServiceThread {
+
+	friend Relay;
+	friend RelayConnection;
+
+protected:
+	int tsi;
+
+	std::thread thread;
+
+	/** Connections of this thread which have pending frames (RelayConnection *). */
+	struct queue pending;
+
+	/** Set if a connection could not be added to the pending queue. */
+	std::atomic<bool> rescan;
+
+	/** All connections handled by this thread. Only accessed by the thread itself. */
+	std::set<RelayConnection *> connections;
+
+public:
+	RelayServiceThread(int i);
+	~RelayServiceThread();
+
+	/** Wake up a connection of this thread. May be called from any thread. */
+	void schedule(RelayConnection *c);
+
+	/** Request writable callbacks for all scheduled connections.
+	 *
+	 * @param skip A connection which is about to be closed.
+	 */
+	void process(RelayConnection *skip = nullptr);
+};
+
 class Relay : public Tool {
 
 public:
 	friend RelaySession;
+	friend RelayConnection;
 
 	Relay(int argc, char *argv[]);
 
@@ -138,11 +239,17 @@ protected:
 
 	bool loopback;
 	int port;
+	size_t queueLength;
+	int threads;
+	size_t rxBufferSize;
 	std::string protocol;
 	std::string hostname;
 
 	uuid_t uuid;
 
+	/** One per libwebsockets service thread. */
+	std::vector<std::unique_ptr<RelayServiceThread>> services;
+
 	/** List of libwebsockets protocols. */
 	std::vector<lws_protocols> protocols;
 
@@ -157,6 +264,8 @@ protected:
 
 	static int protocolCallback(lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len);
 
+	void service(int tsi);
+
 	void usage();
 
 	void parse();
@@ -0,0 +1,477 @@
+/** Load test for villas-relay.
+ *
+ * @author Steffen Vogel <stvogel@eonerc.rwth-aachen.de>
+ * @copyright 2014-2020, Institute for Automation of Complex Power Systems, EONERC
+ * @license GNU General Public License (version 3)
+ *
+ * VILLASnode
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *********************************************************************************/
+
+#include <cstdlib>
+#include <cstring>
+#include <cinttypes>
+#include <iostream>
+#include <atomic>
+#include <vector>
+#include <string>
+
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include <libwebsockets.h>
+
+#include <villas/tool.hpp>
+#include <villas/node/config.h>
+#include <villas/exceptions.hpp>
+#include <villas/log.hpp>
+#include <villas/utils.hpp>
+#include <villas/hist.hpp>
+#include <villas/timing.h>
+
+using namespace villas;
+
+namespace villas {
+namespace node {
+namespace tools {
+
+/** Header of each frame sent by the load test */
+struct test_relay_header {
+	uint64_t sent;		/**< Send timestamp in nanoseconds (CLOCK_MONOTONIC) */
+	uint32_t session;
+	uint32_t sequence;
+} __attribute__((packed));
+
+class TestRelay : public Tool {
+
+public:
+	TestRelay(int argc, char *argv[]) :
+		Tool(argc, argv, "test-relay"),
+		stop(false),
+		context(nullptr),
+		address("localhost"),
+		port(8088),
+		protocol("live"),
+		sessions(10),
+		connections(100),
+		rate(100),
+		length(64),
+		duration(10),
+		hist_warmup(100),
+		hist_buckets(20),
+		established(0),
+		failed(0),
+		sent(0),
+		received(0)
+	{ }
+
+protected:
+	/** A single WebSocket connection to the relay.
+	 *
+	 * The first connection of each session sends frames.
+	 * All other connections of the session receive them.
+	 */
+	struct Connection {
+		TestRelay *tool;
+		lws *wsi;
+
+		unsigned session;
+		unsigned index;
+
+		bool connected;
+
+		size_t pending;		/**< Number of frames which are waiting to be sent. */
+		uint32_t sequence;
+
+		std::vector<uint8_t> buffer;
+	};
+
+	std::atomic<bool> stop;
+
+	lws_context *context;
+
+	std::string address;
+	int port;
+	std::string protocol;
+
+	unsigned sessions;
+	unsigned connections;
+	double rate;
+	size_t length;
+	double duration;
+
+	Hist::cnt_t hist_warmup;
+	int hist_buckets;
+
+	std::vector<Connection> conns;
+
+	size_t established;
+	size_t failed;
+
+	size_t sent;
+	size_t received;
+
+	Hist hist;
+
+	std::vector<lws_protocols> protocols;
+
+	void handler(int signal, siginfo_t *sinfo, void *ctx)
+	{
+		stop = true;
+	}
+
+	static uint64_t now()
+	{
+		struct timespec ts;
+
+		clock_gettime(CLOCK_MONOTONIC, &ts);
+
+		return ts.tv_sec * 1000000000ull + ts.tv_nsec;
+	}
+
+	static int protocolCallback(lws *wsi, enum lws_callback_reasons reason, void *user, void *in, size_t len)
+	{
+		auto *c = reinterpret_cast<Connection *>(user);
+		if (!c)
+			return 0;
+
+		auto *t = c->tool;
+
+		switch (reason) {
+			case LWS_CALLBACK_CLIENT_ESTABLISHED:
+				c->connected = true;
+				t->established++;
+				break;
+
+			case LWS_CALLBACK_CLIENT_CONNECTION_ERROR:
+				t->failed++;
+				t->logger->warn("Failed to connect: session={}, index={}, reason={}", c->session, c->index, in ? (char *) in : "unknown");
+				c->wsi = nullptr;
+				break;
+
+			case LWS_CALLBACK_CLIENT_CLOSED:
+				if (c->connected)
+					t->established--;
+
+				c->connected = false;
+				c->wsi = nullptr;
+				break;
+
+			case LWS_CALLBACK_CLIENT_WRITEABLE: {
+				if (c->pending == 0)
+					break;
+
+				auto *hdr = (struct test_relay_header *) (c->buffer.data() + LWS_PRE);
+
+				hdr->sent = now();
+				hdr->session = c->session;
+				hdr->sequence = c->sequence++;
+
+				int ret = lws_write(wsi, c->buffer.data() + LWS_PRE, t->length, LWS_WRITE_BINARY);
+				if (ret < 0)
+					return -1;
+
+				c->pending--;
+				t->sent++;
+
+				if (c->pending > 0)
+					lws_callback_on_writable(wsi);
+
+				break;
+			}
+
+			case LWS_CALLBACK_CLIENT_RECEIVE: {
+				/* We only look at the first fragment, which carries the header */
+				if (!lws_is_first_fragment(wsi) || len < sizeof(struct test_relay_header))
+					break;
+
+				auto *hdr = (struct test_relay_header *) in;
+
+				t->received++;
+				t->hist.put((now() - hdr->sent) * 1e-9);
+
+				break;
+			}
+
+			default:
+				break;
+		}
+
+		return 0;
+	}
+
+	void usage()
+	{
+		std::cout << "Usage: villas-test-relay [OPTIONS]" << std::endl
+			<< "  OPTIONS is one or more of the following options:" << std::endl
+			<< "    -a ADDR   address of the relay (default: localhost)" << std::endl
+			<< "    -p PORT   port of the relay (default: 8088)" << std::endl
+			<< "    -P PROT   the websocket protocol (default: live)" << std::endl
+			<< "    -s NUM    number of sessions" << std::endl
+			<< "    -c NUM    number of connections per session" << std::endl
+			<< "    -r RATE   frames per second sent to each session" << std::endl
+			<< "    -l LEN    length of each frame in bytes" << std::endl
+			<< "    -D SECS   duration of the test in seconds" << std::endl
+			<< "    -b BKTS   number of buckets for histogram" << std::endl
+			<< "    -w WMUP   duration of histogram warmup phase" << std::endl
+			<< "    -d LVL    set debug level" << std::endl
+			<< "    -h        show this usage information" << std::endl
+			<< "    -V        show the version of the tool" << std::endl << std::endl;
+
+		printCopyright();
+	}
+
+	void parse()
+	{
+		int c;
+		char *endptr;
+		while ((c = getopt (argc, argv, "a:p:P:s:c:r:l:D:b:w:d:hV")) != -1) {
+			switch (c) {
+				case 'a':
+					address = optarg;
+					break;
+
+				case 'p':
+					port = strtoul(optarg, &endptr, 10);
+					goto check;
+
+				case 'P':
+					protocol = optarg;
+					break;
+
+				case 's':
+					sessions = strtoul(optarg, &endptr, 10);
+					goto check;
+
+				case 'c':
+					connections = strtoul(optarg, &endptr, 10);
+					goto check;
+
+				case 'r':
+					rate = strtod(optarg, &endptr);
+					goto check;
+
+				case 'l':
+					length = strtoul(optarg, &endptr, 10);
+					goto check;
+
+				case 'D':
+					duration = strtod(optarg, &endptr);
+					goto check;
+
+				case 'b':
+					hist_buckets = strtoul(optarg, &endptr, 10);
+					goto check;
+
+				case 'w':
+					hist_warmup = strtoul(optarg, &endptr, 10);
+					goto check;
+
+				case 'd':
+					logging.setLevel(optarg);
+					break;
+
+				case 'V':
+					printVersion();
+					exit(EXIT_SUCCESS);
+
+				case 'h':
+				case '?':
+					usage();
+					exit(c == '?' ? EXIT_FAILURE : EXIT_SUCCESS);
+			}
+
+			continue;
+
+check:			if (optarg == endptr)
+				throw RuntimeError("Failed to parse parse option argument '-{} {}'", c, optarg);
+		}
+
+		if (sessions < 1 || connections < 2 || rate <= 0)
+			throw RuntimeError("At least one session with two connections and a positive rate is required");
+
+		if (length < sizeof(struct test_relay_header))
+			length = sizeof(struct test_relay_header);
+	}
+
+	/** Raise the limit of open file descriptors to the hard limit. */
+	void raiseFileLimit(size_t needed)
+	{
+		struct rlimit rl;
+
+		if (getrlimit(RLIMIT_NOFILE, &rl))
+			return;
+
+		if (rl.rlim_cur < rl.rlim_max) {
+			rl.rlim_cur = rl.rlim_max;
+			setrlimit(RLIMIT_NOFILE, &rl);
+		}
+
+		if (rl.rlim_cur < needed)
+			logger->warn("The limit of open files ({}) is too low for {} connections", rl.rlim_cur, needed);
+	}
+
+	void printStatus(double elapsed, size_t sent_delta, size_t recv_delta, double interval)
+	{
+		fprintf(stdout, "%10.3f%8zu%12.1f%12.1f%10.3f%10.3f%10.3f\n",
+			elapsed, established,
+			sent_delta / interval, recv_delta / interval,
+			1e3 * hist.getLowest(), 1e3 * hist.getHighest(), 1e3 * hist.getMean());
+	}
+
+	int main()
+	{
+		size_t total = sessions * connections;
+
+		hist = Hist(hist_buckets, hist_warmup);
+
+		raiseFileLimit(total + 64);
+
+		protocols = {
+			{
+				.name = protocol.c_str(),
+				.callback = protocolCallback,
+				.per_session_data_size = 0,
+				.rx_buffer_size = 0
+			},
+			{ nullptr /* terminator */ }
+		};
+
+		lws_context_creation_info ctx_info = { 0 };
+
+		ctx_info.port = CONTEXT_PORT_NO_LISTEN;
+		ctx_info.protocols = protocols.data();
+		ctx_info.gid = -1;
+		ctx_info.uid = -1;
+		ctx_info.user = (void *) this;
+
+		lws_set_log_level(LLL_ERR, nullptr);
+
+		context = lws_create_context(&ctx_info);
+		if (!context)
+			throw RuntimeError("Failed to initialize libwebsockets context");
+
+		conns.resize(total);
+
+		for (unsigned s = 0; s < sessions; s++) {
+			std::string path = fmt::format("/test-relay-{}", s);
+
+			for (unsigned i = 0; i < connections; i++) {
+				auto &c = conns[s * connections + i];
+
+				c.tool = this;
+				c.session = s;
+				c.index = i;
+				c.connected = false;
+				c.pending = 0;
+				c.sequence = 0;
+				c.buffer.resize(LWS_PRE + length);
+
+				lws_client_connect_info info = { 0 };
+
+				info.context = context;
+				info.address = address.c_str();
+				info.port = port;
+				info.path = path.c_str();
+				info.host = address.c_str();
+				info.origin = address.c_str();
+				info.protocol = protocol.c_str();
+				info.ietf_version_or_minus_one = -1;
+				info.userdata = &c;
+
+				c.wsi = lws_client_connect_via_info(&info);
+				if (!c.wsi)
+					failed++;
+			}
+		}
+
+		logger->info("Opening {} connections to {}:{}", total, address, port);
+
+		uint64_t deadline = now() + 10000000000ull;
+		while (!stop && established + failed < total && now() < deadline)
+			lws_service(context, 10);
+
+		if (established < total)
+			logger->warn("Only {} of {} connections have been established", established, total);
+		else
+			logger->info("Established {} connections", established);
+
+		/* Print header */
+		fprintf(stdout, "%10s%8s%12s%12s%10s%10s%10s\n", "time", "conns", "sent/s", "recv/s", "min", "max", "mean");
+
+		uint64_t start = now(), last = start, end = start + duration * 1e9;
+		size_t scheduled = 0, last_sent = 0, last_recv = 0;
+
+		while (!stop) {
+			uint64_t ts = now();
+			if (ts >= end)
+				break;
+
+			/* Schedule frames according to the rate */
+			size_t due = (ts - start) * 1e-9 * rate;
+			if (due > scheduled) {
+				for (unsigned s = 0; s < sessions; s++) {
+					auto &c = conns[s * connections];
+					if (!c.wsi || !c.connected)
+						continue;
+
+					c.pending += due - scheduled;
+
+					lws_callback_on_writable(c.wsi);
+				}
+
+				scheduled = due;
+			}
+
+			if (ts - last >= 1000000000ull) {
+				printStatus((ts - start) * 1e-9, sent - last_sent, received - last_recv, (ts - last) * 1e-9);
+
+				last = ts;
+				last_sent = sent;
+				last_recv = received;
+			}
+
+			lws_service(context, 1);
+		}
+
+		/* Wait for outstanding frames */
+		deadline = now() + 1000000000ull;
+		while (now() < deadline)
+			lws_service(context, 10);
+
+		double elapsed = (now() - start) * 1e-9;
+		size_t expected = sent * (connections - 1);
+
+		logger->info("Sent {} frames ({:.1f} frames/s)", sent, sent / elapsed);
+		logger->info("Received {} of {} expected frames ({:.1f} frames/s, {} lost)", received, expected, received / elapsed, expected > received ? expected - received : 0);
+
+		hist.print(logger, true);
+
+		lws_context_destroy(context);
+
+		return received == expected ? 0 : -1;
+	}
+};
+
+} /* namespace tools */
+} /* namespace node */
+} /* namespace villas */
+
+int main(int argc, char *argv[])
+{
+	villas::node::tools::TestRelay t(argc, argv);
+
+	return t.run();
+}
@@ -38,6 +38,8 @@
 #include <villas/node.h>
 #include <villas/utils.hpp>
 #include <villas/hist.hpp>
+#include <villas/hdr_hist.hpp>
+#include <villas/task.hpp>
 #include <villas/timing.h>
 #include <villas/pool.h>
 #include <villas/kernel/rt.hpp>
@@ -59,6 +61,8 @@ public:
 		stop(false),
 		fd(STDOUT_FILENO),
 		count(-1),
+		rate(-1),
+		interval(1),
 		hist_warmup(100),
 		hist_buckets(20)
 	{
@@ -87,6 +91,14 @@ protected:
 	/**< Amount of messages which should be sent (default: -1 for unlimited) */
 	int count;
 
+	/**< Rate at which messages are sent (default: -1 for as fast as possible) */
+	double rate;
+
+	/**< Interval in seconds between two printed summaries of the percentiles */
+	double interval;
+
+	/**< Path to a file in which the summary of the percentiles is written */
+	std::string summary;
 
 	Hist::cnt_t hist_warmup;
 	int hist_buckets;
@@ -103,9 +115,12 @@ protected:
 			<< "  NODE    name of the node which shoud be used" << std::endl
 			<< "  OPTIONS is one or more of the following options:" << std::endl
 			<< "    -c CNT  send CNT messages" << std::endl
+			<< "    -r RATE send messages with a fixed RATE and correct for coordinated omission" << std::endl
 			<< "    -f FD   use file descriptor FD for result output instead of stdout" << std::endl
 			<< "    -b BKTS number of buckets for histogram" << std::endl
 			<< "    -w WMUP duration of histogram warmup phase" << std::endl
+			<< "    -i SECS print a summary of the percentiles every SECS seconds" << std::endl
+			<< "    -s FILE write a summary of the percentiles to FILE (CSV if FILE ends with .csv, JSON otherwise)" << std::endl
 			<< "    -h      show this usage information" << std::endl
 			<< "    -V      show the version of the tool" << std::endl << std::endl;
 
@@ -117,12 +132,24 @@ protected:
 		/* Parse Arguments */
 		int c;
 		char *endptr;
-		while ((c = getopt (argc, argv, "w:hr:f:c:b:Vd:")) != -1) {
+		while ((c = getopt (argc, argv, "w:hr:f:c:b:Vd:i:s:")) != -1) {
 			switch (c) {
 				case 'c':
 					count = strtoul(optarg, &endptr, 10);
 					goto check;
 
+				case 'r':
+					rate = strtod(optarg, &endptr);
+					goto check;
+
+				case 'i':
+					interval = strtod(optarg, &endptr);
+					goto check;
+
+				case 's':
+					summary = optarg;
+					break;
+
 				case 'f':
 					fd = strtoul(optarg, &endptr, 10);
 					goto check;
@@ -164,12 +191,45 @@ check:			if (optarg == endptr)
 		nodestr = argv[optind + 1];
 	}
 
+	void writeSummary(const HdrHist &hdr)
+	{
+		int ret;
+		bool csv = summary.size() >= 4 && summary.compare(summary.size() - 4, 4, ".csv") == 0;
+
+		FILE *f = fopen(summary.c_str(), "w");
+		if (!f)
+			throw SystemError("Failed to open summary file: {}", summary);
+
+		if (csv) {
+			HdrHist::printCsvHeader(f);
+			fprintf(f, "\n");
+			hdr.printCsv(f);
+			fprintf(f, "\n");
+
+			ret = 0;
+		}
+		else {
+			json_t *json_summary = hdr.toJson();
+
+			json_object_set_new(json_summary, "corrected", json_boolean(rate > 0));
+
+			ret = json_dumpf(json_summary, f, JSON_INDENT(4));
+
+			json_decref(json_summary);
+		}
+
+		if (fclose(f) || ret)
+			throw SystemError("Failed to write summary file: {}", summary);
+	}
+
 	int main()
 	{
 		int ret;
 
 		Hist hist(hist_buckets, hist_warmup);
-		struct timespec send, recv;
+		HdrHist hdr;
+		Task task(CLOCK_ID);
+		struct timespec send, recv, last_summary;
 
 		struct sample *smp_send = (struct sample *) new char[SAMPLE_LENGTH(2)];
 		struct sample *smp_recv = (struct sample *) new char[SAMPLE_LENGTH(2)];
@@ -200,10 +260,18 @@ check:			if (optarg == endptr)
 		if (ret)
 			throw RuntimeError("Failed to start node {}: reason={}", *node, ret);
 
+		if (rate > 0)
+			task.setRate(rate);
+
 		/* Print header */
 		fprintf(stdout, "%17s%5s%10s%10s%10s%10s%10s\n", "timestamp", "seq", "rtt", "min", "max", "mean", "stddev");
 
+		clock_gettime(CLOCK_ID, &last_summary);
+
 		while (!stop && (count < 0 || count--)) {
+			if (rate > 0)
+				task.wait();
+
 			clock_gettime(CLOCK_ID, &send);
 
 			node_write(node, &smp_send, 1); /* Ping */
@@ -218,6 +286,11 @@ check:			if (optarg == endptr)
 
 			hist.put(rtt);
 
+			if (rate > 0)
+				hdr.putCorrected(rtt, 1.0 / rate);
+			else
+				hdr.put(rtt);
+
 			smp_send->sequence++;
 
 			fprintf(stdout, "%10lld.%06lld%5" PRIu64 "%10.3f%10.3f%10.3f%10.3f%10.3f\n",
@@ -225,8 +298,16 @@ check:			if (optarg == endptr)
 				(long long) recv.tv_nsec / 1000, smp_send->sequence,
 				1e3 * rtt, 1e3 * hist.getLowest(), 1e3 * hist.getHighest(),
 				1e3 * hist.getMean(), 1e3 * hist.getStddev());
+
+			if (interval > 0 && time_delta(&last_summary, &recv) >= interval) {
+				hdr.print(logger);
+				last_summary = recv;
+			}
 		}
 
+		if (rate > 0)
+			task.stop();
+
 		struct stat st;
 		if (!fstat(fd, &st)) {
 			FILE *f = fdopen(fd, "w");
@@ -237,6 +318,10 @@ check:			if (optarg == endptr)
 			throw RuntimeError("Invalid file descriptor: {}", fd);
 
 		hist.print(logger, true);
+		hdr.print(logger);
+
+		if (!summary.empty())
+			writeSummary(hdr);
 
 		ret = node_stop(node);
 		if (ret)
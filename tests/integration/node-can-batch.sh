@@ -0,0 +1,115 @@
+#!/bin/bash
+#
+# Integration test for batched and filtered reception of the can node-type.
+#
+# @author Niklas Eiling <niklas.eiling@eonerc.rwth-aachen.de>
+# @copyright 2014-2020, Institute for Automation of Complex Power Systems, EONERC
+# @license GNU General Public License (version 3)
+#
+# VILLASnode
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+##################################################################################
+
+# To set up vcan interface use the following commands
+# sudo modprobe vcan
+# sudo ip link add dev vcan0 type vcan
+# sudo ip link set vcan0 up
+
+SCRIPT=$(realpath $0)
+SCRIPTPATH=$(dirname ${SCRIPT})
+source ${SCRIPTPATH}/../../tools/villas-helper.sh
+
+CONFIG_FILE=$(mktemp)
+INPUT_FILE=$(mktemp)
+OUTPUT_FILE=$(mktemp)
+
+NUM_SAMPLES=${NUM_SAMPLES:-1000}
+NUM_VALUES=${NUM_VALUES:-3}
+
+CAN_IF=$(ip link show type vcan | head -n1 | awk '{match($2, /(.*):/,a)}END{print a[1]}')
+
+if [[ ! ${CAN_IF} ]]; then
+    echo "Did not find any vcan interface"
+    exit 99
+fi
+
+if [[ ! $(ip link show "${CAN_IF}" up) ]]; then
+    echo "Interface ${CAN_IF} is not up"
+    exit 99
+fi
+
+cat > ${CONFIG_FILE} << EOF
+nodes = {
+	can_tx = {
+		type = "can"
+		interface_name = "${CAN_IF}"
+		sample_rate = 500000
+
+		out = {
+			signals = (
+				{ type = "float", can_id = 66, can_size = 4, can_offset = 0 },
+				{ type = "float", can_id = 66, can_size = 4, can_offset = 4 },
+				{ type = "float", can_id = 1000, can_size = 8, can_offset = 0 }
+			)
+		}
+	}
+
+	can_rx = {
+		type = "can"
+		interface_name = "${CAN_IF}"
+		sample_rate = 500000
+
+		in = {
+			vectorize = 16
+
+			signals = (
+				{ name = "sigin1", type = "float", can_id = 66, can_size = 4, can_offset = 0 },
+				{ name = "sigin2", type = "float", can_id = 66, can_size = 4, can_offset = 4 },
+				{ name = "sigin3", type = "float", can_id = 1000, can_size = 8, can_offset = 0 }
+			)
+		}
+	}
+}
+EOF
+
+# Generate test data
+VILLAS_LOG_PREFIX=$(colorize "[Signal]") \
+villas-signal -v ${NUM_VALUES} -l ${NUM_SAMPLES} -r 10000 -n random > ${INPUT_FILE}
+
+# Receive data
+VILLAS_LOG_PREFIX=$(colorize "[Recv]  ") \
+villas-pipe -r -l ${NUM_SAMPLES} ${CONFIG_FILE} can_rx > ${OUTPUT_FILE} &
+PID=$!
+
+# Wait for node to complete init
+sleep 1
+
+# Frames with unknown IDs are dropped by the kernel filter
+cansend ${CAN_IF} 123#DEADBEEF
+cansend ${CAN_IF} 00099999#DEADBEEF
+
+# Send data
+VILLAS_LOG_PREFIX=$(colorize "[Send]  ") \
+villas-pipe -s -l ${NUM_SAMPLES} ${CONFIG_FILE} can_tx < ${INPUT_FILE}
+
+wait ${PID}
+
+# Compare data
+villas-compare ${INPUT_FILE} ${OUTPUT_FILE}
+RC=$?
+
+rm ${CONFIG_FILE} ${INPUT_FILE} ${OUTPUT_FILE}
+
+exit ${RC}
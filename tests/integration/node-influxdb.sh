@@ -0,0 +1,125 @@
+#!/bin/bash
+#
+# Integration test for batched writes of the influxdb node-type.
+#
+# @author Steffen Vogel <stvogel@eonerc.rwth-aachen.de>
+# @copyright 2014-2020, Institute for Automation of Complex Power Systems, EONERC
+# @license GNU General Public License (version 3)
+#
+# VILLASnode
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+##################################################################################
+
+CONFIG_FILE=$(mktemp)
+SERVER_FILE=$(mktemp)
+OUTPUT_FILE=$(mktemp)
+STATS_FILE=$(mktemp)
+INPUT_FILE=$(mktemp)
+
+NUM_SAMPLES=${NUM_SAMPLES:-1000}
+PORT=${PORT:-18086}
+
+# A stand-in for the HTTP /write endpoint of InfluxDB
+cat > ${SERVER_FILE} << EOF
+import socket
+
+srv = socket.socket()
+srv.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+srv.bind(('127.0.0.1', ${PORT}))
+srv.listen(1)
+
+conns = reqs = 0
+
+with open('${OUTPUT_FILE}', 'wb') as out:
+    while True:
+        c, _ = srv.accept()
+        conns += 1
+        buf = b''
+
+        while True:
+            while b'\r\n\r\n' not in buf:
+                d = c.recv(65536)
+                if not d:
+                    break
+                buf += d
+
+            if b'\r\n\r\n' not in buf:
+                c.close()
+                break
+
+            hdr, buf = buf.split(b'\r\n\r\n', 1)
+            length = [ int(l.split(b':')[1]) for l in hdr.split(b'\r\n') if l.lower().startswith(b'content-length:') ][0]
+
+            while len(buf) < length:
+                buf += c.recv(65536)
+
+            out.write(buf[:length])
+            out.flush()
+            buf = buf[length:]
+            reqs += 1
+
+            with open('${STATS_FILE}', 'w') as f:
+                f.write(f'{conns} {reqs}\n')
+
+            c.sendall(b'HTTP/1.1 204 No Content\r\n\r\n')
+EOF
+
+cat > ${CONFIG_FILE} << EOF
+{
+	"nodes" : {
+		"influx_node" : {
+			"type" : "influxdb",
+
+			"server" : "127.0.0.1:${PORT}",
+			"protocol" : "http",
+			"database" : "villas",
+			"key" : "villas",
+
+			"batch" : {
+				"max_lines" : 100,
+				"linger" : 0.1
+			}
+		}
+	}
+}
+EOF
+
+python3 ${SERVER_FILE} &
+PID=$!
+
+sleep 1
+
+villas-signal -l ${NUM_SAMPLES} -r 1000 random > ${INPUT_FILE}
+
+villas-pipe -s -l ${NUM_SAMPLES} ${CONFIG_FILE} influx_node < ${INPUT_FILE}
+
+kill ${PID}
+wait ${PID}
+
+read CONNS REQS < ${STATS_FILE}
+LINES=$(wc -l < ${OUTPUT_FILE})
+
+echo "Received ${LINES} lines in ${REQS} requests over ${CONNS} connections"
+
+# All lines must arrive in batches over a single persistent connection
+if (( ${LINES} == ${NUM_SAMPLES} && ${CONNS} == 1 && ${REQS} < ${NUM_SAMPLES} )); then
+	RC=0
+else
+	RC=-1
+fi
+
+rm ${CONFIG_FILE} ${SERVER_FILE} ${OUTPUT_FILE} ${STATS_FILE} ${INPUT_FILE}
+
+exit ${RC}
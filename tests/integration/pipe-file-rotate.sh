@@ -0,0 +1,79 @@
+#!/bin/bash
+#
+# Integration test for the rotation of files by the asynchronous writer.
+#
+# @author Steffen Vogel <stvogel@eonerc.rwth-aachen.de>
+# @copyright 2014-2020, Institute for Automation of Complex Power Systems, EONERC
+# @license GNU General Public License (version 3)
+#
+# VILLASnode
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+##################################################################################
+
+NUM_SAMPLES=${NUM_SAMPLES:-150}
+RATE=${RATE:-50}
+
+CONFIG_FILE=$(mktemp)
+NODE_DIR=$(mktemp -d)
+
+# A new file is started every second
+cat > ${CONFIG_FILE} << EOF
+{
+	"nodes" : {
+		"node1" : {
+			"type" : "file",
+			"format" : "villas.human",
+
+			"uri" : "${NODE_DIR}/%H%M%S.dat",
+
+			"out" : {
+				"async" : true,
+				"flush_interval" : 0.1,
+				"rotate_interval" : 1.0
+			}
+		}
+	}
+}
+EOF
+
+# The samples are generated in real-time to span multiple rotation intervals
+villas-signal -l ${NUM_SAMPLES} -r ${RATE} random | \
+villas-pipe -s -L ${NUM_SAMPLES} ${CONFIG_FILE} node1
+
+RC=0
+FILES=$(ls ${NODE_DIR} | wc -l)
+
+if (( ${FILES} < 2 )); then
+	echo "Files have not been rotated: ${FILES} files"
+	RC=1
+fi
+
+# Each file starts with its own header
+for FILE in ${NODE_DIR}/*; do
+	if [ "$(head -c 1 ${FILE})" != "#" ]; then
+		echo "Missing header in ${FILE}"
+		RC=1
+	fi
+done
+
+SAMPLES=$(cat ${NODE_DIR}/* | grep -v '^#' | wc -l)
+if (( ${SAMPLES} != ${NUM_SAMPLES} )); then
+	echo "Expected ${NUM_SAMPLES} samples, found ${SAMPLES}"
+	RC=1
+fi
+
+rm -rf ${CONFIG_FILE} ${NODE_DIR}
+
+exit ${RC}
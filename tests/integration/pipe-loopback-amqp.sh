@@ -51,7 +51,15 @@ cat > ${CONFIG_FILE} << EOF
 
 			"exchange" : "mytestexchange",
 			"routing_key" : "abc",
-		
+
+			"in" : {
+				"prefetch" : 16
+			},
+			"out" : {
+				"samples_per_message" : 2,
+				"confirm" : true
+			},
+
 			"ssl" : {
 				"verify_hostname" : true,
 				"verify_peer" : true,
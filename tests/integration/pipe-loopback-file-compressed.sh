@@ -0,0 +1,71 @@
+#!/bin/bash
+#
+# Integration loopback test for villas-pipe with compressed files.
+#
+# @author Steffen Vogel <stvogel@eonerc.rwth-aachen.de>
+# @copyright 2014-2020, Institute for Automation of Complex Power Systems, EONERC
+# @license GNU General Public License (version 3)
+#
+# VILLASnode
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+##################################################################################
+
+NUM_SAMPLES=${NUM_SAMPLES:-100}
+
+for SUFFIX in gz zst; do
+
+CONFIG_FILE=$(mktemp)
+INPUT_FILE=$(mktemp)
+OUTPUT_FILE=$(mktemp)
+NODE_FILE=$(mktemp --suffix=.${SUFFIX})
+
+# The compression is detected by the file extension
+cat > ${CONFIG_FILE} << EOF
+{
+	"nodes" : {
+		"node1" : {
+			"type" : "file",
+
+			"uri"   : "${NODE_FILE}",
+
+			"in" : {
+				"epoch_mode" : "original",
+				"eof" : "wait"
+			},
+			"out" : {
+				"flush" : true
+			}
+		}
+	}
+}
+EOF
+
+# Generate test data
+villas-signal -l ${NUM_SAMPLES} -n random > ${INPUT_FILE}
+
+villas-pipe -l ${NUM_SAMPLES} ${CONFIG_FILE} node1 > ${OUTPUT_FILE} < ${INPUT_FILE}
+
+# Compare data
+villas-compare ${INPUT_FILE} ${OUTPUT_FILE}
+RC=$?
+
+rm ${OUTPUT_FILE} ${INPUT_FILE} ${CONFIG_FILE} ${NODE_FILE}
+
+if (( ${RC} != 0 )); then
+	echo "Failed for compression: ${SUFFIX}"
+	exit ${RC}
+fi
+
+done
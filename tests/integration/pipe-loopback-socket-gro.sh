@@ -0,0 +1,78 @@
+#!/bin/bash
+#
+# Integration loopback test for UDP segmentation and receive offloading.
+#
+# @author Steffen Vogel <stvogel@eonerc.rwth-aachen.de>
+# @copyright 2014-2020, Institute for Automation of Complex Power Systems, EONERC
+# @license GNU General Public License (version 3)
+#
+# VILLASnode
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+##################################################################################
+
+SCRIPT=$(realpath $0)
+SCRIPTPATH=$(dirname ${SCRIPT})
+source ${SCRIPTPATH}/../../tools/villas-helper.sh
+
+# UDP_GRO requires at least Linux 5.0
+KERNEL_VERSION=$(uname -r | cut -d. -f1)
+if (( ${KERNEL_VERSION} < 5 )); then
+	echo "UDP receive offloading is not supported by this kernel"
+	exit 99
+fi
+
+CONFIG_FILE=$(mktemp)
+INPUT_FILE=$(mktemp)
+OUTPUT_FILE=$(mktemp)
+
+NUM_SAMPLES=${NUM_SAMPLES:-1000}
+
+# Generate test data
+villas-signal -l ${NUM_SAMPLES} -n random > ${INPUT_FILE}
+
+# The receiver reads fewer samples at once than the kernel coalesces
+# into a single super-buffer. The remaining datagrams must not get lost.
+cat > ${CONFIG_FILE} << EOF
+{
+	"nodes" : {
+		"node1" : {
+			"type" : "socket",
+			"format" : "villas.binary",
+			"layer" : "udp",
+
+			"out" : {
+				"address" : "127.0.0.1:12000",
+				"vectorize" : 64,
+				"gso" : true
+			},
+			"in" : {
+				"address" : "127.0.0.1:12000",
+				"vectorize" : 4,
+				"gro" : true
+			}
+		}
+	}
+}
+EOF
+
+villas-pipe -l ${NUM_SAMPLES} ${CONFIG_FILE} node1 < ${INPUT_FILE} > ${OUTPUT_FILE}
+
+# Compare data
+villas-compare ${INPUT_FILE} ${OUTPUT_FILE}
+RC=$?
+
+rm ${OUTPUT_FILE} ${INPUT_FILE} ${CONFIG_FILE}
+
+exit ${RC}
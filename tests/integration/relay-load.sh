@@ -0,0 +1,41 @@
+#!/bin/bash
+#
+# Integration load test for villas-relay with multiple service threads.
+#
+# @author Steffen Vogel <stvogel@eonerc.rwth-aachen.de>
+# @copyright 2014-2020, Institute for Automation of Complex Power Systems, EONERC
+# @license GNU General Public License (version 3)
+#
+# VILLASnode
+#
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+##################################################################################
+
+PORT=${PORT:-18088}
+THREADS=${THREADS:-4}
+
+villas-relay -p ${PORT} -t ${THREADS} &
+PID=$!
+
+# Wait for relay to complete init
+sleep 1
+
+# 20 sessions with 50 connections each
+villas-test-relay -p ${PORT} -s 20 -c 50 -r 50 -D 5
+RC=$?
+
+kill ${PID}
+wait ${PID}
+
+exit ${RC}
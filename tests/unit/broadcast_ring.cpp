@@ -0,0 +1,256 @@
+/** Unit tests for broadcast ring
+ *
+ * @author Steffen Vogel <stvogel@eonerc.rwth-aachen.de>
+ * @copyright 2014-2020, Institute for Automation of Complex Power Systems, EONERC
+ * @license GNU General Public License (version 3)
+ *
+ * VILLASnode
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *********************************************************************************/
+
+#include <criterion/criterion.h>
+
+#include <pthread.h>
+
+#include <villas/utils.hpp>
+#include <villas/memory.h>
+#include <villas/pool.h>
+#include <villas/sample.h>
+#include <villas/broadcast_ring.h>
+
+extern void init_memory();
+
+#define NUM_ELEM 1000
+#define NUM_CONSUMERS 4
+
+struct producer_ctx {
+	struct broadcast_ring *ring;
+	struct pool *pool;
+};
+
+static void * producer(void *ctx)
+{
+	int ret;
+	struct producer_ctx *p = (struct producer_ctx *) ctx;
+
+	for (int i = 0; i < NUM_ELEM; i++) {
+		struct sample *smp = sample_alloc(p->pool);
+		if (!smp)
+			return (void *) 1; /* Indicates an error to the parent thread */
+
+		smp->sequence = i;
+
+		ret = broadcast_ring_publish(p->ring, &smp, 1);
+		if (ret != 1)
+			return (void *) 2; /* Indicates an error to the parent thread */
+
+		/* The ring holds its own reference now */
+		sample_decref(smp);
+	}
+
+	return nullptr;
+}
+
+static void * consumer(void *ctx)
+{
+	int ret;
+	struct broadcast_ring_consumer *c = (struct broadcast_ring_consumer *) ctx;
+
+	struct sample *smps[16];
+
+	for (int i = 0; i < NUM_ELEM;) {
+		ret = broadcast_ring_consume_wait(c, smps, ARRAY_LEN(smps));
+		if (ret <= 0)
+			return (void *) 1; /* Indicates an error to the parent thread */
+
+		for (int j = 0; j < ret; j++, i++) {
+			if (smps[j]->sequence != (uint64_t) i)
+				return (void *) 2; /* Indicates an error to the parent thread */
+		}
+
+		sample_decref_many(smps, ret);
+	}
+
+	return nullptr;
+}
+
+// cppcheck-suppress unknownMacro
+Test(broadcast_ring, multiple_consumers, .timeout = 10, .init = init_memory)
+{
+	int ret;
+	void *r;
+	struct pool pool;
+	struct broadcast_ring ring;
+	struct broadcast_ring_consumer consumers[NUM_CONSUMERS];
+
+	pthread_t tp, tcs[NUM_CONSUMERS];
+
+	ret = pool_init(&pool, 128, SAMPLE_LENGTH(1), &memory_heap);
+	cr_assert_eq(ret, 0);
+
+	ret = broadcast_ring_init(&ring, 32, BroadcastRingOverflow::BLOCK);
+	cr_assert_eq(ret, 0);
+
+	for (int i = 0; i < NUM_CONSUMERS; i++) {
+		ret = broadcast_ring_consumer_init(&consumers[i], &ring);
+		cr_assert_eq(ret, 0);
+
+		ret = pthread_create(&tcs[i], nullptr, consumer, &consumers[i]);
+		cr_assert_eq(ret, 0);
+	}
+
+	struct producer_ctx ctx = {
+		.ring = &ring,
+		.pool = &pool
+	};
+
+	ret = pthread_create(&tp, nullptr, producer, &ctx);
+	cr_assert_eq(ret, 0);
+
+	ret = pthread_join(tp, &r);
+	cr_assert_eq(ret, 0);
+	cr_assert_null(r, "Producer failed: %p", r);
+
+	for (int i = 0; i < NUM_CONSUMERS; i++) {
+		ret = pthread_join(tcs[i], &r);
+		cr_assert_eq(ret, 0);
+		cr_assert_null(r, "Consumer %d failed: %p", i, r);
+
+		cr_assert_eq(broadcast_ring_consumer_lag(&consumers[i]), 0);
+		cr_assert_eq(consumers[i].overruns, 0);
+	}
+
+	ret = broadcast_ring_destroy(&ring);
+	cr_assert_eq(ret, 0);
+
+	/* All samples must have been returned to the pool */
+	cr_assert_eq(queue_available(&pool.queue), 128);
+
+	for (int i = 0; i < NUM_CONSUMERS; i++) {
+		ret = broadcast_ring_consumer_destroy(&consumers[i]);
+		cr_assert_eq(ret, 0);
+	}
+
+	ret = pool_destroy(&pool);
+	cr_assert_eq(ret, 0);
+}
+
+Test(broadcast_ring, drop_slow_consumer, .init = init_memory)
+{
+	int ret;
+	struct pool pool;
+	struct broadcast_ring ring;
+	struct broadcast_ring_consumer fast, slow;
+	struct sample *smps[8], *rcvd[8];
+
+	ret = pool_init(&pool, 16, SAMPLE_LENGTH(1), &memory_heap);
+	cr_assert_eq(ret, 0);
+
+	ret = broadcast_ring_init(&ring, 4, BroadcastRingOverflow::DROP);
+	cr_assert_eq(ret, 0);
+
+	ret = broadcast_ring_consumer_init(&fast, &ring);
+	cr_assert_eq(ret, 0);
+
+	ret = broadcast_ring_consumer_init(&slow, &ring);
+	cr_assert_eq(ret, 0);
+
+	ret = sample_alloc_many(&pool, smps, ARRAY_LEN(smps));
+	cr_assert_eq(ret, ARRAY_LEN(smps));
+
+	ret = broadcast_ring_publish(&ring, smps, 4);
+	cr_assert_eq(ret, 4);
+
+	ret = broadcast_ring_consume(&fast, rcvd, ARRAY_LEN(rcvd));
+	cr_assert_eq(ret, 4);
+	cr_assert_eq(rcvd[0], smps[0]);
+	cr_assert_eq(atomic_load(&rcvd[0]->refcnt), 3);
+
+	sample_decref_many(rcvd, ret);
+
+	/* The ring is full and only the slow consumer is holding it back */
+	ret = broadcast_ring_publish(&ring, smps + 4, 4);
+	cr_assert_eq(ret, 4);
+
+	cr_assert_eq(slow.overruns, 4);
+	cr_assert_eq(fast.overruns, 0);
+	cr_assert_eq(ring.dropped, 4);
+
+	/* The fast consumer receives every sample */
+	ret = broadcast_ring_consume(&fast, rcvd, ARRAY_LEN(rcvd));
+	cr_assert_eq(ret, 4);
+
+	for (int i = 0; i < ret; i++)
+		cr_assert_eq(rcvd[i], smps[4 + i]);
+
+	sample_decref_many(rcvd, ret);
+
+	/* The slow consumer only misses the overwritten samples */
+	ret = broadcast_ring_consume(&slow, rcvd, ARRAY_LEN(rcvd));
+	cr_assert_eq(ret, 4);
+	cr_assert_eq(rcvd[0], smps[4]);
+
+	sample_decref_many(rcvd, ret);
+
+	/* A partial overrun skips only as many samples as needed */
+	ret = broadcast_ring_publish(&ring, smps, 4);
+	cr_assert_eq(ret, 4);
+
+	ret = broadcast_ring_consume(&fast, rcvd, ARRAY_LEN(rcvd));
+	cr_assert_eq(ret, 4);
+
+	sample_decref_many(rcvd, ret);
+
+	ret = broadcast_ring_publish(&ring, smps + 4, 2);
+	cr_assert_eq(ret, 2);
+	cr_assert_eq(slow.overruns, 6);
+
+	ret = broadcast_ring_consume(&slow, rcvd, ARRAY_LEN(rcvd));
+	cr_assert_eq(ret, 4);
+	cr_assert_eq(rcvd[0], smps[2]);
+	cr_assert_eq(rcvd[3], smps[5]);
+
+	sample_decref_many(rcvd, ret);
+
+	/* A detached consumer is not overrun anymore */
+	broadcast_ring_consumer_detach(&slow);
+
+	ret = broadcast_ring_publish(&ring, smps + 6, 2);
+	cr_assert_eq(ret, 2);
+	cr_assert_eq(slow.overruns, 6);
+	cr_assert_eq(fast.overruns, 0);
+
+	ret = broadcast_ring_consume(&fast, rcvd, ARRAY_LEN(rcvd));
+	cr_assert_eq(ret, 4);
+	cr_assert_eq(rcvd[0], smps[4]);
+	cr_assert_eq(rcvd[3], smps[7]);
+
+	sample_decref_many(rcvd, ret);
+	sample_decref_many(smps, ARRAY_LEN(smps));
+
+	ret = broadcast_ring_destroy(&ring);
+	cr_assert_eq(ret, 0);
+
+	cr_assert_eq(queue_available(&pool.queue), 16);
+
+	ret = broadcast_ring_consumer_destroy(&fast);
+	cr_assert_eq(ret, 0);
+
+	ret = broadcast_ring_consumer_destroy(&slow);
+	cr_assert_eq(ret, 0);
+
+	ret = pool_destroy(&pool);
+	cr_assert_eq(ret, 0);
+}
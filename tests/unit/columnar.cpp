@@ -0,0 +1,354 @@
+/** Unit tests for the columnar format.
+ *
+ * @author Steffen Vogel <stvogel@eonerc.rwth-aachen.de>
+ * @copyright 2014-2020, Institute for Automation of Complex Power Systems, EONERC
+ * @license GNU General Public License (version 3)
+ *
+ * VILLASnode
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *********************************************************************************/
+
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <limits>
+#include <endian.h>
+
+#include <criterion/criterion.h>
+
+#include <villas/sample.h>
+#include <villas/pool.h>
+#include <villas/format.hpp>
+#include <villas/formats/columnar.hpp>
+
+using namespace villas::node;
+
+extern void init_memory();
+
+#define NUM_SAMPLES 100
+
+/* Two floating point columns and one integer column */
+#define SIGNALS "ffi"
+#define NUM_VALUES 3
+
+static Format * columnar_make(const char *cfg)
+{
+	json_t *json_format = json_loads(cfg, 0, nullptr);
+	cr_assert_not_null(json_format);
+
+	Format *fmt = FormatFactory::make(json_format);
+	cr_assert_not_null(fmt);
+
+	json_decref(json_format);
+
+	fmt->start(SIGNALS);
+
+	return fmt;
+}
+
+static void columnar_set(struct sample *smp, int64_t ts, uint64_t seq, double f0, double f1, int64_t i)
+{
+	smp->flags = (int) SampleFlags::HAS_TS_ORIGIN | (int) SampleFlags::HAS_SEQUENCE | (int) SampleFlags::HAS_DATA;
+	smp->length = NUM_VALUES;
+	smp->sequence = seq;
+	smp->ts.origin.tv_sec = ts / 1000000000LL;
+	smp->ts.origin.tv_nsec = ts % 1000000000LL;
+
+	smp->data[0].f = f0;
+	smp->data[1].f = f1;
+	smp->data[2].i = i;
+}
+
+/** Encode and decode all samples and compare them bitwise. */
+static void columnar_roundtrip(struct sample *smps[], unsigned cnt)
+{
+	int ret;
+	unsigned rcnt;
+	char buf[16384];
+	size_t wbytes, rbytes;
+	struct pool pool;
+	struct sample *smpt[cnt];
+
+	ret = pool_init(&pool, cnt, SAMPLE_LENGTH(NUM_VALUES));
+	cr_assert_eq(ret, 0);
+
+	ret = sample_alloc_many(&pool, smpt, cnt);
+	cr_assert_eq(ret, (int) cnt);
+
+	Format *fmt = columnar_make("{ \"type\": \"villas.columnar\" }");
+
+	for (unsigned i = 0; i < cnt; i++)
+		smps[i]->signals = fmt->getSignals();
+
+	rcnt = fmt->sprint(buf, sizeof(buf), &wbytes, smps, cnt);
+	cr_assert_eq(rcnt, cnt, "Written only %u of %u samples", rcnt, cnt);
+
+	rcnt = fmt->sscan(buf, wbytes, &rbytes, smpt, cnt);
+	cr_assert_eq(rcnt, cnt, "Read only %u of %u samples back", rcnt, cnt);
+	cr_assert_eq(rbytes, wbytes);
+
+	for (unsigned i = 0; i < cnt; i++) {
+		cr_assert_eq(smpt[i]->length, smps[i]->length);
+		cr_assert_eq(smpt[i]->sequence, smps[i]->sequence, "Sequence mismatch of sample %u", i);
+		cr_assert_eq(smpt[i]->ts.origin.tv_sec, smps[i]->ts.origin.tv_sec, "Timestamp mismatch of sample %u", i);
+		cr_assert_eq(smpt[i]->ts.origin.tv_nsec, smps[i]->ts.origin.tv_nsec, "Timestamp mismatch of sample %u", i);
+
+		/* NaNs do not compare equal */
+		ret = memcmp(smpt[i]->data, smps[i]->data, NUM_VALUES * sizeof(union signal_data));
+		cr_assert_eq(ret, 0, "Value mismatch of sample %u", i);
+	}
+
+	delete fmt;
+
+	sample_free_many(smpt, cnt);
+
+	ret = pool_destroy(&pool);
+	cr_assert_eq(ret, 0);
+}
+
+static void columnar_alloc(struct pool *pool, struct sample *smps[], unsigned cnt)
+{
+	int ret;
+
+	ret = pool_init(pool, cnt, SAMPLE_LENGTH(NUM_VALUES));
+	cr_assert_eq(ret, 0);
+
+	ret = sample_alloc_many(pool, smps, cnt);
+	cr_assert_eq(ret, (int) cnt);
+}
+
+static void columnar_free(struct pool *pool, struct sample *smps[], unsigned cnt)
+{
+	int ret;
+
+	sample_free_many(smps, cnt);
+
+	ret = pool_destroy(pool);
+	cr_assert_eq(ret, 0);
+}
+
+Test(columnar, special_values, .init = init_memory)
+{
+	struct pool pool;
+	struct sample *smps[NUM_SAMPLES];
+
+	const double specials[] = {
+		std::numeric_limits<double>::quiet_NaN(),
+		-std::numeric_limits<double>::quiet_NaN(),
+		std::numeric_limits<double>::signaling_NaN(),
+		std::numeric_limits<double>::infinity(),
+		-std::numeric_limits<double>::infinity(),
+		std::numeric_limits<double>::denorm_min(),
+		std::numeric_limits<double>::max(),
+		-std::numeric_limits<double>::max(),
+		0.0,
+		-0.0,
+		1.0
+	};
+	const unsigned num_specials = sizeof(specials) / sizeof(specials[0]);
+
+	columnar_alloc(&pool, smps, NUM_SAMPLES);
+
+	for (unsigned i = 0; i < NUM_SAMPLES; i++) {
+		double nan_payload;
+		uint64_t bits = 0x7ff0000000000001ULL | ((uint64_t) i << 20);
+
+		memcpy(&nan_payload, &bits, sizeof(bits));
+
+		columnar_set(smps[i], 1000000000LL + i * 1000, i,
+			specials[i % num_specials],
+			i % 2 ? nan_payload : specials[(i * 7) % num_specials],
+			i % 2 ? std::numeric_limits<int64_t>::min() : std::numeric_limits<int64_t>::max());
+	}
+
+	columnar_roundtrip(smps, NUM_SAMPLES);
+
+	columnar_free(&pool, smps, NUM_SAMPLES);
+}
+
+Test(columnar, constant_series, .init = init_memory)
+{
+	struct pool pool;
+	struct sample *smps[NUM_SAMPLES];
+
+	columnar_alloc(&pool, smps, NUM_SAMPLES);
+
+	/* All deltas and XORs are zero, even those of the timestamps */
+	for (unsigned i = 0; i < NUM_SAMPLES; i++)
+		columnar_set(smps[i], 1500000000123456789LL, 42, 3.14, std::numeric_limits<double>::quiet_NaN(), -7);
+
+	columnar_roundtrip(smps, NUM_SAMPLES);
+
+	/* A single sample has no deltas at all */
+	columnar_roundtrip(smps, 1);
+
+	columnar_free(&pool, smps, NUM_SAMPLES);
+}
+
+Test(columnar, timestamp_reset, .init = init_memory)
+{
+	struct pool pool;
+	struct sample *smps[NUM_SAMPLES];
+
+	columnar_alloc(&pool, smps, NUM_SAMPLES);
+
+	for (unsigned i = 0; i < NUM_SAMPLES; i++) {
+		int64_t ts;
+
+		/* The clock and the sequence jump back to zero and forward again */
+		if (i < NUM_SAMPLES / 3)
+			ts = 1600000000000000000LL + i * 100000;
+		else if (i < 2 * NUM_SAMPLES / 3)
+			ts = (i - NUM_SAMPLES / 3) * 100000;
+		else
+			ts = 1700000000000000000LL + i * (i % 4 ? 1 : 0x100000000LL);
+
+		columnar_set(smps[i], ts, i < NUM_SAMPLES / 2 ? i : i - NUM_SAMPLES / 2,
+			sin(i * 0.1), i * 0.5, (int64_t) i * i * (i % 2 ? -1 : 1));
+	}
+
+	columnar_roundtrip(smps, NUM_SAMPLES);
+
+	columnar_free(&pool, smps, NUM_SAMPLES);
+}
+
+Test(columnar, seek, .init = init_memory)
+{
+	int ret, cnt;
+	struct pool pool;
+	struct sample *smps[NUM_SAMPLES + 1];
+	struct sample *smpt[1];
+	struct timespec ts;
+
+	columnar_alloc(&pool, smps, NUM_SAMPLES + 1);
+	smpt[0] = smps[NUM_SAMPLES];
+
+	/* One sample per millisecond */
+	for (unsigned i = 0; i < NUM_SAMPLES; i++)
+		columnar_set(smps[i], 1000000000LL + i * 1000000, i, i, -1.0 * i, i);
+
+	auto *fmt = dynamic_cast<ColumnarFormat *>(columnar_make("{ \"type\": \"villas.columnar\", \"chunk_size\": 16 }"));
+	cr_assert_not_null(fmt);
+
+	for (unsigned i = 0; i < NUM_SAMPLES; i++)
+		smps[i]->signals = fmt->getSignals();
+
+	FILE *stream = tmpfile();
+	cr_assert_not_null(stream);
+
+	cnt = fmt->print(stream, smps, NUM_SAMPLES);
+	cr_assert_eq(cnt, NUM_SAMPLES);
+
+	ret = fmt->finish(stream);
+	cr_assert_eq(ret, 0);
+
+	/* The target lies within the third chunk */
+	ret = fmt->seek(stream, 40e-3, &ts);
+	cr_assert_eq(ret, 0);
+	cr_assert_eq(ts.tv_sec, 1);
+	cr_assert_eq(ts.tv_nsec, 40000000);
+
+	cnt = fmt->scan(stream, smpt, 1);
+	cr_assert_eq(cnt, 1);
+	cr_assert_eq(smpt[0]->sequence, 40);
+
+	cnt = fmt->scan(stream, smpt, 1);
+	cr_assert_eq(cnt, 1);
+	cr_assert_eq(smpt[0]->sequence, 41);
+
+	/* Beyond the end of the recording */
+	ret = fmt->seek(stream, 1.0, &ts);
+	cr_assert_eq(ret, 0);
+
+	cnt = fmt->scan(stream, smpt, 1);
+	cr_assert_leq(cnt, 0);
+
+	/* The stream is still usable after reaching its end */
+	clearerr(stream);
+
+	ret = fmt->seek(stream, 0, &ts);
+	cr_assert_eq(ret, 0);
+
+	cnt = fmt->scan(stream, smpt, 1);
+	cr_assert_eq(cnt, 1);
+	cr_assert_eq(smpt[0]->sequence, 0);
+
+	fclose(stream);
+
+	delete fmt;
+
+	columnar_free(&pool, smps, NUM_SAMPLES + 1);
+}
+
+Test(columnar, corrupt_chunk, .init = init_memory)
+{
+	int ret;
+	char buf[16384], cpy[16384];
+	size_t wbytes, rbytes;
+	struct pool pool;
+	struct sample *smps[NUM_SAMPLES];
+	struct columnar_block b;
+	struct columnar_chunk c;
+
+	columnar_alloc(&pool, smps, NUM_SAMPLES);
+
+	Format *fmt = columnar_make("{ \"type\": \"villas.columnar\" }");
+
+	for (unsigned i = 0; i < NUM_SAMPLES; i++) {
+		columnar_set(smps[i], 1000000000LL + i * 1000000, i, i, -1.0 * i, i);
+		smps[i]->signals = fmt->getSignals();
+	}
+
+	ret = fmt->sprint(buf, sizeof(buf), &wbytes, smps, NUM_SAMPLES);
+	cr_assert_eq(ret, NUM_SAMPLES);
+
+	/* The chunk is truncated, but the length of its block is consistent */
+	for (size_t len = sizeof(b); len < wbytes; len++) {
+		memcpy(cpy, buf, len);
+		memcpy(&b, cpy, sizeof(b));
+
+		b.length = htole32(len - sizeof(b));
+		memcpy(cpy, &b, sizeof(b));
+
+		ret = fmt->sscan(cpy, len, &rbytes, smps, NUM_SAMPLES);
+		cr_assert_lt(ret, 0, "Truncated chunk of %zu bytes has been accepted", len);
+	}
+
+	/* The header of the chunk claims more samples and columns than the block contains */
+	const uint32_t bogus[] = { 1 << 20, 1U << 31, 0xffffffff };
+
+	for (auto v : bogus) {
+		memcpy(cpy, buf, wbytes);
+		memcpy(&c, cpy + sizeof(b), sizeof(c));
+
+		c.count = htole32(v);
+		memcpy(cpy + sizeof(b), &c, sizeof(c));
+
+		ret = fmt->sscan(cpy, wbytes, &rbytes, smps, NUM_SAMPLES);
+		cr_assert_lt(ret, 0, "Sample count %#x has been accepted", v);
+
+		memcpy(&c, buf + sizeof(b), sizeof(c));
+
+		c.columns = htole32(v);
+		memcpy(cpy + sizeof(b), &c, sizeof(c));
+
+		ret = fmt->sscan(cpy, wbytes, &rbytes, smps, NUM_SAMPLES);
+		cr_assert_lt(ret, 0, "Column count %#x has been accepted", v);
+	}
+
+	delete fmt;
+
+	columnar_free(&pool, smps, NUM_SAMPLES);
+}
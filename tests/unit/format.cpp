@@ -208,6 +208,7 @@ ParameterizedTestParameters(format, lowlevel)
 	params.emplace_back("{ \"type\": \"raw\", \"bits\": 64, \"endianess\": \"little\" }",	1, 64);
 	params.emplace_back("{ \"type\": \"villas.human\" }",					10, 0);
 	params.emplace_back("{ \"type\": \"villas.binary\" }",					10, 0);
+	params.emplace_back("{ \"type\": \"villas.columnar\" }",					10, 0);
 	params.emplace_back("{ \"type\": \"csv\" }",						10, 0);
 	params.emplace_back("{ \"type\": \"tsv\" }",						10, 0);
 	params.emplace_back("{ \"type\": \"json\" }",						10, 0);
@@ -298,6 +299,7 @@ ParameterizedTestParameters(format, highlevel)
 	params.emplace_back("{ \"type\": \"raw\", \"bits\": 64, \"endianess\": \"little\" }",	1, 64);
 	params.emplace_back("{ \"type\": \"villas.human\" }",					10, 0);
 	params.emplace_back("{ \"type\": \"villas.binary\" }",					10, 0);
+	params.emplace_back("{ \"type\": \"villas.columnar\" }",					10, 0);
 	params.emplace_back("{ \"type\": \"csv\" }",						10, 0);
 	params.emplace_back("{ \"type\": \"tsv\" }",						10, 0);
 	params.emplace_back("{ \"type\": \"json\" }",						10, 0);
@@ -365,6 +367,9 @@ ParameterizedTest(Param *p, format, highlevel, .init = init_memory)
 	cnt = fmt->print(stream, smps, p->cnt);
 	cr_assert_eq(cnt, p->cnt, "Written only %d of %d samples", cnt, p->cnt);
 
+	ret = fmt->finish(stream);
+	cr_assert_eq(ret, 0);
+
 	ret = fflush(stream);
 	cr_assert_eq(ret, 0);
 
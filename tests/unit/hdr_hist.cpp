@@ -0,0 +1,86 @@
+/** Unit tests for the HDR histogram
+ *
+ * @author Steffen Vogel <stvogel@eonerc.rwth-aachen.de>
+ * @copyright 2014-2020, Institute for Automation of Complex Power Systems, EONERC
+ * @license GNU General Public License (version 3)
+ *
+ * VILLASnode
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *********************************************************************************/
+
+#include <criterion/criterion.h>
+
+#include <villas/hdr_hist.hpp>
+
+using namespace villas;
+
+// cppcheck-suppress unknownMacro
+Test(hdr_hist, percentiles) {
+	HdrHist h(1e-6, 10, 3);
+
+	/* 1, 2, ..., 10000 microseconds */
+	for (int i = 1; i <= 10000; i++)
+		h.put(i * 1e-6);
+
+	cr_assert_eq(h.getTotal(), 10000U);
+	cr_assert_float_eq(h.getLowest(), 1e-6, 1e-12);
+	cr_assert_float_eq(h.getHighest(), 10e-3, 1e-12);
+	cr_assert_float_eq(h.getMean(), 5000.5e-6, 1e-9);
+
+	/* The precision of 3 significant digits allows a relative error of 1e-3 */
+	cr_assert_float_eq(h.getPercentile(50), 5e-3, 5e-3 * 1e-3);
+	cr_assert_float_eq(h.getPercentile(90), 9e-3, 9e-3 * 1e-3);
+	cr_assert_float_eq(h.getPercentile(99), 9.9e-3, 9.9e-3 * 1e-3);
+	cr_assert_float_eq(h.getPercentile(99.9), 9.99e-3, 9.99e-3 * 1e-3);
+	cr_assert_float_eq(h.getPercentile(100), 10e-3, 1e-12);
+}
+
+Test(hdr_hist, merge) {
+	HdrHist a(1e-6, 10, 3), b(1e-6, 10, 3), all(1e-6, 10, 3);
+
+	for (int i = 1; i <= 10000; i++) {
+		(i % 2 ? a : b).put(i * 1e-6);
+		all.put(i * 1e-6);
+	}
+
+	a.merge(b);
+
+	cr_assert_eq(a.getTotal(), all.getTotal());
+	cr_assert_float_eq(a.getLowest(), all.getLowest(), 1e-12);
+	cr_assert_float_eq(a.getHighest(), all.getHighest(), 1e-12);
+
+	for (double p : HdrHist::percentiles)
+		cr_assert_float_eq(a.getPercentile(p), all.getPercentile(p), 1e-12);
+
+	HdrHist c(1e-6, 100, 3);
+	cr_assert_throw(a.merge(c), RuntimeError);
+}
+
+Test(hdr_hist, coordinated_omission) {
+	HdrHist h(1e-6, 10, 3);
+
+	/* A stall of 1 second hides 127 samples at a rate of 128 Hz */
+	for (int i = 0; i < 100; i++)
+		h.putCorrected(1e-3, 1.0 / 128);
+
+	h.putCorrected(1, 1.0 / 128);
+
+	cr_assert_eq(h.getTotal(), 228U);
+	/* Without the correction, 99% of the values would be 1 ms */
+	cr_assert_float_eq(h.getPercentile(40), 1e-3, 1e-6);
+	cr_assert_gt(h.getPercentile(50), 0.1);
+	cr_assert_gt(h.getPercentile(90), 0.8);
+	cr_assert_float_eq(h.getPercentile(100), 1, 1e-12);
+}
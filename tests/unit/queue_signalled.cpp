@@ -29,6 +29,10 @@
 #include <villas/utils.hpp>
 #include <villas/memory.h>
 #include <villas/queue_signalled.h>
+#include <villas/timing.h>
+#include <villas/log.hpp>
+
+using namespace villas;
 
 extern void init_memory();
 
@@ -120,7 +124,11 @@ ParameterizedTestParameters(queue_signalled, simple)
 		{ QueueSignalledMode::POLLING, 0, false },
 #if defined(__linux__) && defined(HAS_EVENTFD)
 		{ QueueSignalledMode::EVENTFD, 0, false },
-		{ QueueSignalledMode::EVENTFD, 0, true }
+		{ QueueSignalledMode::EVENTFD, 0, true },
+#endif
+#ifdef __linux__
+		{ QueueSignalledMode::FUTEX,   0, false },
+		{ QueueSignalledMode::FUTEX,   (int) QueueSignalledFlags::PROCESS_SHARED, false },
 #endif
 	};
 
@@ -163,3 +171,96 @@ ParameterizedTest(struct param *param, queue_signalled, simple, .timeout = 5, .i
 	ret = queue_signalled_destroy(&q);
 	cr_assert_eq(ret, 0);
 }
+
+#define NUM_PINGPONG 10000
+
+struct pingpong {
+	struct queue_signalled ping;
+	struct queue_signalled pong;
+};
+
+static void * ponger(void *ctx)
+{
+	int ret;
+	void *p;
+	struct pingpong *pp = (struct pingpong *) ctx;
+
+	for (int i = 0; i < NUM_PINGPONG; i++) {
+		ret = queue_signalled_pull(&pp->ping, &p);
+		if (ret != 1)
+			return (void *) 1; /* Indicates an error to the parent thread */
+
+		ret = queue_signalled_push(&pp->pong, p);
+		if (ret != 1)
+			return (void *) 2; /* Indicates an error to the parent thread */
+	}
+
+	return nullptr;
+}
+
+ParameterizedTestParameters(queue_signalled, wakeup_latency)
+{
+	static struct param params[] = {
+		{ QueueSignalledMode::PTHREAD, 0, false },
+		{ QueueSignalledMode::PTHREAD, (int) QueueSignalledFlags::PROCESS_SHARED, false },
+#if defined(__linux__) && defined(HAS_EVENTFD)
+		{ QueueSignalledMode::EVENTFD, 0, false },
+#endif
+#ifdef __linux__
+		{ QueueSignalledMode::FUTEX,   0, false },
+		{ QueueSignalledMode::FUTEX,   (int) QueueSignalledFlags::PROCESS_SHARED, false },
+#endif
+	};
+
+	return cr_make_param_array(struct param, params, ARRAY_LEN(params));
+}
+
+/* Measures the round-trip time of a single element bounced between two threads. */
+// cppcheck-suppress unknownMacro
+ParameterizedTest(struct param *param, queue_signalled, wakeup_latency, .timeout = 20, .init = init_memory)
+{
+	int ret;
+	void *r, *p;
+	struct pingpong pp;
+	struct timespec start, end;
+
+	pthread_t t;
+
+	Logger logger = logging.get("test:queue_signalled:wakeup_latency");
+
+	ret = queue_signalled_init(&pp.ping, 16, &memory_heap, param->mode, param->flags);
+	cr_assert_eq(ret, 0);
+
+	ret = queue_signalled_init(&pp.pong, 16, &memory_heap, param->mode, param->flags);
+	cr_assert_eq(ret, 0);
+
+	ret = pthread_create(&t, nullptr, ponger, &pp);
+	cr_assert_eq(ret, 0);
+
+	start = time_now();
+
+	for (intptr_t i = 0; i < NUM_PINGPONG; i++) {
+		ret = queue_signalled_push(&pp.ping, (void *) i);
+		cr_assert_eq(ret, 1);
+
+		ret = queue_signalled_pull(&pp.pong, &p);
+		cr_assert_eq(ret, 1);
+		cr_assert_eq((intptr_t) p, i);
+	}
+
+	end = time_now();
+
+	ret = pthread_join(t, &r);
+	cr_assert_eq(ret, 0);
+	cr_assert_null(r, "Ponger failed: %p", r);
+
+	/* Each round-trip includes two wakeups */
+	logger->info("Wakeup latency: mode={}, flags={:#x}, latency={:.3f} us",
+		(int) param->mode, param->flags, time_delta(&start, &end) * 1e6 / (2 * NUM_PINGPONG));
+
+	ret = queue_signalled_destroy(&pp.ping);
+	cr_assert_eq(ret, 0);
+
+	ret = queue_signalled_destroy(&pp.pong);
+	cr_assert_eq(ret, 0);
+}
@@ -0,0 +1,263 @@
+/** Unit tests for the latest-value mailbox of the shared memory interface.
+ *
+ * @author Steffen Vogel <stvogel@eonerc.rwth-aachen.de>
+ * @copyright 2014-2020, Institute for Automation of Complex Power Systems, EONERC
+ * @license GNU General Public License (version 3)
+ *
+ * VILLASnode
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *********************************************************************************/
+
+
+#include <criterion/criterion.h>
+
+#include <atomic>
+
+#include <pthread.h>
+
+#include <villas/utils.hpp>
+#include <villas/memory.h>
+#include <villas/pool.h>
+#include <villas/sample.h>
+#include <villas/shmem.h>
+
+extern void init_memory();
+
+#define NUM_VALUES 256
+#define NUM_READS 10000
+
+struct writer_ctx {
+	struct shmem_mailbox *mb;
+	struct sample *smp;
+	std::atomic<bool> stop;
+};
+
+static void * writer(void *ctx)
+{
+	struct writer_ctx *w = (struct writer_ctx *) ctx;
+
+	/* Write as fast as possible so that the writer laps the reader */
+	for (uint64_t seq = 1; !std::atomic_load(&w->stop); seq++) {
+		w->smp->sequence = seq;
+
+		for (unsigned i = 0; i < NUM_VALUES; i++)
+			w->smp->data[i].i = seq;
+
+		shmem_mailbox_put(w->mb, &w->smp, 1);
+	}
+
+	return nullptr;
+}
+
+static void * waiter(void *ctx)
+{
+	struct writer_ctx *w = (struct writer_ctx *) ctx;
+
+	return (void *) (intptr_t) shmem_mailbox_wait(w->mb, w->smp);
+}
+
+// cppcheck-suppress unknownMacro
+Test(shmem, mailbox_latest, .init = init_memory)
+{
+	int ret;
+	struct pool pool;
+	struct shmem_mailbox mb;
+	struct sample *smps[3], *smp;
+
+	ret = pool_init(&pool, 4, SAMPLE_LENGTH(1), &memory_heap);
+	cr_assert_eq(ret, 0);
+
+	ret = shmem_mailbox_init(&mb, 1, &memory_heap);
+	cr_assert_eq(ret, 0);
+
+	ret = sample_alloc_many(&pool, smps, 3);
+	cr_assert_eq(ret, 3);
+
+	for (int i = 0; i < 3; i++) {
+		smps[i]->sequence = i;
+		smps[i]->length = 1;
+		smps[i]->data[0].f = i;
+	}
+
+	smp = sample_alloc(&pool);
+	cr_assert_not_null(smp);
+
+	ret = shmem_mailbox_get(&mb, smp);
+	cr_assert_eq(ret, 0);
+
+	/* Only the last sample is passed */
+	ret = shmem_mailbox_put(&mb, smps, 2);
+	cr_assert_eq(ret, 2);
+
+	ret = shmem_mailbox_put(&mb, smps + 2, 1);
+	cr_assert_eq(ret, 1);
+
+	cr_assert_eq(atomic_load(&mb.overwrites), 2);
+
+	ret = shmem_mailbox_get(&mb, smp);
+	cr_assert_eq(ret, 1);
+	cr_assert_eq(smp->sequence, 2);
+	cr_assert_eq(smp->length, 1);
+	cr_assert_float_eq(smp->data[0].f, 2.0, 1e-9);
+
+	/* A sample is read only once */
+	ret = shmem_mailbox_get(&mb, smp);
+	cr_assert_eq(ret, 0);
+
+	shmem_mailbox_close(&mb);
+
+	ret = shmem_mailbox_get(&mb, smp);
+	cr_assert_eq(ret, -1);
+
+	sample_decref(smp);
+	sample_decref_many(smps, 3);
+
+	ret = shmem_mailbox_destroy(&mb);
+	cr_assert_eq(ret, 0);
+
+	ret = pool_destroy(&pool);
+	cr_assert_eq(ret, 0);
+}
+
+Test(shmem, mailbox_lapping_writer, .timeout = 20, .init = init_memory)
+{
+	int ret;
+	void *r;
+	pthread_t tw;
+	struct pool pool;
+	struct shmem_mailbox mb;
+	struct writer_ctx w;
+	struct sample *smp;
+
+	ret = pool_init(&pool, 2, SAMPLE_LENGTH(NUM_VALUES), &memory_heap);
+	cr_assert_eq(ret, 0);
+
+	ret = shmem_mailbox_init(&mb, NUM_VALUES, &memory_heap);
+	cr_assert_eq(ret, 0);
+
+	w.mb = &mb;
+	w.smp = sample_alloc(&pool);
+	cr_assert_not_null(w.smp);
+
+	w.smp->length = NUM_VALUES;
+	std::atomic_init(&w.stop, false);
+
+	smp = sample_alloc(&pool);
+	cr_assert_not_null(smp);
+
+	ret = pthread_create(&tw, nullptr, writer, &w);
+	cr_assert_eq(ret, 0);
+
+	uint64_t last = 0;
+	for (int i = 0; i < NUM_READS;) {
+		ret = shmem_mailbox_get(&mb, smp);
+		cr_assert_geq(ret, 0);
+
+		if (ret == 0)
+			continue;
+
+		/* A torn read would mix the values of different samples */
+		cr_assert_eq(smp->length, NUM_VALUES);
+		for (unsigned j = 0; j < NUM_VALUES; j++)
+			cr_assert_eq(smp->data[j].i, (int64_t) smp->sequence);
+
+		cr_assert_gt(smp->sequence, last);
+		last = smp->sequence;
+
+		i++;
+	}
+
+	std::atomic_store(&w.stop, true);
+
+	ret = pthread_join(tw, &r);
+	cr_assert_eq(ret, 0);
+
+	/* Every sample which has not been read was overwritten */
+	ret = shmem_mailbox_get(&mb, smp);
+	cr_assert_geq(ret, 0);
+
+	cr_assert_geq(atomic_load(&mb.overwrites) + NUM_READS + ret, atomic_load(&mb.written));
+
+	sample_decref(smp);
+	sample_decref(w.smp);
+
+	ret = shmem_mailbox_destroy(&mb);
+	cr_assert_eq(ret, 0);
+
+	ret = pool_destroy(&pool);
+	cr_assert_eq(ret, 0);
+}
+
+Test(shmem, mailbox_wait, .timeout = 10, .init = init_memory)
+{
+	int ret;
+	void *r;
+	pthread_t tw;
+	struct pool pool;
+	struct shmem_mailbox mb;
+	struct writer_ctx w;
+	struct sample *smp;
+
+	ret = pool_init(&pool, 2, SAMPLE_LENGTH(1), &memory_heap);
+	cr_assert_eq(ret, 0);
+
+	ret = shmem_mailbox_init(&mb, 1, &memory_heap);
+	cr_assert_eq(ret, 0);
+
+	w.mb = &mb;
+	w.smp = sample_alloc(&pool);
+	cr_assert_not_null(w.smp);
+
+	smp = sample_alloc(&pool);
+	cr_assert_not_null(smp);
+
+	smp->sequence = 42;
+	smp->length = 0;
+
+	/* A sleeping reader is woken up by a new sample */
+	ret = pthread_create(&tw, nullptr, waiter, &w);
+	cr_assert_eq(ret, 0);
+
+	usleep(100000);
+
+	ret = shmem_mailbox_put(&mb, &smp, 1);
+	cr_assert_eq(ret, 1);
+
+	ret = pthread_join(tw, &r);
+	cr_assert_eq(ret, 0);
+	cr_assert_eq((intptr_t) r, 1);
+	cr_assert_eq(w.smp->sequence, 42);
+
+	/* ... and by closing the mailbox */
+	ret = pthread_create(&tw, nullptr, waiter, &w);
+	cr_assert_eq(ret, 0);
+
+	usleep(100000);
+
+	shmem_mailbox_close(&mb);
+
+	ret = pthread_join(tw, &r);
+	cr_assert_eq(ret, 0);
+	cr_assert_eq((intptr_t) r, -1);
+
+	sample_decref(smp);
+	sample_decref(w.smp);
+
+	ret = shmem_mailbox_destroy(&mb);
+	cr_assert_eq(ret, 0);
+
+	ret = pool_destroy(&pool);
+	cr_assert_eq(ret, 0);
+}